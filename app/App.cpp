@@ -1,5 +1,9 @@
 #include "App.h"
 
+#include <iostream>
+#include <set>
+#include <string>
+
 const Coordinate GROSS_GLOCKNER(47.0742f, 12.6947f);
 
 const Coordinate SCHNEEBERG(47.7671f, 15.8056f);
@@ -16,9 +20,10 @@ const int zoom_range = 5;
 
 const float terrain_width = wms::tile_width(root.lat, zoom) * 0.01f;
 
-App::App(size_t width, size_t height)
+App::App(size_t width, size_t height, const TileSources& sources)
     : Window(width, height),
-      m_terrain(TileId(root, zoom), zoom_range, {glm::vec2(-terrain_width / 2.0f), glm::vec2(terrain_width / 2.0f)})
+      m_terrain(TileId(root, zoom), zoom_range, {glm::vec2(-terrain_width / 2.0f), glm::vec2(terrain_width / 2.0f)},
+                sources)
 {
   float fov = 45.0f, aspect_ratio = float(width) / float(height), near = 1.0f, far = 100000.0f;
   m_camera.set_attributes(glm::radians(fov), aspect_ratio, near, far);
@@ -64,7 +69,7 @@ void App::render_ui()
   glm::vec3 pos = m_camera.local_position();
   glm::vec2 pos2 = {pos.x, pos.z};
 
-  Coordinate coord = m_terrain.point_to_coordinate(pos);
+  DCoordinate coord = m_terrain.point_to_coordinate(pos);
 
   glm::vec3 forward = -m_camera.local_z_axis();
   int angle = static_cast<int>(glm::degrees(std::atan2(forward.x, forward.z)));
@@ -78,11 +83,17 @@ void App::render_ui()
   ImGui::Text("Zoom Level Range: [%d, %d] (%d)", m_terrain.min_zoom, m_terrain.max_zoom,
               m_terrain.max_zoom - m_terrain.min_zoom);
   ImGui::Text("Camera: pitch = %.2f, yaw = %.2f", m_camera.pitch, m_camera.yaw);
+  ImGui::Text("Frames at target zoom: %.1f%%", m_terrain.target_zoom_ratio() * 100.0f);
+  if (m_recording) ImGui::Text("Recording camera path: %zu frames (C to stop)", m_camera_path.frames.size());
   ImGui::Checkbox("Wireframe", &m_terrain.wireframe);
   ImGui::Checkbox("Ray Intersect", &m_terrain.intersect_terrain);
   ImGui::Checkbox("Debug View", &m_terrain.debug_view);
   ImGui::Checkbox("Frustum Culling", &m_terrain.frustum_culling);
+  ImGui::Checkbox("Occlusion Culling", &m_terrain.occlusion_culling);
+  ImGui::Checkbox("Curved Earth", &m_terrain.curved_earth);
   ImGui::Checkbox("Enable Shading", &m_terrain.shading);
+  ImGui::Checkbox("Prefetching", &m_terrain.prefetching);
+  ImGui::Checkbox("Pipelining", &m_terrain.pipelining);
 
   ImGui::SliderFloat("Camera Speed", &m_speed, 10.0f, 5000.0f);
 
@@ -102,12 +113,50 @@ void App::render_ui()
     ImGui::SliderFloat("Fog Density", &m_terrain.fog_density, 0.0f, 10.0f);
   }
 
+  if (ImGui::CollapsingHeader("Profiler")) {
+    render_profiler_ui();
+  }
+
   if (ImGui::Button("Reload Shaders")) {
     m_terrain.reload_shaders();
   }
   ImGui::End();
 }
 
+void App::render_profiler_ui()
+{
+  Profiler& profiler = m_terrain.profiler();
+  const FrameStats& frame = profiler.last_frame();
+
+  ImGui::Checkbox("Enabled", &profiler.enabled);
+  ImGui::Text("Frame: %.2f ms (average %.2f ms)", frame.duration_ms, profiler.average_frame_ms());
+
+  std::set<std::string> scopes;
+  for (const auto& scope : frame.scopes) scopes.insert(scope.name);
+
+  for (const auto& name : scopes) {
+    ImGui::Text("%s: %.3f ms", name.c_str(), profiler.average_cpu_ms(name));
+  }
+
+  for (const auto& name : {"terrain", "sky"}) {
+    ImGui::Text("GPU %s: %.3f ms", name, profiler.average_gpu_ms(name));
+  }
+
+  for (const auto& [name, value] : frame.counters) {
+    ImGui::Text("%s: %lld", name.c_str(), static_cast<long long>(value));
+  }
+
+  if (ImGui::Button("Save Trace")) {
+    profiler.write_chrome_trace("trace.json");
+  }
+
+  ImGui::SameLine();
+
+  if (ImGui::Button("Save CSV")) {
+    profiler.write_csv("frames.csv");
+  }
+}
+
 void App::run()
 {
   m_clock.init();
@@ -117,6 +166,7 @@ void App::run()
 
     if (!m_paused) {
       update(dt);
+      if (m_recording) record_camera(dt);
       render(dt);
     }
 
@@ -124,6 +174,31 @@ void App::run()
   }
 }
 
+void App::toggle_recording()
+{
+  m_recording = !m_recording;
+
+  if (m_recording) {
+    m_camera_path = CameraPath();
+    m_camera_path.root_tile = m_terrain.root_tile();
+    m_camera_path.max_zoom_level_range = m_terrain.max_zoom_level_range();
+    m_camera_path.bounds = m_terrain.bounds();
+    m_recording_offset = glm::vec2(0.0f);
+  } else if (write_camera_path("camera_path.txt", m_camera_path)) {
+    std::cout << "Saved " << m_camera_path.frames.size() << " frames to camera_path.txt\n";
+  }
+}
+
+void App::record_camera(float dt)
+{
+  glm::vec3 position = m_camera.world_position();
+  float elevation = m_terrain.elevation(glm::vec2(position.x, position.z));
+
+  // in the world space of the root tile the recording started on
+  position += glm::vec3(m_recording_offset.x, 0.0f, m_recording_offset.y);
+  m_camera_path.frames.push_back({dt, position, -m_camera.local_z_axis(), m_camera.projection_matrix(), elevation});
+}
+
 void App::read_input(float dt)
 {
   SDL_Event event;
@@ -146,6 +221,9 @@ void App::read_input(float dt)
           case SDLK_i:
             m_render_ui = !m_render_ui;
             break;
+          case SDLK_c:
+            toggle_recording();
+            break;
         }
         break;
 
@@ -198,7 +276,11 @@ void App::read_input(float dt)
     position += right * m_speed * dt;
   }
 
-  auto position2 = clamp_range(glm::vec2(position.x, position.z), m_terrain.bounds());
+  // the root tiles follow the camera, the world is rebased when it moves onto another one
+  auto position2 = m_terrain.clamp(glm::vec2(position.x, position.z));
+  const glm::vec2 offset = m_terrain.follow(position2);
+  position2 -= offset;
+  m_recording_offset += offset;
   m_camera.set_local_position({position2.x, position.y, position2.y});
 }
 
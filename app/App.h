@@ -3,6 +3,7 @@
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include "../gfx/gfx.h"
+#include "CameraPath.h"
 #include "Clock.h"
 #include "TerrainRenderer.h"
 #include "Window.h"
@@ -45,7 +46,7 @@ class FirstPersonCamera : public Camera
 class App : public Window
 {
  public:
-  App(size_t width, size_t height);
+  App(size_t width, size_t height, const TileSources& sources = {});
   void run();
 
  private:
@@ -53,14 +54,20 @@ class App : public Window
   bool m_paused{false};
   bool m_mousedown{false};
   bool m_render_ui{true};
+  bool m_recording{false};
   float m_speed{100.0f};
   FirstPersonCamera m_camera;
   TerrainRenderer m_terrain;
   Clock m_clock;
+  CameraPath m_camera_path;
+  glm::vec2 m_recording_offset{0.0f};  // how far the world was rebased since the recording started
 
   void read_input(float dt);
   void update(float dt);
   void render(float dt);
   void render_terrain();
   void render_ui();
+  void render_profiler_ui();
+  void toggle_recording();
+  void record_camera(float dt);
 };
@@ -1,8 +1,34 @@
+/*
+  app [--ortho LOCATION] [--height LOCATION]
+
+  The tiles come from the default tile servers unless another location is
+  given: a tile server url, a directory, an MBTiles file, a GeoTIFF or
+  "basemap" for the ortho tiles.
+*/
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
 #include "App.h"
 
-int main()
+int main(int argc, char* argv[])
 {
-  App app(1280, 720);
+  TileSources sources;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+
+    if (arg == "--ortho" && i + 1 < argc) {
+      sources.ortho = TileSources::with_location(sources.ortho, argv[++i]);
+    } else if (arg == "--height" && i + 1 < argc) {
+      sources.height = TileSources::with_location(sources.height, argv[++i]);
+    } else {
+      std::cerr << "Usage: app [--ortho LOCATION] [--height LOCATION]\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  App app(1280, 720, sources);
   app.run();
   return 0;
 }
@@ -0,0 +1,434 @@
+#include "AABBTree.h"
+
+#include <cassert>
+
+// the fat box is extended by this times the displacement of the object
+static constexpr float DISPLACEMENT_MULTIPLIER = 2.0f;
+
+// bins of the surface area heuristic in rebuild()
+static constexpr int NUM_BINS = 16;
+
+AABBTree::AABBTree(float margin) : m_margin(margin) {}
+
+int AABBTree::insert(const AABB& aabb, uint64_t user_data)
+{
+  const int leaf = allocate_node();
+
+  Node& node = m_nodes[leaf];
+  node.aabb = aabb.expanded(m_margin);
+  node.user_data = user_data;
+  node.height = 0;
+  node.moved = true;
+
+  insert_leaf(leaf);
+  m_moved.push_back(leaf);
+  m_num_proxies++;
+
+  return leaf;
+}
+
+void AABBTree::remove(int proxy)
+{
+  assert(0 <= proxy && proxy < int(m_nodes.size()) && m_nodes[proxy].height == 0);
+
+  remove_leaf(proxy);
+  free_node(proxy);
+  m_num_proxies--;
+}
+
+bool AABBTree::update(int proxy, const AABB& aabb, const glm::vec3& displacement)
+{
+  assert(0 <= proxy && proxy < int(m_nodes.size()) && m_nodes[proxy].height == 0);
+
+  AABB fat = aabb.expanded(m_margin);
+  glm::vec3 d = DISPLACEMENT_MULTIPLIER * displacement;
+  fat.min += glm::min(d, glm::vec3(0.0f));
+  fat.max += glm::max(d, glm::vec3(0.0f));
+
+  const AABB& current = m_nodes[proxy].aabb;
+
+  // still inside, unless the fat box got much larger than needed after a fast movement
+  if (current.contains(aabb) && fat.expanded(4.0f * m_margin).contains(current)) {
+    return false;
+  }
+
+  remove_leaf(proxy);
+  m_nodes[proxy].aabb = fat;
+  insert_leaf(proxy);
+
+  if (!m_nodes[proxy].moved) {
+    m_nodes[proxy].moved = true;
+    m_moved.push_back(proxy);
+  }
+
+  return true;
+}
+
+void AABBTree::find_pairs(std::vector<std::pair<int, int>>& pairs)
+{
+  pairs.clear();
+
+  for (int proxy : m_moved) {
+    const Node& node = m_nodes[proxy];
+    if (node.height != 0 || !node.moved) continue;  // removed since
+
+    query(node.aabb, [&](int other) {
+      // if both moved, the pair is reported by the smaller one
+      if (other != proxy && !(m_nodes[other].moved && other < proxy)) {
+        pairs.emplace_back(std::min(proxy, other), std::max(proxy, other));
+      }
+      return true;
+    });
+  }
+
+  for (int proxy : m_moved) {
+    if (m_nodes[proxy].height == 0) m_nodes[proxy].moved = false;
+  }
+  m_moved.clear();
+
+  // a proxy that was removed and inserted again can be in m_moved twice
+  std::sort(pairs.begin(), pairs.end());
+  pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+}
+
+void AABBTree::rebuild()
+{
+  std::vector<BuildLeaf> leaves;
+  leaves.reserve(m_num_proxies);
+
+  for (size_t i = 0; i < m_nodes.size(); ++i) {
+    const AABB& aabb = m_nodes[i].aabb;
+    if (m_nodes[i].height == 0) {
+      leaves.push_back({int(i), aabb.center(), aabb.min, aabb.max});
+    } else if (m_nodes[i].height > 0) {
+      free_node(int(i));
+    }
+  }
+
+  m_root = NULL_NODE;
+  if (leaves.empty()) return;
+
+  m_root = build(leaves.data(), leaves.size());
+  m_nodes[m_root].parent = NULL_NODE;
+}
+
+int AABBTree::height() const { return m_root == NULL_NODE ? 0 : m_nodes[m_root].height; }
+
+float AABBTree::area_ratio() const
+{
+  if (m_root == NULL_NODE) return 0.0f;
+
+  float area = 0.0f;
+  for (const Node& node : m_nodes) {
+    if (node.height > 0) area += node.aabb.half_area();
+  }
+
+  return area / m_nodes[m_root].aabb.half_area();
+}
+
+bool AABBTree::validate() const
+{
+  size_t num_free = 0;
+  for (int node = m_free; node != NULL_NODE; node = m_nodes[node].parent) {
+    if (m_nodes[node].height != -1) return false;
+    num_free++;
+  }
+
+  size_t num_leaves = 0;
+  if (m_root != NULL_NODE && !validate(m_root, NULL_NODE, num_leaves)) return false;
+
+  size_t num_used = 2 * num_leaves - (num_leaves > 0 ? 1 : 0);
+  return num_leaves == m_num_proxies && num_used + num_free == m_nodes.size();
+}
+
+bool AABBTree::validate(int index, int parent, size_t& num_leaves) const
+{
+  const Node& node = m_nodes[index];
+  if (node.parent != parent) return false;
+
+  if (node.is_leaf()) {
+    num_leaves++;
+    return node.height == 0 && node.child2 == NULL_NODE;
+  }
+
+  const Node& child1 = m_nodes[node.child1];
+  const Node& child2 = m_nodes[node.child2];
+
+  if (node.height != 1 + std::max(child1.height, child2.height)) return false;
+  if (!node.aabb.contains(child1.aabb) || !node.aabb.contains(child2.aabb)) return false;
+
+  return validate(node.child1, index, num_leaves) && validate(node.child2, index, num_leaves);
+}
+
+int AABBTree::allocate_node()
+{
+  int index;
+
+  if (m_free == NULL_NODE) {
+    index = int(m_nodes.size());
+    m_nodes.emplace_back();
+  } else {
+    index = m_free;
+    m_free = m_nodes[index].parent;
+    m_nodes[index] = Node();
+  }
+
+  return index;
+}
+
+void AABBTree::free_node(int index)
+{
+  Node& node = m_nodes[index];
+  node.parent = m_free;
+  node.child1 = node.child2 = NULL_NODE;
+  node.height = -1;
+  node.moved = false;
+  m_free = index;
+}
+
+void AABBTree::insert_leaf(int leaf)
+{
+  if (m_root == NULL_NODE) {
+    m_root = leaf;
+    m_nodes[leaf].parent = NULL_NODE;
+    return;
+  }
+
+  // Walk down to the sibling with the lowest cost: the area of the new parent plus the growth of all
+  // ancestors. Stops early if going further down can only be more expensive.
+  const AABB aabb = m_nodes[leaf].aabb;
+  int index = m_root;
+
+  while (!m_nodes[index].is_leaf()) {
+    const Node& node = m_nodes[index];
+    const float area = node.aabb.half_area();
+    const float combined_area = AABB::merge(node.aabb, aabb).half_area();
+
+    // cost of making the new leaf a sibling of this node
+    const float cost = 2.0f * combined_area;
+    // minimum cost of pushing it further down
+    const float inheritance_cost = 2.0f * (combined_area - area);
+
+    auto child_cost = [&](int child) {
+      const Node& c = m_nodes[child];
+      float merged = AABB::merge(c.aabb, aabb).half_area();
+      return (c.is_leaf() ? merged : merged - c.aabb.half_area()) + inheritance_cost;
+    };
+
+    const float cost1 = child_cost(node.child1), cost2 = child_cost(node.child2);
+
+    if (cost < cost1 && cost < cost2) break;
+
+    index = cost1 < cost2 ? node.child1 : node.child2;
+  }
+
+  const int sibling = index;
+  const int old_parent = m_nodes[sibling].parent;
+  const int new_parent = allocate_node();
+
+  m_nodes[new_parent].parent = old_parent;
+  m_nodes[new_parent].child1 = sibling;
+  m_nodes[new_parent].child2 = leaf;
+  m_nodes[sibling].parent = new_parent;
+  m_nodes[leaf].parent = new_parent;
+
+  if (old_parent == NULL_NODE) {
+    m_root = new_parent;
+  } else if (m_nodes[old_parent].child1 == sibling) {
+    m_nodes[old_parent].child1 = new_parent;
+  } else {
+    m_nodes[old_parent].child2 = new_parent;
+  }
+
+  fix_upwards(new_parent);
+}
+
+void AABBTree::remove_leaf(int leaf)
+{
+  if (leaf == m_root) {
+    m_root = NULL_NODE;
+    return;
+  }
+
+  const int parent = m_nodes[leaf].parent;
+  const int grand_parent = m_nodes[parent].parent;
+  const int sibling = m_nodes[parent].child1 == leaf ? m_nodes[parent].child2 : m_nodes[parent].child1;
+
+  m_nodes[sibling].parent = grand_parent;
+  free_node(parent);
+
+  if (grand_parent == NULL_NODE) {
+    m_root = sibling;
+    return;
+  }
+
+  if (m_nodes[grand_parent].child1 == parent) {
+    m_nodes[grand_parent].child1 = sibling;
+  } else {
+    m_nodes[grand_parent].child2 = sibling;
+  }
+
+  fix_upwards(grand_parent);
+}
+
+void AABBTree::refit(int index)
+{
+  Node& node = m_nodes[index];
+  const Node& child1 = m_nodes[node.child1];
+  const Node& child2 = m_nodes[node.child2];
+
+  node.aabb = AABB::merge(child1.aabb, child2.aabb);
+  node.height = 1 + std::max(child1.height, child2.height);
+}
+
+void AABBTree::rotate(int index)
+{
+  // Swapping a child x with a grandchild y below the other child z changes only the box of z, so the
+  // swap that shrinks z the most is applied.
+  float best_reduction = 0.0f;
+  int best_x = NULL_NODE, best_y = NULL_NODE;
+
+  auto consider = [&](int x, int z) {
+    const Node& node_z = m_nodes[z];
+    if (node_z.is_leaf()) return;
+
+    const float area = node_z.aabb.half_area();
+    const AABB& box_x = m_nodes[x].aabb;
+
+    // y = child1 leaves x and child2 below z, and the other way round
+    float reduction1 = area - AABB::merge(box_x, m_nodes[node_z.child2].aabb).half_area();
+    float reduction2 = area - AABB::merge(box_x, m_nodes[node_z.child1].aabb).half_area();
+
+    if (reduction1 > best_reduction) {
+      best_reduction = reduction1;
+      best_x = x;
+      best_y = node_z.child1;
+    }
+    if (reduction2 > best_reduction) {
+      best_reduction = reduction2;
+      best_x = x;
+      best_y = node_z.child2;
+    }
+  };
+
+  const int child1 = m_nodes[index].child1, child2 = m_nodes[index].child2;
+  consider(child1, child2);
+  consider(child2, child1);
+
+  if (best_x == NULL_NODE) return;
+
+  const int z = m_nodes[best_y].parent;
+
+  if (m_nodes[index].child1 == best_x) {
+    m_nodes[index].child1 = best_y;
+  } else {
+    m_nodes[index].child2 = best_y;
+  }
+
+  if (m_nodes[z].child1 == best_y) {
+    m_nodes[z].child1 = best_x;
+  } else {
+    m_nodes[z].child2 = best_x;
+  }
+
+  m_nodes[best_y].parent = index;
+  m_nodes[best_x].parent = z;
+
+  refit(z);
+  refit(index);
+}
+
+void AABBTree::fix_upwards(int index)
+{
+  while (index != NULL_NODE) {
+    refit(index);
+    rotate(index);
+    index = m_nodes[index].parent;
+  }
+}
+
+int AABBTree::build(BuildLeaf* leaves, size_t count)
+{
+  if (count == 1) return leaves[0].index;
+
+  glm::vec3 center_min = leaves[0].center, center_max = center_min;
+  for (size_t i = 1; i < count; ++i) {
+    center_min = glm::min(center_min, leaves[i].center);
+    center_max = glm::max(center_max, leaves[i].center);
+  }
+
+  const glm::vec3 extent = center_max - center_min;
+  const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+  size_t middle = 0;
+
+  if (extent[axis] > 0.0f) {
+    const float scale = float(NUM_BINS) / extent[axis];
+    auto bin_of = [&](const BuildLeaf& leaf) {
+      return std::min(int((leaf.center[axis] - center_min[axis]) * scale), NUM_BINS - 1);
+    };
+
+    std::array<size_t, NUM_BINS> bin_count{};
+    std::array<glm::vec3, NUM_BINS> bin_min, bin_max;
+    bin_min.fill(glm::vec3(std::numeric_limits<float>::max()));
+    bin_max.fill(glm::vec3(std::numeric_limits<float>::lowest()));
+
+    for (size_t i = 0; i < count; ++i) {
+      int bin = bin_of(leaves[i]);
+      bin_count[bin]++;
+      bin_min[bin] = glm::min(bin_min[bin], leaves[i].min);
+      bin_max[bin] = glm::max(bin_max[bin], leaves[i].max);
+    }
+
+    // cost of splitting after bin i is area * count of both sides
+    std::array<float, NUM_BINS> left_cost{};
+    AABB left(bin_min[0], bin_max[0]);
+    size_t left_count = 0;
+    for (int i = 0; i < NUM_BINS - 1; ++i) {
+      left = AABB::merge(left, AABB(bin_min[i], bin_max[i]));
+      left_count += bin_count[i];
+      left_cost[i] = left_count > 0 ? left.half_area() * float(left_count) : 0.0f;
+    }
+
+    float best_cost = std::numeric_limits<float>::max();
+    int best_split = -1;
+    AABB right(bin_min[NUM_BINS - 1], bin_max[NUM_BINS - 1]);
+    size_t right_count = 0;
+    for (int i = NUM_BINS - 1; i > 0; --i) {
+      right = AABB::merge(right, AABB(bin_min[i], bin_max[i]));
+      right_count += bin_count[i];
+      if (right_count == 0 || right_count == count) continue;
+
+      float cost = left_cost[i - 1] + right.half_area() * float(right_count);
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_split = i - 1;
+      }
+    }
+
+    if (best_split >= 0) {
+      BuildLeaf* split =
+          std::partition(leaves, leaves + count, [&](const BuildLeaf& leaf) { return bin_of(leaf) <= best_split; });
+      middle = size_t(split - leaves);
+    }
+  }
+
+  // all centers in one place
+  if (middle == 0 || middle == count) {
+    middle = count / 2;
+    std::nth_element(leaves, leaves + middle, leaves + count,
+                     [&](const BuildLeaf& a, const BuildLeaf& b) { return a.center[axis] < b.center[axis]; });
+  }
+
+  const int index = allocate_node();
+  const int child1 = build(leaves, middle);
+  const int child2 = build(leaves + middle, count - middle);
+
+  m_nodes[index].child1 = child1;
+  m_nodes[index].child2 = child2;
+  m_nodes[child1].parent = index;
+  m_nodes[child2].parent = index;
+  refit(index);
+
+  return index;
+}
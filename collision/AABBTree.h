@@ -0,0 +1,242 @@
+/*
+  Dynamic bounding volume hierarchy, the broadphase for objects placed on the
+  terrain. Leaves store the boxes of the objects grown by a margin ("fat"
+  boxes), so objects that move a little do not have to be reinserted. The
+  nodes live in one array and refer to each other by index, so the tree can
+  grow without invalidating anything and freed nodes are reused.
+
+  Inserting picks the sibling with the lowest increase of surface area, and
+  the nodes on the way back up are rotated if that shrinks them, which keeps
+  the tree close to what a surface area heuristic build would give.
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Collision.h"
+
+class AABBTree
+{
+ public:
+  static constexpr int NULL_NODE = -1;
+
+  // margin is added on all sides of the boxes of the objects
+  AABBTree(float margin = 0.1f);
+
+  // Returns the id of the new proxy, it is valid until the proxy is removed.
+  int insert(const AABB&, uint64_t user_data = 0);
+
+  void remove(int proxy);
+
+  // Returns true if the proxy was reinserted because the box left its fat box. The fat box is extended
+  // by the displacement of the object, so it has to be reinserted less often if it keeps moving.
+  bool update(int proxy, const AABB&, const glm::vec3& displacement = glm::vec3(0.0f));
+
+  inline const AABB& fat_aabb(int proxy) const { return m_nodes[proxy].aabb; }
+
+  inline uint64_t user_data(int proxy) const { return m_nodes[proxy].user_data; }
+
+  // Calls callback(proxy) for all proxies whose fat box overlaps the box, until it returns false.
+  template <class Callback>
+  void query(const AABB&, Callback&& callback) const;
+
+  // Calls callback(proxy) for all proxies whose fat box is (even partly) inside the frustum, until it
+  // returns false. Subtrees that are completely inside are not tested further.
+  template <class Callback>
+  void query(const Frustum&, Callback&& callback) const;
+
+  // Calls callback(proxy) for all proxies whose fat box is hit by the ray closer than max_t. The callback
+  // returns the new max_t, e.g. the distance to the object if it was hit to only look for closer ones,
+  // or 0 to stop.
+  template <class Callback>
+  void ray_cast(const Ray&, float max_t, Callback&& callback) const;
+
+  // Overlapping pairs of fat boxes where at least one of the proxies was inserted or reinserted since
+  // the last call, as (smaller id, larger id) and sorted.
+  void find_pairs(std::vector<std::pair<int, int>>& pairs);
+
+  // Builds the tree again from the top with a binned surface area heuristic, e.g. after inserting many
+  // objects at once. Proxy ids do not change.
+  void rebuild();
+
+  inline size_t size() const { return m_num_proxies; }
+
+  int height() const;
+
+  // summed surface area of the internal nodes relative to the root, lower is better
+  float area_ratio() const;
+
+  // checks links, heights and boxes of all nodes, for tests
+  bool validate() const;
+
+ private:
+  struct Node {
+    AABB aabb{glm::vec3(0.0f), glm::vec3(0.0f)};
+    uint64_t user_data{0};
+    int parent{NULL_NODE};  // next free node if the node is free
+    int child1{NULL_NODE}, child2{NULL_NODE};
+    int height{0};  // 0 for leaves, -1 for free nodes
+    bool moved{false};
+
+    inline bool is_leaf() const { return child1 == NULL_NODE; }
+  };
+
+  // Traversal stack that only allocates for very deep trees.
+  class Stack
+  {
+   public:
+    inline bool empty() const { return m_size == 0; }
+
+    inline void push(int node)
+    {
+      if (m_size < m_inline.size()) {
+        m_inline[m_size] = node;
+      } else {
+        m_overflow.push_back(node);
+      }
+      m_size++;
+    }
+
+    inline int pop()
+    {
+      m_size--;
+      if (m_size < m_inline.size()) return m_inline[m_size];
+      int node = m_overflow.back();
+      m_overflow.pop_back();
+      return node;
+    }
+
+   private:
+    std::array<int, 64> m_inline;
+    std::vector<int> m_overflow;
+    size_t m_size{0};
+  };
+
+  const float m_margin;
+  std::vector<Node> m_nodes;
+  int m_root{NULL_NODE};
+  int m_free{NULL_NODE};
+  size_t m_num_proxies{0};
+  std::vector<int> m_moved;  // proxies for the next find_pairs, may contain removed ones
+
+  int allocate_node();
+
+  void free_node(int node);
+
+  void insert_leaf(int leaf);
+
+  void remove_leaf(int leaf);
+
+  // box and height from the children
+  void refit(int node);
+
+  // swaps a child with a grandchild on the other side if that shrinks the node
+  void rotate(int node);
+
+  // refits and rotates the node and all its ancestors
+  void fix_upwards(int node);
+
+  // copy of a leaf for rebuild(), so the build does not jump around in m_nodes
+  struct BuildLeaf {
+    int index;
+    glm::vec3 center, min, max;
+  };
+
+  int build(BuildLeaf* leaves, size_t count);
+
+  bool validate(int node, int parent, size_t& num_leaves) const;
+};
+
+template <class Callback>
+void AABBTree::query(const AABB& aabb, Callback&& callback) const
+{
+  if (m_root == NULL_NODE) return;
+
+  Stack stack;
+  stack.push(m_root);
+
+  while (!stack.empty()) {
+    const int index = stack.pop();
+    const Node& node = m_nodes[index];
+
+    if (!aabb_vs_aabb(node.aabb, aabb)) continue;
+
+    if (node.is_leaf()) {
+      if (!callback(index)) return;
+    } else {
+      stack.push(node.child1);
+      stack.push(node.child2);
+    }
+  }
+}
+
+template <class Callback>
+void AABBTree::query(const Frustum& frustum, Callback&& callback) const
+{
+  if (m_root == NULL_NODE) return;
+
+  // negative entries are subtrees that are inside, their leaves are reported without testing
+  Stack stack;
+  stack.push(m_root);
+  std::size_t plane_hint = 0;
+
+  while (!stack.empty()) {
+    int index = stack.pop();
+    bool inside = index < 0;
+    if (inside) index = -index - 1;
+    const Node& node = m_nodes[index];
+
+    if (!inside) {
+      Containment containment = classify_aabb_vs_frustum(node.aabb, frustum, &plane_hint);
+      if (containment == Containment::OUTSIDE) continue;
+      inside = containment == Containment::INSIDE;
+    }
+
+    if (node.is_leaf()) {
+      if (!callback(index)) return;
+    } else {
+      stack.push(inside ? -node.child1 - 1 : node.child1);
+      stack.push(inside ? -node.child2 - 1 : node.child2);
+    }
+  }
+}
+
+template <class Callback>
+void AABBTree::ray_cast(const Ray& ray, float max_t, Callback&& callback) const
+{
+  if (m_root == NULL_NODE) return;
+
+  const glm::vec3 inv_direction = 1.0f / ray.direction;
+
+  auto hit = [&](const AABB& aabb) {
+    glm::vec3 t1 = (aabb.min - ray.origin) * inv_direction;
+    glm::vec3 t2 = (aabb.max - ray.origin) * inv_direction;
+    glm::vec3 t_near = glm::min(t1, t2), t_far = glm::max(t1, t2);
+    float enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+    float exit = std::min(std::min(t_far.x, t_far.y), std::min(t_far.z, max_t));
+    return enter <= exit;
+  };
+
+  Stack stack;
+  stack.push(m_root);
+
+  while (!stack.empty()) {
+    const int index = stack.pop();
+    const Node& node = m_nodes[index];
+
+    if (!hit(node.aabb)) continue;
+
+    if (node.is_leaf()) {
+      float t = callback(index);
+      if (t <= 0.0f) return;
+      max_t = std::min(max_t, t);
+    } else {
+      stack.push(node.child1);
+      stack.push(node.child2);
+    }
+  }
+}
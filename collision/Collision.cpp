@@ -1,5 +1,7 @@
 #include "Collision.h"
 
+#include <algorithm>
+
 AABB::AABB(const glm::vec3& min_, const glm::vec3& max_) : min(min_), max(max_) {}
 
 AABB AABB::from_center_and_size(const glm::vec3& center, const glm::vec3& size)
@@ -8,7 +10,9 @@ AABB AABB::from_center_and_size(const glm::vec3& center, const glm::vec3& size)
   return AABB(center - half_size, center + half_size);
 }
 
-bool AABB::contains(const AABB& other)
+AABB AABB::merge(const AABB& a, const AABB& b) { return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max)); }
+
+bool AABB::contains(const AABB& other) const
 {
   return glm::all(glm::lessThanEqual(min, other.min)) && glm::all(glm::lessThanEqual(other.max, max));
 }
@@ -26,10 +30,10 @@ std::array<glm::vec3, 8> AABB::vertices() const
 {
   return {
       glm::vec3(min.x, min.y, min.z), glm::vec3(max.x, min.y, min.z),
-      glm::vec3(min.z, min.y, max.z), glm::vec3(max.x, min.y, max.z),
+      glm::vec3(min.x, min.y, max.z), glm::vec3(max.x, min.y, max.z),
 
       glm::vec3(min.x, max.y, min.z), glm::vec3(max.x, max.y, min.z),
-      glm::vec3(min.z, max.y, max.z), glm::vec3(max.x, max.y, max.z),
+      glm::vec3(min.x, max.y, max.z), glm::vec3(max.x, max.y, max.z),
   };
 }
 
@@ -157,6 +161,25 @@ bool ray_vs_sphere(const Ray& ray, const Sphere& sphere, float& t)
   }
 }
 
+bool ray_vs_aabb(const Ray& ray, const AABB& aabb, float& t)
+{
+  // slab test, divisions by zero give infinities that work out for rays parallel to a slab
+  glm::vec3 inv_direction = 1.0f / ray.direction;
+  glm::vec3 t1 = (aabb.min - ray.origin) * inv_direction;
+  glm::vec3 t2 = (aabb.max - ray.origin) * inv_direction;
+  glm::vec3 t_near = glm::min(t1, t2), t_far = glm::max(t1, t2);
+
+  float enter = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.0f));
+  float exit = std::min(std::min(t_far.x, t_far.y), t_far.z);
+
+  if (enter > exit) {
+    return false;
+  }
+
+  t = enter;
+  return true;
+}
+
 bool point_vs_plane(const Point& point, const Plane& plane)
 {
   float d = plane.signed_distance(point);
@@ -181,42 +204,48 @@ bool sphere_vs_sphere(const Sphere& a, const Sphere& b)
 
 bool aabb_vs_aabb(const AABB& a, const AABB& b)
 {
-  return glm::all(glm::greaterThanEqual(a.min, b.max)) && glm::all(glm::greaterThanEqual(b.min, a.max));
+  return glm::all(glm::lessThanEqual(a.min, b.max)) && glm::all(glm::lessThanEqual(b.min, a.max));
 }
 
 bool aabb_vs_plane(const AABB& aabb, const Plane& plane)
 {
-  for (const glm::vec3& corner : aabb.vertices()) {
-    if (0.0f <= plane.signed_distance(corner)) {
-      return true;
-    }
-  }
-  return false;
+  return 0.0f <= plane.signed_distance(aabb.positive_vertex(plane.normal));
 }
 
 // https://cgvr.cs.uni-bremen.de/teaching/cg_literatur/lighthouse3d_view_frustum_culling/index.html
+// Only the corner furthest along the plane normal has to be tested, if it is
+// behind the plane all others are as well.
 bool aabb_vs_frustum(const AABB& aabb, const Frustum& frustum)
 {
-  auto vertices = aabb.vertices();
+  for (const Plane& plane : frustum.planes) {
+    if (!aabb_vs_plane(aabb, plane)) {
+      return false;
+    }
+  }
+
+  return true;
+}
 
-  int total_in = 0;
+Containment classify_aabb_vs_frustum(const AABB& aabb, const Frustum& frustum, std::size_t* plane_hint)
+{
+  const std::size_t num_planes = frustum.planes.size();
+  const std::size_t first = plane_hint ? *plane_hint % num_planes : 0;
 
-  for (const Plane& plane : frustum.planes) {
-    int out = 0;
-    int in = 0;
-
-    for (int i = 0; i < 8; ++i) {
-      if (plane.signed_distance(vertices[i]) < 0.0f) {
-        out++;
-      } else {
-        in++;
-      }
+  Containment result = Containment::INSIDE;
+
+  for (std::size_t j = 0; j < num_planes; ++j) {
+    std::size_t i = (first + j) % num_planes;
+    const Plane& plane = frustum.planes[i];
+
+    if (plane.signed_distance(aabb.positive_vertex(plane.normal)) < 0.0f) {
+      if (plane_hint) *plane_hint = i;
+      return Containment::OUTSIDE;
     }
 
-    if (out == 8) {
-      return false;  // all 8 corners are outside
+    if (plane.signed_distance(aabb.negative_vertex(plane.normal)) < 0.0f) {
+      result = Containment::INTERSECTING;
     }
   }
 
-  return true;
+  return result;
 }
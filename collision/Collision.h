@@ -3,6 +3,7 @@
 #include <array>
 #include <glm/glm.hpp>
 #include <iostream>
+#include <limits>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/io.hpp>
 
@@ -15,14 +16,35 @@ struct AABB {
   inline glm::vec3 size() const { return max - min; }
   inline glm::vec3 center() const { return min + size() / 2.0f; }
   std::array<glm::vec3, 8> vertices() const;
-  bool contains(const AABB &);
+  // corner furthest in the direction of the normal
+  inline glm::vec3 positive_vertex(const glm::vec3 &normal) const
+  {
+    return glm::vec3(normal.x >= 0.0f ? max.x : min.x, normal.y >= 0.0f ? max.y : min.y,
+                     normal.z >= 0.0f ? max.z : min.z);
+  }
+  // corner furthest against the direction of the normal
+  inline glm::vec3 negative_vertex(const glm::vec3 &normal) const
+  {
+    return glm::vec3(normal.x >= 0.0f ? min.x : max.x, normal.y >= 0.0f ? min.y : max.y,
+                     normal.z >= 0.0f ? min.z : max.z);
+  }
+  bool contains(const AABB &) const;
+  // the box grown by margin on all sides
+  inline AABB expanded(float margin) const { return AABB(min - glm::vec3(margin), max + glm::vec3(margin)); }
+  // half the surface area, used as the cost of a node in bounding volume hierarchies
+  inline float half_area() const
+  {
+    glm::vec3 s = size();
+    return s.x * s.y + s.y * s.z + s.z * s.x;
+  }
+  static AABB merge(const AABB &a, const AABB &b);
   static AABB from_center_and_size(const glm::vec3 &center, const glm::vec3 &size);
 
   template <class It>
   static AABB from_points(It begin, It end)
   {
     using limits = std::numeric_limits<float>;
-    glm::vec3 min(limits::max()), max(limits::min());
+    glm::vec3 min(limits::max()), max(limits::lowest());
 
     for (auto it = begin; it != end; ++it) {
       min = glm::min(min, *it);
@@ -75,6 +97,9 @@ struct Frustum {
   std::array<glm::vec3, 8> vertices() const;
 };
 
+// Result of a test against a frustum.
+enum class Containment { OUTSIDE = 0, INTERSECTING, INSIDE };
+
 inline std::ostream &operator<<(std::ostream &os, const Plane &p) { return os << p.normal << ", " << p.distance; }
 
 inline std::ostream &operator<<(std::ostream &os, const AABB &a) { return os << a.min << " " << a.max; }
@@ -99,6 +124,9 @@ bool ray_vs_plane(const Ray &, const Plane &, float &t);
 // Return true if ray intersects sphere.
 bool ray_vs_sphere(const Ray &, const Sphere &, float &t);
 
+// Return true if ray intersects aabb, t is the distance to where it enters (0 if the origin is inside).
+bool ray_vs_aabb(const Ray &, const AABB &, float &t);
+
 // Return true if point is in front of plane (signed distance is >= 0).
 bool point_vs_plane(const Point &, const Plane &);
 
@@ -116,3 +144,9 @@ bool aabb_vs_aabb(const AABB &, const AABB &);
 
 // Return true if aabb is (even partly) inside frustum.
 bool aabb_vs_frustum(const AABB &, const Frustum &);
+
+// Return whether the aabb is outside, partly inside or inside the frustum. Boxes near the corners of the
+// frustum can be classified as intersecting even though they are outside. If plane_hint is set, that plane
+// is tested first and updated to the plane that rejected the aabb, which is usually the same one in the
+// next frame.
+Containment classify_aabb_vs_frustum(const AABB &, const Frustum &, std::size_t *plane_hint = nullptr);
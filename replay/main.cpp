@@ -0,0 +1,146 @@
+/*
+  Headless replay of a recorded camera path through the LOD selection,
+  culling and tile requests. Record a path in the app with the C key.
+
+  replay camera_path.txt --csv frames.csv
+  replay camera_path.txt --latency 30 --requests 1 --max-cpu-ms 2.0
+*/
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CameraPath.h"
+#include "LodReplay.h"
+
+static void print_usage()
+{
+  std::cout << "Usage: replay CAMERA_PATH [options]\n"
+               "\n"
+               "Options:\n"
+               "  --csv FILE                per frame stats\n"
+               "  --latency N               frames until a requested tile arrives (default: 6)\n"
+               "  --requests N              concurrent tile requests (default: 3)\n"
+               "  --threads N               parallel LOD selection, 0 is single threaded (default: 0)\n"
+               "  --no-culling              disable frustum culling\n"
+               "  --no-prefetch             disable prefetching\n"
+               "  --max-cpu-ms X            fail if the 95th percentile of the prepare time is higher\n"
+               "  --min-target-ratio X      fail if fewer frames are drawn without falling back\n";
+}
+
+int main(int argc, char* argv[])
+{
+  std::string path_filename, csv_filename;
+  ReplayConfig config;
+  double max_cpu_ms = 0.0;
+  float min_target_ratio = 0.0f;
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+
+      auto next = [&]() -> std::string {
+        if (i + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+        return argv[++i];
+      };
+
+      if (arg == "--csv") {
+        csv_filename = next();
+      } else if (arg == "--latency") {
+        config.latency_frames = unsigned(std::stoul(next()));
+      } else if (arg == "--requests") {
+        config.max_concurrent_requests = unsigned(std::stoul(next()));
+      } else if (arg == "--threads") {
+        config.num_threads = std::stoul(next());
+      } else if (arg == "--no-culling") {
+        config.frustum_culling = false;
+      } else if (arg == "--no-prefetch") {
+        config.prefetching = false;
+      } else if (arg == "--max-cpu-ms") {
+        max_cpu_ms = std::stod(next());
+      } else if (arg == "--min-target-ratio") {
+        min_target_ratio = std::stof(next());
+      } else if (arg == "--help" || arg == "-h") {
+        print_usage();
+        return EXIT_SUCCESS;
+      } else if (arg.rfind("--", 0) != 0 && path_filename.empty()) {
+        path_filename = arg;
+      } else {
+        throw std::invalid_argument("unknown argument " + arg);
+      }
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << "\n\n";
+    print_usage();
+    return EXIT_FAILURE;
+  }
+
+  if (path_filename.empty()) {
+    print_usage();
+    return EXIT_FAILURE;
+  }
+
+  CameraPath path;
+  if (!read_camera_path(path_filename, path)) {
+    return EXIT_FAILURE;
+  }
+
+  if (path.frames.empty()) {
+    std::cerr << "Error: " << path_filename << " has no frames\n";
+    return EXIT_FAILURE;
+  }
+
+  LodReplay replay(path, config);
+  std::vector<ReplayFrameStats> frames = replay.run();
+
+  if (!csv_filename.empty() && !write_replay_csv(csv_filename, frames)) {
+    return EXIT_FAILURE;
+  }
+
+  std::vector<double> cpu_ms;
+  size_t requested = 0, prefetched = 0, drawn = 0, max_pending = 0, at_target = 0;
+  double fallback_depth = 0.0;
+
+  for (const auto& frame : frames) {
+    cpu_ms.push_back(frame.cpu_ms);
+    requested += frame.tiles_requested;
+    prefetched += frame.tiles_prefetched;
+    drawn += frame.tiles_drawn;
+    max_pending = std::max(max_pending, frame.tiles_pending);
+    fallback_depth += frame.mean_fallback_depth;
+    if (frame.tiles_fallback == 0 && frame.tiles_placeholder == 0) at_target++;
+  }
+
+  std::sort(cpu_ms.begin(), cpu_ms.end());
+  double mean_cpu_ms = 0.0;
+  for (double ms : cpu_ms) mean_cpu_ms += ms;
+  mean_cpu_ms /= double(cpu_ms.size());
+  double p95_cpu_ms = cpu_ms[std::min(cpu_ms.size() - 1, cpu_ms.size() * 95 / 100)];
+  float target_ratio = float(at_target) / float(frames.size());
+
+  std::cout << fmt::format("{} frames, {:.1f} tiles drawn per frame\n", frames.size(),
+                           double(drawn) / double(frames.size()));
+  std::cout << fmt::format("prepare: {:.3f} ms mean, {:.3f} ms p95, {:.3f} ms max\n", mean_cpu_ms, p95_cpu_ms,
+                           cpu_ms.back());
+  std::cout << fmt::format("tiles: {} requested, {} of them prefetched, at most {} pending\n", requested, prefetched,
+                           max_pending);
+  std::cout << fmt::format("fallback: {:.1f}% of frames at target zoom, {:.2f} levels mean fallback depth\n",
+                           100.0f * target_ratio, fallback_depth / double(frames.size()));
+
+  bool passed = true;
+
+  if (max_cpu_ms > 0.0 && p95_cpu_ms > max_cpu_ms) {
+    std::cerr << fmt::format("FAILED: prepare p95 {:.3f} ms > {:.3f} ms\n", p95_cpu_ms, max_cpu_ms);
+    passed = false;
+  }
+
+  if (target_ratio < min_target_ratio) {
+    std::cerr << fmt::format("FAILED: target zoom ratio {:.3f} < {:.3f}\n", target_ratio, min_target_ratio);
+    passed = false;
+  }
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
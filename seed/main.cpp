@@ -0,0 +1,179 @@
+/*
+  Headless tool to pre-seed the tile disk cache for offline use.
+
+  seed --bbox 47.0 10.0 47.5 11.0 --zoom 6 12
+  seed --polygon 47.0,10.0 47.5,10.5 47.0,11.0 --zoom 6 14 --type ortho --rate 20
+*/
+#include <fmt/core.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "TileCache.h"
+#include "TileRegion.h"
+#include "TileSeeder.h"
+
+static void print_usage()
+{
+  std::cout << "Usage: seed (--bbox MIN_LAT MIN_LON MAX_LAT MAX_LON | --polygon LAT,LON ...) --zoom MIN MAX [options]\n"
+               "\n"
+               "Options:\n"
+               "  --type ortho|height|all   tiles to download (default: all)\n"
+               "  --url URL                 custom tile server, replaces --type\n"
+               "  --pattern PATTERN         zxy-north, zxy-south, zyx-north or zyx-south (default: zxy-south)\n"
+               "  --filetype EXT            appended to the tile url, e.g. .png (default: none)\n"
+               "  --cache-dir DIR           disk cache of the custom tile server (default: tiles/custom)\n"
+               "  --threads N               concurrent requests (default: 4)\n"
+               "  --rate N                  max requests per second (default: unlimited)\n"
+               "  --dry-run                 print number of tiles and estimated size only\n";
+}
+
+static std::optional<UrlPattern> parse_pattern(const std::string& name)
+{
+  if (name == "zxy-north") return UrlPattern::ZXY_Y_NORTH;
+  if (name == "zxy-south") return UrlPattern::ZXY_Y_SOUTH;
+  if (name == "zyx-north") return UrlPattern::ZYX_Y_NORTH;
+  if (name == "zyx-south") return UrlPattern::ZYX_Y_SOUTH;
+  return std::nullopt;
+}
+
+static std::optional<DCoordinate> parse_coordinate(const std::string& text)
+{
+  auto comma = text.find(',');
+  if (comma == std::string::npos) return std::nullopt;
+  return DCoordinate(std::stod(text.substr(0, comma)), std::stod(text.substr(comma + 1)));
+}
+
+static std::string format_bytes(size_t bytes) { return fmt::format("{:.1f} MB", double(bytes) / (1024.0 * 1024.0)); }
+
+int main(int argc, char* argv[])
+{
+  std::vector<DCoordinate> polygon;
+  std::optional<unsigned> min_zoom, max_zoom;
+  std::string type = "all";
+  TileServiceConfig custom = {"", UrlPattern::ZXY_Y_SOUTH, "", "tiles/custom"};
+  unsigned num_threads = 4;
+  float rate = 0.0f;
+  bool dry_run = false;
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+
+      auto next = [&]() -> std::string {
+        if (i + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+        return argv[++i];
+      };
+
+      if (arg == "--bbox") {
+        double min_lat = std::stod(next()), min_lon = std::stod(next());
+        double max_lat = std::stod(next()), max_lon = std::stod(next());
+        polygon = {DCoordinate(min_lat, min_lon), DCoordinate(min_lat, max_lon), DCoordinate(max_lat, max_lon),
+                   DCoordinate(max_lat, min_lon)};
+      } else if (arg == "--polygon") {
+        polygon.clear();
+        while (i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0) {
+          auto coord = parse_coordinate(next());
+          if (!coord) throw std::invalid_argument("expected LAT,LON");
+          polygon.push_back(*coord);
+        }
+      } else if (arg == "--zoom") {
+        min_zoom = unsigned(std::stoul(next()));
+        max_zoom = unsigned(std::stoul(next()));
+      } else if (arg == "--type") {
+        type = next();
+      } else if (arg == "--url") {
+        custom.url = next();
+      } else if (arg == "--pattern") {
+        auto pattern = parse_pattern(next());
+        if (!pattern) throw std::invalid_argument("unknown url pattern");
+        custom.url_pattern = *pattern;
+      } else if (arg == "--filetype") {
+        custom.filetype = next();
+      } else if (arg == "--cache-dir") {
+        custom.cache_dir = next();
+      } else if (arg == "--threads") {
+        num_threads = unsigned(std::stoul(next()));
+      } else if (arg == "--rate") {
+        rate = std::stof(next());
+      } else if (arg == "--dry-run") {
+        dry_run = true;
+      } else if (arg == "--help" || arg == "-h") {
+        print_usage();
+        return EXIT_SUCCESS;
+      } else {
+        throw std::invalid_argument("unknown argument " + arg);
+      }
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << "\n\n";
+    print_usage();
+    return EXIT_FAILURE;
+  }
+
+  if (polygon.size() < 3 || !min_zoom || !max_zoom || *max_zoom < *min_zoom || TileId::MAX_ZOOM < *max_zoom) {
+    print_usage();
+    return EXIT_FAILURE;
+  }
+
+  std::vector<TileServiceConfig> services;
+
+  if (!custom.url.empty()) {
+    services.push_back(custom);
+  } else if (type == "ortho" || type == "all") {
+    services.push_back(ORTHO_TILE_SERVICE);
+  }
+
+  if (custom.url.empty() && (type == "height" || type == "all")) {
+    services.push_back(HEIGHT_TILE_SERVICE);
+  }
+
+  if (services.empty()) {
+    std::cerr << "Error: unknown tile type " << std::quoted(type) << "\n";
+    return EXIT_FAILURE;
+  }
+
+  TileRegion region(polygon);
+  std::vector<TileId> tiles = region.tiles(*min_zoom, *max_zoom);
+
+  bool all_succeeded = true;
+
+  for (const auto& config : services) {
+    TileService service(config);
+    TileSeeder seeder(service, num_threads, rate);
+
+    std::cout << config.url << " -> " << config.cache_dir << "\n";
+    std::cout << tiles.size() << " tiles, estimated " << format_bytes(seeder.estimate_size(tiles)) << "\n";
+
+    if (dry_run) continue;
+
+    auto start = std::chrono::steady_clock::now();
+    auto last_report = start;
+
+    auto report = [&](const SeedProgress& progress) {
+      auto now = std::chrono::steady_clock::now();
+      if (progress.done() < progress.total && now - last_report < std::chrono::milliseconds(250)) return;
+      last_report = now;
+
+      float elapsed = std::chrono::duration<float>(now - start).count();
+      std::cout << fmt::format("\r[{}/{}] {} downloaded, {} skipped, {} not available, {} failed, {} ({:.1f} tiles/s)",
+                               progress.done(), progress.total, progress.downloaded, progress.skipped,
+                               progress.not_available, progress.failed, format_bytes(progress.downloaded_bytes),
+                               float(progress.done()) / elapsed)
+                << std::flush;
+    };
+
+    SeedProgress progress = seeder.seed(tiles, report);
+    std::cout << "\n";
+
+    // tiles the server does not have are not an error, the renderer falls back to their parents
+    all_succeeded = all_succeeded && progress.failed == 0;
+  }
+
+  return all_succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
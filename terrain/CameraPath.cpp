@@ -0,0 +1,87 @@
+#include "CameraPath.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+bool write_camera_path(const std::string& filename, const CameraPath& path)
+{
+  std::ofstream file(filename);
+
+  if (!file) {
+    std::cerr << "Could not write " << filename << "\n";
+    return false;
+  }
+
+  file << std::setprecision(std::numeric_limits<float>::max_digits10);
+
+  file << "# zoom x y max_zoom_level_range min_x min_y max_x max_y\n";
+  file << path.root_tile.zoom << " " << path.root_tile.x << " " << path.root_tile.y << " "
+       << path.max_zoom_level_range << " " << path.bounds.min.x << " " << path.bounds.min.y << " "
+       << path.bounds.max.x << " " << path.bounds.max.y << "\n";
+
+  file << "# dt position(3) forward(3) projection(16, column major) elevation\n";
+  for (const auto& frame : path.frames) {
+    file << frame.dt;
+    for (int i = 0; i < 3; ++i) file << " " << frame.position[i];
+    for (int i = 0; i < 3; ++i) file << " " << frame.forward[i];
+    for (int c = 0; c < 4; ++c) {
+      for (int r = 0; r < 4; ++r) file << " " << frame.projection[c][r];
+    }
+    file << " " << frame.elevation << "\n";
+  }
+
+  return bool(file);
+}
+
+bool read_camera_path(const std::string& filename, CameraPath& path)
+{
+  std::ifstream file(filename);
+
+  if (!file) {
+    std::cerr << "Could not read " << filename << "\n";
+    return false;
+  }
+
+  path = CameraPath();
+  bool has_header = false;
+  std::string line;
+  unsigned line_number = 0;
+
+  while (std::getline(file, line)) {
+    line_number++;
+    if (line.empty() || line[0] == '#') continue;
+
+    std::istringstream stream(line);
+
+    if (!has_header) {
+      stream >> path.root_tile.zoom >> path.root_tile.x >> path.root_tile.y >> path.max_zoom_level_range >>
+          path.bounds.min.x >> path.bounds.min.y >> path.bounds.max.x >> path.bounds.max.y;
+      has_header = true;
+    } else {
+      CameraPathFrame frame;
+      stream >> frame.dt;
+      for (int i = 0; i < 3; ++i) stream >> frame.position[i];
+      for (int i = 0; i < 3; ++i) stream >> frame.forward[i];
+      for (int c = 0; c < 4; ++c) {
+        for (int r = 0; r < 4; ++r) stream >> frame.projection[c][r];
+      }
+      stream >> frame.elevation;
+      path.frames.push_back(frame);
+    }
+
+    if (!stream) {
+      std::cerr << "Invalid camera path " << filename << ":" << line_number << "\n";
+      return false;
+    }
+  }
+
+  if (!has_header) {
+    std::cerr << "Invalid camera path " << filename << "\n";
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,31 @@
+/*
+  Camera poses recorded from the app, one per frame, to replay the LOD
+  selection headless. Stored as plain text, one frame per line.
+*/
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "Common.h"
+#include "TileUtils.h"
+
+struct CameraPathFrame {
+  float dt;  // seconds since the previous frame
+  glm::vec3 position, forward;
+  glm::mat4 projection;
+  float elevation;  // terrain elevation below the camera in meters, there is no height data during the replay
+};
+
+// The terrain setup is stored with the path, the positions only make sense for the same bounds.
+struct CameraPath {
+  TileId root_tile;
+  unsigned max_zoom_level_range{0};
+  Bounds<glm::vec2> bounds{glm::vec2(0.0f), glm::vec2(0.0f)};
+  std::vector<CameraPathFrame> frames;
+};
+
+bool write_camera_path(const std::string& filename, const CameraPath& path);
+
+bool read_camera_path(const std::string& filename, CameraPath& path);
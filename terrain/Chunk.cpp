@@ -88,15 +88,15 @@ Chunk::Chunk(unsigned vertex_count, float size)
   m_vao->unbind();
 }
 
-void Chunk::draw(ShaderProgram* shader, const glm::vec2& min, const glm::vec2& max) const
+void Chunk::draw(ShaderProgram* shader, const glm::vec2& min, const glm::vec2& max, const glm::dvec3& origin) const
 {
   shader->bind();
 
-  glm::mat4 model(1.0f);
-  model = glm::translate(model, glm::vec3(min.x, 0.0f, min.y));
-  model = glm::scale(model, glm::vec3(max.x - min.x));
+  glm::dmat4 model(1.0);
+  model = glm::translate(model, glm::dvec3(min.x, 0.0, min.y) - origin);
+  model = glm::scale(model, glm::dvec3(double(max.x) - double(min.x)));
 
-  shader->set_uniform("u_model", model);
+  shader->set_uniform("u_model", glm::mat4(model));
 
   m_vao->bind();
   glDrawElements(GL_TRIANGLES, m_vertex_count, GL_UNSIGNED_INT, 0);
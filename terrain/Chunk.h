@@ -12,7 +12,10 @@ class Chunk
  public:
   Chunk(unsigned vertex_count, float size = 1.0f);
 
-  void draw(ShaderProgram* shader, const glm::vec2& min, const glm::vec2& max) const;
+  // The model matrix is relative to the origin, computed in double precision so tiles far from the world origin
+  // do not jitter.
+  void draw(ShaderProgram* shader, const glm::vec2& min, const glm::vec2& max,
+            const glm::dvec3& origin = glm::dvec3(0.0)) const;
 
  private:
   struct Vertex {
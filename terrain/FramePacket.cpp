@@ -0,0 +1,332 @@
+#include "FramePacket.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <glm/gtc/matrix_transform.hpp>
+#include <limits>
+#include <set>
+
+#include "Collision.h"
+#include "QuadTree.h"
+
+// deepest zoom level the automatic level of detail goes to, the tile services have nothing below it
+#define AUTO_MAX_ZOOM 16U
+
+// highest point on earth, for nodes without a height range
+static constexpr float MAX_TERRAIN_ELEVATION = 8849.0f;
+
+static AABB aabb_from_node(const Node* node, float drop = 0.0f)
+{
+  float height = 100.0f;  // TODO: do something smarter
+  return AABB({node->min.x, -drop, node->min.y}, {node->max.x, height, node->max.y});
+}
+
+static Bounds<float> meters_per_unit(const std::vector<RootTile>& roots)
+{
+  Bounds<float> range(std::numeric_limits<float>::max(), 0.0f);
+
+  for (const RootTile& root : roots) {
+    const Bounds<Coordinate> coords = root.id.bounds();
+    const float north = std::abs(coords.min.lat), south = std::abs(coords.max.lat);
+    const float equator = coords.min.lat * coords.max.lat <= 0.0f ? 0.0f : std::min(north, south);
+    range.min = std::min(range.min, wms::tile_width(std::max(north, south), root.id.zoom) / root.bounds.size().x);
+    range.max = std::max(range.max, wms::tile_width(equator, root.id.zoom) / root.bounds.size().x);
+  }
+
+  return range;
+}
+
+FramePreparer::FramePreparer(const TileId& root_tile, unsigned max_zoom_level_range, const Bounds<glm::vec2>& bounds,
+                             float terrain_scaling_factor, ElevationFunction elevation, RaycastFunction raycast,
+                             HeightRangeFunction height_range)
+    : m_root_zoom(root_tile.zoom),
+      m_max_zoom_level_range(max_zoom_level_range),
+      m_terrain_scaling_factor(terrain_scaling_factor),
+      m_elevation(std::move(elevation)),
+      m_raycast(std::move(raycast)),
+      m_height_range(std::move(height_range)),
+      m_roots({{root_tile, bounds}}),
+      m_bounds(bounds),
+      m_meters_per_unit(meters_per_unit(m_roots))
+{
+}
+
+void FramePreparer::set_roots(const std::vector<RootTile>& roots, const glm::vec2& offset)
+{
+  assert(!roots.empty());
+
+  m_roots = roots;
+  m_meters_per_unit = meters_per_unit(m_roots);
+  m_bounds = roots.front().bounds;
+
+  for (const RootTile& root : m_roots) {
+    assert(root.id.zoom == m_root_zoom);
+    m_bounds.min = glm::min(m_bounds.min, root.bounds.min);
+    m_bounds.max = glm::max(m_bounds.max, root.bounds.max);
+  }
+
+  m_prefetcher.rebase(glm::vec3(offset.x, 0.0f, offset.y));
+}
+
+void FramePreparer::prepare(const FrameInput& input, FramePacket& packet, TaskScheduler* scheduler)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  packet.frame = m_frame++;
+  packet.input = input;
+  packet.draws.clear();
+  packet.prefetch.clear();
+  packet.nodes_visited = packet.nodes_culled = packet.nodes_occluded = packet.nodes_beyond_horizon = 0;
+  packet.occlusion_ms = 0.0;
+
+  calculate_zoom_levels(input, packet);
+
+  glm::vec2 center = {input.position.x, input.position.z};
+  glm::vec2 lod_center = input.smart_lod ? this->lod_center(input, input.position, input.forward) : center;
+  packet.lod_center = clamp_range(lod_center, m_bounds);
+
+  select_tiles(packet, scheduler);
+  select_prefetch_tiles(packet);
+
+  packet.prepare_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void FramePreparer::calculate_zoom_levels(const FrameInput& input, FramePacket& packet) const
+{
+  if (input.manual_zoom) {
+    packet.min_zoom = input.min_zoom;
+    packet.max_zoom = input.max_zoom;
+    return;
+  }
+
+  // linear interpolate
+  // this should probably be something more clever
+  glm::vec2 center = {input.position.x, input.position.z};
+  float altitude_in_meters = input.position.y / m_terrain_scaling_factor;
+  float alt = std::max(0.0f, altitude_in_meters - m_elevation(center));
+  float min_alt = 0, max_alt = 25000;
+  float normalized_height = alt / (max_alt - min_alt);
+  float factor = glm::clamp(1.0f - normalized_height, 0.0f, 1.0f);
+
+  packet.max_zoom = std::max(int(AUTO_MAX_ZOOM * factor), int(m_root_zoom + 1U));
+
+  int requested_zoom_range = packet.max_zoom - m_root_zoom;
+  int zoom_range = glm::clamp(requested_zoom_range, 1, m_max_zoom_level_range);
+
+  packet.min_zoom = packet.max_zoom - zoom_range;
+}
+
+glm::vec2 FramePreparer::lod_center(const FrameInput& input, const glm::vec3& position3,
+                                    const glm::vec3& forward) const
+{
+  glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
+  glm::vec2 position = {position3.x, position3.z};
+
+  if (input.intersect_terrain) {
+    // the terrain we are looking at should be the highest lod
+    if (m_raycast) {
+      if (std::optional<glm::vec3> point = m_raycast(position3, forward)) {
+        return clamp_range(glm::vec2(point->x, point->z), m_bounds);
+      }
+    }
+
+    // looking past the resident terrain, e.g. at the horizon
+    float t;
+    Ray ray(position3, forward);
+    Plane plane(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 30.0f, 0.0f));
+
+    if (ray_vs_plane(ray, plane, t)) {
+      glm::vec3 point = ray.point_at(t);
+      glm::vec2 new_position = {point.x, point.z};
+      return clamp_range(new_position, m_bounds);
+    } else {
+      return position;
+    }
+  } else {
+    // we don't want the lod center the be right below the camera. Depending
+    // on the altitude it should be in front of the camera.
+    glm::vec2 view_direction = glm::normalize(glm::vec2(forward.x, forward.z));
+
+    float alt = position3.y / m_terrain_scaling_factor;
+    float min_alt = 0, max_alt = 20000;
+
+    float distance_to_horizon = map_range(alt, min_alt, max_alt, 0.0f, input.max_horizon);
+
+    glm::vec2 horizon = position + view_direction * distance_to_horizon;
+    horizon = clamp_range(horizon, m_bounds);
+
+    // if the camera is looking down, the lod center should be directly below the camera
+    float t = glm::max(glm::dot(forward, -up), 0.0f);
+
+    return glm::mix(horizon, position, t);
+  }
+}
+
+void FramePreparer::select_tiles(FramePacket& packet, TaskScheduler* scheduler)
+{
+  const FrameInput& input = packet.input;
+
+  Frustum frustum(input.projection * input.view);
+
+  // the filter runs concurrently with a scheduler
+  std::atomic<int64_t> nodes_visited = 0, nodes_culled = 0, nodes_beyond_horizon = 0;
+  const int min_zoom = packet.min_zoom;
+
+  auto filter = [&](Node* node) {
+    nodes_visited++;
+    if (node->is_leaf && min_zoom <= int(m_root_zoom + node->depth)) {
+      if (input.curved_earth && beyond_horizon(input.position, node)) {
+        nodes_beyond_horizon++;
+        return false;
+      }
+      const float drop = input.curved_earth ? curvature_drop(input.position, node) : 0.0f;
+      if (!input.frustum_culling || aabb_vs_frustum(aabb_from_node(node, drop), frustum)) {
+        return true;
+      }
+      nodes_culled++;
+    }
+    return false;
+  };
+
+  // front to back, so the occlusion horizon carries over from one root tile to the next
+  m_horizon.reset(input.position);
+
+  for (const RootTile* root : front_to_back(input.position)) {
+    QuadTree quad_tree(packet.lod_center, root->bounds.min, root->bounds.max, packet.max_zoom - m_root_zoom, root->id,
+                       scheduler);
+
+    std::vector<Node*> nodes = quad_tree.select(filter, scheduler);
+    packet.nodes_occluded += int64_t(cull_occluded(input.position, nodes, packet));
+
+    for (const Node* node : nodes) {
+      packet.draws.push_back({node->id, node->min, node->max, node->depth});
+    }
+  }
+
+  // Sort nodes so biggest zoom level is rendered and requested first
+  std::stable_sort(packet.draws.begin(), packet.draws.end(),
+                   [](const DrawItem& a, const DrawItem& b) { return a.depth > b.depth; });
+
+  packet.nodes_visited = nodes_visited;
+  packet.nodes_culled = nodes_culled;
+  packet.nodes_beyond_horizon = nodes_beyond_horizon;
+}
+
+void FramePreparer::select_prefetch_tiles(FramePacket& packet)
+{
+  const FrameInput& input = packet.input;
+
+  m_prefetcher.update({input.position, input.forward}, input.dt);
+
+  if (!input.prefetching) {
+    return;
+  }
+
+  std::set<TileId> unique_tiles;
+
+  for (const CameraPose& pose : m_prefetcher.predict()) {
+    glm::vec2 center = {pose.position.x, pose.position.z};
+    glm::vec2 lod_center = input.smart_lod ? this->lod_center(input, pose.position, pose.forward) : center;
+    lod_center = clamp_range(lod_center, m_bounds);
+
+    glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 view = glm::lookAt(pose.position, pose.position + pose.forward, up);
+    Frustum frustum(input.projection * view);
+
+    // neighbouring leaves are usually culled by the same plane, so that one is tested first
+    std::size_t plane_hint = 0;
+    std::vector<Node*> leaves;
+
+    std::function<void(Node*)> visitor = [&](Node* node) {
+      if (!node->is_leaf || int(m_root_zoom + node->depth) < packet.min_zoom) {
+        return;
+      }
+      if (input.curved_earth && beyond_horizon(pose.position, node)) {
+        return;
+      }
+      const float drop = input.curved_earth ? curvature_drop(pose.position, node) : 0.0f;
+      if (!input.frustum_culling ||
+          classify_aabb_vs_frustum(aabb_from_node(node, drop), frustum, &plane_hint) != Containment::OUTSIDE) {
+        leaves.push_back(node);
+      }
+    };
+
+    m_horizon.reset(pose.position);
+
+    for (const RootTile* root : front_to_back(pose.position)) {
+      QuadTree quad_tree(lod_center, root->bounds.min, root->bounds.max, packet.max_zoom - m_root_zoom, root->id);
+
+      leaves.clear();
+      quad_tree.visit(visitor);
+
+      // the tiles behind a ridge are not needed from there either
+      cull_occluded(pose.position, leaves, packet);
+
+      for (const Node* node : leaves) {
+        if (unique_tiles.insert(node->id).second) packet.prefetch.push_back(node->id);
+      }
+    }
+  }
+}
+
+std::vector<const RootTile*> FramePreparer::front_to_back(const glm::vec3& eye) const
+{
+  // Along any ray from the eye the root tiles come one step further from the tile with the eye at a time, as
+  // they are a grid.
+  const glm::vec2 eye2(eye.x, eye.z);
+  auto steps = [&eye2](const RootTile* root) {
+    const glm::ivec2 offset(glm::floor((eye2 - root->bounds.min) / root->bounds.size()));
+    return std::abs(offset.x) + std::abs(offset.y);
+  };
+
+  std::vector<const RootTile*> roots;
+  roots.reserve(m_roots.size());
+  for (const RootTile& root : m_roots) roots.push_back(&root);
+
+  std::stable_sort(roots.begin(), roots.end(), [&](const RootTile* a, const RootTile* b) { return steps(a) < steps(b); });
+  return roots;
+}
+
+bool FramePreparer::beyond_horizon(const glm::vec3& eye, const Node* node) const
+{
+  float max_height = MAX_TERRAIN_ELEVATION;
+
+  if (m_height_range) {
+    if (std::optional<Bounds<float>> range = m_height_range(node->id)) {
+      max_height = range->max / m_terrain_scaling_factor;
+    }
+  }
+
+  // Lines of sight from the eye and from the top of the node touch the earth at their horizons. The map
+  // distance is underestimated with the scale closest to a pole, so nothing visible is culled.
+  const glm::vec2 eye2(eye.x, eye.z);
+  const float distance = glm::length(glm::clamp(eye2, node->min, node->max) - eye2) * m_meters_per_unit.min;
+  const float eye_altitude = std::max(eye.y / m_terrain_scaling_factor, 0.0f);
+
+  return distance > wms::geographical_distance_to_horizon(eye_altitude) +
+                        wms::geographical_distance_to_horizon(std::max(max_height, 0.0f));
+}
+
+float FramePreparer::curvature_drop(const glm::vec3& eye, const Node* node) const
+{
+  // d^2 / 2R at the farthest corner, overestimated with the scale closest to the equator
+  const glm::vec2 eye2(eye.x, eye.z);
+  const float distance = glm::length(glm::max(glm::abs(node->min - eye2), glm::abs(node->max - eye2)));
+  return distance * distance * m_meters_per_unit.max / (2.0f * wms::EARTH_RADIUS);
+}
+
+size_t FramePreparer::cull_occluded(const glm::vec3& eye, std::vector<Node*>& leaves, FramePacket& packet)
+{
+  if (!packet.input.occlusion_culling || !m_height_range) {
+    return 0;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  size_t occluded = ::cull_occluded(leaves, eye, m_height_range, m_horizon);
+
+  packet.occlusion_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return occluded;
+}
@@ -0,0 +1,118 @@
+/*
+  A frame is split into a CPU prepare phase and a GL submit phase.
+  FramePreparer selects the visible tiles and the tiles to prefetch without
+  touching GL, so it can run on a worker while the previous frame is
+  submitted, and in headless tests. The result is an immutable FramePacket.
+*/
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <optional>
+#include <vector>
+
+#include "Common.h"
+#include "OcclusionHorizon.h"
+#include "Prefetcher.h"
+#include "RootGrid.h"
+#include "TileUtils.h"
+
+class TaskScheduler;
+
+// Camera and settings, copied on the render thread so the prepare phase
+// does not race with the UI.
+struct FrameInput {
+  glm::vec3 position{0.0f}, forward{0.0f, 0.0f, -1.0f};
+  glm::mat4 view{1.0f}, projection{1.0f};
+  float dt{0.0f};  // seconds since the last frame
+
+  int min_zoom{0}, max_zoom{0};
+  bool manual_zoom{false};
+  bool intersect_terrain{false};
+  bool smart_lod{true};
+  bool frustum_culling{true};
+  bool occlusion_culling{true};  // needs the height ranges of the tiles
+  bool curved_earth{false};      // tiles beyond the horizon are culled
+  bool prefetching{true};
+  float max_horizon{500.0f};
+};
+
+// One tile to draw, in world space.
+struct DrawItem {
+  TileId tile;
+  glm::vec2 min, max;
+  unsigned depth;  // relative to the root tile
+};
+
+struct FramePacket {
+  uint64_t frame{0};
+  FrameInput input;
+  int min_zoom{0}, max_zoom{0};
+  glm::vec2 lod_center{0.0f};
+  std::vector<DrawItem> draws;     // highest zoom level first
+  std::vector<TileId> prefetch;    // predicted tiles, nearest first
+  int64_t nodes_visited{0}, nodes_culled{0};
+  int64_t nodes_occluded{0};  // visible leaves hidden behind the terrain, not counted in nodes_culled
+  int64_t nodes_beyond_horizon{0};  // leaves below the horizon of the curved earth, not counted in nodes_culled
+  double prepare_ms{0.0};
+  double occlusion_ms{0.0};  // part of prepare_ms, including the prefetch tiles
+};
+
+class FramePreparer
+{
+ public:
+  // elevation in meters for a point in world space, called from the prepare thread
+  using ElevationFunction = std::function<float(const glm::vec2&)>;
+
+  // closest point of the terrain on a ray in world space, called from the prepare thread
+  using RaycastFunction = std::function<std::optional<glm::vec3>(const glm::vec3& origin, const glm::vec3& direction)>;
+
+  // Without a raycast the LOD center is where the view hits a plane, with intersect_terrain set. Without
+  // height ranges there is no occlusion culling.
+  FramePreparer(const TileId& root_tile, unsigned max_zoom_level_range, const Bounds<glm::vec2>& bounds,
+                float terrain_scaling_factor, ElevationFunction elevation, RaycastFunction raycast = nullptr,
+                HeightRangeFunction height_range = nullptr);
+
+  // Replaces the root tiles, by default the one from the constructor. Offset is what was subtracted from world
+  // space if it was rebased, see RootGrid. Not while preparing.
+  void set_roots(const std::vector<RootTile>& roots, const glm::vec2& offset = glm::vec2(0.0f));
+
+  // Overwrites the packet, its buffers are reused. Not thread safe, only one
+  // prepare can run at a time. With a scheduler the LOD selection is parallel.
+  void prepare(const FrameInput& input, FramePacket& packet, TaskScheduler* scheduler = nullptr);
+
+  glm::vec2 lod_center(const FrameInput& input, const glm::vec3& position, const glm::vec3& forward) const;
+
+ private:
+  const unsigned m_root_zoom;
+  const int m_max_zoom_level_range;
+  const float m_terrain_scaling_factor;
+  const ElevationFunction m_elevation;
+  const RaycastFunction m_raycast;
+  const HeightRangeFunction m_height_range;
+  std::vector<RootTile> m_roots;
+  Bounds<glm::vec2> m_bounds;       // of all root tiles
+  Bounds<float> m_meters_per_unit;  // at the edges of the root tiles closest to a pole and the equator
+  Prefetcher m_prefetcher;
+  OcclusionHorizon m_horizon;
+  uint64_t m_frame{0};
+
+  void calculate_zoom_levels(const FrameInput& input, FramePacket& packet) const;
+
+  void select_tiles(FramePacket& packet, TaskScheduler* scheduler);
+
+  // the root tiles in an order where none is behind a later one as seen from the eye
+  std::vector<const RootTile*> front_to_back(const glm::vec3& eye) const;
+
+  // If the eye cannot see over the curvature of the earth to even the highest point of the node.
+  bool beyond_horizon(const glm::vec3& eye, const Node* node) const;
+
+  // the most the curved earth drops at the node, in world units
+  float curvature_drop(const glm::vec3& eye, const Node* node) const;
+
+  // removes the leaves hidden by the terrain in front of them if enabled, returns how many
+  size_t cull_occluded(const glm::vec3& eye, std::vector<Node*>& leaves, FramePacket& packet);
+
+  void select_prefetch_tiles(FramePacket& packet);
+};
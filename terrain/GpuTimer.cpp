@@ -0,0 +1,61 @@
+#include "GpuTimer.h"
+
+#include <cassert>
+
+GpuTimer::GpuTimer(const std::string& name) : m_name(name)
+{
+  for (auto& query : m_queries) {
+    glGenQueries(1, &query.id);
+  }
+}
+
+GpuTimer::~GpuTimer()
+{
+  for (auto& query : m_queries) {
+    glDeleteQueries(1, &query.id);
+  }
+}
+
+void GpuTimer::begin(uint64_t frame)
+{
+  assert(!m_active);
+  Query& query = m_queries[m_next];
+
+  // all queries are in flight, skip this frame instead of stalling
+  if (query.pending) {
+    return;
+  }
+
+  query.frame = frame;
+  query.pending = true;
+  m_active = true;
+  glBeginQuery(GL_TIME_ELAPSED, query.id);
+}
+
+void GpuTimer::end()
+{
+  if (!m_active) {
+    return;
+  }
+
+  glEndQuery(GL_TIME_ELAPSED);
+  m_active = false;
+  m_next = (m_next + 1) % LATENCY;
+}
+
+void GpuTimer::collect(Profiler& profiler)
+{
+  for (auto& query : m_queries) {
+    if (!query.pending || (m_active && &query == &m_queries[m_next])) continue;
+
+    GLint available = 0;
+    glGetQueryObjectiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) continue;
+
+    GLuint64 nanoseconds = 0;
+    glGetQueryObjectui64v(query.id, GL_QUERY_RESULT, &nanoseconds);
+    query.pending = false;
+
+    profiler.record_gpu(m_name, query.frame, double(nanoseconds) / 1e6);
+  }
+}
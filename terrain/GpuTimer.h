@@ -0,0 +1,45 @@
+/*
+  Measures the GPU time of a render pass with timer queries. Results are
+  read a few frames later, so the CPU never waits for the GPU.
+*/
+#pragma once
+
+#include <array>
+#include <string>
+
+#include "../gfx/gfx.h"
+#include "Profiler.h"
+
+class GpuTimer
+{
+ public:
+  GpuTimer(const std::string& name);
+
+  ~GpuTimer();
+
+  GpuTimer(const GpuTimer&) = delete;
+  GpuTimer& operator=(const GpuTimer&) = delete;
+
+  // only one timer can be active at a time
+  void begin(uint64_t frame);
+
+  void end();
+
+  // report all finished queries to the profiler
+  void collect(Profiler&);
+
+ private:
+  // number of frames the results may lag behind
+  static constexpr size_t LATENCY = 4;
+
+  struct Query {
+    GLuint id{0};
+    uint64_t frame{0};
+    bool pending{false};
+  };
+
+  const std::string m_name;
+  std::array<Query, LATENCY> m_queries;
+  size_t m_next{0};
+  bool m_active{false};
+};
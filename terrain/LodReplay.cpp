@@ -0,0 +1,187 @@
+#include "LodReplay.h"
+
+#include <algorithm>
+#include <fstream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+
+SimulatedTileSource::SimulatedTileSource(unsigned latency_frames, unsigned max_concurrent_requests)
+    : m_latency_frames(latency_frames), m_max_concurrent_requests(std::max(max_concurrent_requests, 1U))
+{
+}
+
+bool SimulatedTileSource::get_tile(const TileId& tile)
+{
+  if (is_resident(tile)) {
+    return true;
+  }
+
+  request(tile);
+  return false;
+}
+
+void SimulatedTileSource::prefetch(const std::vector<TileId>& tiles)
+{
+  for (const auto& tile : tiles) {
+    if (num_pending() >= m_max_concurrent_requests) {
+      break;
+    }
+
+    if (!is_resident(tile) && !m_pending.contains(tile)) {
+      request(tile);
+      m_prefetched++;
+    }
+  }
+}
+
+bool SimulatedTileSource::is_resident(const TileId& tile) const { return m_resident.contains(tile); }
+
+std::optional<TileId> SimulatedTileSource::resident_ancestor(const TileId& tile)
+{
+  return m_resident.resident_ancestor(tile);
+}
+
+void SimulatedTileSource::request(const TileId& tile)
+{
+  if (m_pending.insert(tile).second) {
+    m_queue.push_back(tile);
+    m_requested++;
+  }
+}
+
+void SimulatedTileSource::update()
+{
+  for (auto& request : m_in_flight) {
+    if (request.frames_left > 0) request.frames_left--;
+  }
+
+  auto done = std::stable_partition(m_in_flight.begin(), m_in_flight.end(),
+                                    [](const Request& request) { return request.frames_left > 0; });
+
+  for (auto it = done; it != m_in_flight.end(); ++it) {
+    m_pending.erase(it->tile);
+    m_resident.insert(it->tile);
+  }
+  m_in_flight.erase(done, m_in_flight.end());
+  m_resident.end_frame();
+
+  while (m_in_flight.size() < m_max_concurrent_requests && !m_queue.empty()) {
+    m_in_flight.push_back({m_queue.front(), m_latency_frames});
+    m_queue.pop_front();
+  }
+}
+
+LodReplay::LodReplay(const CameraPath& path, const ReplayConfig& config)
+    : m_path(path),
+      m_config(config),
+      m_preparer(path.root_tile, path.max_zoom_level_range, path.bounds,
+                 path.bounds.size().x / path.root_tile.width_in_meters(),
+                 [this](const glm::vec2&) { return m_elevation; }),
+      m_tiles(config.latency_frames, config.max_concurrent_requests)
+{
+  if (m_config.num_threads > 0) {
+    m_scheduler = std::make_unique<TaskScheduler>(m_config.num_threads);
+  }
+
+  // the renderer requests these at startup as fallback
+  m_tiles.get_tile(m_path.root_tile);
+  for (const auto& child : m_path.root_tile.children()) {
+    m_tiles.get_tile(child);
+  }
+}
+
+std::vector<ReplayFrameStats> LodReplay::run()
+{
+  std::vector<ReplayFrameStats> stats;
+  stats.reserve(m_path.frames.size());
+
+  for (const auto& frame : m_path.frames) {
+    stats.push_back(step(frame));
+  }
+
+  return stats;
+}
+
+ReplayFrameStats LodReplay::step(const CameraPathFrame& frame)
+{
+  FrameInput input;
+  input.position = frame.position;
+  input.forward = frame.forward;
+  input.view = glm::lookAt(frame.position, frame.position + frame.forward, glm::vec3(0.0f, 1.0f, 0.0f));
+  input.projection = frame.projection;
+  input.dt = frame.dt;
+  input.frustum_culling = m_config.frustum_culling;
+  input.prefetching = m_config.prefetching;
+
+  m_elevation = frame.elevation;
+  m_preparer.prepare(input, m_packet, m_scheduler.get());
+
+  size_t requested = m_tiles.num_requested(), prefetched = m_tiles.num_prefetched();
+
+  ReplayFrameStats stats = {};
+  stats.frame = m_packet.frame;
+  stats.min_zoom = m_packet.min_zoom;
+  stats.max_zoom = m_packet.max_zoom;
+  stats.nodes_visited = m_packet.nodes_visited;
+  stats.nodes_culled = m_packet.nodes_culled;
+  stats.tiles_drawn = m_packet.draws.size();
+  stats.cpu_ms = m_packet.prepare_ms;
+
+  // same lookups as TerrainRenderer::submit
+  unsigned fallback_depth_sum = 0;
+
+  for (const DrawItem& item : m_packet.draws) {
+    if (m_tiles.get_tile(item.tile)) continue;
+
+    std::optional<TileId> ancestor = m_tiles.resident_ancestor(item.tile);
+    bool found = ancestor && ancestor->zoom >= m_path.root_tile.zoom;
+    TileId parent = found ? *ancestor : m_path.root_tile;
+
+    if (!found) {
+      m_tiles.get_tile(m_path.root_tile);
+      stats.tiles_placeholder++;
+    } else {
+      stats.tiles_fallback++;
+    }
+
+    unsigned depth = item.tile.zoom - parent.zoom;
+    stats.max_fallback_depth = std::max(stats.max_fallback_depth, depth);
+    fallback_depth_sum += depth;
+  }
+
+  m_tiles.prefetch(m_packet.prefetch);
+
+  stats.mean_fallback_depth = stats.tiles_drawn > 0 ? float(fallback_depth_sum) / float(stats.tiles_drawn) : 0.0f;
+  stats.tiles_requested = m_tiles.num_requested() - requested;
+  stats.tiles_prefetched = m_tiles.num_prefetched() - prefetched;
+
+  m_tiles.update();
+
+  stats.tiles_pending = m_tiles.num_pending();
+  stats.tiles_resident = m_tiles.num_resident();
+
+  return stats;
+}
+
+bool write_replay_csv(const std::string& filename, const std::vector<ReplayFrameStats>& frames)
+{
+  std::ofstream file(filename);
+
+  if (!file) {
+    std::cerr << "Could not write " << filename << "\n";
+    return false;
+  }
+
+  file << "frame,min_zoom,max_zoom,nodes_visited,nodes_culled,tiles_drawn,tiles_requested,tiles_prefetched,"
+          "tiles_pending,tiles_resident,tiles_fallback,tiles_placeholder,max_fallback_depth,mean_fallback_depth,"
+          "cpu_ms\n";
+
+  for (const auto& f : frames) {
+    file << f.frame << "," << f.min_zoom << "," << f.max_zoom << "," << f.nodes_visited << "," << f.nodes_culled << ","
+         << f.tiles_drawn << "," << f.tiles_requested << "," << f.tiles_prefetched << "," << f.tiles_pending << ","
+         << f.tiles_resident << "," << f.tiles_fallback << "," << f.tiles_placeholder << "," << f.max_fallback_depth
+         << "," << f.mean_fallback_depth << "," << f.cpu_ms << "\n";
+  }
+
+  return bool(file);
+}
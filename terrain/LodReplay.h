@@ -0,0 +1,109 @@
+/*
+  Replays a recorded camera path through the LOD selection, culling and
+  tile requests without a GPU or network, as a performance regression test
+  for LOD and cache changes.
+*/
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "CameraPath.h"
+#include "FramePacket.h"
+#include "ResidentTiles.h"
+#include "TaskScheduler.h"
+#include "TileUtils.h"
+
+// Stands in for a tile service. Requests are answered in order, with a
+// limited number in flight, and every request takes a fixed number of frames.
+class SimulatedTileSource
+{
+ public:
+  SimulatedTileSource(unsigned latency_frames, unsigned max_concurrent_requests);
+
+  // Returns true if the tile is resident, requests it otherwise.
+  bool get_tile(const TileId&);
+
+  // Only requests tiles while there is no backlog, like TileService::prefetch.
+  void prefetch(const std::vector<TileId>&);
+
+  bool is_resident(const TileId&) const;
+
+  // the same lookup as TileCache::resident_ancestor_texture
+  std::optional<TileId> resident_ancestor(const TileId&);
+
+  // advance by one frame
+  void update();
+
+  inline size_t num_requested() const { return m_requested; }
+
+  inline size_t num_prefetched() const { return m_prefetched; }
+
+  inline size_t num_resident() const { return m_resident.size(); }
+
+  inline size_t num_pending() const { return m_queue.size() + m_in_flight.size(); }
+
+ private:
+  struct Request {
+    TileId tile;
+    unsigned frames_left;
+  };
+
+  const unsigned m_latency_frames;
+  const unsigned m_max_concurrent_requests;
+  ResidentTiles m_resident;
+  std::set<TileId> m_pending;
+  std::deque<TileId> m_queue;
+  std::vector<Request> m_in_flight;
+  size_t m_requested{0}, m_prefetched{0};
+
+  void request(const TileId&);
+};
+
+struct ReplayConfig {
+  unsigned latency_frames{6};  // 100 ms at 60 fps
+  unsigned max_concurrent_requests{3};
+  bool frustum_culling{true};
+  bool prefetching{true};
+  size_t num_threads{0};  // for the parallel LOD selection, 0 is single threaded
+};
+
+struct ReplayFrameStats {
+  uint64_t frame;
+  int min_zoom, max_zoom;
+  int64_t nodes_visited, nodes_culled;
+  size_t tiles_drawn;
+  size_t tiles_requested, tiles_prefetched;  // new requests in this frame
+  size_t tiles_pending, tiles_resident;
+  size_t tiles_fallback;     // drawn with a lower zoom parent
+  size_t tiles_placeholder;  // no parent loaded either
+  unsigned max_fallback_depth;
+  float mean_fallback_depth;  // over all drawn tiles, placeholders count as falling back to the root
+  double cpu_ms;              // prepare phase
+};
+
+class LodReplay
+{
+ public:
+  LodReplay(const CameraPath& path, const ReplayConfig& config = {});
+
+  std::vector<ReplayFrameStats> run();
+
+  ReplayFrameStats step(const CameraPathFrame& frame);
+
+ private:
+  const CameraPath& m_path;
+  const ReplayConfig m_config;
+  float m_elevation{0.0f};
+  FramePreparer m_preparer;
+  FramePacket m_packet;
+  SimulatedTileSource m_tiles;
+  std::unique_ptr<TaskScheduler> m_scheduler;
+};
+
+bool write_replay_csv(const std::string& filename, const std::vector<ReplayFrameStats>& frames);
@@ -0,0 +1,211 @@
+#include "Mipmap.h"
+
+#include <array>
+#include <cassert>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define MIPMAP_SIMD 1
+#else
+#define MIPMAP_SIMD 0
+#endif
+
+// linear values have 14 bits, so the sum of a 2x2 block still fits into 16 bits
+static constexpr float LINEAR_MAX = float((1 << 14) - 1);
+
+struct SrgbTables {
+  std::array<uint16_t, 256> to_linear;
+  std::vector<uint8_t> from_sum;  // sRGB value of the average, indexed by the sum of 4 linear values
+
+  SrgbTables() : from_sum(1 << 16)
+  {
+    for (int i = 0; i < 256; ++i) {
+      float s = float(i) / 255.0f;
+      float linear = s <= 0.04045f ? s / 12.92f : std::pow((s + 0.055f) / 1.055f, 2.4f);
+      to_linear[i] = uint16_t(std::lround(linear * LINEAR_MAX));
+    }
+
+    for (size_t i = 0; i < from_sum.size(); ++i) {
+      float linear = std::min(float(i) / (4.0f * LINEAR_MAX), 1.0f);
+      float s = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+      from_sum[i] = uint8_t(std::lround(s * 255.0f));
+    }
+  }
+};
+
+static const SrgbTables& srgb_tables()
+{
+  static const SrgbTables tables;
+  return tables;
+}
+
+static void widen_row(const uint8_t* row, uint16_t* out, size_t count, int channels, MipFilter filter)
+{
+  if (filter == MipFilter::LINEAR) {
+    for (size_t i = 0; i < count; ++i) out[i] = row[i];
+    return;
+  }
+
+  const auto& to_linear = srgb_tables().to_linear;
+  for (size_t i = 0; i < count; ++i) {
+    bool alpha = channels == 4 && i % 4 == 3;
+    out[i] = alpha ? uint16_t(row[i] << 6) : to_linear[row[i]];
+  }
+}
+
+// The vertical half of the 2x2 box filter.
+static void add_rows(const uint16_t* a, const uint16_t* b, uint16_t* out, size_t count)
+{
+  size_t i = 0;
+
+#if MIPMAP_SIMD
+  for (; i + 8 <= count; i += 8) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi16(va, vb));
+  }
+#endif
+
+  for (; i < count; ++i) {
+    out[i] = uint16_t(a[i] + b[i]);
+  }
+}
+
+// first channel is the most significant one
+static uint32_t pixel_value(const uint8_t* pixel, int channels)
+{
+  uint32_t value = 0;
+  for (int c = 0; c < std::min(channels, 4); ++c) value = (value << 8) | pixel[c];
+  return value;
+}
+
+static std::vector<uint8_t> downsample_max(const uint8_t* pixels, int width, int height, int channels)
+{
+  const int w = mip_size(width, 1), h = mip_size(height, 1);
+  std::vector<uint8_t> result(size_t(w) * h * channels);
+
+  for (int y = 0; y < h; ++y) {
+    int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+
+    for (int x = 0; x < w; ++x) {
+      int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+      const uint8_t* candidates[] = {
+          pixels + (size_t(y0) * width + x0) * channels,
+          pixels + (size_t(y0) * width + x1) * channels,
+          pixels + (size_t(y1) * width + x0) * channels,
+          pixels + (size_t(y1) * width + x1) * channels,
+      };
+
+      const uint8_t* largest = candidates[0];
+      for (const uint8_t* candidate : candidates) {
+        if (pixel_value(candidate, channels) > pixel_value(largest, channels)) largest = candidate;
+      }
+
+      std::copy(largest, largest + channels, &result[(size_t(y) * w + x) * channels]);
+    }
+  }
+
+  return result;
+}
+
+std::vector<uint8_t> downsample(const uint8_t* pixels, int width, int height, int channels, MipFilter filter)
+{
+  assert(pixels && width > 0 && height > 0 && channels > 0);
+
+  if (filter == MipFilter::MAX) {
+    return downsample_max(pixels, width, height, channels);
+  }
+
+  const int w = mip_size(width, 1), h = mip_size(height, 1);
+  const size_t row_size = size_t(width) * channels;
+  std::vector<uint8_t> result(size_t(w) * h * channels);
+
+  std::vector<uint16_t> top(row_size), bottom(row_size), rows(row_size);
+  const auto& from_sum = srgb_tables().from_sum;
+
+  for (int y = 0; y < h; ++y) {
+    int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+    widen_row(pixels + y0 * row_size, top.data(), row_size, channels, filter);
+    widen_row(pixels + y1 * row_size, bottom.data(), row_size, channels, filter);
+    add_rows(top.data(), bottom.data(), rows.data(), row_size);
+
+    uint8_t* out = result.data() + size_t(y) * w * channels;
+
+    for (int x = 0; x < w; ++x) {
+      const uint16_t* left = &rows[size_t(std::min(2 * x, width - 1)) * channels];
+      const uint16_t* right = &rows[size_t(std::min(2 * x + 1, width - 1)) * channels];
+
+      for (int c = 0; c < channels; ++c) {
+        int sum = left[c] + right[c];
+
+        if (filter == MipFilter::LINEAR) {
+          out[x * channels + c] = uint8_t((sum + 2) >> 2);
+        } else {
+          out[x * channels + c] = (channels == 4 && c == 3) ? uint8_t((sum + 128) >> 8) : from_sum[sum];
+        }
+      }
+    }
+  }
+
+  return result;
+}
+
+MipChain generate_mipmaps(const uint8_t* pixels, int width, int height, int channels, MipFilter filter)
+{
+  assert(pixels && width > 0 && height > 0 && channels > 0);
+
+  MipChain chain;
+  if (!pixels || width <= 0 || height <= 0 || channels <= 0) return chain;
+
+  chain.width = width;
+  chain.height = height;
+  chain.channels = channels;
+  chain.levels.emplace_back(pixels, pixels + size_t(width) * height * channels);
+
+  while (width > 1 || height > 1) {
+    chain.levels.push_back(downsample(chain.levels.back().data(), width, height, channels, filter));
+    width = mip_size(width, 1);
+    height = mip_size(height, 1);
+  }
+
+  return chain;
+}
+
+std::vector<uint8_t> synthesize_parent(const std::array<ImageView, 4>& children, MipFilter filter)
+{
+  const int width = children[0].width, height = children[0].height, channels = children[0].channels;
+
+  for (const auto& child : children) {
+    assert(child.valid() && child.width == width && child.height == height && child.channels == channels);
+    if (!child.valid() || child.width != width || child.height != height || child.channels != channels) return {};
+  }
+
+  assert(width % 2 == 0 && height % 2 == 0);
+  const int w = width / 2, h = height / 2;
+  const size_t row_size = size_t(w) * channels;
+
+  // quadrant offsets in children order
+  const int offset_x[] = {0, w, w, 0};
+  const int offset_y[] = {0, 0, h, h};
+
+  std::vector<uint8_t> parent(size_t(width) * height * channels);
+
+  for (size_t i = 0; i < children.size(); ++i) {
+    std::vector<uint8_t> quadrant = downsample(children[i].data, width, height, channels, filter);
+
+    for (int y = 0; y < h; ++y) {
+      uint8_t* out = &parent[(size_t(offset_y[i] + y) * width + offset_x[i]) * channels];
+      std::copy_n(&quadrant[y * row_size], row_size, out);
+    }
+  }
+
+  return parent;
+}
+
+size_t MipChain::size() const
+{
+  size_t size = 0;
+  for (const auto& level : levels) size += level.size();
+  return size;
+}
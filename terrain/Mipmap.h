@@ -0,0 +1,62 @@
+/*
+  Mip chains computed on the CPU, so they can be built on a worker thread
+  together with the rest of the tile and uploaded level by level instead of
+  calling glGenerateMipmap on the render thread.
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+enum class MipFilter {
+  LINEAR,  // 2x2 box filter on the stored values, e.g. normal maps
+  SRGB,    // 2x2 box filter in linear space, for color. A fourth channel is alpha and filtered linearly
+  MAX,     // largest of the 2x2 pixels, so coarse height levels never cut off peaks. Compared by the first
+           // channel, then the next ones, and copied as a whole so heights spread over several bytes stay intact
+};
+
+// Non-owning view of 8-bit pixels in row order.
+struct ImageView {
+  const uint8_t* data{nullptr};
+  int width{0}, height{0}, channels{0};
+  std::shared_ptr<const void> owner;  // keeps pixels alive that may be freed while in use, else empty
+
+  ImageView() = default;
+  ImageView(const uint8_t* data_, int width_, int height_, int channels_)
+      : data(data_), width(width_), height(height_), channels(channels_)
+  {
+  }
+
+  inline bool valid() const { return data != nullptr && width > 0 && height > 0 && channels > 0; }
+};
+
+struct MipChain {
+  int width{0}, height{0}, channels{0};
+  std::vector<std::vector<uint8_t>> levels;  // level 0 is the full image
+
+  // bytes of all levels together
+  size_t size() const;
+
+  inline bool valid() const { return width > 0 && height > 0 && channels > 0 && !levels.empty(); }
+};
+
+// Size of a mip level, rounded down like OpenGL does.
+inline int mip_size(int size, size_t level)
+{
+  return std::max(size >> level, 1);
+}
+
+// Half the size in both directions, at least 1x1.
+std::vector<uint8_t> downsample(const uint8_t* pixels, int width, int height, int channels, MipFilter filter);
+
+// All levels down to 1x1, level 0 is a copy of the pixels.
+MipChain generate_mipmaps(const uint8_t* pixels, int width, int height, int channels, MipFilter filter);
+
+// A parent tile built from its four children, each downsampled into one quadrant. The children are in
+// TileId::children() order (clockwise from the north west) and must have the same even size, which is
+// also the size of the parent.
+std::vector<uint8_t> synthesize_parent(const std::array<ImageView, 4>& children, MipFilter filter);
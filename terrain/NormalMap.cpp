@@ -0,0 +1,176 @@
+#include "NormalMap.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define NORMAL_MAP_SIMD 1
+#else
+#define NORMAL_MAP_SIMD 0
+#endif
+
+glm::vec2 encode_octahedral(const glm::vec3& n)
+{
+  // https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+  glm::vec3 v = n / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+  glm::vec2 e = glm::vec2(v.x, v.z);
+
+  if (v.y < 0.0f) {
+    glm::vec2 sign = glm::vec2(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+    e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) * sign;
+  }
+
+  return e * 0.5f + 0.5f;
+}
+
+glm::vec3 decode_octahedral(const glm::vec2& encoded)
+{
+  glm::vec2 e = encoded * 2.0f - 1.0f;
+  glm::vec3 n = glm::vec3(e.x, 1.0f - std::abs(e.x) - std::abs(e.y), e.y);
+  float t = glm::max(-n.y, 0.0f);
+  n.x += (n.x >= 0.0f) ? -t : t;
+  n.z += (n.z >= 0.0f) ? -t : t;
+  return glm::normalize(n);
+}
+
+// Heights in meters with a one pixel border taken from the neighbouring tiles.
+struct PaddedHeights {
+  int stride;
+  std::vector<float> heights;
+
+  PaddedHeights(const HeightView& center, const std::array<HeightView, 4>& neighbours, float height_scaling_factor)
+      : stride(center.width + 2), heights(std::size_t(center.width + 2) * (center.height + 2))
+  {
+    const int w = center.width, h = center.height;
+    const float scale = height_scaling_factor / 255.0f;
+
+    auto usable = [](const HeightView& n, int width, int height) {
+      return n.valid() && n.width == width && n.height == height;
+    };
+
+    for (int y = 0; y < h; ++y) {
+      for (int x = 0; x < w; ++x) {
+        at(x, y) = center.at(x, y) * scale;
+      }
+    }
+
+    // if there is no neighbour, continue the slope at the border
+    const HeightView& west = neighbours[NormalMap::WEST];
+    const HeightView& east = neighbours[NormalMap::EAST];
+    for (int y = 0; y < h; ++y) {
+      at(-1, y) = usable(west, w, h) ? west.at(w - 1, y) * scale : 2.0f * at(0, y) - at(std::min(1, w - 1), y);
+      at(w, y) = usable(east, w, h) ? east.at(0, y) * scale : 2.0f * at(w - 1, y) - at(std::max(w - 2, 0), y);
+    }
+
+    const HeightView& north = neighbours[NormalMap::NORTH];
+    const HeightView& south = neighbours[NormalMap::SOUTH];
+    for (int x = 0; x < w; ++x) {
+      at(x, -1) = usable(north, w, h) ? north.at(x, h - 1) * scale : 2.0f * at(x, 0) - at(x, std::min(1, h - 1));
+      at(x, h) = usable(south, w, h) ? south.at(x, 0) * scale : 2.0f * at(x, h - 1) - at(x, std::max(h - 2, 0));
+    }
+  }
+
+  inline float& at(int x, int y) { return heights[std::size_t(y + 1) * stride + (x + 1)]; }
+
+  inline const float* row(int y) const { return heights.data() + std::size_t(y + 1) * stride + 1; }
+};
+
+static inline uint8_t to_unorm8(float value) { return uint8_t(std::lround(glm::clamp(value, 0.0f, 1.0f) * 255.0f)); }
+
+NormalMap compute_normal_map_reference(const HeightView& center, const std::array<HeightView, 4>& neighbours,
+                                       float height_scaling_factor, float pixel_size)
+{
+  assert(center.valid());
+
+  PaddedHeights padded(center, neighbours, height_scaling_factor);
+
+  NormalMap normal_map;
+  normal_map.width = center.width;
+  normal_map.height = center.height;
+  normal_map.data.resize(std::size_t(center.width) * center.height * 2);
+
+  for (int y = 0; y < center.height; ++y) {
+    for (int x = 0; x < center.width; ++x) {
+      float left = padded.at(x - 1, y), right = padded.at(x + 1, y);
+      float up = padded.at(x, y - 1), down = padded.at(x, y + 1);
+
+      // central differences, the tile y-axis maps to the world z-axis
+      glm::vec3 normal = glm::normalize(glm::vec3(left - right, 2.0f * pixel_size, up - down));
+      glm::vec2 encoded = encode_octahedral(normal);
+
+      std::size_t i = 2 * (std::size_t(y) * center.width + x);
+      normal_map.data[i + 0] = to_unorm8(encoded.x);
+      normal_map.data[i + 1] = to_unorm8(encoded.y);
+    }
+  }
+
+  return normal_map;
+}
+
+NormalMap compute_normal_map(const HeightView& center, const std::array<HeightView, 4>& neighbours,
+                             float height_scaling_factor, float pixel_size)
+{
+  assert(center.valid());
+
+  PaddedHeights padded(center, neighbours, height_scaling_factor);
+
+  const int w = center.width, h = center.height;
+
+  NormalMap normal_map;
+  normal_map.width = w;
+  normal_map.height = h;
+  normal_map.data.resize(std::size_t(w) * h * 2);
+
+  // The y component of the unnormalized normal is always positive, so the
+  // octahedral projection never needs to fold and the normalization can be
+  // skipped, as the projection divides by the L1 norm anyway.
+  const float ny = 2.0f * pixel_size;
+
+  for (int y = 0; y < h; ++y) {
+    const float* up = padded.row(y - 1);
+    const float* row = padded.row(y);
+    const float* down = padded.row(y + 1);
+    uint8_t* out = normal_map.data.data() + 2 * std::size_t(y) * w;
+
+    int x = 0;
+
+#if NORMAL_MAP_SIMD
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 ny4 = _mm_set1_ps(ny);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+
+    for (; x + 4 <= w; x += 4) {
+      __m128 nx = _mm_sub_ps(_mm_loadu_ps(row + x - 1), _mm_loadu_ps(row + x + 1));
+      __m128 nz = _mm_sub_ps(_mm_loadu_ps(up + x), _mm_loadu_ps(down + x));
+
+      __m128 l1 = _mm_add_ps(_mm_add_ps(_mm_and_ps(nx, abs_mask), _mm_and_ps(nz, abs_mask)), ny4);
+      __m128 inv = _mm_div_ps(half, l1);
+
+      // e * 0.5 + 0.5, scaled to [0, 255]
+      __m128 ex = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(nx, inv), half), scale);
+      __m128 ez = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(nz, inv), half), scale);
+
+      __m128i ix = _mm_cvtps_epi32(ex);
+      __m128i iz = _mm_cvtps_epi32(ez);
+
+      __m128i lo = _mm_unpacklo_epi32(ix, iz);
+      __m128i hi = _mm_unpackhi_epi32(ix, iz);
+      __m128i packed = _mm_packs_epi32(lo, hi);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 2 * x), _mm_packus_epi16(packed, packed));
+    }
+#endif
+
+    for (; x < w; ++x) {
+      float nx = row[x - 1] - row[x + 1];
+      float nz = up[x] - down[x];
+      float l1 = std::abs(nx) + ny + std::abs(nz);
+      out[2 * x + 0] = to_unorm8(nx / l1 * 0.5f + 0.5f);
+      out[2 * x + 1] = to_unorm8(nz / l1 * 0.5f + 0.5f);
+    }
+  }
+
+  return normal_map;
+}
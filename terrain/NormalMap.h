@@ -0,0 +1,61 @@
+/*
+  Precomputed terrain normals.
+  Normals are generated once per height tile and stored octahedral encoded
+  in two bytes per pixel (RG8), so the vertex shader only needs a single
+  texture fetch.
+*/
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+// Non-owning view of an 8-bit height tile. Only the first channel is used.
+struct HeightView {
+  const uint8_t* data{nullptr};
+  int width{0}, height{0}, channels{1};
+  std::shared_ptr<const void> owner;  // see ImageView
+
+  HeightView() = default;
+  HeightView(const uint8_t* data_, int width_, int height_, int channels_)
+      : data(data_), width(width_), height(height_), channels(channels_)
+  {
+  }
+
+  inline bool valid() const { return data != nullptr && width > 0 && height > 0; }
+
+  inline uint8_t at(int x, int y) const { return data[(y * width + x) * channels]; }
+};
+
+struct NormalMap {
+  // y-axis of the tile points south, just like TileId::y
+  enum Neighbour : std::size_t { WEST = 0, EAST = 1, NORTH = 2, SOUTH = 3 };
+
+  int width{0}, height{0};
+  std::vector<uint8_t> data;  // RG8, octahedral encoded
+
+  inline glm::vec3 normal(int x, int y) const;
+};
+
+// Octahedral encoding of a unit vector (y is up) into [0, 1]^2.
+glm::vec2 encode_octahedral(const glm::vec3& normal);
+
+glm::vec3 decode_octahedral(const glm::vec2& encoded);
+
+// Compute normals for a height tile. Missing (invalid) neighbours are
+// extrapolated from the tile itself, so borders are only seamless if the
+// neighbours are available.
+NormalMap compute_normal_map(const HeightView& center, const std::array<HeightView, 4>& neighbours,
+                             float height_scaling_factor, float pixel_size);
+
+// Straightforward scalar implementation, used to validate the vectorized one.
+NormalMap compute_normal_map_reference(const HeightView& center, const std::array<HeightView, 4>& neighbours,
+                                       float height_scaling_factor, float pixel_size);
+
+inline glm::vec3 NormalMap::normal(int x, int y) const
+{
+  std::size_t i = 2 * (std::size_t(y) * width + x);
+  return decode_octahedral(glm::vec2(data[i + 0], data[i + 1]) / 255.0f);
+}
@@ -0,0 +1,200 @@
+#include "OcclusionHorizon.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+static constexpr float PI = 3.14159265358979f;
+
+OcclusionHorizon::OcclusionHorizon(size_t num_directions)
+    : m_slopes(num_directions, std::numeric_limits<float>::lowest()), m_directions(num_directions)
+{
+  assert(num_directions > 0);
+
+  for (size_t i = 0; i < num_directions; ++i) {
+    const float angle = float(i) / float(num_directions) * 2.0f * PI - PI;
+    m_directions[i] = glm::vec2(std::cos(angle), std::sin(angle));
+  }
+}
+
+void OcclusionHorizon::reset(const glm::vec3& eye)
+{
+  m_eye = eye;
+  std::fill(m_slopes.begin(), m_slopes.end(), std::numeric_limits<float>::lowest());
+}
+
+bool OcclusionHorizon::directions(const Bounds<glm::vec2>& area, float& first, float& last) const
+{
+  const glm::vec2 eye(m_eye.x, m_eye.z);
+
+  if (glm::all(glm::lessThanEqual(area.min, eye)) && glm::all(glm::lessThanEqual(eye, area.max))) {
+    return false;
+  }
+
+  // the eye is outside, so the corners are less than half a turn apart around the center
+  const glm::vec2 to_center = area.center() - eye;
+  const float reference = std::atan2(to_center.y, to_center.x);
+  const std::array<glm::vec2, 4> corners = {area.min, glm::vec2(area.max.x, area.min.y), area.max,
+                                            glm::vec2(area.min.x, area.max.y)};
+  float lo = 0.0f, hi = 0.0f;
+
+  for (const glm::vec2& corner : corners) {
+    const glm::vec2 to_corner = corner - eye;
+    float angle = std::atan2(to_corner.y, to_corner.x) - reference;
+    if (angle > PI) angle -= 2.0f * PI;
+    if (angle < -PI) angle += 2.0f * PI;
+    lo = std::min(lo, angle);
+    hi = std::max(hi, angle);
+  }
+
+  const float n = float(m_slopes.size());
+  first = (reference + lo + PI) / (2.0f * PI) * n;
+  last = (reference + hi + PI) / (2.0f * PI) * n;
+
+  if (first < 0.0f) {
+    first += n;
+    last += n;
+  }
+
+  return true;
+}
+
+void OcclusionHorizon::add_occluder(const Bounds<glm::vec2>& area, float min_height)
+{
+  float first, last;
+
+  if (!directions(area, first, last)) {
+    return;
+  }
+
+  const glm::vec2 eye(m_eye.x, m_eye.z);
+  const float height = min_height - m_eye.y;
+  const int begin = int(std::ceil(first)), end = int(std::floor(last));
+  const size_t n = m_slopes.size();
+
+  if (height < 0.0f) {
+    // below the eye the lowest slope is at the closest point
+    const float slope = height / std::max(glm::length(glm::clamp(eye, area.min, area.max) - eye), 1e-6f);
+
+    for (int i = begin; i < end; ++i) {
+      float& horizon = m_slopes[size_t(i) % n];
+      horizon = std::max(horizon, slope);
+    }
+    return;
+  }
+
+  // Above the eye it is where the rays enter the area. Between two neighbouring rays that is farthest on one
+  // of them, as the area is convex.
+  auto entry = [&](int i) {
+    const glm::vec2& direction = m_directions[size_t(i) % n];
+    const glm::vec2 t1 = (area.min - eye) / direction, t2 = (area.max - eye) / direction;
+    const glm::vec2 t_near = glm::min(t1, t2);
+    return std::max(std::max(t_near.x, t_near.y), 1e-6f);
+  };
+
+  float previous = entry(begin);
+
+  for (int i = begin; i < end; ++i) {
+    const float next = entry(i + 1);
+    float& horizon = m_slopes[size_t(i) % n];
+    horizon = std::max(horizon, height / std::max(previous, next));
+    previous = next;
+  }
+}
+
+bool OcclusionHorizon::is_occluded(const Bounds<glm::vec2>& area, float max_height) const
+{
+  float first, last;
+
+  if (!directions(area, first, last)) {
+    return false;
+  }
+
+  // the highest slope of the area in any of its directions
+  const glm::vec2 eye(m_eye.x, m_eye.z);
+  const float height = max_height - m_eye.y;
+  const float closest = glm::length(glm::clamp(eye, area.min, area.max) - eye);
+  const float farthest = glm::length(glm::max(glm::abs(area.min - eye), glm::abs(area.max - eye)));
+
+  if (height >= 0.0f && closest <= 0.0f) {
+    return false;
+  }
+
+  const float slope = height / (height >= 0.0f ? closest : farthest);
+  const size_t n = m_slopes.size();
+
+  for (int i = int(std::floor(first)); i < int(std::ceil(last)); ++i) {
+    if (slope > m_slopes[size_t(i) % n]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// which child of the parent the node is, in Node::NW ... Node::SW order
+static size_t quadrant(const glm::vec2& point, const glm::vec2& center)
+{
+  const bool east = point.x >= center.x, south = point.y >= center.y;
+  return south ? (east ? Node::SE : Node::SW) : (east ? Node::NE : Node::NW);
+}
+
+size_t cull_occluded(std::vector<Node*>& leaves, const glm::vec3& eye, const HeightRangeFunction& height_range,
+                     OcclusionHorizon& horizon)
+{
+  const glm::vec2 eye2(eye.x, eye.z);
+
+  // Front to back order of a quad tree: in every node, first the child with the eye, then its two neighbours
+  // and the opposite one last. Along any ray from the eye the leaves come in that order, two bits per level.
+  std::vector<uint64_t> keys(leaves.size());
+
+  for (size_t i = 0; i < leaves.size(); ++i) {
+    uint64_t key = 0;
+
+    for (const Node* node = leaves[i]; node->parent != nullptr; node = node->parent) {
+      assert(node->depth <= 31);
+      const glm::vec2 center = node->parent->center();
+      const size_t child = quadrant(node->center(), center);
+      const size_t nearest = quadrant(eye2, center);
+      static constexpr std::array<uint64_t, 4> rank = {0, 1, 3, 2};
+      key |= rank[(child + 4 - nearest) % 4] << (64 - 2 * node->depth);
+    }
+
+    keys[i] = key;
+  }
+
+  std::vector<size_t> order(leaves.size());
+  std::iota(order.begin(), order.end(), size_t(0));
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+
+  std::vector<bool> occluded(leaves.size(), false);
+  size_t num_occluded = 0;
+
+  for (size_t i : order) {
+    const Node* leaf = leaves[i];
+    const std::optional<Bounds<float>> range = height_range(leaf->id);
+
+    if (!range) {
+      continue;
+    }
+
+    const Bounds<glm::vec2> area(leaf->min, leaf->max);
+
+    if (horizon.is_occluded(area, range->max)) {
+      occluded[i] = true;
+      num_occluded++;
+    } else {
+      horizon.add_occluder(area, range->min);
+    }
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < leaves.size(); ++i) {
+    if (!occluded[i]) leaves[kept++] = leaves[i];
+  }
+  leaves.resize(kept);
+
+  return num_occluded;
+}
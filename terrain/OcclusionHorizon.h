@@ -0,0 +1,58 @@
+/*
+  Occlusion culling against the terrain itself, for valleys where the ridge
+  in front of the camera hides most of what passes frustum culling.
+
+  The horizon is the highest slope (height over distance) of the terrain
+  seen so far, for each direction around the camera. Tiles are tested front
+  to back: a tile whose highest point stays below the horizon in all the
+  directions it covers is hidden, otherwise its lowest point is added to the
+  horizon. Both tests are conservative, so a tile is only culled if it is
+  certainly hidden by the min/max heights of the tiles in front of it.
+*/
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <optional>
+#include <vector>
+
+#include "Common.h"
+#include "QuadTree.h"
+
+class OcclusionHorizon
+{
+ public:
+  OcclusionHorizon(size_t num_directions = 512);
+
+  // clears the horizon, the eye is in world space
+  void reset(const glm::vec3& eye);
+
+  // The ground of the area is nowhere lower than min_height. Only the directions that are completely covered
+  // by the area are raised.
+  void add_occluder(const Bounds<glm::vec2>& area, float min_height);
+
+  // True if no point of the area at or below max_height can be seen over the occluders.
+  bool is_occluded(const Bounds<glm::vec2>& area, float max_height) const;
+
+  inline size_t num_directions() const { return m_slopes.size(); }
+
+ private:
+  glm::vec3 m_eye{0.0f};
+  std::vector<float> m_slopes;
+  std::vector<glm::vec2> m_directions;  // where each direction starts, counterclockwise from -x
+
+  // directions covered by the area, as fractional indices with first <= last, may be larger than the number
+  // of directions. False if the eye is in the area.
+  bool directions(const Bounds<glm::vec2>& area, float& first, float& last) const;
+};
+
+// lowest and highest point of a tile in world units, if it is known
+using HeightRangeFunction = std::function<std::optional<Bounds<float>>(const TileId&)>;
+
+// Removes the leaves of a quad tree that are hidden by the ones in front of them and returns how many were
+// removed. The others keep their order. Leaves without a height range are neither culled nor occluders. The
+// horizon has to be reset to the eye before, it is not reset here so the trees of several root tiles can be
+// culled one after the other, front to back.
+size_t cull_occluded(std::vector<Node*>& leaves, const glm::vec3& eye, const HeightRangeFunction& height_range,
+                     OcclusionHorizon& horizon);
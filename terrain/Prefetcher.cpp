@@ -0,0 +1,80 @@
+#include "Prefetcher.h"
+
+#include <cmath>
+
+// time constant of the velocity smoothing in seconds
+#define SMOOTHING 0.25f
+
+// integration step for the extrapolation in seconds
+#define PREDICTION_STEP 0.1f
+
+// rotate around the up axis, from the x-axis towards the z-axis
+static glm::vec3 rotate_yaw(const glm::vec3& v, float angle)
+{
+  float c = std::cos(angle), s = std::sin(angle);
+  return {v.x * c - v.z * s, v.y, v.x * s + v.z * c};
+}
+
+static float signed_yaw_angle(const glm::vec3& from, const glm::vec3& to)
+{
+  return std::atan2(from.x * to.z - from.z * to.x, from.x * to.x + from.z * to.z);
+}
+
+Prefetcher::Prefetcher(float lookahead_, unsigned steps_) : lookahead(lookahead_), steps(steps_) {}
+
+void Prefetcher::update(const CameraPose& pose, float dt)
+{
+  if (!m_initialized || dt <= 0.0f) {
+    m_initialized = true;
+    m_pose = pose;
+    return;
+  }
+
+  glm::vec3 velocity = (pose.position - m_pose.position) / dt;
+  float turn_rate = 0.0f;
+
+  // the heading is undefined while looking straight up or down
+  if (std::abs(m_pose.forward.y) < 0.999f && std::abs(pose.forward.y) < 0.999f) {
+    turn_rate = signed_yaw_angle(m_pose.forward, pose.forward) / dt;
+  }
+
+  float alpha = 1.0f - std::exp(-dt / SMOOTHING);
+  m_velocity = glm::mix(m_velocity, velocity, alpha);
+  m_turn_rate = glm::mix(m_turn_rate, turn_rate, alpha);
+  m_pose = pose;
+}
+
+void Prefetcher::rebase(const glm::vec3& offset) { m_pose.position -= offset; }
+
+CameraPose Prefetcher::predict(float seconds) const
+{
+  CameraPose predicted = m_pose;
+  glm::vec3 velocity = m_velocity;
+
+  // integrate, so turning flight follows an arc
+  int num_steps = glm::max(1, int(std::ceil(seconds / PREDICTION_STEP)));
+  float dt = seconds / float(num_steps);
+
+  for (int i = 0; i < num_steps; ++i) {
+    velocity = rotate_yaw(velocity, m_turn_rate * dt);
+    predicted.position += velocity * dt;
+  }
+
+  predicted.forward = rotate_yaw(m_pose.forward, m_turn_rate * seconds);
+  return predicted;
+}
+
+std::vector<CameraPose> Prefetcher::predict() const
+{
+  std::vector<CameraPose> poses;
+
+  if (!m_initialized) {
+    return poses;
+  }
+
+  for (unsigned i = 1; i <= steps; ++i) {
+    poses.push_back(predict(lookahead * float(i) / float(steps)));
+  }
+
+  return poses;
+}
@@ -0,0 +1,46 @@
+/*
+  Predicts where the camera will be in the next few seconds, so tiles
+  can be requested before they become visible.
+*/
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+struct CameraPose {
+  glm::vec3 position, forward;
+};
+
+class Prefetcher
+{
+ public:
+  // lookahead in seconds, split into evenly spaced predicted poses
+  Prefetcher(float lookahead = 3.0f, unsigned steps = 3);
+
+  // Feed the current camera pose, dt is the time since the last update.
+  void update(const CameraPose& pose, float dt);
+
+  // The world was moved by -offset, see RootGrid. Keeps the velocity.
+  void rebase(const glm::vec3& offset);
+
+  // Extrapolate the trajectory by assuming constant speed and turn rate.
+  CameraPose predict(float seconds) const;
+
+  // Predicted poses up to the lookahead, nearest first.
+  std::vector<CameraPose> predict() const;
+
+  // in world units per second
+  inline glm::vec3 velocity() const { return m_velocity; }
+
+  // in radians per second around the up axis
+  inline float turn_rate() const { return m_turn_rate; }
+
+  float lookahead;
+  unsigned steps;
+
+ private:
+  bool m_initialized{false};
+  CameraPose m_pose;
+  glm::vec3 m_velocity{0.0f};
+  float m_turn_rate{0.0f};
+};
@@ -0,0 +1,245 @@
+#include "Profiler.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <set>
+
+double FrameStats::cpu_ms(const std::string& name) const
+{
+  double sum = 0.0;
+  for (const auto& scope : scopes) {
+    if (name == scope.name) sum += scope.duration_ms;
+  }
+  return sum;
+}
+
+Profiler::Scope::~Scope()
+{
+  if (m_index != Scope::NONE) m_profiler->end_scope(m_index);
+}
+
+Profiler::Profiler(size_t history_size) : m_history_size(std::max(history_size, size_t(1))) {}
+
+void Profiler::begin_frame()
+{
+  assert(!m_in_frame);
+
+  uint64_t index = m_history.empty() ? 0 : m_history.back().index + 1;
+
+  m_frame_start = Clock::now();
+  m_in_frame = true;
+  m_depth = 0;
+
+  m_current = FrameStats();
+  m_current.index = index;
+  m_current.start_ms = elapsed_ms(m_created);
+}
+
+void Profiler::end_frame()
+{
+  assert(m_in_frame);
+  assert(m_depth == 0);
+
+  m_current.duration_ms = elapsed_ms(m_frame_start);
+
+  for (const auto& [name, value] : m_gauges) {
+    m_current.counters[name] = value;
+  }
+
+  m_in_frame = false;
+  m_history.push_back(std::move(m_current));
+
+  while (m_history.size() > m_history_size) {
+    m_history.pop_front();
+  }
+}
+
+Profiler::Scope Profiler::scope(const char* name)
+{
+  if (!enabled || !m_in_frame) {
+    return Scope(this, Scope::NONE);
+  }
+
+  m_current.scopes.push_back({name, m_depth++, elapsed_ms(m_frame_start), 0.0});
+  return Scope(this, m_current.scopes.size() - 1);
+}
+
+void Profiler::record_cpu(const char* name, double ms)
+{
+  if (!enabled || !m_in_frame) return;
+
+  double end_ms = elapsed_ms(m_frame_start);
+  m_current.scopes.push_back({name, m_depth, std::max(end_ms - ms, 0.0), ms});
+}
+
+void Profiler::end_scope(size_t index)
+{
+  // the frame ended while the scope was open
+  if (!m_in_frame || m_current.scopes.size() <= index) return;
+
+  ScopeTiming& timing = m_current.scopes[index];
+  timing.duration_ms = elapsed_ms(m_frame_start) - timing.start_ms;
+  m_depth--;
+}
+
+void Profiler::count(const std::string& name, int64_t value)
+{
+  if (enabled) m_current.counters[name] += value;
+}
+
+void Profiler::set(const std::string& name, int64_t value)
+{
+  if (enabled) m_gauges[name] = value;
+}
+
+void Profiler::record_gpu(const std::string& name, uint64_t frame, double ms)
+{
+  if (frame == m_current.index && m_in_frame) {
+    m_current.gpu_ms[name] += ms;
+    return;
+  }
+
+  for (auto it = m_history.rbegin(); it != m_history.rend(); ++it) {
+    if (it->index == frame) {
+      it->gpu_ms[name] += ms;
+      return;
+    }
+  }
+}
+
+const FrameStats& Profiler::last_frame() const
+{
+  static const FrameStats empty;
+  return m_history.empty() ? empty : m_history.back();
+}
+
+double Profiler::average_cpu_ms(const std::string& name) const
+{
+  if (m_history.empty()) return 0.0;
+
+  double sum = 0.0;
+  for (const auto& frame : m_history) sum += frame.cpu_ms(name);
+  return sum / double(m_history.size());
+}
+
+double Profiler::average_gpu_ms(const std::string& name) const
+{
+  double sum = 0.0;
+  size_t frames = 0;
+
+  for (const auto& frame : m_history) {
+    auto it = frame.gpu_ms.find(name);
+    if (it == frame.gpu_ms.end()) continue;
+    sum += it->second;
+    frames++;
+  }
+
+  return frames > 0 ? sum / double(frames) : 0.0;
+}
+
+double Profiler::average_frame_ms() const
+{
+  if (m_history.empty()) return 0.0;
+
+  double sum = 0.0;
+  for (const auto& frame : m_history) sum += frame.duration_ms;
+  return sum / double(m_history.size());
+}
+
+bool Profiler::write_chrome_trace(const std::string& filename) const
+{
+  std::ofstream file(filename);
+
+  if (!file) {
+    std::cerr << "Could not write " << filename << "\n";
+    return false;
+  }
+
+  // timestamps are in microseconds, cpu scopes on thread 1 and gpu passes on thread 2
+  file << "{\"traceEvents\":[\n";
+  file << R"({"name":"thread_name","ph":"M","pid":1,"tid":1,"args":{"name":"CPU"}},)" << "\n";
+  file << R"({"name":"thread_name","ph":"M","pid":1,"tid":2,"args":{"name":"GPU"}})";
+
+  for (const auto& frame : m_history) {
+    double frame_us = frame.start_ms * 1000.0;
+
+    file << fmt::format(",\n{{\"name\":\"frame {}\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                        frame.index, frame_us, frame.duration_ms * 1000.0);
+
+    for (const auto& scope : frame.scopes) {
+      file << fmt::format(",\n{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                          scope.name, frame_us + scope.start_ms * 1000.0, scope.duration_ms * 1000.0);
+    }
+
+    // the gpu passes are not synchronized with the cpu timeline, lay them out back to back
+    double gpu_us = frame_us;
+    for (const auto& [name, ms] : frame.gpu_ms) {
+      file << fmt::format(",\n{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":{:.3f},\"dur\":{:.3f}}}", name,
+                          gpu_us, ms * 1000.0);
+      gpu_us += ms * 1000.0;
+    }
+
+    for (const auto& [name, value] : frame.counters) {
+      file << fmt::format(",\n{{\"name\":\"{}\",\"ph\":\"C\",\"pid\":1,\"ts\":{:.3f},\"args\":{{\"value\":{}}}}}", name,
+                          frame_us, value);
+    }
+  }
+
+  file << "\n]}\n";
+  return bool(file);
+}
+
+bool Profiler::write_csv(const std::string& filename) const
+{
+  std::ofstream file(filename);
+
+  if (!file) {
+    std::cerr << "Could not write " << filename << "\n";
+    return false;
+  }
+
+  std::set<std::string> scopes, gpu_passes, counters;
+
+  for (const auto& frame : m_history) {
+    for (const auto& scope : frame.scopes) scopes.insert(scope.name);
+    for (const auto& [name, ms] : frame.gpu_ms) gpu_passes.insert(name);
+    for (const auto& [name, value] : frame.counters) counters.insert(name);
+  }
+
+  file << "frame,frame_ms";
+  for (const auto& name : scopes) file << "," << name << "_ms";
+  for (const auto& name : gpu_passes) file << ",gpu " << name << "_ms";
+  for (const auto& name : counters) file << "," << name;
+  file << "\n";
+
+  for (const auto& frame : m_history) {
+    file << frame.index << "," << frame.duration_ms;
+
+    for (const auto& name : scopes) file << "," << frame.cpu_ms(name);
+
+    for (const auto& name : gpu_passes) {
+      auto it = frame.gpu_ms.find(name);
+      file << ",";
+      if (it != frame.gpu_ms.end()) file << it->second;
+    }
+
+    for (const auto& name : counters) {
+      auto it = frame.counters.find(name);
+      file << "," << (it != frame.counters.end() ? it->second : 0);
+    }
+
+    file << "\n";
+  }
+
+  return bool(file);
+}
+
+double Profiler::elapsed_ms(Clock::time_point since) const
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
@@ -0,0 +1,110 @@
+/*
+  Per-frame CPU timings, GPU timings and counters. Only used from the
+  render thread.
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+struct ScopeTiming {
+  const char* name;  // string literal
+  unsigned depth;
+  double start_ms, duration_ms;  // start is relative to the frame start
+};
+
+struct FrameStats {
+  uint64_t index{0};
+  double start_ms{0.0}, duration_ms{0.0};  // start is relative to the profiler creation
+  std::vector<ScopeTiming> scopes;
+  std::map<std::string, double> gpu_ms;  // arrives a few frames late
+  std::map<std::string, int64_t> counters;
+
+  // sum of all scopes with that name
+  double cpu_ms(const std::string& name) const;
+};
+
+class Profiler
+{
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  class Scope
+  {
+   public:
+    // index of a scope that is not recorded
+    static constexpr size_t NONE = SIZE_MAX;
+
+    Scope(Profiler* profiler, size_t index) : m_profiler(profiler), m_index(index) {}
+    Scope(Scope&& other) noexcept : m_profiler(other.m_profiler), m_index(other.m_index) { other.m_index = NONE; }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    ~Scope();
+
+   private:
+    Profiler* m_profiler;
+    size_t m_index;
+  };
+
+  // number of frames kept in the history
+  Profiler(size_t history_size = 300);
+
+  void begin_frame();
+
+  void end_frame();
+
+  // Time the enclosing block, name must be a string literal.
+  [[nodiscard]] Scope scope(const char* name);
+
+  // Timing measured elsewhere, e.g. on a worker thread. Recorded as if it ended now.
+  void record_cpu(const char* name, double ms);
+
+  // Counters start at zero every frame.
+  void count(const std::string& name, int64_t value = 1);
+
+  // Gauges keep their value, e.g. the number of resident tiles.
+  void set(const std::string& name, int64_t value);
+
+  // GPU timings are only available a few frames later.
+  void record_gpu(const std::string& name, uint64_t frame, double ms);
+
+  inline uint64_t frame_index() const { return m_current.index; }
+
+  // the last completed frame
+  const FrameStats& last_frame() const;
+
+  inline const std::deque<FrameStats>& history() const { return m_history; }
+
+  // average over the history
+  double average_cpu_ms(const std::string& name) const;
+
+  double average_gpu_ms(const std::string& name) const;
+
+  double average_frame_ms() const;
+
+  // Chrome trace event format, open with chrome://tracing or Perfetto.
+  bool write_chrome_trace(const std::string& filename) const;
+
+  // one row per frame
+  bool write_csv(const std::string& filename) const;
+
+  bool enabled{true};
+
+ private:
+  const size_t m_history_size;
+  const Clock::time_point m_created{Clock::now()};
+  Clock::time_point m_frame_start;
+  bool m_in_frame{false};
+  unsigned m_depth{0};
+  FrameStats m_current;
+  std::map<std::string, int64_t> m_gauges;
+  std::deque<FrameStats> m_history;
+
+  void end_scope(size_t index);
+
+  double elapsed_ms(Clock::time_point since) const;
+};
@@ -1,11 +1,18 @@
 #include "QuadTree.h"
 
+#include "TaskScheduler.h"
+
 QuadTree::QuadTree(const glm::vec2& point, const glm::vec2& min, const glm::vec2& max, unsigned max_depth,
-                   const TileId& root_tile)
+                   const TileId& root_tile, TaskScheduler* scheduler)
     : m_root(std::make_unique<Node>(min, max, 0, root_tile, nullptr)), m_max_depth(max_depth), m_root_tile(root_tile)
 {
-  assert(m_root->contains(point));
-  insert(m_root, point);
+  if (scheduler) {
+    TaskGroup group;
+    insert(m_root, point, *scheduler, group);
+    scheduler->wait(group);
+  } else {
+    insert(m_root, point);
+  }
 }
 
 std::vector<Node*> QuadTree::nodes()
@@ -26,20 +33,87 @@ std::vector<Node*> QuadTree::leaves()
   return leaves;
 }
 
-void QuadTree::insert(std::unique_ptr<Node>& node, const glm::vec2& point)
+std::vector<Node*> QuadTree::select(const std::function<bool(Node*)>& filter, TaskScheduler* scheduler) const
 {
-  auto split_heuristic = [](const glm::vec2& p, Node* n, unsigned max_depth) {
-    if (max_depth <= n->depth) {
-      return false;
-    }
+  assert(m_root != nullptr);
+
+  std::vector<Node*> selected;
 
-    float width = n->size().x;
-    float distance = glm::distance(n->center(), p);
-    float factor = 0.75f;
-    return (distance * factor) < width;
+  if (!scheduler) {
+    select(m_root.get(), filter, selected);
+    return selected;
+  }
+
+  // Cut the tree into segments in depth first order. Every segment collects into its own
+  // list, so merging them gives the same order as the single threaded version.
+  struct Segment {
+    Node* node;
+    bool subtree;
+    std::vector<Node*> selected;
+  };
+
+  std::vector<Segment> segments;
+
+  std::function<void(Node*)> cut = [&](Node* node) {
+    if (node->depth < PARALLEL_DEPTH) {
+      segments.push_back({node, false, {}});
+      if (!node->is_leaf) {
+        for (const auto& child : node->children) cut(child.get());
+      }
+    } else {
+      segments.push_back({node, true, {}});
+    }
   };
+  cut(m_root.get());
 
-  if (split_heuristic(point, node.get(), m_max_depth)) {
+  TaskGroup group;
+
+  for (Segment& segment : segments) {
+    if (segment.subtree) {
+      scheduler->run(
+          group, [&filter, &segment]() { select(segment.node, filter, segment.selected); }, TaskPriority::HIGH);
+    } else if (filter(segment.node)) {
+      segment.selected.push_back(segment.node);
+    }
+  }
+
+  scheduler->wait(group);
+
+  for (const Segment& segment : segments) {
+    selected.insert(selected.end(), segment.selected.begin(), segment.selected.end());
+  }
+
+  return selected;
+}
+
+void QuadTree::select(Node* node, const std::function<bool(Node*)>& filter, std::vector<Node*>& selected)
+{
+  if (filter(node)) {
+    selected.push_back(node);
+  }
+
+  if (!node->is_leaf) {
+    for (const auto& child : node->children) {
+      select(child.get(), filter, selected);
+    }
+  }
+}
+
+bool QuadTree::should_split(const Node* node, const glm::vec2& point) const
+{
+  if (m_max_depth <= node->depth) {
+    return false;
+  }
+
+  float width = node->size().x;
+  float distance = glm::distance(node->center(), point);
+  float factor = 0.75f;
+  return (distance * factor) < width;
+}
+
+void QuadTree::insert(std::unique_ptr<Node>& node, const glm::vec2& point)
+{
+  if (should_split(node.get(), point)) {
     node->split();
     for (auto& child : node->children) {
       insert(child, point);
@@ -47,6 +121,21 @@ void QuadTree::insert(std::unique_ptr<Node>& node, const glm::vec2& point)
   }
 }
 
+void QuadTree::insert(std::unique_ptr<Node>& node, const glm::vec2& point, TaskScheduler& scheduler,
+                      TaskGroup& group)
+{
+  if (should_split(node.get(), point)) {
+    node->split();
+    for (auto& child : node->children) {
+      if (child->depth < PARALLEL_DEPTH) {
+        insert(child, point, scheduler, group);
+      } else {
+        scheduler.run(group, [this, &child, point]() { insert(child, point); }, TaskPriority::HIGH);
+      }
+    }
+  }
+}
+
 void Node::split()
 {
   auto child_depth = depth + 1;
@@ -8,6 +8,9 @@
 
 #include "TileUtils.h"
 
+class TaskGroup;
+class TaskScheduler;
+
 struct Node {
   enum : std::size_t { NW = 0, NE = 1, SE = 2, SW = 3 };
   glm::vec2 min, max;
@@ -37,13 +40,19 @@ struct Node {
 class QuadTree
 {
  public:
+  // Nodes are split by their distance to the point, which may be outside of the tree when it is one of several
+  // root tiles. With a scheduler the subtrees below PARALLEL_DEPTH are built concurrently.
   QuadTree(const glm::vec2& point, const glm::vec2& min, const glm::vec2& max, unsigned m_max_depth,
-           const TileId& root_tile);
+           const TileId& root_tile, TaskScheduler* scheduler = nullptr);
 
   std::vector<Node*> nodes();
 
   std::vector<Node*> leaves();
 
+  // Nodes for which the filter returns true, in depth first order like visit(). With a
+  // scheduler the subtrees are filtered concurrently, so the filter has to be thread safe.
+  std::vector<Node*> select(const std::function<bool(Node*)>& filter, TaskScheduler* scheduler = nullptr) const;
+
   Node* root() const { return m_root.get(); }
 
   unsigned max_depth() const { return m_max_depth; }
@@ -62,12 +71,21 @@ class QuadTree
   }
 
  private:
+  // depth of the subtrees that are handed to the scheduler, 4^2 of them for a full tree
+  static constexpr unsigned PARALLEL_DEPTH = 2;
+
   const TileId m_root_tile;
   const unsigned m_max_depth;
   std::unique_ptr<Node> m_root{nullptr};
 
+  bool should_split(const Node* node, const glm::vec2& point) const;
+
   void insert(std::unique_ptr<Node>& child, const glm::vec2& point);
 
+  void insert(std::unique_ptr<Node>& child, const glm::vec2& point, TaskScheduler& scheduler, TaskGroup& group);
+
+  static void select(Node* node, const std::function<bool(Node*)>& filter, std::vector<Node*>& selected);
+
   void visit(const std::unique_ptr<Node>& node, std::function<void(Node*)> visitor) const
   {
     assert(node != nullptr);
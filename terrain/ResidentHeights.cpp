@@ -0,0 +1,38 @@
+#include "ResidentHeights.h"
+
+void ResidentHeights::insert(const TileId& tile, std::pair<uint8_t, uint8_t> range)
+{
+  std::unique_lock lock(m_mutex);
+  m_tiles[tile.key()] = range;
+}
+
+bool ResidentHeights::contains(const TileId& tile) const
+{
+  std::unique_lock lock(m_mutex);
+  return m_tiles.contains(tile.key());
+}
+
+bool ResidentHeights::has_resident_below(const TileId& tile) const
+{
+  std::unique_lock lock(m_mutex);
+  auto it = m_tiles.upper_bound(tile.key());
+  return it != m_tiles.end() && it->first < tile.end_key();
+}
+
+std::optional<std::pair<uint8_t, uint8_t>> ResidentHeights::height_range(const TileId& tile, unsigned min_zoom) const
+{
+  std::unique_lock lock(m_mutex);
+
+  for (unsigned zoom = tile.zoom + 1; zoom-- > min_zoom;) {
+    auto it = m_tiles.find(tile.ancestor(zoom).key());
+    if (it != m_tiles.end()) return it->second;
+  }
+
+  return std::nullopt;
+}
+
+size_t ResidentHeights::size() const
+{
+  std::unique_lock lock(m_mutex);
+  return m_tiles.size();
+}
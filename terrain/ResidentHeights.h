@@ -0,0 +1,38 @@
+/*
+  Height tiles that are uploaded, for the threads that prepare frames while
+  the render thread uploads more. The lowest and highest value of a tile are
+  computed once when it is prepared, so culling does not have to look at
+  the pixels. The tiles are kept in the order of their Z-order keys, so
+  whether a tile has resident descendants is a single search.
+*/
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "TileUtils.h"
+
+class ResidentHeights
+{
+ public:
+  // lowest and highest height value of the tile
+  void insert(const TileId&, std::pair<uint8_t, uint8_t> range);
+
+  bool contains(const TileId&) const;
+
+  // any resident tile below the tile, not the tile itself
+  bool has_resident_below(const TileId&) const;
+
+  // Range of the tile or its deepest resident ancestor down to min_zoom. An ancestor covers more terrain, so
+  // its range contains the one of the tile.
+  std::optional<std::pair<uint8_t, uint8_t>> height_range(const TileId&, unsigned min_zoom = 0) const;
+
+  size_t size() const;
+
+ private:
+  mutable std::mutex m_mutex;
+  std::map<uint64_t, std::pair<uint8_t, uint8_t>> m_tiles;
+};
@@ -0,0 +1,93 @@
+#include "ResidentTiles.h"
+
+void ResidentTiles::insert(const TileId& tile)
+{
+  if (!m_resident.insert(tile.key()).second) {
+    return;
+  }
+
+  // the tile answers for itself now, its descendants might have a deeper ancestor
+  m_answers.erase(tile.key());
+  auto it = m_answers.lower_bound(tile.key());
+  auto end = m_answers.lower_bound(tile.end_key());
+
+  for (; it != end; ++it) {
+    Answer& answer = it->second;
+    if (answer.ancestor_zoom == NONE || answer.ancestor_zoom < tile.zoom) answer.ancestor_zoom = tile.zoom;
+  }
+}
+
+void ResidentTiles::erase(const TileId& tile)
+{
+  if (m_resident.erase(tile.key()) == 0) {
+    return;
+  }
+
+  auto it = m_answers.lower_bound(tile.key());
+  auto end = m_answers.lower_bound(tile.end_key());
+
+  for (; it != end; ++it) {
+    Answer& answer = it->second;
+    if (answer.ancestor_zoom == tile.zoom) answer.ancestor_zoom = find_ancestor_zoom(answer.tile);
+  }
+}
+
+void ResidentTiles::end_frame()
+{
+  // only every MAX_ANSWER_AGE frames, so the answers are not all visited every frame
+  if (++m_frame % MAX_ANSWER_AGE != 0) {
+    return;
+  }
+
+  std::erase_if(m_answers, [this](const auto& item) { return m_frame - item.second.last_asked > MAX_ANSWER_AGE; });
+}
+
+bool ResidentTiles::contains(const TileId& tile) const
+{
+  return m_resident.contains(tile.key());
+}
+
+std::optional<TileId> ResidentTiles::resident_ancestor(const TileId& tile)
+{
+  const uint64_t key = tile.key();
+
+  if (m_resident.contains(key)) {
+    return tile;
+  }
+
+  auto it = m_answers.find(key);
+  if (it == m_answers.end()) {
+    it = m_answers.emplace(key, Answer{tile, find_ancestor_zoom(tile), m_frame}).first;
+  }
+
+  it->second.last_asked = m_frame;
+
+  if (it->second.ancestor_zoom == NONE) {
+    return std::nullopt;
+  }
+
+  return tile.ancestor(it->second.ancestor_zoom);
+}
+
+std::vector<TileId> ResidentTiles::resident_descendants(const TileId& tile) const
+{
+  std::vector<TileId> descendants;
+
+  auto it = m_resident.upper_bound(tile.key());
+  auto end = m_resident.lower_bound(tile.end_key());
+
+  for (; it != end; ++it) {
+    descendants.push_back(TileId::from_key(*it));
+  }
+
+  return descendants;
+}
+
+unsigned ResidentTiles::find_ancestor_zoom(const TileId& tile) const
+{
+  for (unsigned zoom = tile.zoom; zoom-- > 0;) {
+    if (contains(tile.ancestor(zoom))) return zoom;
+  }
+
+  return NONE;
+}
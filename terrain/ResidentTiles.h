@@ -0,0 +1,64 @@
+/*
+  Deepest resident ancestor of a tile, used to fall back to a lower zoom
+  level while a texture is missing. The answers are cached per asked tile
+  and updated when tiles are inserted or erased, so a lookup is a single
+  search instead of a walk up the tree with a hash lookup per level.
+  Answers that were not asked for in a while are dropped, so the cache
+  does not grow while the camera moves on.
+
+  The tiles are kept in the order of their Z-order keys, so the resident
+  descendants of a tile are a single range.
+*/
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <vector>
+
+#include "TileUtils.h"
+
+class ResidentTiles
+{
+ public:
+  void insert(const TileId&);
+
+  void erase(const TileId&);
+
+  bool contains(const TileId&) const;
+
+  // The tile itself if it is resident, its deepest resident ancestor otherwise.
+  std::optional<TileId> resident_ancestor(const TileId&);
+
+  // resident tiles below the tile, not the tile itself, in Z-order
+  std::vector<TileId> resident_descendants(const TileId&) const;
+
+  inline size_t size() const { return m_resident.size(); }
+
+  // tiles asked about that are not resident themselves
+  inline size_t num_cached_answers() const { return m_answers.size(); }
+
+  // Drops the answers that were not asked for in the last MAX_ANSWER_AGE frames. Call once per frame.
+  void end_frame();
+
+  static constexpr unsigned MAX_ANSWER_AGE = 60;
+
+ private:
+  static constexpr unsigned NONE = ~0U;
+
+  struct Answer {
+    TileId tile;
+    unsigned ancestor_zoom;  // NONE if no ancestor is resident
+    unsigned last_asked;     // frame
+  };
+
+  // The keys are in Z-order, so the descendants of a tile are a contiguous
+  // range right after it.
+  std::set<uint64_t> m_resident;
+  std::map<uint64_t, Answer> m_answers;
+  unsigned m_frame{0};
+
+  // walks up the tree, the tile itself is not checked
+  unsigned find_ancestor_zoom(const TileId&) const;
+};
@@ -0,0 +1,157 @@
+#include "RootGrid.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+
+// x wraps around the antimeridian
+static unsigned wrap(int64_t x, unsigned zoom)
+{
+  const int64_t n = int64_t(1) << zoom;
+  return unsigned(((x % n) + n) % n);
+}
+
+RootGrid::RootGrid(const TileId& center, const Bounds<glm::vec2>& bounds, unsigned radius)
+    : m_bounds(bounds), m_radius(radius), m_center(center)
+{
+  update_roots();
+}
+
+glm::vec2 RootGrid::update(const glm::vec2& point)
+{
+  glm::ivec2 offset = tile_offset(point);
+
+  // there are no tiles north and south of the map
+  const int64_t n = int64_t(1) << m_center.zoom;
+  offset.y = int(std::clamp(int64_t(m_center.y) + offset.y, int64_t(0), n - 1) - int64_t(m_center.y));
+
+  if (offset == glm::ivec2(0)) {
+    return glm::vec2(0.0f);
+  }
+
+  m_center = TileId(m_center.zoom, wrap(int64_t(m_center.x) + offset.x, m_center.zoom), m_center.y + offset.y);
+  update_roots();
+
+  return glm::vec2(offset) * m_bounds.size();
+}
+
+Bounds<glm::vec2> RootGrid::extent() const
+{
+  Bounds<glm::vec2> extent = m_bounds;
+
+  for (const RootTile& root : m_roots) {
+    extent.min = glm::min(extent.min, root.bounds.min);
+    extent.max = glm::max(extent.max, root.bounds.max);
+  }
+
+  return extent;
+}
+
+Bounds<glm::vec2> RootGrid::tile_bounds(const TileId& tile) const
+{
+  assert(tile.zoom == m_center.zoom);
+
+  // the shorter way around the antimeridian
+  const int64_t n = int64_t(1) << m_center.zoom;
+  int64_t dx = int64_t(tile.x) - int64_t(m_center.x);
+  if (dx > n / 2) dx -= n;
+  if (dx < -n / 2) dx += n;
+  const int64_t dy = int64_t(tile.y) - int64_t(m_center.y);
+
+  const glm::vec2 offset = glm::vec2(float(dx), float(dy)) * m_bounds.size();
+  return Bounds<glm::vec2>(m_bounds.min + offset, m_bounds.max + offset);
+}
+
+const RootTile* RootGrid::find(const glm::vec2& point) const
+{
+  for (const RootTile& root : m_roots) {
+    if (contains(point, root.bounds)) {
+      return &root;
+    }
+  }
+
+  return nullptr;
+}
+
+const RootTile* RootGrid::find(const TileId& tile) const
+{
+  if (tile.zoom < m_center.zoom) {
+    return nullptr;
+  }
+
+  const unsigned shift = tile.zoom - m_center.zoom;
+  const TileId root(m_center.zoom, tile.x >> shift, tile.y >> shift);
+
+  for (const RootTile& candidate : m_roots) {
+    if (candidate.id == root) {
+      return &candidate;
+    }
+  }
+
+  return nullptr;
+}
+
+glm::vec2 RootGrid::clamp(const glm::vec2& point) const
+{
+  const unsigned last = (1U << m_center.zoom) - 1U;
+  const float north = tile_bounds(TileId(m_center.zoom, m_center.x, 0U)).min.y;
+  const float south = tile_bounds(TileId(m_center.zoom, m_center.x, last)).max.y;
+  return glm::vec2(point.x, std::clamp(point.y, north, south));
+}
+
+DCoordinate RootGrid::point_to_coordinate(const glm::vec2& point) const
+{
+  const glm::vec2 clamped = clamp(point);
+  const glm::ivec2 offset = tile_offset(clamped);
+  const unsigned last = (1U << m_center.zoom) - 1U;
+  const int64_t y = std::clamp(int64_t(m_center.y) + offset.y, int64_t(0), int64_t(last));
+  const TileId tile(m_center.zoom, wrap(int64_t(m_center.x) + offset.x, m_center.zoom), unsigned(y));
+
+  const glm::dvec2 size(m_bounds.size());
+  const glm::dvec2 tiles(double(offset.x), double(y - int64_t(m_center.y)));
+  const glm::dvec2 min = glm::dvec2(m_bounds.min) + tiles * size;
+  const Bounds<DCoordinate> coords = tile.bounds<double>();
+  return map_range(glm::dvec2(clamped), min, min + size, coords.min.to_vec2(), coords.max.to_vec2());
+}
+
+glm::vec2 RootGrid::coordinate_to_point(const DCoordinate& coord) const
+{
+  const TileId tile(coord, m_center.zoom);
+  const Bounds<glm::vec2> bounds = tile_bounds(tile);
+  const Bounds<DCoordinate> coords = tile.bounds<double>();
+  return glm::vec2(map_range(coord.to_vec2(), coords.min.to_vec2(), coords.max.to_vec2(), glm::dvec2(bounds.min),
+                             glm::dvec2(bounds.max)));
+}
+
+void RootGrid::update_roots()
+{
+  m_roots.clear();
+
+  const int radius = int(m_radius);
+  const int64_t n = int64_t(1) << m_center.zoom;
+
+  for (int dy = -radius; dy <= radius; ++dy) {
+    const int64_t y = int64_t(m_center.y) + dy;
+    if (y < 0 || y >= n) continue;
+
+    for (int dx = -radius; dx <= radius; ++dx) {
+      const glm::vec2 offset = glm::vec2(float(dx), float(dy)) * m_bounds.size();
+      const TileId id(m_center.zoom, wrap(int64_t(m_center.x) + dx, m_center.zoom), unsigned(y));
+      m_roots.push_back({id, Bounds<glm::vec2>(m_bounds.min + offset, m_bounds.max + offset)});
+    }
+  }
+
+  // nearest first, in steps from tile to tile
+  auto steps = [this](const RootTile& root) {
+    const glm::ivec2 offset = tile_offset(root.bounds.center());
+    return std::abs(offset.x) + std::abs(offset.y);
+  };
+  std::stable_sort(m_roots.begin(), m_roots.end(),
+                   [&](const RootTile& a, const RootTile& b) { return steps(a) < steps(b); });
+}
+
+glm::ivec2 RootGrid::tile_offset(const glm::vec2& point) const
+{
+  return glm::ivec2(glm::floor((point - m_bounds.min) / m_bounds.size()));
+}
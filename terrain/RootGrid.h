@@ -0,0 +1,77 @@
+/*
+  A window of root tiles on the WMS grid around the camera, each the root
+  of its own quad tree, so the terrain is not limited to a single tile.
+  The window slides when the camera moves onto another tile.
+
+  World coordinates are relative to the root tile under the camera, which
+  always covers the same bounds. When the camera moves onto another tile
+  the world is rebased, so floats keep their precision on long routes.
+  All root tiles have the same size in world units, they are squares in
+  the mercator projection.
+*/
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Common.h"
+#include "TileUtils.h"
+
+struct RootTile {
+  TileId id;
+  Bounds<glm::vec2> bounds;  // in world space
+};
+
+class RootGrid
+{
+ public:
+  // The center tile covers the bounds, radius is the number of tiles on each side of it.
+  RootGrid(const TileId& center, const Bounds<glm::vec2>& bounds, unsigned radius = 1);
+
+  // Moves the window onto the tile under the point if it is another one. Returns the offset that was subtracted
+  // from world space, it has to be subtracted from positions kept outside as well. Zero if nothing changed.
+  glm::vec2 update(const glm::vec2& point);
+
+  // the tile under the camera
+  inline const TileId& center() const { return m_center; }
+
+  // of the center tile, these never change
+  inline const Bounds<glm::vec2>& bounds() const { return m_bounds; }
+
+  // center tile first, then by distance. Wraps around east and west, ends at the north and south edge of the map.
+  inline const std::vector<RootTile>& roots() const { return m_roots; }
+
+  inline unsigned radius() const { return m_radius; }
+
+  // covered by all root tiles
+  Bounds<glm::vec2> extent() const;
+
+  // where a tile of the root zoom level is in world space, also outside of the window
+  Bounds<glm::vec2> tile_bounds(const TileId&) const;
+
+  // the root tile with the point or nullptr
+  const RootTile* find(const glm::vec2& point) const;
+
+  // the root tile a tile of the root zoom level or deeper is part of, or nullptr
+  const RootTile* find(const TileId&) const;
+
+  // keeps the point between the north and south edge of the map
+  glm::vec2 clamp(const glm::vec2& point) const;
+
+  // Linear within each root tile, like the textures are mapped. In double, so the coordinates can address
+  // tiles beyond zoom 16.
+  DCoordinate point_to_coordinate(const glm::vec2&) const;
+
+  glm::vec2 coordinate_to_point(const DCoordinate&) const;
+
+ private:
+  const Bounds<glm::vec2> m_bounds;
+  const unsigned m_radius;
+  TileId m_center;
+  std::vector<RootTile> m_roots;
+
+  void update_roots();
+
+  // offset in tiles from the center tile to the one under the point
+  glm::ivec2 tile_offset(const glm::vec2& point) const;
+};
@@ -0,0 +1,304 @@
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <cassert>
+
+// the scheduler and worker index of the current thread
+static thread_local const TaskScheduler* current_scheduler = nullptr;
+static thread_local int current_worker = -1;
+
+bool TaskScheduler::Deque::push(TaskSlot* slot)
+{
+  int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+  int64_t top = m_top.load(std::memory_order_acquire);
+
+  if (bottom - top >= int64_t(QUEUE_CAPACITY)) {
+    return false;
+  }
+
+  m_buffer[bottom & MASK].store(slot, std::memory_order_release);
+  m_bottom.store(bottom + 1, std::memory_order_seq_cst);
+  return true;
+}
+
+TaskScheduler::TaskSlot* TaskScheduler::Deque::pop()
+{
+  int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+  m_bottom.store(bottom, std::memory_order_seq_cst);
+  int64_t top = m_top.load(std::memory_order_seq_cst);
+
+  if (bottom < top) {
+    m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  TaskSlot* slot = m_buffer[bottom & MASK].load(std::memory_order_acquire);
+
+  if (top == bottom) {
+    // last item, race against the thieves
+    if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      slot = nullptr;
+    }
+    m_bottom.store(bottom + 1, std::memory_order_relaxed);
+  }
+
+  return slot;
+}
+
+TaskScheduler::TaskSlot* TaskScheduler::Deque::steal()
+{
+  int64_t top = m_top.load(std::memory_order_seq_cst);
+  int64_t bottom = m_bottom.load(std::memory_order_seq_cst);
+
+  if (bottom <= top) {
+    return nullptr;
+  }
+
+  TaskSlot* slot = m_buffer[top & MASK].load(std::memory_order_acquire);
+
+  if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+    return nullptr;
+  }
+
+  return slot;
+}
+
+TaskScheduler::TaskScheduler(size_t num_workers)
+    : m_external_slots(std::make_unique<TaskSlot[]>(QUEUE_CAPACITY))
+{
+  num_workers = std::max(num_workers, size_t(1));
+
+  // create all workers before starting them, they steal from each other
+  for (size_t i = 0; i < num_workers; ++i) {
+    auto worker = std::make_unique<Worker>();
+    worker->slots = std::make_unique<TaskSlot[]>(QUEUE_CAPACITY);
+    m_workers.push_back(std::move(worker));
+  }
+
+  for (size_t i = 0; i < num_workers; ++i) {
+    m_workers[i]->thread = std::thread([this, i]() { worker_loop(i); });
+  }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+  {
+    std::unique_lock lock(m_sleep_mutex);
+    m_stop = true;
+  }
+  m_wake_up.notify_all();
+
+  for (auto& worker : m_workers) {
+    worker->thread.join();
+  }
+
+  // run what is left, so no group waits forever
+  while (TaskSlot* slot = find_task(-1)) {
+    execute(slot);
+  }
+}
+
+void TaskScheduler::run(Task task, TaskPriority priority) { submit(std::move(task), nullptr, priority); }
+
+void TaskScheduler::run(TaskGroup& group, Task task, TaskPriority priority)
+{
+  group.m_pending++;
+  submit(std::move(task), &group, priority);
+}
+
+void TaskScheduler::then(TaskGroup& group, Task continuation, TaskPriority priority)
+{
+  {
+    std::unique_lock lock(group.m_mutex);
+
+    if (group.m_pending > 0) {
+      assert(!group.m_continuation);
+      group.m_continuation = std::move(continuation);
+      group.m_continuation_priority = priority;
+      return;
+    }
+  }
+
+  submit(std::move(continuation), nullptr, priority);
+}
+
+void TaskScheduler::wait(TaskGroup& group)
+{
+  int index = worker_index();
+
+  while (group.m_pending > 0 || group.m_finishing > 0) {
+    if (TaskSlot* slot = find_task(index)) {
+      execute(slot);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void TaskScheduler::submit(Task&& task, TaskGroup* group, TaskPriority priority)
+{
+  const size_t p = size_t(priority);
+  int index = worker_index();
+
+  if (index >= 0) {
+    Worker& worker = *m_workers[index];
+    TaskSlot* slot = allocate(worker.slots.get(), worker.next_slot);
+
+    if (slot) {
+      slot->task = std::move(task);
+      slot->group = group;
+
+      if (worker.deques[p].push(slot)) {
+        notify();
+        return;
+      }
+
+      // deque is full
+      execute(slot);
+      return;
+    }
+  } else {
+    std::unique_lock lock(m_external_mutex);
+    TaskSlot* slot = allocate(m_external_slots.get(), m_next_external_slot);
+
+    if (slot) {
+      slot->task = std::move(task);
+      slot->group = group;
+      m_external_queues[p].push_back(slot);
+      m_external_size++;
+      lock.unlock();
+
+      notify();
+      return;
+    }
+  }
+
+  // too many tasks in flight, run it right here
+  task();
+  task.reset();
+  if (group) finish(group);
+}
+
+int TaskScheduler::worker_index() const { return current_scheduler == this ? current_worker : -1; }
+
+void TaskScheduler::worker_loop(size_t index)
+{
+  current_scheduler = this;
+  current_worker = int(index);
+
+  while (true) {
+    uint64_t epoch = m_epoch.load();
+
+    if (TaskSlot* slot = find_task(int(index))) {
+      execute(slot);
+      continue;
+    }
+
+    std::unique_lock lock(m_sleep_mutex);
+    if (m_stop) break;
+
+    m_sleeping++;
+    m_wake_up.wait(lock, [&]() { return m_stop || m_epoch.load() != epoch; });
+    m_sleeping--;
+
+    if (m_stop) break;
+  }
+}
+
+TaskScheduler::TaskSlot* TaskScheduler::find_task(int index)
+{
+  const size_t num_workers = m_workers.size();
+
+  for (size_t p = 0; p < NUM_PRIORITIES; ++p) {
+    if (index >= 0) {
+      if (TaskSlot* slot = m_workers[index]->deques[p].pop()) return slot;
+    }
+
+    if (m_external_size > 0) {
+      std::unique_lock lock(m_external_mutex);
+      auto& queue = m_external_queues[p];
+
+      if (!queue.empty()) {
+        TaskSlot* slot = queue.front();
+        queue.pop_front();
+        m_external_size--;
+        return slot;
+      }
+    }
+
+    // start with the next worker, so not everyone steals from the same one
+    size_t start = index >= 0 ? size_t(index) + 1 : 0;
+    for (size_t i = 0; i < num_workers; ++i) {
+      size_t victim = (start + i) % num_workers;
+      if (int(victim) == index) continue;
+      if (TaskSlot* slot = m_workers[victim]->deques[p].steal()) return slot;
+    }
+  }
+
+  return nullptr;
+}
+
+void TaskScheduler::execute(TaskSlot* slot)
+{
+  slot->task();
+  slot->task.reset();
+
+  TaskGroup* group = slot->group;
+  slot->group = nullptr;
+  slot->in_use.store(false, std::memory_order_release);
+
+  if (group) finish(group);
+}
+
+void TaskScheduler::finish(TaskGroup* group)
+{
+  // announce that the group is still in use, before it can reach zero
+  group->m_finishing++;
+
+  if (group->m_pending.fetch_sub(1) == 1) {
+    std::optional<Task> continuation;
+    TaskPriority priority;
+
+    {
+      std::unique_lock lock(group->m_mutex);
+      if (group->m_continuation && group->m_pending == 0) {
+        continuation = std::move(group->m_continuation);
+        group->m_continuation.reset();
+        priority = group->m_continuation_priority;
+      }
+    }
+
+    group->m_finishing--;  // the group must not be accessed after this
+
+    if (continuation) submit(std::move(*continuation), nullptr, priority);
+    return;
+  }
+
+  group->m_finishing--;
+}
+
+void TaskScheduler::notify()
+{
+  m_epoch++;
+
+  if (m_sleeping > 0) {
+    std::unique_lock lock(m_sleep_mutex);
+    m_wake_up.notify_one();
+  }
+}
+
+TaskScheduler::TaskSlot* TaskScheduler::allocate(TaskSlot* slots, size_t& next_slot)
+{
+  // slots are mostly freed in order, when the next few are all taken the queue is full anyway
+  for (size_t i = 0; i < MAX_SLOT_SEARCH; ++i) {
+    TaskSlot* slot = &slots[(next_slot + i) % QUEUE_CAPACITY];
+
+    if (!slot->in_use.load(std::memory_order_acquire)) {
+      slot->in_use.store(true, std::memory_order_relaxed);
+      next_slot = (next_slot + i + 1) % QUEUE_CAPACITY;
+      return slot;
+    }
+  }
+
+  return nullptr;
+}
@@ -0,0 +1,211 @@
+/*
+  Work-stealing task scheduler for short CPU bound tasks, e.g. normal map
+  generation or parallel culling. Every worker owns one Chase-Lev deque per
+  priority, idle workers steal from the others. Tasks are stored inline in
+  preallocated slots, so submitting a task does not allocate.
+
+  Blocking work like downloads should stay on a ThreadPool.
+*/
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+enum class TaskPriority : size_t { HIGH = 0, NORMAL = 1, LOW = 2 };
+
+// Move-only callable with small buffer storage, never allocates.
+class Task
+{
+ public:
+  static constexpr size_t CAPACITY = 64;
+
+  Task() = default;
+
+  template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>>
+  Task(F&& function)
+  {
+    using Function = std::decay_t<F>;
+    static_assert(sizeof(Function) <= CAPACITY, "captures too large, capture a pointer instead");
+    static_assert(alignof(Function) <= alignof(std::max_align_t));
+    static_assert(std::is_nothrow_move_constructible_v<Function>);
+
+    new (m_storage) Function(std::forward<F>(function));
+    m_operations = &operations<Function>;
+  }
+
+  Task(Task&& other) noexcept { move_from(other); }
+
+  Task& operator=(Task&& other) noexcept
+  {
+    if (this != &other) {
+      reset();
+      move_from(other);
+    }
+    return *this;
+  }
+
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  ~Task() { reset(); }
+
+  void operator()() { m_operations->invoke(m_storage); }
+
+  explicit operator bool() const { return m_operations != nullptr; }
+
+  void reset()
+  {
+    if (m_operations) {
+      m_operations->destroy(m_storage);
+      m_operations = nullptr;
+    }
+  }
+
+ private:
+  struct Operations {
+    void (*invoke)(void*);
+    void (*move)(void* to, void* from);
+    void (*destroy)(void*);
+  };
+
+  template <typename Function>
+  static constexpr Operations operations = {
+      [](void* f) { (*static_cast<Function*>(f))(); },
+      [](void* to, void* from) { new (to) Function(std::move(*static_cast<Function*>(from))); },
+      [](void* f) { static_cast<Function*>(f)->~Function(); },
+  };
+
+  alignas(std::max_align_t) unsigned char m_storage[CAPACITY];
+  const Operations* m_operations{nullptr};
+
+  void move_from(Task& other)
+  {
+    if (other.m_operations) {
+      other.m_operations->move(m_storage, other.m_storage);
+      m_operations = other.m_operations;
+      other.reset();
+    }
+  }
+};
+
+// Tasks that can be waited for together. Must outlive its tasks.
+class TaskGroup
+{
+ public:
+  TaskGroup() = default;
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  inline unsigned pending() const { return m_pending.load(); }
+
+ private:
+  friend class TaskScheduler;
+
+  std::atomic<unsigned> m_pending{0};
+  std::atomic<unsigned> m_finishing{0};  // threads that still access the group after their task
+  std::mutex m_mutex;
+  std::optional<Task> m_continuation;
+  TaskPriority m_continuation_priority{TaskPriority::NORMAL};
+};
+
+class TaskScheduler
+{
+ public:
+  TaskScheduler(size_t num_workers = std::thread::hardware_concurrency());
+
+  ~TaskScheduler();
+
+  TaskScheduler(const TaskScheduler&) = delete;
+  TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+  void run(Task task, TaskPriority priority = TaskPriority::NORMAL);
+
+  void run(TaskGroup& group, Task task, TaskPriority priority = TaskPriority::NORMAL);
+
+  // Run the continuation once all tasks of the group are finished, right
+  // away if there are none. wait() does not wait for the continuation.
+  void then(TaskGroup& group, Task continuation, TaskPriority priority = TaskPriority::NORMAL);
+
+  // Execute tasks on the calling thread until all tasks of the group are finished.
+  void wait(TaskGroup& group);
+
+  inline size_t num_workers() const { return m_workers.size(); }
+
+ private:
+  // tasks that can be in flight per worker, and for all other threads together
+  static constexpr size_t QUEUE_CAPACITY = 4096;
+  static constexpr size_t NUM_PRIORITIES = 3;
+  static constexpr size_t MAX_SLOT_SEARCH = 64;
+
+  struct TaskSlot {
+    Task task;
+    TaskGroup* group{nullptr};
+    std::atomic<bool> in_use{false};
+  };
+
+  // Chase-Lev deque, the owner pushes and pops at the bottom, thieves steal from the top.
+  class Deque
+  {
+   public:
+    bool push(TaskSlot* slot);
+    TaskSlot* pop();
+    TaskSlot* steal();
+
+   private:
+    static constexpr int64_t MASK = QUEUE_CAPACITY - 1;
+    alignas(64) std::atomic<int64_t> m_top{0};
+    alignas(64) std::atomic<int64_t> m_bottom{0};
+    std::array<std::atomic<TaskSlot*>, QUEUE_CAPACITY> m_buffer{};
+  };
+
+  struct Worker {
+    std::array<Deque, NUM_PRIORITIES> deques;
+    std::unique_ptr<TaskSlot[]> slots;
+    size_t next_slot{0};
+    std::thread thread;
+  };
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+
+  // tasks submitted by other threads
+  std::mutex m_external_mutex;
+  std::array<std::deque<TaskSlot*>, NUM_PRIORITIES> m_external_queues;
+  std::atomic<size_t> m_external_size{0};
+  std::unique_ptr<TaskSlot[]> m_external_slots;
+  size_t m_next_external_slot{0};
+
+  std::atomic<bool> m_stop{false};
+  std::atomic<uint64_t> m_epoch{0};
+  std::atomic<unsigned> m_sleeping{0};
+  std::mutex m_sleep_mutex;
+  std::condition_variable m_wake_up;
+
+  void submit(Task&& task, TaskGroup* group, TaskPriority priority);
+
+  // index of the worker running on this thread, or -1
+  int worker_index() const;
+
+  void worker_loop(size_t index);
+
+  TaskSlot* find_task(int index);
+
+  void execute(TaskSlot* slot);
+
+  void finish(TaskGroup* group);
+
+  void notify();
+
+  static TaskSlot* allocate(TaskSlot* slots, size_t& next_slot);
+};
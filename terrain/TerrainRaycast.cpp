@@ -0,0 +1,431 @@
+#include "TerrainRaycast.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+
+// about 44 KB each for 256x256 tiles
+static constexpr size_t MAX_PYRAMIDS = 512;
+
+// rays are moved this fraction of a cell past each border, so they never get stuck on it
+static constexpr float CELL_EPSILON = 1e-3f;
+
+HeightPyramid build_height_pyramid(const HeightView& heights)
+{
+  assert(heights.valid() && heights.width >= 2 && heights.height >= 2);
+
+  HeightPyramid pyramid;
+  pyramid.heights = heights;
+
+  if (!heights.valid() || heights.width < 2 || heights.height < 2) {
+    return pyramid;
+  }
+
+  // a block of 2x2 cells has 3x3 samples, shared with the neighbouring blocks
+  int nx = pyramid.blocks_x(0), ny = pyramid.blocks_y(0);
+  std::vector<uint8_t> max_level(size_t(nx) * ny), min_level(size_t(nx) * ny);
+
+  for (int by = 0; by < ny; ++by) {
+    for (int bx = 0; bx < nx; ++bx) {
+      uint8_t hi = 0, lo = 255;
+
+      for (int y = 2 * by; y <= std::min(2 * by + 2, heights.height - 1); ++y) {
+        for (int x = 2 * bx; x <= std::min(2 * bx + 2, heights.width - 1); ++x) {
+          hi = std::max(hi, heights.at(x, y));
+          lo = std::min(lo, heights.at(x, y));
+        }
+      }
+
+      max_level[size_t(by) * nx + bx] = hi;
+      min_level[size_t(by) * nx + bx] = lo;
+    }
+  }
+
+  pyramid.max_levels.push_back(std::move(max_level));
+  pyramid.min_levels.push_back(std::move(min_level));
+
+  for (size_t level = 1; nx > 1 || ny > 1; ++level) {
+    const int below_x = nx, below_y = ny;
+    nx = pyramid.blocks_x(level);
+    ny = pyramid.blocks_y(level);
+
+    const std::vector<uint8_t>& max_below = pyramid.max_levels.back();
+    const std::vector<uint8_t>& min_below = pyramid.min_levels.back();
+    std::vector<uint8_t> max_level(size_t(nx) * ny), min_level(size_t(nx) * ny);
+
+    for (int by = 0; by < ny; ++by) {
+      int y0 = 2 * by, y1 = std::min(2 * by + 1, below_y - 1);
+
+      for (int bx = 0; bx < nx; ++bx) {
+        int x0 = 2 * bx, x1 = std::min(2 * bx + 1, below_x - 1);
+        size_t i00 = size_t(y0) * below_x + x0, i01 = size_t(y0) * below_x + x1;
+        size_t i10 = size_t(y1) * below_x + x0, i11 = size_t(y1) * below_x + x1;
+
+        max_level[size_t(by) * nx + bx] =
+            std::max(std::max(max_below[i00], max_below[i01]), std::max(max_below[i10], max_below[i11]));
+        min_level[size_t(by) * nx + bx] =
+            std::min(std::min(min_below[i00], min_below[i01]), std::min(min_below[i10], min_below[i11]));
+      }
+    }
+
+    pyramid.max_levels.push_back(std::move(max_level));
+    pyramid.min_levels.push_back(std::move(min_level));
+  }
+
+  return pyramid;
+}
+
+std::pair<uint8_t, uint8_t> height_range(const HeightPyramid& pyramid, const glm::ivec2& min, const glm::ivec2& max)
+{
+  assert(!pyramid.max_levels.empty() && min.x < max.x && min.y < max.y);
+
+  // the finest level where at most 2x2 blocks cover the cells
+  size_t level = 0;
+  while (level + 1 < pyramid.max_levels.size() && (max.x - min.x > (2 << level) || max.y - min.y > (2 << level))) {
+    level++;
+  }
+
+  const int block = 2 << level, nx = pyramid.blocks_x(level), ny = pyramid.blocks_y(level);
+  const int bx0 = std::clamp(min.x / block, 0, nx - 1), bx1 = std::clamp((max.x - 1) / block, 0, nx - 1);
+  const int by0 = std::clamp(min.y / block, 0, ny - 1), by1 = std::clamp((max.y - 1) / block, 0, ny - 1);
+  uint8_t lo = 255, hi = 0;
+
+  for (int by = by0; by <= by1; ++by) {
+    for (int bx = bx0; bx <= bx1; ++bx) {
+      lo = std::min(lo, pyramid.min_levels[level][size_t(by) * nx + bx]);
+      hi = std::max(hi, pyramid.max_levels[level][size_t(by) * nx + bx]);
+    }
+  }
+
+  return {lo, hi};
+}
+
+// https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm
+static bool ray_vs_triangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& a,
+                            const glm::vec3& b, const glm::vec3& c, float& t)
+{
+  glm::vec3 e1 = b - a, e2 = c - a;
+  glm::vec3 p = glm::cross(direction, e2);
+  float det = glm::dot(e1, p);
+
+  if (det == 0.0f) {
+    return false;
+  }
+
+  float inv_det = 1.0f / det;
+  glm::vec3 s = origin - a;
+  float u = glm::dot(s, p) * inv_det;
+
+  if (u < 0.0f || u > 1.0f) {
+    return false;
+  }
+
+  glm::vec3 q = glm::cross(s, e1);
+  float v = glm::dot(direction, q) * inv_det;
+
+  if (v < 0.0f || u + v > 1.0f) {
+    return false;
+  }
+
+  t = glm::dot(e2, q) * inv_det;
+  return true;
+}
+
+std::optional<HeightfieldHit> raycast_heightfield(const HeightPyramid& pyramid, const glm::vec3& origin,
+                                                  const glm::vec3& direction, float t_min, float t_max)
+{
+  if (pyramid.max_levels.empty()) {
+    return std::nullopt;
+  }
+
+  const HeightView& heights = pyramid.heights;
+  const int cells_x = pyramid.cells_x(), cells_y = pyramid.cells_y();
+  const int top = int(pyramid.max_levels.size());
+  const float top_height = pyramid.max_levels.back()[0];
+  const float t_begin = t_min;
+  const glm::vec3 inv_direction = 1.0f / direction;
+
+  // clip to the box of the heightfield, there is no floor
+  auto clip = [&](int axis, float min, float max) {
+    if (direction[axis] == 0.0f) {
+      if (origin[axis] < min || origin[axis] > max) t_max = -1.0f;
+      return;
+    }
+    float t1 = (min - origin[axis]) * inv_direction[axis], t2 = (max - origin[axis]) * inv_direction[axis];
+    t_min = std::max(t_min, std::min(t1, t2));
+    t_max = std::min(t_max, std::max(t1, t2));
+  };
+
+  clip(0, 0.0f, float(cells_x));
+  clip(1, std::numeric_limits<float>::lowest(), top_height);
+  clip(2, 0.0f, float(cells_y));
+
+  if (t_min > t_max) {
+    return std::nullopt;
+  }
+
+  const float step = CELL_EPSILON / std::max(std::max(std::abs(direction.x), std::abs(direction.z)), 1e-20f);
+
+  auto advance = [&](float t_exit) { return std::max(t_exit + step, std::nextafter(t_exit, t_max + 1.0f)); };
+
+  auto vertex = [&](int x, int y) { return glm::vec3(float(x), float(heights.at(x, y)), float(y)); };
+
+  int level = top;
+  float t = t_min;
+
+  while (t <= t_max) {
+    const glm::vec3 position = origin + direction * t;
+    const int size = 1 << level;
+    const int nx = level == 0 ? cells_x : pyramid.blocks_x(level - 1);
+    const int ny = level == 0 ? cells_y : pyramid.blocks_y(level - 1);
+    const int cx = std::clamp(int(std::floor(position.x / float(size))), 0, nx - 1);
+    const int cy = std::clamp(int(std::floor(position.z / float(size))), 0, ny - 1);
+
+    // where the ray leaves the cell
+    const float x0 = float(cx * size), x1 = float(std::min((cx + 1) * size, cells_x));
+    const float z0 = float(cy * size), z1 = float(std::min((cy + 1) * size, cells_y));
+    float t_exit = t_max;
+    if (direction.x != 0.0f) t_exit = std::min(t_exit, ((direction.x > 0.0f ? x1 : x0) - origin.x) * inv_direction.x);
+    if (direction.z != 0.0f) t_exit = std::min(t_exit, ((direction.z > 0.0f ? z1 : z0) - origin.z) * inv_direction.z);
+    t_exit = std::max(t_exit, t);
+
+    if (level == 0) {
+      // the two triangles of the cell, split along the diagonal from the north west
+      const glm::vec3 a = vertex(cx, cy), b = vertex(cx + 1, cy), c = vertex(cx + 1, cy + 1), d = vertex(cx, cy + 1);
+      const float t_lo = std::max(t - step, t_begin), t_hi = t_exit + step;
+      float t_hit = std::numeric_limits<float>::max();
+      glm::vec3 normal;
+
+      auto triangle = [&](const glm::vec3& p, const glm::vec3& q, const glm::vec3& r) {
+        float t_triangle;
+        if (ray_vs_triangle(origin, direction, p, q, r, t_triangle) && t_lo <= t_triangle && t_triangle <= t_hi &&
+            t_triangle < t_hit) {
+          t_hit = t_triangle;
+          normal = glm::cross(r - p, q - p);  // points up
+        }
+      };
+
+      triangle(a, b, c);
+      triangle(a, c, d);
+
+      if (t_hit <= t_hi) {
+        return HeightfieldHit{t_hit, normal};
+      }
+
+      t = advance(t_exit);
+      level = std::min(level + 1, top);
+      continue;
+    }
+
+    const size_t i = size_t(cy) * nx + cx;
+    const float y_enter = position.y, y_exit = origin.y + direction.y * t_exit;
+
+    // completely above the highest or below the lowest point of the block
+    if (std::min(y_enter, y_exit) > float(pyramid.max_levels[level - 1][i]) ||
+        std::max(y_enter, y_exit) < float(pyramid.min_levels[level - 1][i])) {
+      t = advance(t_exit);
+      level = std::min(level + 1, top);
+      continue;
+    }
+
+    level--;
+  }
+
+  return std::nullopt;
+}
+
+// height of the two triangles of the cell at a point of the heightfield
+static float surface_height(const HeightView& heights, float x, float z)
+{
+  const int cx = std::clamp(int(std::floor(x)), 0, heights.width - 2);
+  const int cy = std::clamp(int(std::floor(z)), 0, heights.height - 2);
+  const float fx = std::clamp(x - float(cx), 0.0f, 1.0f), fz = std::clamp(z - float(cy), 0.0f, 1.0f);
+  const float a = heights.at(cx, cy), b = heights.at(cx + 1, cy), c = heights.at(cx + 1, cy + 1),
+              d = heights.at(cx, cy + 1);
+
+  if (fx >= fz) {
+    return a + (b - a) * fx + (c - b) * fz;
+  }
+  return a + (c - d) * fx + (d - a) * fz;
+}
+
+// clips the ray to the bounds in the x-z-plane
+static bool clip(const Ray& ray, const Bounds<glm::vec2>& bounds, float& t_min, float& t_max)
+{
+  const glm::vec2 origin(ray.origin.x, ray.origin.z), direction(ray.direction.x, ray.direction.z);
+
+  for (int axis = 0; axis < 2; ++axis) {
+    if (direction[axis] == 0.0f) {
+      if (origin[axis] < bounds.min[axis] || origin[axis] > bounds.max[axis]) return false;
+      continue;
+    }
+
+    float t1 = (bounds.min[axis] - origin[axis]) / direction[axis];
+    float t2 = (bounds.max[axis] - origin[axis]) / direction[axis];
+    t_min = std::max(t_min, std::min(t1, t2));
+    t_max = std::min(t_max, std::max(t1, t2));
+  }
+
+  return t_min <= t_max;
+}
+
+TerrainRaycaster::TerrainRaycaster(const TileId& root_tile, unsigned max_zoom, const Bounds<glm::vec2>& bounds,
+                                   float height_scale, HeightSource source, ResidentQuery has_resident_below)
+    : m_root_tile(root_tile),
+      m_max_zoom(max_zoom),
+      m_bounds(bounds),
+      m_height_scale(height_scale),
+      m_source(std::move(source)),
+      m_has_resident_below(std::move(has_resident_below))
+{
+}
+
+std::optional<TerrainHit> TerrainRaycaster::raycast(const Ray& ray, float max_distance)
+{
+  const Ray normalized(ray.origin, glm::normalize(ray.direction));
+  float t_min = 0.0f, t_max = max_distance;
+
+  if (!clip(normalized, m_bounds, t_min, t_max)) {
+    return std::nullopt;
+  }
+
+  return raycast(m_root_tile, m_bounds, normalized, t_min, t_max, m_root_tile, pyramid(m_root_tile));
+}
+
+size_t TerrainRaycaster::num_pyramids()
+{
+  std::unique_lock lock(m_mutex);
+  return m_pyramids.size();
+}
+
+std::shared_ptr<const HeightPyramid> TerrainRaycaster::pyramid(const TileId& tile)
+{
+  {
+    std::unique_lock lock(m_mutex);
+    auto it = m_pyramids.find(tile);
+
+    if (it != m_pyramids.end()) {
+      it->second.last_used = ++m_lookups;
+      return it->second.pyramid;
+    }
+  }
+
+  HeightView heights = m_source(tile);
+
+  if (!heights.valid() || heights.width < 2 || heights.height < 2) {
+    return nullptr;
+  }
+
+  // built without holding the lock, another thread may have done the same
+  auto pyramid = std::make_shared<const HeightPyramid>(build_height_pyramid(heights));
+
+  std::unique_lock lock(m_mutex);
+
+  if (m_pyramids.size() >= MAX_PYRAMIDS) {
+    auto oldest = std::min_element(m_pyramids.begin(), m_pyramids.end(), [](const auto& a, const auto& b) {
+      return a.second.last_used < b.second.last_used;
+    });
+    m_pyramids.erase(oldest);
+  }
+
+  auto [it, inserted] = m_pyramids.try_emplace(tile, CachedPyramid{pyramid, ++m_lookups});
+  return it->second.pyramid;
+}
+
+Bounds<glm::vec2> TerrainRaycaster::tile_bounds(const TileId& tile) const
+{
+  return descendant_bounds(m_root_tile, m_bounds, tile);
+}
+
+std::optional<TerrainHit> TerrainRaycaster::raycast(const TileId& tile, const Bounds<glm::vec2>& bounds,
+                                                    const Ray& ray, float t_min, float t_max,
+                                                    const TileId& data_tile,
+                                                    const std::shared_ptr<const HeightPyramid>& data)
+{
+  // Non-resident levels in between are walked with the data of the ancestor, the
+  // leaves the quad tree requests are often several levels below the root.
+  if (tile.zoom < m_max_zoom && m_has_resident_below(tile)) {
+    const std::array<TileId, 4> children = tile.children();
+
+    // in TileId::children() order, like the quad tree
+    const glm::vec2 middle = bounds.center();
+    const std::array<Bounds<glm::vec2>, 4> child_bounds = {
+        Bounds<glm::vec2>(bounds.min, middle),
+        Bounds<glm::vec2>({middle.x, bounds.min.y}, {bounds.max.x, middle.y}),
+        Bounds<glm::vec2>(middle, bounds.max),
+        Bounds<glm::vec2>({bounds.min.x, middle.y}, {middle.x, bounds.max.y}),
+    };
+
+    struct Visit {
+      float t_min, t_max;
+      size_t child;
+    };
+
+    std::array<Visit, 4> visits;
+    size_t num_visits = 0;
+
+    for (size_t i = 0; i < children.size(); ++i) {
+      float child_t_min = t_min, child_t_max = t_max;
+      if (clip(ray, child_bounds[i], child_t_min, child_t_max)) visits[num_visits++] = {child_t_min, child_t_max, i};
+    }
+
+    // front to back, so the first hit is the closest one
+    std::sort(visits.begin(), visits.begin() + num_visits,
+              [](const Visit& a, const Visit& b) { return a.t_min < b.t_min; });
+
+    for (size_t k = 0; k < num_visits; ++k) {
+      const Visit& visit = visits[k];
+      const size_t i = visit.child;
+
+      // only for the children the ray enters
+      std::shared_ptr<const HeightPyramid> child_data = pyramid(children[i]);
+      const bool resident = child_data != nullptr;
+
+      auto hit = raycast(children[i], child_bounds[i], ray, visit.t_min, visit.t_max,
+                         resident ? children[i] : data_tile, resident ? child_data : data);
+      if (hit) return hit;
+    }
+
+    return std::nullopt;
+  }
+
+  if (!data) {
+    return std::nullopt;
+  }
+
+  return raycast_tile(data_tile, *data, ray, t_min, t_max);
+}
+
+std::optional<TerrainHit> TerrainRaycaster::raycast_tile(const TileId& data_tile, const HeightPyramid& pyramid,
+                                                         const Ray& ray, float t_min, float t_max) const
+{
+  const Bounds<glm::vec2> bounds = tile_bounds(data_tile);
+
+  // the heightfield is an axis aligned scaling away, so t stays the same
+  const glm::vec3 cell_size(bounds.size().x / float(pyramid.cells_x()), m_height_scale,
+                            bounds.size().y / float(pyramid.cells_y()));
+  const glm::vec3 origin = (ray.origin - glm::vec3(bounds.min.x, 0.0f, bounds.min.y)) / cell_size;
+  const glm::vec3 direction = ray.direction / cell_size;
+
+  // A ray that comes in from the side below the surface went through the gap to a neighbour with less
+  // detail, which the renderer closes with skirts. It hits the skirt where it enters.
+  if (t_min > 0.0f) {
+    const glm::vec3 entry = origin + direction * t_min;
+
+    if (entry.y < surface_height(pyramid.heights, entry.x, entry.z)) {
+      const glm::vec3 normal = glm::normalize(-glm::vec3(ray.direction.x, 0.0f, ray.direction.z));
+      return TerrainHit{ray.point_at(t_min), normal, t_min, data_tile};
+    }
+  }
+
+  std::optional<HeightfieldHit> hit = raycast_heightfield(pyramid, origin, direction, t_min, t_max);
+
+  if (!hit) {
+    return std::nullopt;
+  }
+
+  // normals are scaled by the inverse
+  glm::vec3 normal = glm::normalize(hit->normal / cell_size);
+  return TerrainHit{ray.point_at(hit->t), normal, hit->t, data_tile};
+}
@@ -0,0 +1,121 @@
+/*
+  Rays against the height tiles, for picking and to focus the LOD on the
+  terrain the camera looks at. Only resident tiles are used, nothing is
+  requested or waited for.
+
+  Every height tile gets a min/max pyramid over blocks of its cells, so a ray
+  skips blocks it passes above with a single test and only the cells it
+  actually grazes are tested against their two triangles. The quad tree is
+  walked front to back from the root, down to every resident tile below the
+  nodes the ray enters, and a node uses the heights of its deepest resident
+  ancestor if it is not resident itself.
+*/
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "Collision.h"
+#include "Common.h"
+#include "NormalMap.h"
+#include "TileUtils.h"
+
+// Max and min heights of blocks of cells. Level 0 has blocks of 2x2 cells, each level halves the number of
+// blocks until there is a single one. The cells are between the samples, so a tile with 256x256 samples has
+// 255x255 cells.
+struct HeightPyramid {
+  HeightView heights;  // not owned, must outlive the pyramid
+  std::vector<std::vector<uint8_t>> max_levels, min_levels;
+
+  inline int cells_x() const { return heights.width - 1; }
+  inline int cells_y() const { return heights.height - 1; }
+
+  // blocks in a row of a level
+  inline int blocks_x(size_t level) const { return (cells_x() + (2 << level) - 1) / (2 << level); }
+  inline int blocks_y(size_t level) const { return (cells_y() + (2 << level) - 1) / (2 << level); }
+};
+
+HeightPyramid build_height_pyramid(const HeightView&);
+
+// Lowest and highest height value of the cells from min to max (exclusive), from the few blocks of the
+// pyramid that cover them, so it may be a bit wider.
+std::pair<uint8_t, uint8_t> height_range(const HeightPyramid&, const glm::ivec2& min, const glm::ivec2& max);
+
+struct HeightfieldHit {
+  float t;
+  glm::vec3 normal;  // in the space of the heightfield, not normalized
+};
+
+// Ray in the space of the heightfield: x and z in cells, y in height values. The direction does not have to
+// be normalized. Only hits with t_min <= t <= t_max are reported, a ray from below the surface hits it from
+// below.
+std::optional<HeightfieldHit> raycast_heightfield(const HeightPyramid&, const glm::vec3& origin,
+                                                  const glm::vec3& direction, float t_min, float t_max);
+
+struct TerrainHit {
+  glm::vec3 position, normal;
+  float distance;
+  TileId tile;  // height tile that was hit, an ancestor of the visible tile if that one is not resident
+};
+
+class TerrainRaycaster
+{
+ public:
+  // Pixels of a resident height tile or an invalid view, must not block. The pixels must stay valid.
+  using HeightSource = std::function<HeightView(const TileId&)>;
+
+  // Whether any tile below the tile, not the tile itself, is resident. Must not block.
+  using ResidentQuery = std::function<bool(const TileId&)>;
+
+  // height_scale is world units per height value, the root tile covers the bounds
+  TerrainRaycaster(const TileId& root_tile, unsigned max_zoom, const Bounds<glm::vec2>& bounds, float height_scale,
+                   HeightSource source, ResidentQuery has_resident_below);
+
+  // Thread safe. The direction of the ray is normalized, so the distance is in world units. A ray that enters a
+  // tile from the side below its surface hits that side, like the skirts between tiles of different zoom levels.
+  std::optional<TerrainHit> raycast(const Ray&, float max_distance = std::numeric_limits<float>::max());
+
+  // pyramids kept for tiles hit recently
+  size_t num_pyramids();
+
+  // after the world was rebased, no raycast may run at the same time
+  inline void set_bounds(const Bounds<glm::vec2>& bounds) { m_bounds = bounds; }
+
+ private:
+  const TileId m_root_tile;
+  const unsigned m_max_zoom;
+  Bounds<glm::vec2> m_bounds;
+  const float m_height_scale;
+  const HeightSource m_source;
+  const ResidentQuery m_has_resident_below;
+
+  struct CachedPyramid {
+    std::shared_ptr<const HeightPyramid> pyramid;
+    uint64_t last_used;
+  };
+
+  std::mutex m_mutex;
+  std::map<TileId, CachedPyramid> m_pyramids;
+  uint64_t m_lookups{0};
+
+  // the pyramid of a resident tile, built on first use
+  std::shared_ptr<const HeightPyramid> pyramid(const TileId&);
+
+  Bounds<glm::vec2> tile_bounds(const TileId&) const;
+
+  // data is the pyramid of the tile or its deepest resident ancestor
+  std::optional<TerrainHit> raycast(const TileId& tile, const Bounds<glm::vec2>& bounds, const Ray&, float t_min,
+                                    float t_max, const TileId& data_tile,
+                                    const std::shared_ptr<const HeightPyramid>& data);
+
+  std::optional<TerrainHit> raycast_tile(const TileId& data_tile, const HeightPyramid&, const Ray&, float t_min,
+                                         float t_max) const;
+};
@@ -1,17 +1,33 @@
 #include "TerrainRenderer.h"
 
+#include <fmt/core.h>
+
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include <optional>
 
 #include "Collision.h"
 #include "Common.h"
+#include "TileUtils.h"
 
 #define ENABLE_FOG      1
 #define ENABLE_FALLBACK 1
 #define ENABLE_SKYBOX   1
 
+// root tiles on each side of the one under the camera
+#define ROOT_GRID_RADIUS 1U
+
+// for decoding the height map
+#if 0
+const float MIN_ELEVATION = 0.0f, MAX_ELEVATION = 8191.0f;
+#else
+const float MIN_ELEVATION = 0.0f, MAX_ELEVATION = 3795.0f;
+#endif
+
 /* clang-format off */
 const char* shader_vert =
 #include "generated/terrain.vert"
@@ -30,12 +46,6 @@ const char* skybox_frag =
 ;
 /* clang-format on */
 
-static AABB aabb_from_node(const Node* node)
-{
-  float height = 100.0f;  // TODO: do something smarter
-  return AABB({node->min.x, 0.0f, node->min.y}, {node->max.x, height, node->max.y});
-}
-
 static Bounds<glm::vec2> rescale_uv(const TileId& parent_tile_id, const TileId& tile_id)
 {
   // what is the problem here?
@@ -57,7 +67,7 @@ static Bounds<glm::vec2> rescale_uv(const TileId& parent_tile_id, const TileId&
 }
 
 TerrainRenderer::TerrainRenderer(const TileId& root_tile, unsigned max_zoom_level_range,
-                                 const Bounds<glm::vec2>& bounds)
+                                 const Bounds<glm::vec2>& bounds, const TileSources& sources)
     :
 #if NDEBUG
       m_terrain_shader(std::make_unique<ShaderProgram>(shader_vert, shader_frag)),
@@ -72,37 +82,94 @@ TerrainRenderer::TerrainRenderer(const TileId& root_tile, unsigned max_zoom_leve
 #endif
       m_root_tile(root_tile),
       m_chunk(32, 1.0f),
-      m_bounds(bounds),
-      m_coord_bounds(root_tile.bounds()),
+      m_grid(root_tile, bounds, ROOT_GRID_RADIUS),
       m_max_zoom_level_range(max_zoom_level_range),
+      m_tile_cache(MAX_ELEVATION - MIN_ELEVATION, sources),
+      m_preparer(
+          root_tile, max_zoom_level_range, bounds, bounds.size().x / root_tile.width_in_meters(),
+          [this](const glm::vec2& point) { return elevation(point); },
+          [this](const glm::vec3& origin, const glm::vec3& direction) -> std::optional<glm::vec3> {
+            std::optional<TerrainHit> hit = raycast(Ray(origin, direction));
+            return hit ? std::optional<glm::vec3>(hit->position) : std::nullopt;
+          },
+          [this](const TileId& tile) { return height_range(tile); }),
       min_zoom(root_tile.zoom),
       max_zoom(root_tile.zoom + max_zoom_level_range)
 {
   // the rendered terrain does not necessarily match with it's size in meters
-  float width = m_bounds.size().x;
+  float width = bounds.size().x;
   float tile_width = m_root_tile.width_in_meters();
   m_terrain_scaling_factor = width / tile_width;
 
-// for decoding the height map
-#if 0
-  const float min_elevation = 0.0f, max_elevation = 8191.0f;
-#else
-  const float min_elevation = 0.0f, max_elevation = 3795.0f;
-#endif
-  m_height_scaling_factor = (max_elevation - min_elevation);
+  m_height_scaling_factor = (MAX_ELEVATION - MIN_ELEVATION);
+
+  m_tile_cache.profiler = &m_profiler;
+
+  update_roots();
+}
+
+void TerrainRenderer::update_roots()
+{
+  // the raycasters of tiles that are still in the window keep their pyramids
+  std::erase_if(m_raycasters, [this](const auto& entry) {
+    const RootTile* root = m_grid.find(entry.first);
+    return !root || root->id != entry.first;
+  });
+
+  const float height_scale = this->height_scale();
+  std::vector<TileId> new_roots;
+
+  for (const RootTile& root : m_grid.roots()) {
+    auto it = m_raycasters.find(root.id);
+
+    if (it != m_raycasters.end()) {
+      it->second->set_bounds(root.bounds);
+      continue;
+    }
+
+    m_raycasters[root.id] = std::make_unique<TerrainRaycaster>(
+        root.id, root.id.zoom + m_max_zoom_level_range, root.bounds, height_scale,
+        [this](const TileId& tile) {
+          ImageView image = m_tile_cache.resident_image(tile, TileType::HEIGHT);
+          HeightView heights(image.data, image.width, image.height, image.channels);
+          heights.owner = image.owner;
+          return heights;
+        },
+        [this](const TileId& tile) { return m_tile_cache.resident_heights().has_resident_below(tile); });
+    new_roots.push_back(root.id);
+  }
 
 #if 1
-  (void)m_tile_cache.tile_texture_sync(m_root_tile, TileType::ORTHO);
-  (void)m_tile_cache.tile_texture_sync(m_root_tile, TileType::HEIGHT);
+  // Request low zoom tiles as fallback, the one under the camera first. The
+  // tiles of roots that were in the window before are already cached or
+  // queued. Until they arrive, placeholders are rendered.
+  for (const TileId& root : new_roots) {
+    (void)m_tile_cache.tile_texture(root, TileType::ORTHO);
+    (void)m_tile_cache.tile_texture(root, TileType::HEIGHT);
+  }
 
-  // request low zoom tiles as fallback
-  for (auto& child : m_root_tile.children()) {
-    (void)m_tile_cache.tile_texture_sync(child, TileType::ORTHO);
-    (void)m_tile_cache.tile_texture_sync(child, TileType::HEIGHT);
+  for (auto& child : m_grid.center().children()) {
+    (void)m_tile_cache.tile_texture(child, TileType::ORTHO);
+    (void)m_tile_cache.tile_texture(child, TileType::HEIGHT);
   }
 #endif
 }
 
+glm::vec2 TerrainRenderer::follow(const glm::vec2& position)
+{
+  const glm::vec2 offset = m_grid.update(position);
+
+  if (offset != glm::vec2(0.0f)) {
+    update_roots();
+    m_preparer.set_roots(m_grid.roots(), offset);
+
+    // the next packet was prepared in the old world space
+    m_packet_ready = false;
+  }
+
+  return offset;
+}
+
 void TerrainRenderer::reload_shaders()
 {
 #if !NDEBUG
@@ -118,7 +185,7 @@ void TerrainRenderer::reload_shaders()
 
 float TerrainRenderer::elevation(const glm::vec2& point)
 {
-  Coordinate coord = point_to_coordinate(point);
+  DCoordinate coord = point_to_coordinate(point);
   return m_tile_cache.elevation(coord) * m_height_scaling_factor;
 }
 
@@ -129,111 +196,87 @@ float TerrainRenderer::altitude_over_terrain(const glm::vec2& point, float altit
   return std::max(0.0f, altitude_in_meters - elevation);
 }
 
-Plane TerrainRenderer::collider(const glm::vec2& point)
+std::optional<TerrainHit> TerrainRenderer::raycast(const Ray& ray, float max_distance)
 {
-  float elevation = this->elevation(point);
-  glm::vec3 normal = glm::vec3(0.0f, 1.0f, 0.0f);  // TODO: fix this
-  glm::vec3 point_on_plane = glm::vec3(point.x, elevation * scaling_factor(), point.y);
-  return Plane(normal, point_on_plane);
-}
+  std::optional<TerrainHit> closest;
 
-Coordinate TerrainRenderer::point_to_coordinate(const glm::vec2& point) const
-{
-  auto coord_min = m_coord_bounds.min.to_vec2();
-  auto coord_max = m_coord_bounds.max.to_vec2();
-  return map_range(point, m_bounds.min, m_bounds.max, coord_min, coord_max);
-}
+  for (const auto& [root, raycaster] : m_raycasters) {
+    std::optional<TerrainHit> hit = raycaster->raycast(ray, max_distance);
+    if (hit && (!closest || hit->distance < closest->distance)) {
+      closest = hit;
+      max_distance = hit->distance;
+    }
+  }
 
-glm::vec2 TerrainRenderer::coordinate_to_point(const Coordinate& coord) const
-{
-  auto coord_min = m_coord_bounds.min.to_vec2();
-  auto coord_max = m_coord_bounds.max.to_vec2();
-  return map_range(coord.to_vec2(), coord_min, coord_max, m_bounds.min, m_bounds.max);
+  return closest;
 }
 
-void TerrainRenderer::calculate_zoom_levels(const glm::vec2& center, float altitude)
+std::optional<Bounds<float>> TerrainRenderer::height_range(const TileId& tile)
 {
-  // linear interpolate
-  // this should probably be something more clever
-  float alt = altitude_over_terrain(center, altitude);
-  float min_alt = 0, max_alt = 25000;
-  float normalized_height = alt / (max_alt - min_alt);
-  float factor = glm::clamp(1.0f - normalized_height, 0.0f, 1.0f);
+  const RootTile* root = m_grid.find(tile);
 
-  max_zoom = std::max(int(TileId::MAX_ZOOM * factor), int(m_root_tile.zoom + 1U));
+  if (!root) {
+    return std::nullopt;
+  }
+
+  // the tiles are not looked at, the ranges were computed when they were prepared
+  auto range = m_tile_cache.resident_heights().height_range(tile, root->id.zoom);
 
-  int requested_zoom_range = max_zoom - m_root_tile.zoom;
-  int zoom_range = glm::clamp(requested_zoom_range, 1, m_max_zoom_level_range);
+  if (!range) {
+    return std::nullopt;
+  }
 
-  min_zoom = max_zoom - zoom_range;
+  return Bounds<float>(float(range->first) * height_scale(), float(range->second) * height_scale());
 }
 
-glm::vec2 TerrainRenderer::calculate_lod_center(const Camera& camera)
+float TerrainRenderer::height_scale() const
 {
-  glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
-  glm::vec3 position3 = camera.world_position();
-  glm::vec2 position = {position3.x, position3.z};
-  glm::vec3 forward = -camera.local_z_axis();
-
-  if (intersect_terrain) {
-    // the terrain we are looking at should be the highest lod
-
-    float t;
-    Ray ray(position3, forward);
-    Plane plane(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 30.0f, 0.0f));
-
-    if (ray_vs_plane(ray, plane, t)) {
-      glm::vec3 point = ray.point_at(t);
-      glm::vec2 new_position = {point.x, point.z};
-      return clamp_range(new_position, m_bounds);
-    } else {
-      return position;
-    }
-  } else {
-    // we don't want the lod center the be right below the camera. Depending
-    // on the altitude it should be in front of the camera.
-    glm::vec2 view_direction = glm::normalize(glm::vec2(forward.x, forward.z));
-
-    float alt = position3.y / scaling_factor();
-    float min_alt = 0, max_alt = 20000;
-
-    float distance_to_horizon = map_range(alt, min_alt, max_alt, 0.0f, max_horizon);
+  // a height value of 255 is MAX_ELEVATION meters, scaled like the rest of the terrain
+  return (MAX_ELEVATION - MIN_ELEVATION) * m_terrain_scaling_factor / 255.0f;
+}
 
-    glm::vec2 horizon = position + view_direction * distance_to_horizon;
-    horizon = clamp_range(horizon, m_bounds);
+Plane TerrainRenderer::collider(const glm::vec2& point)
+{
+  float elevation = this->elevation(point);
+  glm::vec3 normal = glm::vec3(0.0f, 1.0f, 0.0f);  // TODO: fix this
+  glm::vec3 point_on_plane = glm::vec3(point.x, elevation * scaling_factor(), point.y);
+  return Plane(normal, point_on_plane);
+}
 
-    // if the camera is looking down, the lod center should be directly below the camera
-    float t = glm::max(glm::dot(forward, -up), 0.0f);
+DCoordinate TerrainRenderer::point_to_coordinate(const glm::vec2& point) const
+{
+  return m_grid.point_to_coordinate(point);
+}
 
-    return glm::mix(horizon, position, t);
-  }
+glm::vec2 TerrainRenderer::coordinate_to_point(const DCoordinate& coord) const
+{
+  return m_grid.coordinate_to_point(coord);
 }
 
-Texture* TerrainRenderer::find_cached_lower_zoom_parent(Node* node, Bounds<glm::vec2>& uv, const TileType& type,
-                                                        TileId& used)
+Texture* TerrainRenderer::find_cached_lower_zoom_parent(const TileId& tile_id, Bounds<glm::vec2>& uv,
+                                                        const TileType& type, TileId& used)
 {
   Texture* parent_texture = nullptr;
-  TileId tile_id = node->id;
   used = tile_id;
 
-  unsigned zoom = m_root_tile.zoom + node->depth;
-
-  Node* parent = node->parent;
   TileId parent_tile_id = tile_id;
 
+  // the root tile the tile is part of
+  const RootTile* root = m_grid.find(tile_id);
+  const TileId root_tile = root ? root->id : m_grid.center();
+
 #if 1
-  while (parent != nullptr) {
-    parent_tile_id = parent->id;
-    parent_texture = m_tile_cache.tile_texture_cached(parent_tile_id, type);
-    if (parent_texture) break;
-    parent = parent->parent;
+  parent_texture = m_tile_cache.resident_ancestor_texture(tile_id, type, parent_tile_id);
+
+  if (parent_tile_id.zoom < root_tile.zoom) {
+    parent_texture = nullptr;
   }
 #endif
 
 #if 1
   if (!parent_texture) {
-    parent_tile_id = m_root_tile;
-    parent_texture = m_tile_cache.tile_texture(m_root_tile, type);
+    parent_tile_id = root_tile;
+    parent_texture = m_tile_cache.tile_texture(root_tile, type);
     // assert(parent_texture);
   }
 #endif
@@ -245,39 +288,138 @@ Texture* TerrainRenderer::find_cached_lower_zoom_parent(Node* node, Bounds<glm::
   return parent_texture;
 }
 
+TaskScheduler* TerrainRenderer::lod_workers()
+{
+  if (!m_lod_workers) {
+    m_lod_workers = std::make_unique<TaskScheduler>(1);
+  }
+
+  return m_lod_workers.get();
+}
+
 void TerrainRenderer::render(const Camera& camera)
 {
-  glm::vec3 position = camera.world_position();
-  glm::vec2 center = glm::vec2(position.x, position.z);
-  float altitude = position.y;
+  m_profiler.begin_frame();
+  m_terrain_gpu_timer.collect(m_profiler);
+  m_sky_gpu_timer.collect(m_profiler);
 
-  Coordinate coord = point_to_coordinate(center);
+  const FrameInput input = frame_input(camera);
+  TaskScheduler* workers = pipelining ? lod_workers() : nullptr;
 
-  glm::vec3 lat_lon_alt = glm::vec3(coord.lat, altitude / m_terrain_scaling_factor, coord.lon);
+  // Without a packet from the last frame, this frame is prepared right away
+  // and drawn without preparing the next one, so every input is prepared once.
+  const bool prepare_now = !pipelining || !m_packet_ready;
 
-  // focus point for the level of detail
-  glm::vec2 lod_center = center;
+  if (prepare_now) {
+    auto scope = m_profiler.scope("prepare");
+    m_preparer.prepare(input, m_packets[m_submit_index]);
+  }
+
+  const FramePacket& packet = m_packets[m_submit_index];
 
-  if (smart_lod) {
-    lod_center = calculate_lod_center(camera);
+  if (!prepare_now) {
+    // Prepare the next frame while this one is submitted. The packets are
+    // drawn one frame late, with the camera they were prepared for.
+    FramePacket* next = &m_packets[1 - m_submit_index];
+    m_next_input = input;
+    workers->run(m_prepare_group, [this, next]() { m_preparer.prepare(m_next_input, *next); }, TaskPriority::HIGH);
   }
 
-  lod_center = clamp_range(lod_center, m_bounds);
+  submit(packet);
 
-  if (!manual_zoom) {
-    calculate_zoom_levels(center, altitude);
+  if (!prepare_now) {
+    {
+      auto scope = m_profiler.scope("wait for prepare");
+      workers->wait(m_prepare_group);
+    }
+
+    m_submit_index = 1 - m_submit_index;
+    m_profiler.record_cpu("prepare", m_packets[m_submit_index].prepare_ms);
+  }
+
+  m_packet_ready = pipelining;
+
+  for (TileType type : {TileType::ORTHO, TileType::HEIGHT}) {
+    TileServiceStats stats = m_tile_cache.stats(type);
+    const char* prefix = type == TileType::ORTHO ? "ortho" : "height";
+    m_profiler.set(fmt::format("{} tiles requested", prefix), int64_t(stats.requested));
+    m_profiler.set(fmt::format("{} tiles resident", prefix), int64_t(stats.resident));
+    m_profiler.set(fmt::format("{} tiles failed", prefix), int64_t(stats.failed));
+    m_profiler.set(fmt::format("{} bytes downloaded", prefix), int64_t(stats.downloaded_bytes));
+  }
+
+  m_profiler.set("textures", int64_t(m_tile_cache.num_textures()));
+  m_profiler.end_frame();
+}
+
+FrameInput TerrainRenderer::frame_input(const Camera& camera)
+{
+  auto now = std::chrono::steady_clock::now();
+
+  FrameInput input;
+  input.position = camera.world_position();
+  input.forward = -camera.local_z_axis();
+  input.view = camera.view_matrix();
+  input.projection = camera.projection_matrix();
+  input.dt = std::chrono::duration<float>(now - m_last_frame).count();
+  input.min_zoom = min_zoom;
+  input.max_zoom = max_zoom;
+  input.manual_zoom = manual_zoom;
+  input.intersect_terrain = intersect_terrain;
+  input.smart_lod = smart_lod;
+  input.frustum_culling = frustum_culling;
+  input.occlusion_culling = occlusion_culling;
+  input.curved_earth = curved_earth;
+  input.prefetching = prefetching;
+  input.max_horizon = max_horizon;
+
+  m_last_frame = now;
+
+  return input;
+}
+
+void TerrainRenderer::submit(const FramePacket& packet)
+{
+  const FrameInput& input = packet.input;
+
+  if (!input.manual_zoom) {
+    min_zoom = packet.min_zoom;
+    max_zoom = packet.max_zoom;
   }
 
-  QuadTree quad_tree(lod_center, m_bounds.min, m_bounds.max, max_zoom - m_root_tile.zoom, m_root_tile);
+  m_profiler.count("nodes visited", packet.nodes_visited);
+  m_profiler.count("nodes culled", packet.nodes_culled);
+  m_profiler.count("nodes occluded", packet.nodes_occluded);
+  m_profiler.count("nodes beyond horizon", packet.nodes_beyond_horizon);
+  m_profiler.record_cpu("occlusion culling", packet.occlusion_ms);
+
+  DCoordinate coord = point_to_coordinate(glm::vec2(input.position.x, input.position.z));
+
+  glm::vec3 lat_lon_alt = glm::vec3(float(coord.lat), input.position.y / m_terrain_scaling_factor, float(coord.lon));
 
   if (wireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+  // Tiles are drawn relative to the camera with the rotation of the view only, its translation was rounded in
+  // float and would bring back the jitter.
+  const glm::dvec3 origin(input.position);
+  const glm::mat4 view(glm::mat3(input.view));
+
+  // mercator n of the north and south edge of the first root tile, for the scale at each latitude
+  const float tiles = float(1U << m_root_tile.zoom);
+  const glm::vec2 mercator_n(wms::PI - 2.0f * wms::PI * float(m_root_tile.y) / tiles,
+                             wms::PI - 2.0f * wms::PI * float(m_root_tile.y + 1U) / tiles);
+
   m_terrain_shader->bind();
-  m_terrain_shader->set_uniform("u_view", camera.view_matrix());
-  m_terrain_shader->set_uniform("u_proj", camera.projection_matrix());
-  m_terrain_shader->set_uniform("u_camera_position", camera.world_position());
+  m_terrain_shader->set_uniform("u_view", view);
+  m_terrain_shader->set_uniform("u_proj", input.projection);
+  m_terrain_shader->set_uniform("u_origin", glm::vec3(origin));
   m_terrain_shader->set_uniform("u_height_scaling_factor", m_height_scaling_factor);
   m_terrain_shader->set_uniform("u_terrain_scaling_factor", m_terrain_scaling_factor);
+  m_terrain_shader->set_uniform("u_curved_earth", input.curved_earth);
+  m_terrain_shader->set_uniform("u_earth_radius", wms::EARTH_RADIUS);
+  const Bounds<glm::vec2> first_root = m_grid.tile_bounds(m_root_tile);
+  m_terrain_shader->set_uniform("u_mercator_z", glm::vec2(first_root.min.y, first_root.max.y));
+  m_terrain_shader->set_uniform("u_mercator_n", mercator_n);
 
   m_terrain_shader->set_uniform("u_debug_view", debug_view);
   m_terrain_shader->set_uniform("u_shading", shading);
@@ -300,40 +442,71 @@ void TerrainRenderer::render(const Camera& camera)
   m_terrain_shader->set_uniform("u_fog_far", fog_far);
   m_terrain_shader->set_uniform("u_fog_density", fog_density);
 
-  // This render function is executed on all quadtree nodes.
-  auto render_tile = [&, this](Node* node) {
-    TileId tile_id = node->id;
+  bool at_target_zoom = true;
+
+  // This render function is executed on all visible tiles.
+  auto render_tile = [&, this](const DrawItem& item) {
+    TileId tile_id = item.tile;
 
-    Texture *albedo = nullptr, *heightmap = nullptr;
+    Texture *albedo = nullptr, *heightmap = nullptr, *normalmap = nullptr;
+
+    auto lookup_scope = std::make_optional(m_profiler.scope("cache lookup"));
 
 #if 1
     albedo = m_tile_cache.tile_texture(tile_id, TileType::ORTHO);
     heightmap = m_tile_cache.tile_texture(tile_id, TileType::HEIGHT);
+    normalmap = m_tile_cache.tile_texture(tile_id, TileType::NORMAL);
 #endif
 
     // Render only part of tile if we fallback to lower resolution.
     Bounds<glm::vec2> albedo_uv(glm::vec2(0.0f), glm::vec2(1.0f));
     Bounds<glm::vec2> height_uv(glm::vec2(0.0f), glm::vec2(1.0f));
+    Bounds<glm::vec2> normal_uv(glm::vec2(0.0f), glm::vec2(1.0f));
+
+    TileId albedo_tile_id, height_tile_id, normal_tile_id;
 
-    TileId albedo_tile_id, height_tile_id;
+    if (!albedo || !heightmap) {
+      at_target_zoom = false;
+    }
 
 #if ENABLE_FALLBACK
     if (!albedo) {
-      albedo = find_cached_lower_zoom_parent(node, albedo_uv, TileType::ORTHO, albedo_tile_id);
+      albedo = find_cached_lower_zoom_parent(tile_id, albedo_uv, TileType::ORTHO, albedo_tile_id);
     }
 
     if (!heightmap) {
-      heightmap = find_cached_lower_zoom_parent(node, height_uv, TileType::HEIGHT, height_tile_id);
+      heightmap = find_cached_lower_zoom_parent(tile_id, height_uv, TileType::HEIGHT, height_tile_id);
+    }
+
+    if (!normalmap) {
+      normalmap = find_cached_lower_zoom_parent(tile_id, normal_uv, TileType::NORMAL, normal_tile_id);
     }
 #endif
 
+    // nothing loaded yet, render flat terrain at sea level
+    if (!albedo) {
+      albedo = m_tile_cache.placeholder_texture(TileType::ORTHO);
+      albedo_uv = Bounds<glm::vec2>(glm::vec2(0.0f), glm::vec2(1.0f));
+    }
+
+    if (!heightmap) {
+      heightmap = m_tile_cache.placeholder_texture(TileType::HEIGHT);
+      height_uv = Bounds<glm::vec2>(glm::vec2(0.0f), glm::vec2(1.0f));
+    }
+
+    // normal maps lag behind the height maps, don't hold back the tile for them
+    if (!normalmap) {
+      normalmap = m_tile_cache.placeholder_texture(TileType::NORMAL);
+      normal_uv = Bounds<glm::vec2>(glm::vec2(0.0f), glm::vec2(1.0f));
+    }
+
+    lookup_scope.reset();
+
     if (albedo && heightmap) {
-      m_terrain_shader->set_uniform("u_zoom", node->depth);
+      auto draw_scope = m_profiler.scope("draw");
+      m_profiler.count("nodes drawn");
 
-      const float pixel_per_tile = 128;
-      float tile_width = tile_id.width_in_meters();
-      float pixel_resolution = tile_width / pixel_per_tile;
-      m_terrain_shader->set_uniform("u_pixel_resolution", pixel_resolution);
+      m_terrain_shader->set_uniform("u_zoom", item.depth);
 
       albedo->bind(0);
       m_terrain_shader->set_uniform("u_albedo_texture", 0);
@@ -345,50 +518,40 @@ void TerrainRenderer::render(const Camera& camera)
       m_terrain_shader->set_uniform("u_height_uv_min", height_uv.min);
       m_terrain_shader->set_uniform("u_height_uv_max", height_uv.max);
 
-      m_chunk.draw(m_terrain_shader.get(), node->min, node->max);
-    }
-  };
-
-  Frustum frustum(camera.view_projection_matrix());
-
-  // frustum culling
-  auto is_visible = [&](Node* node) {
-    AABB aabb = aabb_from_node(node);
-    return aabb_vs_frustum(aabb, frustum);
-  };
-
-#if 1
-  // ideally we should test for visibility here. In a quadtree, if a parent node
-  // is not visible, it's children will also not be visible.
-  std::vector<Node*> nodes;
+      normalmap->bind(2);
+      m_terrain_shader->set_uniform("u_normal_texture", 2);
+      m_terrain_shader->set_uniform("u_normal_uv_min", normal_uv.min);
+      m_terrain_shader->set_uniform("u_normal_uv_max", normal_uv.max);
 
-  std::function<void(Node*)> visitor = [&](Node* node) {
-    if (node->is_leaf && min_zoom <= (m_root_tile.zoom + node->depth) && (!frustum_culling || is_visible(node))) {
-      nodes.push_back(node);
+      m_chunk.draw(m_terrain_shader.get(), item.min, item.max, origin);
     }
   };
 
-  quad_tree.visit(visitor);
-#else
-  // only leaves are rendered
-  auto nodes = quad_tree.leaves();
-#endif
+  m_terrain_gpu_timer.begin(m_profiler.frame_index());
+  std::for_each(packet.draws.begin(), packet.draws.end(), render_tile);
+  m_terrain_gpu_timer.end();
 
-  // Sort nodes so biggest zoom level is rendered and requested first
-  std::sort(nodes.begin(), nodes.end(), [](Node* a, Node* b) { return a->depth > b->depth; });
+  m_frames_rendered++;
+  if (at_target_zoom) m_frames_at_target_zoom++;
+  m_tile_cache.end_frame();
 
-  //  we should really exploit our quadtree stucture to reduce the frustum culling tests
-  std::for_each(nodes.begin(), nodes.end(), render_tile);
+  // after the visible tiles, so they are requested first
+  if (!packet.prefetch.empty()) {
+    auto scope = m_profiler.scope("prefetch");
+    m_tile_cache.prefetch(packet.prefetch);
+  }
 
 #if ENABLE_SKYBOX
   if (!wireframe) {
+    auto scope = m_profiler.scope("sky");
+    m_sky_gpu_timer.begin(m_profiler.frame_index());
     glCullFace(GL_BACK);
     glDepthFunc(GL_LEQUAL);
 
     m_sky_shader->bind();
-    m_sky_shader->set_uniform("u_view", glm::mat4(glm::mat3(camera.view_matrix())));
-    m_sky_shader->set_uniform("u_proj", camera.projection_matrix());
-    m_sky_shader->set_uniform("u_camera_position", camera.world_position());
+    m_sky_shader->set_uniform("u_view", glm::mat4(glm::mat3(input.view)));
+    m_sky_shader->set_uniform("u_proj", input.projection);
+    m_sky_shader->set_uniform("u_camera_position", input.position);
     m_sky_shader->set_uniform("u_sky_color", sky_color_1);
     m_sky_shader->set_uniform("u_light_blue", light_blue);
     m_sky_shader->set_uniform("u_dark_blue", dark_blue);
@@ -399,6 +562,8 @@ void TerrainRenderer::render(const Camera& camera)
 
     glDepthFunc(GL_LESS);
     glCullFace(GL_FRONT);
+
+    m_sky_gpu_timer.end();
   }
 #endif
 
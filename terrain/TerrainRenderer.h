@@ -1,12 +1,21 @@
 #pragma once
+#include <array>
+#include <chrono>
 #include <glm/glm.hpp>
+#include <map>
 
 #include "../gfx/gfx.h"
 #include "Chunk.h"
 #include "Collision.h"
 #include "Common.h"
 #include "Cube.h"
+#include "FramePacket.h"
+#include "GpuTimer.h"
+#include "Profiler.h"
 #include "QuadTree.h"
+#include "RootGrid.h"
+#include "TaskScheduler.h"
+#include "TerrainRaycast.h"
 #include "TileCache.h"
 
 using namespace gfx;
@@ -15,7 +24,8 @@ using namespace gfx::gl;
 class TerrainRenderer
 {
  public:
-  TerrainRenderer(const TileId& root_tile, unsigned max_zoom_level_range, const Bounds<glm::vec2>& bounds);
+  TerrainRenderer(const TileId& root_tile, unsigned max_zoom_level_range, const Bounds<glm::vec2>& bounds,
+                  const TileSources& sources = {});
 
   void render(const Camera& camera);
 
@@ -31,18 +41,43 @@ class TerrainRenderer
   // and handling
   Plane collider(const glm::vec2&);
 
+  // Closest hit of the ray with the resident height tiles, also the ones not rendered right now. Thread safe, but
+  // not while following the camera.
+  std::optional<TerrainHit> raycast(const Ray&, float max_distance = std::numeric_limits<float>::max());
+
+  // Slides the root tiles with the camera, not while rendering. Returns the offset that was subtracted from world
+  // space when it was rebased onto another root tile, the camera has to be moved by it as well.
+  glm::vec2 follow(const glm::vec2& position);
+
+  // keeps a point between the north and south edge of the map
+  inline glm::vec2 clamp(const glm::vec2& point) const { return m_grid.clamp(point); }
+
   // relation of terrain unit to meters
   // divide to go from game coordinates to meters
   // multiply to go from meters to game
+  // at the north edge of the first root tile, it does not change when the world is rebased
   inline float scaling_factor() const { return m_terrain_scaling_factor; }
 
-  inline Bounds<glm::vec2> bounds() const { return m_bounds; }
+  // of the root tile under the camera
+  inline Bounds<glm::vec2> bounds() const { return m_grid.bounds(); }
+
+  inline TileId root_tile() const { return m_grid.center(); }
+
+  inline const std::vector<RootTile>& root_tiles() const { return m_grid.roots(); }
+
+  inline unsigned max_zoom_level_range() const { return m_max_zoom_level_range; }
 
-  inline TileId root_tile() const { return m_root_tile; }
+  DCoordinate point_to_coordinate(const glm::vec2&) const;
 
-  Coordinate point_to_coordinate(const glm::vec2&) const;
+  glm::vec2 coordinate_to_point(const DCoordinate&) const;
 
-  glm::vec2 coordinate_to_point(const Coordinate&) const;
+  inline Profiler& profiler() { return m_profiler; }
+
+  // fraction of rendered frames where no tile had to fall back to a lower zoom level
+  inline float target_zoom_ratio() const
+  {
+    return m_frames_rendered > 0 ? float(m_frames_at_target_zoom) / float(m_frames_rendered) : 0.0f;
+  }
 
   bool wireframe{false};
   bool intersect_terrain{false};
@@ -51,7 +86,11 @@ class TerrainRenderer
   bool manual_zoom{false};
   bool shading{true};
   bool frustum_culling{true};
+  bool occlusion_culling{true};
+  bool curved_earth{false};  // drops the terrain with the distance and culls what is beyond the horizon
   bool smart_lod{true};
+  bool prefetching{true};
+  bool pipelining{true};  // prepare the next frame on a worker while this one is submitted
   float fog_far{2000.0f};
   float fog_density{0.66f};
   float max_horizon{500.0f};
@@ -61,19 +100,43 @@ class TerrainRenderer
 
  private:
   std::unique_ptr<ShaderProgram> m_terrain_shader, m_sky_shader;
-  const TileId m_root_tile;
+  const TileId m_root_tile;  // the first one, defines the scale
   const Chunk m_chunk;
   const Cube m_sky_box;
-  const Bounds<glm::vec2> m_bounds;
-  const Bounds<Coordinate> m_coord_bounds;
+  RootGrid m_grid;
   const int m_max_zoom_level_range;
   TileCache m_tile_cache;
+  std::map<TileId, std::unique_ptr<TerrainRaycaster>> m_raycasters;  // by root tile
   float m_height_scaling_factor;
   float m_terrain_scaling_factor;
+  FramePreparer m_preparer;
+  std::chrono::steady_clock::time_point m_last_frame;
+  unsigned m_frames_rendered{0}, m_frames_at_target_zoom{0};
+  Profiler m_profiler;
+  GpuTimer m_terrain_gpu_timer{"terrain"}, m_sky_gpu_timer{"sky"};
+  std::array<FramePacket, 2> m_packets;
+  size_t m_submit_index{0};
+  bool m_packet_ready{false};
+  FrameInput m_next_input;
+  TaskGroup m_prepare_group;
+  std::unique_ptr<TaskScheduler> m_lod_workers;  // the render thread helps while waiting
+
+  // for the current root tiles, also requests the textures of new ones as fallback
+  void update_roots();
+
+  // created on first use, one worker is enough for pipelining
+  TaskScheduler* lod_workers();
+
+  std::optional<Bounds<float>> height_range(const TileId&);
+
+  // world units per height value
+  float height_scale() const;
 
-  void calculate_zoom_levels(const glm::vec2& center, float altitude);
+  // snapshot of the camera and the settings
+  FrameInput frame_input(const Camera& camera);
 
-  glm::vec2 calculate_lod_center(const Camera& camera);
+  // draw a prepared frame, only place where GL is used
+  void submit(const FramePacket& packet);
 
-  Texture* find_cached_lower_zoom_parent(Node* node, Bounds<glm::vec2>& uv, const TileType&, TileId& used);
+  Texture* find_cached_lower_zoom_parent(const TileId& tile, Bounds<glm::vec2>& uv, const TileType&, TileId& used);
 };
@@ -0,0 +1,359 @@
+#include "TextureCompression.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <iostream>
+
+#include "Mipmap.h"
+
+// end points are refined once with least squares after the first index assignment
+#define REFINE_END_POINTS 1
+
+static const char MAGIC[4] = {'B', 'C', '1', 'T'};
+static const uint32_t FILE_VERSION = 2;  // 2: gamma correct mipmaps
+
+static uint16_t to_565(const glm::vec3& color)
+{
+  glm::vec3 c = glm::clamp(color, 0.0f, 255.0f);
+  auto r = uint16_t(std::lround(c.x * 31.0f / 255.0f));
+  auto g = uint16_t(std::lround(c.y * 63.0f / 255.0f));
+  auto b = uint16_t(std::lround(c.z * 31.0f / 255.0f));
+  return uint16_t((r << 11) | (g << 5) | b);
+}
+
+static glm::ivec3 from_565(uint16_t color)
+{
+  int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+  return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+}
+
+// colors of the four indices in 4 color mode
+static std::array<glm::ivec3, 4> palette(uint16_t c0, uint16_t c1)
+{
+  glm::ivec3 a = from_565(c0), b = from_565(c1);
+  return {a, b, (2 * a + b) / 3, (a + 2 * b) / 3};
+}
+
+static int distance2(const glm::ivec3& a, const glm::ivec3& b)
+{
+  glm::ivec3 d = a - b;
+  return d.x * d.x + d.y * d.y + d.z * d.z;
+}
+
+// nearest palette entry for every pixel, returns the squared error
+static int assign_indices(const glm::ivec3* pixels, uint16_t c0, uint16_t c1, uint8_t* indices)
+{
+  auto colors = palette(c0, c1);
+  int error = 0;
+
+  for (int i = 0; i < 16; ++i) {
+    int best = 0, best_distance = distance2(pixels[i], colors[0]);
+    for (int j = 1; j < 4; ++j) {
+      int d = distance2(pixels[i], colors[j]);
+      if (d < best_distance) {
+        best = j;
+        best_distance = d;
+      }
+    }
+    indices[i] = uint8_t(best);
+    error += best_distance;
+  }
+
+  return error;
+}
+
+// Least squares end points for the given indices.
+static bool refine(const glm::ivec3* pixels, const uint8_t* indices, glm::vec3& e0, glm::vec3& e1)
+{
+  static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+
+  float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+  glm::vec3 ax(0.0f), bx(0.0f);
+
+  for (int i = 0; i < 16; ++i) {
+    float a = weights[indices[i]], b = 1.0f - a;
+    glm::vec3 x = glm::vec3(pixels[i]);
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    ax += a * x;
+    bx += b * x;
+  }
+
+  float determinant = aa * bb - ab * ab;
+  if (std::abs(determinant) < 1e-6f) return false;
+
+  e0 = (ax * bb - bx * ab) / determinant;
+  e1 = (bx * aa - ax * ab) / determinant;
+  return true;
+}
+
+static void write_block(uint16_t c0, uint16_t c1, const uint8_t* indices, uint8_t* block)
+{
+  uint32_t bits = 0;
+
+  if (c0 < c1) {
+    // 4 color mode needs c0 > c1, swapping the end points swaps index 0 and 1, and 2 and 3
+    std::swap(c0, c1);
+    for (int i = 0; i < 16; ++i) bits |= uint32_t(indices[i] ^ 1) << (2 * i);
+  } else if (c0 == c1) {
+    bits = 0;  // 3 color mode, index 0 is the only exact color
+  } else {
+    for (int i = 0; i < 16; ++i) bits |= uint32_t(indices[i]) << (2 * i);
+  }
+
+  block[0] = uint8_t(c0 & 0xFF);
+  block[1] = uint8_t(c0 >> 8);
+  block[2] = uint8_t(c1 & 0xFF);
+  block[3] = uint8_t(c1 >> 8);
+  for (int i = 0; i < 4; ++i) block[4 + i] = uint8_t(bits >> (8 * i));
+}
+
+void encode_bc1_block(const uint8_t* rgb, uint8_t* block)
+{
+  glm::ivec3 pixels[16];
+  glm::vec3 mean(0.0f);
+
+  for (int i = 0; i < 16; ++i) {
+    pixels[i] = {rgb[3 * i], rgb[3 * i + 1], rgb[3 * i + 2]};
+    mean += glm::vec3(pixels[i]);
+  }
+  mean /= 16.0f;
+
+  // principal axis of the colors, by power iteration on the covariance
+  float cov[6] = {0.0f};
+  for (const auto& pixel : pixels) {
+    glm::vec3 d = glm::vec3(pixel) - mean;
+    cov[0] += d.x * d.x;
+    cov[1] += d.x * d.y;
+    cov[2] += d.x * d.z;
+    cov[3] += d.y * d.y;
+    cov[4] += d.y * d.z;
+    cov[5] += d.z * d.z;
+  }
+
+  glm::vec3 axis(1.0f, 1.0f, 1.0f);
+  for (int i = 0; i < 4; ++i) {
+    glm::vec3 next = {cov[0] * axis.x + cov[1] * axis.y + cov[2] * axis.z,
+                      cov[1] * axis.x + cov[3] * axis.y + cov[4] * axis.z,
+                      cov[2] * axis.x + cov[4] * axis.y + cov[5] * axis.z};
+    float length = glm::length(next);
+    if (length < 1e-6f) break;
+    axis = next / length;
+  }
+
+  float min_t = 0.0f, max_t = 0.0f;
+  for (const auto& pixel : pixels) {
+    float t = glm::dot(glm::vec3(pixel) - mean, axis);
+    min_t = std::min(min_t, t);
+    max_t = std::max(max_t, t);
+  }
+
+  // inset the end points a little, the extremes are mostly outliers
+  float inset = (max_t - min_t) / 16.0f;
+  glm::vec3 e0 = mean + axis * (max_t - inset);
+  glm::vec3 e1 = mean + axis * (min_t + inset);
+
+  uint16_t c0 = to_565(e0), c1 = to_565(e1);
+  uint8_t indices[16];
+  int error = assign_indices(pixels, c0, c1, indices);
+
+#if REFINE_END_POINTS
+  if (error > 0 && refine(pixels, indices, e0, e1)) {
+    uint16_t r0 = to_565(e0), r1 = to_565(e1);
+    uint8_t refined[16];
+    int refined_error = assign_indices(pixels, r0, r1, refined);
+
+    if (refined_error < error) {
+      c0 = r0;
+      c1 = r1;
+      std::memcpy(indices, refined, sizeof(indices));
+    }
+  }
+#endif
+
+  write_block(c0, c1, indices, block);
+}
+
+void decode_bc1_block(const uint8_t* block, uint8_t* rgb)
+{
+  uint16_t c0 = uint16_t(block[0] | (block[1] << 8));
+  uint16_t c1 = uint16_t(block[2] | (block[3] << 8));
+  uint32_t bits = uint32_t(block[4]) | (uint32_t(block[5]) << 8) | (uint32_t(block[6]) << 16) |
+                  (uint32_t(block[7]) << 24);
+
+  std::array<glm::ivec3, 4> colors = palette(c0, c1);
+
+  if (c0 <= c1) {
+    // 3 color mode, the encoder never uses the black entry
+    glm::ivec3 a = from_565(c0), b = from_565(c1);
+    colors[2] = (a + b) / 2;
+    colors[3] = glm::ivec3(0);
+  }
+
+  for (int i = 0; i < 16; ++i) {
+    const glm::ivec3& color = colors[(bits >> (2 * i)) & 3];
+    rgb[3 * i + 0] = uint8_t(color.x);
+    rgb[3 * i + 1] = uint8_t(color.y);
+    rgb[3 * i + 2] = uint8_t(color.z);
+  }
+}
+
+static std::vector<uint8_t> encode_level(const std::vector<uint8_t>& rgb, int width, int height)
+{
+  int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+  std::vector<uint8_t> blocks(size_t(blocks_x) * blocks_y * BC1_BLOCK_SIZE);
+  uint8_t block_pixels[16 * 3];
+
+  for (int by = 0; by < blocks_y; ++by) {
+    for (int bx = 0; bx < blocks_x; ++bx) {
+      // levels smaller than a block repeat their edge pixels
+      for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+          int px = std::min(bx * 4 + x, width - 1), py = std::min(by * 4 + y, height - 1);
+          std::memcpy(&block_pixels[3 * (y * 4 + x)], &rgb[3 * (size_t(py) * width + px)], 3);
+        }
+      }
+      encode_bc1_block(block_pixels, &blocks[(size_t(by) * blocks_x + bx) * BC1_BLOCK_SIZE]);
+    }
+  }
+
+  return blocks;
+}
+
+CompressedImage compress_bc1(const uint8_t* pixels, int width, int height, int channels, bool mipmaps)
+{
+  assert(channels == 3 || channels == 4);
+
+  CompressedImage image;
+  if (!pixels || width <= 0 || height <= 0 || (channels != 3 && channels != 4)) return image;
+
+  image.width = width;
+  image.height = height;
+
+  std::vector<uint8_t> rgb(size_t(width) * height * 3);
+  for (size_t i = 0; i < size_t(width) * height; ++i) {
+    std::memcpy(&rgb[3 * i], &pixels[channels * i], 3);
+  }
+
+  while (true) {
+    image.levels.push_back(encode_level(rgb, width, height));
+
+    if (!mipmaps || (width == 1 && height == 1)) break;
+
+    rgb = downsample(rgb.data(), width, height, 3, MipFilter::SRGB);
+    width = mip_size(width, 1);
+    height = mip_size(height, 1);
+  }
+
+  return image;
+}
+
+std::vector<uint8_t> decompress_bc1(const CompressedImage& image, size_t level)
+{
+  assert(level < image.levels.size());
+
+  int width = std::max(image.width >> level, 1), height = std::max(image.height >> level, 1);
+  int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+  const std::vector<uint8_t>& blocks = image.levels[level];
+
+  std::vector<uint8_t> rgb(size_t(width) * height * 3);
+  uint8_t block_pixels[16 * 3];
+
+  for (int by = 0; by < blocks_y; ++by) {
+    for (int bx = 0; bx < blocks_x; ++bx) {
+      decode_bc1_block(&blocks[(size_t(by) * blocks_x + bx) * BC1_BLOCK_SIZE], block_pixels);
+
+      for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+          int px = bx * 4 + x, py = by * 4 + y;
+          if (px < width && py < height) {
+            std::memcpy(&rgb[3 * (size_t(py) * width + px)], &block_pixels[3 * (y * 4 + x)], 3);
+          }
+        }
+      }
+    }
+  }
+
+  return rgb;
+}
+
+size_t CompressedImage::size() const
+{
+  size_t bytes = 0;
+  for (const auto& level : levels) bytes += level.size();
+  return bytes;
+}
+
+bool write_compressed_image(const std::string& filename, const CompressedImage& image)
+{
+  std::ofstream file(filename, std::ios::binary);
+
+  if (!file) {
+    std::cerr << "Could not write " << filename << "\n";
+    return false;
+  }
+
+  uint32_t header[4] = {FILE_VERSION, uint32_t(image.width), uint32_t(image.height), uint32_t(image.levels.size())};
+  file.write(MAGIC, sizeof(MAGIC));
+  file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+  for (const auto& level : image.levels) {
+    uint32_t size = uint32_t(level.size());
+    file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    file.write(reinterpret_cast<const char*>(level.data()), std::streamsize(level.size()));
+  }
+
+  return bool(file);
+}
+
+bool read_compressed_image(const std::string& filename, CompressedImage& image)
+{
+  std::ifstream file(filename, std::ios::binary);
+  if (!file) return false;
+
+  char magic[4];
+  uint32_t header[4];
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char*>(header), sizeof(header));
+
+  if (!file || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || header[0] != FILE_VERSION || header[3] > 32) {
+    std::cerr << "Invalid compressed tile " << filename << "\n";
+    return false;
+  }
+
+  image = CompressedImage();
+  image.width = int(header[1]);
+  image.height = int(header[2]);
+  image.levels.resize(header[3]);
+
+  for (size_t i = 0; i < image.levels.size(); ++i) {
+    int width = std::max(image.width >> i, 1), height = std::max(image.height >> i, 1);
+    size_t expected = size_t((width + 3) / 4) * ((height + 3) / 4) * BC1_BLOCK_SIZE;
+
+    uint32_t size = 0;
+    file.read(reinterpret_cast<char*>(&size), sizeof(size));
+
+    if (!file || size != expected) {
+      std::cerr << "Invalid compressed tile " << filename << "\n";
+      image = CompressedImage();
+      return false;
+    }
+
+    image.levels[i].resize(size);
+    file.read(reinterpret_cast<char*>(image.levels[i].data()), std::streamsize(size));
+  }
+
+  if (!file) {
+    std::cerr << "Invalid compressed tile " << filename << "\n";
+    image = CompressedImage();
+    return false;
+  }
+
+  return true;
+}
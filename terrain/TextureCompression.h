@@ -0,0 +1,41 @@
+/*
+  BC1 (DXT1) encoder for the ortho tiles. Every 4x4 block is stored as two
+  RGB565 end points and 2 bit indices, 8 bytes instead of 48 for RGB8.
+  Runs on the CPU without a GL context, so tiles can be compressed on a
+  worker thread and cached on disk.
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+static constexpr size_t BC1_BLOCK_SIZE = 8;
+
+struct CompressedImage {
+  int width{0}, height{0};
+  std::vector<std::vector<uint8_t>> levels;  // mip levels, blocks in row order
+
+  // bytes of all levels together
+  size_t size() const;
+
+  inline bool valid() const { return width > 0 && height > 0 && !levels.empty(); }
+};
+
+// Encode an image with 3 or 4 channels, alpha is ignored. With mipmaps all
+// levels down to 1x1 are computed with a gamma correct box filter before the
+// encoding.
+CompressedImage compress_bc1(const uint8_t* pixels, int width, int height, int channels, bool mipmaps = true);
+
+// RGB8 pixels of one level, for tests and quality measurements.
+std::vector<uint8_t> decompress_bc1(const CompressedImage& image, size_t level = 0);
+
+// 16 RGB8 pixels in row order
+void encode_bc1_block(const uint8_t* rgb, uint8_t* block);
+
+void decode_bc1_block(const uint8_t* block, uint8_t* rgb);
+
+bool write_compressed_image(const std::string& filename, const CompressedImage& image);
+
+bool read_compressed_image(const std::string& filename, CompressedImage& image);
@@ -18,7 +18,7 @@ class ThreadedQueue
   {
     {
       std::unique_lock lock(m_mutex);
-      m_queue.push_front(item);
+      m_queue.push(item);
     }
     m_condition.notify_one();
   }
@@ -1,49 +1,251 @@
 #include "TileCache.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <filesystem>
 #include <iostream>
+#include <optional>
+#include <string_view>
 
 #include "Common.h"
 
-TileCache::TileCache()
-    :
-#if 0
-      m_ortho_service("https://gataki.cg.tuwien.ac.at/raw/basemap/tiles", UrlPattern::ZYX_Y_SOUTH, ".jpeg", "tiles/ortho-1"),
-#else
-      m_ortho_service("https://server.arcgisonline.com/ArcGIS/rest/services/World_Imagery/MapServer/tile",
-                      UrlPattern::ZYX_Y_SOUTH, "", "tiles/ortho-2"),
+#define NUM_WORKER_THREADS 2
+
+// ortho tiles are uploaded as BC1 with precomputed mipmaps, 6x less VRAM and upload bandwidth than RGB8
+#define COMPRESS_ORTHO_TILES 1
+
+// parents are built from four resident children instead of downloading them, e.g. when zooming out
+#define SYNTHESIZE_PARENTS 1
+
+// synthesized tiles kept on the CPU, about 200 kB each
+#define MAX_SYNTHESIZED_TILES 256
+
+// remembered tiles that cannot be synthesized, forgotten all at once beyond this
+#define MAX_NOT_SYNTHESIZABLE 4096
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
 #endif
-      m_height_service("https://www.jakobmaier.at/tiles/dem", UrlPattern::ZXY_Y_NORTH, ".png", "tiles/height-1")
+
+// BC1 is not part of core OpenGL, e.g. some Mesa drivers do not have it. Needs a current context.
+static bool supports_bc1()
 {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+
+  for (GLint i = 0; i < count; ++i) {
+    const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+    if (name && std::string_view(name) == "GL_EXT_texture_compression_s3tc") return true;
+  }
+
+  std::cerr << "GL_EXT_texture_compression_s3tc is not supported, ortho tiles are uploaded uncompressed\n";
+  return false;
+}
+
+static ImageView image_view(const Image* image)
+{
+  if (!image || !image->loaded()) return ImageView();
+  return ImageView(image->data(), image->width(), image->height(), image->channels());
+}
+
+static MipFilter mip_filter(const TileType& tile_type)
+{
+  switch (tile_type) {
+    case TileType::ORTHO:
+      return MipFilter::SRGB;
+    case TileType::HEIGHT:
+      return MipFilter::MAX;
+    default:
+      return MipFilter::LINEAR;
+  }
+}
+
+// Z-order key of the tile with the type in the lowest bits, so the textures of a tile are next to each other
+static uint64_t texture_key(const TileId& tile, const TileType& tile_type)
+{
+  return (tile.key() << 2) | uint64_t(tile_type);
+}
+
+const TileServiceConfig ORTHO_TILE_SERVICE = {
+    "https://server.arcgisonline.com/ArcGIS/rest/services/World_Imagery/MapServer/tile", UrlPattern::ZYX_Y_SOUTH, "",
+    "tiles/ortho-2", "assets/tiles/ortho-2"};
+
+const TileServiceConfig BASEMAP_TILE_SERVICE = {"https://gataki.cg.tuwien.ac.at/raw/basemap/tiles",
+                                                UrlPattern::ZYX_Y_SOUTH, ".jpeg", "tiles/ortho-1",
+                                                "assets/tiles/ortho-1"};
+
+const TileServiceConfig HEIGHT_TILE_SERVICE = {"https://www.jakobmaier.at/tiles/dem", UrlPattern::ZXY_Y_NORTH, ".png",
+                                               "tiles/height-1", "assets/tiles/height-1"};
+
+TileServiceConfig TileSources::with_location(const TileServiceConfig& base, const std::string& location)
+{
+  if (location == "basemap") {
+    return BASEMAP_TILE_SERVICE;
+  }
+
+  TileServiceConfig config = base;
+  config.url = location;
+  config.source = guess_tile_source_type(location);
+  config.cache_dir = cache_dir_for(location);
+  config.bundle_dir.clear();  // the bundled tiles belong to the default server
+  return config;
+}
+
+// FNV-1a, the directory name must not change between runs like std::hash may
+std::string TileSources::cache_dir_for(const std::string& location)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (char c : location) {
+    hash = (hash ^ uint8_t(c)) * 0x100000001b3ULL;
+  }
+
+  // readable part is the end of the location, e.g. the file name
+  std::string name = location.substr(location.size() - std::min<size_t>(location.size(), 32));
+  std::replace_if(name.begin(), name.end(), [](char c) { return !std::isalnum(uint8_t(c)) && c != '-'; }, '_');
+
+  return fmt::format("tiles/{}-{:016x}", name, hash);
+}
+
+TileCache::TileCache(float height_scaling_factor, const TileSources& sources)
+    : m_height_scaling_factor(height_scaling_factor),
+      m_compress_ortho(COMPRESS_ORTHO_TILES && supports_bc1()),
+      m_ortho_service(sources.ortho),
+      m_height_service(sources.height),
+      m_workers(NUM_WORKER_THREADS)
+{
+}
+
+// Encoded tiles are cached next to the downloaded ones. Runs on the workers.
+static CompressedImage compress_tile(const TileId& tile, const Image& image, const std::string& cache_dir)
+{
+  namespace fs = std::filesystem;
+
+  std::string filename = fmt::format("{}/{}.bc1", cache_dir, tile.to_string());
+  std::string source_filename = fmt::format("{}/{}.png", cache_dir, tile.to_string());
+
+  // the tile might have been downloaded again since it was encoded
+  std::error_code error;
+  bool outdated = fs::exists(source_filename, error) && fs::exists(filename, error) &&
+                  fs::last_write_time(filename, error) < fs::last_write_time(source_filename, error);
+
+  CompressedImage compressed;
+  if (!outdated && read_compressed_image(filename, compressed) && compressed.width == image.width() &&
+      compressed.height == image.height()) {
+    return compressed;
+  }
+
+  compressed = compress_bc1(image.data(), image.width(), image.height(), image.channels());
+
+  // local sources have no cache of their own, their encoded tiles are worth keeping all the same
+  if (!cache_dir.empty() && (fs::is_directory(cache_dir, error) || fs::create_directories(cache_dir, error))) {
+    write_compressed_image(filename, compressed);
+  }
+
+  return compressed;
+}
+
+// Mip chain or BC1 of a tile that is not cached on disk, and the range of height tiles. Runs on the workers.
+static PreparedTexture prepare_pixels(const ImageView& image, const TileType& tile_type, bool compress)
+{
+  PreparedTexture prepared;
+
+  if (tile_type == TileType::HEIGHT) {
+    HeightView heights(image.data, image.width, image.height, image.channels);
+    uint8_t lo = 255, hi = 0;
+
+    for (int y = 0; y < heights.height; ++y) {
+      for (int x = 0; x < heights.width; ++x) {
+        lo = std::min(lo, heights.at(x, y));
+        hi = std::max(hi, heights.at(x, y));
+      }
+    }
+
+    prepared.height_range = std::make_pair(lo, hi);
+  }
+
+#if COMPRESS_ORTHO_TILES
+  if (compress && tile_type == TileType::ORTHO && image.channels >= 3) {
+    prepared.compressed = compress_bc1(image.data, image.width, image.height, image.channels);
+    return prepared;
+  }
+#endif
+
+  prepared.mipmaps = generate_mipmaps(image.data, image.width, image.height, image.channels, mip_filter(tile_type));
+  return prepared;
 }
 
 Texture* TileCache::tile_texture(const TileId& tile, const TileType& tile_type)
 {
-  std::string name = tile.to_string() + "+" + std::to_string(tile_type);
+  const uint64_t key = texture_key(tile, tile_type);
 
-  if (m_gpu_cache.contains(name)) {
-    return m_gpu_cache[name].get();
+  if (m_gpu_cache.contains(key)) {
+    return m_gpu_cache[key].get();
   }
 
-  Image* image = request_image(tile, tile_type);
+  std::optional<PreparedTexture> prepared;
+  {
+    std::unique_lock lock(m_prepared_mutex);
+    auto it = m_prepared.find(key);
+
+    if (it != m_prepared.end()) {
+      prepared = std::move(it->second);
+      m_prepared.erase(it);
+    }
+  }
 
-  if (image) {
-    auto texture = create_texture(*image);
-    m_gpu_cache[name] = std::move(texture);
-    return m_gpu_cache[name].get();
+  if (prepared) {
+    m_prepare_requested.erase(key);
+    return insert_texture(tile, tile_type, *prepared);
   }
 
+  if (m_prepare_requested.contains(key)) {
+    return nullptr;
+  }
+
+#if SYNTHESIZE_PARENTS
+  if (tile_type != TileType::NORMAL && can_synthesize(tile, tile_type)) {
+    request_synthesis(tile, tile_type);
+    return nullptr;
+  }
+#endif
+
+  if (tile_type == TileType::NORMAL) {
+    // computed from the height tile, which might be synthesized as well
+    if (!resident_image(tile, TileType::HEIGHT).valid()) {
+      (void)tile_texture(tile, TileType::HEIGHT);
+      return nullptr;
+    }
+  } else {
+    Image* image = request_image(tile, tile_type);
+
+    if (!image || !image->loaded()) {
+      return nullptr;
+    }
+  }
+
+  m_prepare_requested.insert(key);
+
+  // Downloaded images stay in the TileService and synthesized height tiles are kept until their normal map is
+  // uploaded, so the worker can look them up again.
+  auto prepare_request = [this, tile, tile_type]() {
+    PreparedTexture prepared = prepare_texture(tile, tile_type);
+    std::unique_lock lock(m_prepared_mutex);
+    m_prepared[texture_key(tile, tile_type)] = std::move(prepared);
+  };
+
+  m_workers.run(prepare_request, tile_type == TileType::NORMAL ? TaskPriority::LOW : TaskPriority::NORMAL);
   return nullptr;
 }
 
 Texture* TileCache::tile_texture_sync(const TileId& tile, const TileType& tile_type)
 {
-  std::string name = tile.to_string() + "+" + std::to_string(tile_type);
+  const uint64_t key = texture_key(tile, tile_type);
 
   Image* image = nullptr;
 
-  if (m_gpu_cache.contains(name)) {
-    return m_gpu_cache[name].get();
+  if (m_gpu_cache.contains(key)) {
+    return m_gpu_cache[key].get();
   }
 
   switch (tile_type) {
@@ -51,6 +253,7 @@ Texture* TileCache::tile_texture_sync(const TileId& tile, const TileType& tile_t
       image = m_ortho_service.get_tile_sync(tile);
       break;
     case TileType::HEIGHT:
+    case TileType::NORMAL:
       image = m_height_service.get_tile_sync(tile);
       break;
     default:
@@ -58,21 +261,362 @@ Texture* TileCache::tile_texture_sync(const TileId& tile, const TileType& tile_t
   }
 
   assert(image);
-  if (!image) return nullptr;
+  if (!image || !image->loaded()) return nullptr;
 
-  auto texture = create_texture(*image);
-  m_gpu_cache[name] = std::move(texture);
-  return m_gpu_cache[name].get();
+  return insert_texture(tile, tile_type, prepare_texture(tile, tile_type));
 }
 
 Texture* TileCache::tile_texture_cached(const TileId& tile, const TileType& tile_type)
 {
-  std::string name = tile.to_string() + "+" + std::to_string(tile_type);
-  return m_gpu_cache[name].get();
+  auto it = m_gpu_cache.find(texture_key(tile, tile_type));
+  return it != m_gpu_cache.end() ? it->second.get() : nullptr;
+}
+
+Texture* TileCache::resident_ancestor_texture(const TileId& tile, const TileType& tile_type, TileId& used)
+{
+  std::optional<TileId> ancestor = m_resident[tile_type].resident_ancestor(tile);
+
+  if (!ancestor) {
+    return nullptr;
+  }
+
+  used = *ancestor;
+  return tile_texture_cached(*ancestor, tile_type);
 }
 
-std::unique_ptr<Texture> TileCache::create_texture(const Image& image)
+Texture* TileCache::insert_texture(const TileId& tile, const TileType& tile_type, const PreparedTexture& prepared)
 {
+  std::unique_ptr<Texture> texture = create_texture(prepared);
+
+  if (!texture) {
+    return nullptr;
+  }
+
+  const uint64_t key = texture_key(tile, tile_type);
+  m_gpu_cache[key] = std::move(texture);
+  m_resident[tile_type].insert(tile);
+  m_not_synthesizable.erase(key);
+  if (tile.zoom > 0) m_not_synthesizable.erase(texture_key(tile.parent(), tile_type));
+  if (prepared.height_range) m_resident_heights.insert(tile, *prepared.height_range);
+  return m_gpu_cache[key].get();
+}
+
+void TileCache::end_frame()
+{
+  for (auto& resident : m_resident) {
+    resident.end_frame();
+  }
+
+  evict_synthesized();
+}
+
+void TileCache::prefetch(const std::vector<TileId>& tiles)
+{
+#if SYNTHESIZE_PARENTS
+  std::vector<TileId> ortho_tiles, height_tiles;
+  for (const auto& tile : tiles) {
+    if (!can_synthesize(tile, TileType::ORTHO)) ortho_tiles.push_back(tile);
+    if (!can_synthesize(tile, TileType::HEIGHT)) height_tiles.push_back(tile);
+  }
+
+  m_ortho_service.prefetch(ortho_tiles);
+  m_height_service.prefetch(height_tiles);
+#else
+  m_ortho_service.prefetch(tiles);
+  m_height_service.prefetch(tiles);
+#endif
+}
+
+Texture* TileCache::placeholder_texture(const TileType& tile_type)
+{
+  auto& texture = m_placeholders[tile_type];
+
+  if (!texture) {
+    switch (tile_type) {
+      case TileType::ORTHO: {
+        const uint8_t grey[] = {128, 128, 128};
+        texture = create_texture(grey, 1, 1, GL_RGB8, GL_RGB);
+        break;
+      }
+      case TileType::HEIGHT: {
+        const uint8_t sea_level[] = {0, 0, 0};
+        texture = create_texture(sea_level, 1, 1, GL_RGB8, GL_RGB);
+        break;
+      }
+      case TileType::NORMAL: {
+        const glm::vec2 encoded = encode_octahedral(glm::vec3(0.0f, 1.0f, 0.0f)) * 255.0f;
+        const uint8_t up[] = {uint8_t(encoded.x + 0.5f), uint8_t(encoded.y + 0.5f)};
+        texture = create_texture(up, 1, 1, GL_RG8, GL_RG);
+        break;
+      }
+      default:
+        assert(false);
+        return nullptr;
+    }
+  }
+
+  return texture.get();
+}
+
+PreparedTexture TileCache::prepare_texture(const TileId& tile, const TileType& tile_type)
+{
+  switch (tile_type) {
+    case TileType::ORTHO: {
+      const Image* image = m_ortho_service.get_tile_cached(tile);
+#if COMPRESS_ORTHO_TILES
+      if (m_compress_ortho && image->channels() >= 3) {
+        PreparedTexture prepared;
+        prepared.compressed = compress_tile(tile, *image, m_ortho_service.cache_dir());
+        return prepared;
+      }
+#endif
+      return prepare_pixels(image_view(image), tile_type, m_compress_ortho);
+    }
+    case TileType::HEIGHT:
+      return prepare_pixels(image_view(m_height_service.get_tile_cached(tile)), tile_type, false);
+
+    case TileType::NORMAL: {
+      ImageView image = resident_image(tile, TileType::HEIGHT);
+      HeightView height(image.data, image.width, image.height, image.channels);
+      float pixel_size = tile.width_in_meters() / height.width;
+
+      NormalMap normal_map = compute_normal_map(height, height_neighbours(tile), m_height_scaling_factor, pixel_size);
+      return prepare_pixels(ImageView(normal_map.data.data(), normal_map.width, normal_map.height, 2), tile_type,
+                            false);
+    }
+    default:
+      assert(false);
+      return {};
+  }
+}
+
+ImageView TileCache::resident_image(const TileId& tile, const TileType& tile_type)
+{
+  assert(tile_type != TileType::NORMAL);
+
+  ImageView image = image_view(tile_type == TileType::ORTHO ? m_ortho_service.get_tile_cached(tile)
+                                                            : m_height_service.get_tile_cached(tile));
+  if (image.valid()) {
+    return image;
+  }
+
+  std::unique_lock lock(m_prepared_mutex);
+  auto it = m_synthesized.find(texture_key(tile, tile_type));
+
+  if (it != m_synthesized.end()) {
+    it->second.last_used = ++m_synthesized_lookups;
+
+    const SynthesizedTile& synthesized = *it->second.tile;
+    ImageView synthesized_image(synthesized.pixels.data(), synthesized.width, synthesized.height,
+                                synthesized.channels);
+    synthesized_image.owner = it->second.tile;  // the tile may be evicted while the view is in use
+    return synthesized_image;
+  }
+
+  return ImageView();
+}
+
+bool TileCache::can_synthesize(const TileId& tile, const TileType& tile_type)
+{
+  // asked for every missing tile every frame, the lookups below lock a mutex each
+  const uint64_t key = texture_key(tile, tile_type);
+  if (m_not_synthesizable.contains(key)) {
+    return false;
+  }
+
+  if (!children_resident(tile, tile_type)) {
+    if (m_not_synthesizable.size() >= MAX_NOT_SYNTHESIZABLE) m_not_synthesizable.clear();
+    m_not_synthesizable.insert(key);
+    return false;
+  }
+
+  return true;
+}
+
+bool TileCache::children_resident(const TileId& tile, const TileType& tile_type)
+{
+  if (tile.zoom >= TileId::MAX_ZOOM || resident_image(tile, tile_type).valid()) {
+    return false;
+  }
+
+  std::array<TileId, 4> children = tile.children();
+  ImageView first = resident_image(children[0], tile_type);
+
+  if (!first.valid() || first.width % 2 != 0 || first.height % 2 != 0) {
+    return false;
+  }
+
+  for (size_t i = 1; i < children.size(); ++i) {
+    ImageView child = resident_image(children[i], tile_type);
+
+    if (!child.valid() || child.width != first.width || child.height != first.height ||
+        child.channels != first.channels) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void TileCache::request_synthesis(const TileId& tile, const TileType& tile_type)
+{
+  m_prepare_requested.insert(texture_key(tile, tile_type));
+
+  if (profiler) {
+    profiler->count("tiles synthesized", 1);
+  }
+
+  auto synthesis_request = [this, tile, tile_type]() {
+    std::array<TileId, 4> children = tile.children();
+    std::array<ImageView, 4> images;
+    for (size_t i = 0; i < children.size(); ++i) images[i] = resident_image(children[i], tile_type);
+
+    auto parent = std::make_shared<SynthesizedTile>();
+    parent->width = images[0].width;
+    parent->height = images[0].height;
+    parent->channels = images[0].channels;
+    parent->pixels = synthesize_parent(images, mip_filter(tile_type));
+
+    PreparedTexture prepared = prepare_pixels(
+        ImageView(parent->pixels.data(), parent->width, parent->height, parent->channels), tile_type,
+        m_compress_ortho);
+
+    const uint64_t key = texture_key(tile, tile_type);
+    std::unique_lock lock(m_prepared_mutex);
+    m_prepared[key] = std::move(prepared);
+    m_synthesized[key] = SynthesizedEntry{std::move(parent), ++m_synthesized_lookups};
+  };
+
+  m_workers.run(synthesis_request, TaskPriority::NORMAL);
+}
+
+void TileCache::evict_synthesized()
+{
+  std::unique_lock lock(m_prepared_mutex);
+
+  if (m_synthesized.size() <= MAX_SYNTHESIZED_TILES) {
+    return;
+  }
+
+  // The pixels are only needed again for the parent or a neighbour's normal map, which are made from other
+  // tiles if these are gone. The normal map of a height tile is computed from its pixels, so it has to be
+  // uploaded as well.
+  std::vector<std::pair<uint64_t, uint64_t>> uploaded;  // last used and key
+  for (const auto& [key, entry] : m_synthesized) {
+    const uint64_t normal_key = (key & ~uint64_t(3)) | uint64_t(TileType::NORMAL);
+    bool is_height = (key & 3) == TileType::HEIGHT;
+
+    if (m_gpu_cache.contains(key) && (!is_height || m_gpu_cache.contains(normal_key))) {
+      uploaded.emplace_back(entry.last_used, key);
+    }
+  }
+
+  // down to three quarters, so this does not run every frame
+  const size_t excess = m_synthesized.size() - MAX_SYNTHESIZED_TILES * 3 / 4;
+  const size_t evicted = std::min(excess, uploaded.size());
+  std::nth_element(uploaded.begin(), uploaded.begin() + evicted, uploaded.end());
+
+  for (size_t i = 0; i < evicted; ++i) {
+    m_synthesized.erase(uploaded[i].second);
+  }
+}
+
+std::array<HeightView, 4> TileCache::height_neighbours(const TileId& tile)
+{
+  std::array<HeightView, 4> neighbours;
+  // in NormalMap::Neighbour order
+  const std::array<TileId, 4> tiles = {tile.neighbour(-1, 0), tile.neighbour(+1, 0), tile.neighbour(0, -1),
+                                       tile.neighbour(0, +1)};
+
+  for (size_t i = 0; i < tiles.size(); ++i) {
+    ImageView image = resident_image(tiles[i], TileType::HEIGHT);
+    if (image.valid()) {
+      neighbours[i] = HeightView(image.data, image.width, image.height, image.channels);
+      neighbours[i].owner = image.owner;
+    }
+  }
+
+  return neighbours;
+}
+
+std::unique_ptr<Texture> TileCache::create_texture(const PreparedTexture& prepared)
+{
+  return prepared.compressed.valid() ? create_texture(prepared.compressed) : create_texture(prepared.mipmaps);
+}
+
+std::unique_ptr<Texture> TileCache::create_texture(const MipChain& mipmaps)
+{
+  static const GLint internal_formats[] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+  static const GLenum formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+
+  assert(mipmaps.valid() && mipmaps.channels <= 4);
+  if (!mipmaps.valid() || mipmaps.channels > 4) return nullptr;
+
+  std::optional<Profiler::Scope> scope;
+  if (profiler) {
+    scope.emplace(profiler->scope("upload"));
+    profiler->count("bytes uploaded", int64_t(mipmaps.size()));
+  }
+
+  auto texture = std::make_unique<Texture>();
+  texture->bind();
+  texture->set_parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  texture->set_parameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  texture->set_parameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  texture->set_parameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  texture->set_parameter(GL_TEXTURE_MAX_LEVEL, GLint(mipmaps.levels.size()) - 1);
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (size_t level = 0; level < mipmaps.levels.size(); ++level) {
+    glTexImage2D(GL_TEXTURE_2D, GLint(level), internal_formats[mipmaps.channels - 1],
+                 mip_size(mipmaps.width, level), mip_size(mipmaps.height, level), 0, formats[mipmaps.channels - 1],
+                 GL_UNSIGNED_BYTE, mipmaps.levels[level].data());
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  texture->unbind();
+  return texture;
+}
+
+std::unique_ptr<Texture> TileCache::create_texture(const CompressedImage& image)
+{
+  std::optional<Profiler::Scope> scope;
+  if (profiler) {
+    scope.emplace(profiler->scope("upload"));
+    profiler->count("bytes uploaded", int64_t(image.size()));
+  }
+
+  auto texture = std::make_unique<Texture>();
+  texture->bind();
+  texture->set_parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  texture->set_parameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  texture->set_parameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  texture->set_parameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  texture->set_parameter(GL_TEXTURE_MAX_LEVEL, GLint(image.levels.size()) - 1);
+
+  // the mipmaps are part of the image, they can't be generated from compressed data
+  for (size_t level = 0; level < image.levels.size(); ++level) {
+    const auto& blocks = image.levels[level];
+    glCompressedTexImage2D(GL_TEXTURE_2D, GLint(level), GL_COMPRESSED_RGB_S3TC_DXT1_EXT, mip_size(image.width, level),
+                           mip_size(image.height, level), 0, GLsizei(blocks.size()), blocks.data());
+  }
+
+  texture->unbind();
+  return texture;
+}
+
+// only used for the placeholders
+std::unique_ptr<Texture> TileCache::create_texture(const uint8_t* pixels, int width, int height,
+                                                   GLint internal_format, GLenum format)
+{
+  std::optional<Profiler::Scope> scope;
+  if (profiler) {
+    scope.emplace(profiler->scope("upload"));
+    profiler->count("bytes uploaded", int64_t(width) * height * (format == GL_RG ? 2 : format == GL_RGB ? 3 : 4));
+  }
+
   auto texture = std::make_unique<Texture>();
   texture->bind();
   texture->set_parameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -82,7 +626,7 @@ std::unique_ptr<Texture> TileCache::create_texture(const Image& image)
   texture->set_parameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-  texture->set_image(image);
+  glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
   glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
   texture->generate_mipmap();
@@ -99,30 +643,48 @@ Image* TileCache::request_image(const TileId& tile, const TileType& tile_type)
     case TileType::HEIGHT:
       return m_height_service.get_tile(tile);
 
+    case TileType::NORMAL:  // not backed by an image
     default:
       assert(false);
       return nullptr;
   }
 }
 
-float TileCache::elevation(const Coordinate& coord)
+TileServiceStats TileCache::stats(const TileType& tile_type)
 {
-  TileId tile(coord, 7);  // probably not the best, as this is very low res
+  switch (tile_type) {
+    case TileType::ORTHO:
+      return m_ortho_service.stats();
+    case TileType::HEIGHT:
+      return m_height_service.stats();
+    default:
+      return {};
+  }
+}
 
-  Bounds<Coordinate> bounds = tile.bounds();
+float TileCache::elevation(const DCoordinate& coord)
+{
+  TileId tile(coord, 7);  // probably not the best, as this is very low res
 
   Image* image = m_height_service.get_tile(tile);
+
+  // never block, use a lower zoom level until the tile is loaded
+  while (!image && tile.zoom > 0) {
+    tile = tile.parent();
+    image = m_height_service.get_tile_cached(tile);
+  }
+
   if (!image) {
-    image = m_height_service.get_tile_sync(tile);
+    return 0.0f;
   }
 
-  assert(image);
+  Bounds<DCoordinate> bounds = tile.bounds<double>();
 
   auto val = coord.to_vec2();
   auto min = bounds.min.to_vec2();
   auto max = bounds.max.to_vec2();
 
-  glm::vec2 uv = map_range(val, min, max, glm::vec2(0.0f), glm::vec2(1.0f));
+  glm::vec2 uv = glm::vec2(map_range(val, min, max, glm::dvec2(0.0), glm::dvec2(1.0)));
 
   glm::u8vec4 pixel = image->sample(uv);
 
@@ -5,19 +5,59 @@
 */
 #pragma once
 
+#include <array>
 #include <chrono>
 #include <memory>
-#include <string>
+#include <mutex>
+#include <optional>
+#include <set>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "../gfx/gfx.h"
+#include "Mipmap.h"
+#include "NormalMap.h"
+#include "Profiler.h"
+#include "ResidentHeights.h"
+#include "ResidentTiles.h"
+#include "TaskScheduler.h"
+#include "TextureCompression.h"
 #include "TileService.h"
 #include "TileUtils.h"
 
 using namespace gfx;
 using namespace gfx::gl;
 
-enum TileType : size_t { ORTHO = 0, HEIGHT = 1 };
+// Normal maps are not downloaded, they are computed from the height tiles.
+enum TileType : size_t { ORTHO = 0, HEIGHT = 1, NORMAL = 2 };
+
+// Tile servers used by the renderer and the command line tools. BASEMAP_TILE_SERVICE is an alternative to
+// ORTHO_TILE_SERVICE.
+extern const TileServiceConfig ORTHO_TILE_SERVICE, BASEMAP_TILE_SERVICE, HEIGHT_TILE_SERVICE;
+
+// Where the renderer gets its tiles from, e.g. local files for air-gapped use.
+struct TileSources {
+  TileServiceConfig ortho{ORTHO_TILE_SERVICE}, height{HEIGHT_TILE_SERVICE};
+
+  // base with another url, directory, MBTiles file or GeoTIFF and its own cache, or BASEMAP_TILE_SERVICE for "basemap"
+  static TileServiceConfig with_location(const TileServiceConfig& base, const std::string& location);
+
+  // every location caches its tiles in a directory of its own, tiles of different sources must not mix
+  static std::string cache_dir_for(const std::string& location);
+};
+
+// Texture data computed on a worker thread, only one of them is valid.
+struct PreparedTexture {
+  MipChain mipmaps;
+  CompressedImage compressed;
+  std::optional<std::pair<uint8_t, uint8_t>> height_range;  // of HEIGHT tiles, for ResidentHeights
+};
+
+// A parent tile built from its four children instead of downloading it.
+struct SynthesizedTile {
+  int width{0}, height{0}, channels{0};
+  std::vector<uint8_t> pixels;
+};
 
 using TimePoint = std::chrono::time_point<std::chrono::system_clock>;
 
@@ -29,7 +69,8 @@ struct CacheInfo {
 class TileCache
 {
  public:
-  TileCache();
+  // height_scaling_factor is the elevation in meters of a height map value of 1.0. Needs a current GL context.
+  TileCache(float height_scaling_factor = 1.0f, const TileSources& sources = {});
 
   Texture* tile_texture(const TileId&, const TileType&);
 
@@ -37,13 +78,90 @@ class TileCache
 
   Texture* tile_texture_cached(const TileId&, const TileType&);
 
-  float elevation(const Coordinate&);
+  // Texture of the tile or its deepest ancestor that has one, without a lookup per zoom level.
+  // used is set to the tile of the returned texture.
+  Texture* resident_ancestor_texture(const TileId&, const TileType&, TileId& used);
+
+  // Tiles that will probably be needed soon, most urgent first.
+  void prefetch(const std::vector<TileId>&);
+
+  // forgets fallback lookups that were not repeated in a while
+  void end_frame();
+
+  // 1x1 texture that can be used if no tile of that type is available
+  Texture* placeholder_texture(const TileType&);
+
+  float elevation(const DCoordinate&);
+
+  // Pixels of a downloaded or synthesized ORTHO or HEIGHT tile, without requesting it. Thread safe, the
+  // view keeps synthesized pixels alive.
+  ImageView resident_image(const TileId&, const TileType&);
+
+  // only ORTHO and HEIGHT are downloaded
+  TileServiceStats stats(const TileType&);
+
+  inline size_t num_textures() const { return m_gpu_cache.size(); }
+
+  // uploaded height tiles, thread safe
+  inline const ResidentHeights& resident_heights() const { return m_resident_heights; }
+
+  // times texture uploads if set
+  Profiler* profiler{nullptr};
 
  private:
-  std::unordered_map<std::string, std::unique_ptr<Texture>> m_gpu_cache;
+  const float m_height_scaling_factor;
+  const bool m_compress_ortho;  // to BC1 if COMPRESS_ORTHO_TILES and the driver supports it
+  std::unordered_map<uint64_t, std::unique_ptr<Texture>> m_gpu_cache;  // by texture key, see TileCache.cpp
+  std::array<std::unique_ptr<Texture>, 3> m_placeholders;
+  std::array<ResidentTiles, 3> m_resident;  // tiles in m_gpu_cache
+  ResidentHeights m_resident_heights;       // the HEIGHT tiles of m_resident, for the other threads
   TileService m_ortho_service, m_height_service;
 
-  std::unique_ptr<Texture> create_texture(const Image& image);
+  // textures are prepared on the workers, including the mipmaps, and uploaded on the next request
+  std::mutex m_prepared_mutex;
+  std::set<uint64_t> m_prepare_requested;
+  std::unordered_map<uint64_t, PreparedTexture> m_prepared;
+
+  // kept on the CPU, so their own parents can be synthesized too. Guarded by m_prepared_mutex
+  struct SynthesizedEntry {
+    std::shared_ptr<const SynthesizedTile> tile;
+    uint64_t last_used{0};
+  };
+  std::unordered_map<uint64_t, SynthesizedEntry> m_synthesized;
+  uint64_t m_synthesized_lookups{0};
+
+  // texture keys of tiles that could not be synthesized, asked again when one of their children is uploaded
+  std::unordered_set<uint64_t> m_not_synthesizable;
+
+  TaskScheduler m_workers;
+
+  // adds the texture to m_gpu_cache
+  Texture* insert_texture(const TileId&, const TileType&, const PreparedTexture&);
+
+  std::unique_ptr<Texture> create_texture(const PreparedTexture& prepared);
+
+  std::unique_ptr<Texture> create_texture(const MipChain& mipmaps);
+
+  std::unique_ptr<Texture> create_texture(const CompressedImage& image);
+
+  std::unique_ptr<Texture> create_texture(const uint8_t* pixels, int width, int height, GLint internal_format,
+                                          GLenum format);
 
   Image* request_image(const TileId&, const TileType&);
+
+  // runs on the workers, the source images must be loaded
+  PreparedTexture prepare_texture(const TileId&, const TileType&);
+
+  // the tile is not resident, but all four of its children are
+  bool can_synthesize(const TileId&, const TileType&);
+
+  // can_synthesize without remembering the answer
+  bool children_resident(const TileId&, const TileType&);
+
+  void request_synthesis(const TileId&, const TileType&);
+
+  // drops the least recently used synthesized tiles whose textures are uploaded
+  void evict_synthesized();
+
+  std::array<HeightView, 4> height_neighbours(const TileId&);
 };
@@ -0,0 +1,149 @@
+#include "TileRegion.h"
+
+#include <algorithm>
+#include <cassert>
+
+struct LatLon {
+  double lat, lon;
+};
+
+// https://en.wikipedia.org/wiki/Orientation_(geometry)
+static double orientation(const LatLon& a, const LatLon& b, const LatLon& c)
+{
+  return (b.lon - a.lon) * (c.lat - a.lat) - (b.lat - a.lat) * (c.lon - a.lon);
+}
+
+static bool segments_intersect(const LatLon& p0, const LatLon& p1, const LatLon& q0, const LatLon& q1)
+{
+  double d0 = orientation(q0, q1, p0), d1 = orientation(q0, q1, p1);
+  double d2 = orientation(p0, p1, q0), d3 = orientation(p0, p1, q1);
+  return ((d0 > 0.0) != (d1 > 0.0)) && ((d2 > 0.0) != (d3 > 0.0));
+}
+
+TileRegion::TileRegion(const std::vector<DCoordinate>& polygon) : m_polygon(polygon)
+{
+  assert(polygon.size() >= 3);
+
+  m_min_lat = m_max_lat = polygon.front().lat;
+  m_min_lon = m_max_lon = polygon.front().lon;
+
+  for (const auto& coord : polygon) {
+    m_min_lat = std::min(m_min_lat, coord.lat);
+    m_max_lat = std::max(m_max_lat, coord.lat);
+    m_min_lon = std::min(m_min_lon, coord.lon);
+    m_max_lon = std::max(m_max_lon, coord.lon);
+  }
+}
+
+TileRegion TileRegion::from_bounds(double min_lat, double min_lon, double max_lat, double max_lon)
+{
+  return TileRegion({
+      DCoordinate(min_lat, min_lon),
+      DCoordinate(min_lat, max_lon),
+      DCoordinate(max_lat, max_lon),
+      DCoordinate(max_lat, min_lon),
+  });
+}
+
+std::vector<TileId> TileRegion::tiles(unsigned min_zoom, unsigned max_zoom) const
+{
+  std::vector<TileId> result;
+
+  for (unsigned zoom = min_zoom; zoom <= max_zoom; ++zoom) {
+    auto tiles_at_zoom = tiles(zoom);
+    result.insert(result.end(), tiles_at_zoom.begin(), tiles_at_zoom.end());
+  }
+
+  return result;
+}
+
+std::vector<TileId> TileRegion::tiles(unsigned zoom) const
+{
+  const unsigned max_tile = (1U << zoom) - 1U;
+
+  // web mercator does not reach the poles
+  const double max_lat = 85.0511;
+  double north = std::clamp(m_max_lat, -max_lat, max_lat), south = std::clamp(m_min_lat, -max_lat, max_lat);
+  double west = std::clamp(m_min_lon, -180.0, 180.0), east = std::clamp(m_max_lon, -180.0, 180.0);
+
+  // y-axis points south, so the northern edge has the smallest y
+  unsigned min_x = std::min(wms::lon2tilex(west, zoom), max_tile);
+  unsigned max_x = std::min(wms::lon2tilex(east, zoom), max_tile);
+  unsigned min_y = std::min(wms::lat2tiley(north, zoom), max_tile);
+  unsigned max_y = std::min(wms::lat2tiley(south, zoom), max_tile);
+
+  std::vector<TileId> result;
+
+  for (unsigned y = min_y; y <= max_y; ++y) {
+    for (unsigned x = min_x; x <= max_x; ++x) {
+      TileId tile(zoom, x, y);
+      if (overlaps(tile)) {
+        result.push_back(tile);
+      }
+    }
+  }
+
+  return result;
+}
+
+bool TileRegion::contains(const DCoordinate& coord) const
+{
+  // https://wrfranklin.org/Research/Short_Notes/pnpoly.html
+  bool inside = false;
+
+  for (std::size_t i = 0, j = m_polygon.size() - 1; i < m_polygon.size(); j = i++) {
+    const DCoordinate &a = m_polygon[i], &b = m_polygon[j];
+    if (((a.lat > coord.lat) != (b.lat > coord.lat)) &&
+        (coord.lon < (b.lon - a.lon) * (coord.lat - a.lat) / (b.lat - a.lat) + a.lon)) {
+      inside = !inside;
+    }
+  }
+
+  return inside;
+}
+
+bool TileRegion::overlaps(const TileId& tile) const
+{
+  Bounds<DCoordinate> bounds = tile.bounds<double>();
+
+  // the tile bounds min is the north west corner
+  double north = bounds.min.lat, south = bounds.max.lat;
+  double west = bounds.min.lon, east = bounds.max.lon;
+
+  if (east < m_min_lon || m_max_lon < west || north < m_min_lat || m_max_lat < south) {
+    return false;
+  }
+
+  // polygon corner inside the tile
+  for (const auto& coord : m_polygon) {
+    if (west <= coord.lon && coord.lon <= east && south <= coord.lat && coord.lat <= north) {
+      return true;
+    }
+  }
+
+  // tile corner inside the polygon
+  const std::array<LatLon, 4> corners = {
+      LatLon{north, west},
+      LatLon{north, east},
+      LatLon{south, east},
+      LatLon{south, west},
+  };
+
+  for (const auto& corner : corners) {
+    if (contains(DCoordinate(corner.lat, corner.lon))) {
+      return true;
+    }
+  }
+
+  // crossing edges
+  for (std::size_t i = 0, j = m_polygon.size() - 1; i < m_polygon.size(); j = i++) {
+    LatLon a{m_polygon[i].lat, m_polygon[i].lon}, b{m_polygon[j].lat, m_polygon[j].lon};
+    for (std::size_t k = 0; k < corners.size(); ++k) {
+      if (segments_intersect(a, b, corners[k], corners[(k + 1) % corners.size()])) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,32 @@
+/*
+  Enumerates the tiles that cover a region of the map.
+*/
+#pragma once
+
+#include <vector>
+
+#include "TileUtils.h"
+
+// A region given as a polygon of lat/lon coordinates, edges are straight
+// lines in lat/lon space. A bounding box is just a polygon with 4 corners.
+// In double, so the edges of the region are exact down to MAX_ZOOM.
+class TileRegion
+{
+ public:
+  explicit TileRegion(const std::vector<DCoordinate>& polygon);
+
+  static TileRegion from_bounds(double min_lat, double min_lon, double max_lat, double max_lon);
+
+  // All tiles that overlap the region, ordered by zoom level, then row, then column.
+  std::vector<TileId> tiles(unsigned min_zoom, unsigned max_zoom) const;
+
+  std::vector<TileId> tiles(unsigned zoom) const;
+
+  bool overlaps(const TileId&) const;
+
+  bool contains(const DCoordinate&) const;
+
+ private:
+  std::vector<DCoordinate> m_polygon;
+  double m_min_lat, m_min_lon, m_max_lat, m_max_lon;
+};
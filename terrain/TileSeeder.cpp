@@ -0,0 +1,108 @@
+#include "TileSeeder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+// number of cached files to look at for the size estimate
+#define SIZE_SAMPLES 1000
+
+TileSeeder::TileSeeder(TileService& service, unsigned num_threads, float max_requests_per_second)
+    : m_service(service), m_num_threads(std::max(num_threads, 1U)), m_max_requests_per_second(max_requests_per_second)
+{
+}
+
+SeedProgress TileSeeder::seed(const std::vector<TileId>& region, const ProgressCallback& callback)
+{
+  using Clock = std::chrono::steady_clock;
+
+  // in Z-order, so the files of neighbouring tiles and siblings are written one after the other
+  std::vector<TileId> tiles = region;
+  std::sort(tiles.begin(), tiles.end());
+
+  SeedProgress progress;
+  progress.total = tiles.size();
+
+  std::mutex mutex;
+  std::atomic<size_t> next_tile{0};
+
+  // requests are spaced evenly, this is shared by all workers
+  const auto interval = m_max_requests_per_second > 0.0f
+                            ? std::chrono::duration_cast<Clock::duration>(
+                                  std::chrono::duration<float>(1.0f / m_max_requests_per_second))
+                            : Clock::duration::zero();
+  Clock::time_point next_request = Clock::now();
+
+  auto worker = [&]() {
+    for (size_t i = next_tile++; i < tiles.size(); i = next_tile++) {
+      const TileId& tile = tiles[i];
+      bool skipped = m_service.is_saved_on_disk(tile);
+      bool not_available = !skipped && m_service.is_marked_not_available(tile);
+      bool success = skipped;
+      size_t downloaded_bytes = 0;
+
+      if (!skipped && !not_available) {
+        if (interval != Clock::duration::zero()) {
+          Clock::time_point slot;
+          {
+            std::unique_lock lock(mutex);
+            slot = next_request = std::max(next_request + interval, Clock::now());
+          }
+          std::this_thread::sleep_until(slot);
+        }
+
+        success = m_service.download_to_disk(tile, &downloaded_bytes);
+        not_available = !success && m_service.is_marked_not_available(tile);
+      }
+
+      std::unique_lock lock(mutex);
+
+      if (skipped) {
+        progress.skipped++;
+      } else if (not_available) {
+        progress.not_available++;
+      } else if (success) {
+        progress.downloaded++;
+        progress.downloaded_bytes += downloaded_bytes;
+      } else {
+        progress.failed++;
+      }
+
+      if (callback) callback(progress);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < m_num_threads; ++i) {
+    threads.push_back(std::thread(worker));
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  return progress;
+}
+
+size_t TileSeeder::estimate_size(const std::vector<TileId>& tiles) const
+{
+  namespace fs = std::filesystem;
+
+  size_t sampled_files = 0, sampled_bytes = 0;
+  std::error_code error;
+
+  if (fs::exists(m_service.cache_dir(), error)) {
+    for (const auto& entry : fs::directory_iterator(m_service.cache_dir(), error)) {
+      // only the tiles, not the validators, markers or encoded textures next to them
+      if (!entry.is_regular_file() || entry.path().extension() != ".png") continue;
+      sampled_bytes += entry.file_size();
+      if (++sampled_files >= SIZE_SAMPLES) break;
+    }
+  }
+
+  size_t tile_size = sampled_files > 0 ? sampled_bytes / sampled_files : DEFAULT_TILE_SIZE;
+  return tiles.size() * tile_size;
+}
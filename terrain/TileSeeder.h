@@ -0,0 +1,44 @@
+/*
+  Fills the disk cache of a TileService with all tiles of a region, so the
+  renderer can be used without network access.
+*/
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "TileService.h"
+#include "TileUtils.h"
+
+struct SeedProgress {
+  size_t total{0}, downloaded{0}, skipped{0}, failed{0};
+  size_t not_available{0};  // the server does not have them, now or in an earlier run
+  size_t downloaded_bytes{0};
+
+  inline size_t done() const { return downloaded + skipped + failed + not_available; }
+};
+
+class TileSeeder
+{
+ public:
+  using ProgressCallback = std::function<void(const SeedProgress&)>;
+
+  // max_requests_per_second <= 0 disables rate limiting
+  TileSeeder(TileService& service, unsigned num_threads = 4, float max_requests_per_second = 0.0f);
+
+  // Download all tiles that are not already on disk, so an interrupted run
+  // can simply be restarted. The callback is called after every tile, from
+  // the worker threads, but never concurrently. Tiles are downloaded in Z-order.
+  SeedProgress seed(const std::vector<TileId>& tiles, const ProgressCallback& callback = nullptr);
+
+  // Estimated bytes on disk after seeding, based on the tiles already cached.
+  size_t estimate_size(const std::vector<TileId>& tiles) const;
+
+  // assumed tile size if there are no cached tiles to estimate from
+  static constexpr size_t DEFAULT_TILE_SIZE = 20 * 1024;
+
+ private:
+  TileService& m_service;
+  const unsigned m_num_threads;
+  const float m_max_requests_per_second;
+};
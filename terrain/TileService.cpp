@@ -1,13 +1,17 @@
 #include "TileService.h"
 
-#include <cpr/cpr.h>
 #include <fmt/core.h>
 
+#include <algorithm>
 #include <filesystem>
+#include <fstream>
 
 #define LOG_REQUESTS  false
 #define CACHE_ON_DISK true
-#define NUM_THREADS   3
+
+// failed requests are retried after RETRY_DELAY, doubling with every failure up to MAX_RETRY_DELAY
+#define RETRY_DELAY     std::chrono::seconds(2)
+#define MAX_RETRY_DELAY std::chrono::seconds(120)
 
 inline std::ostream& operator<<(std::ostream& os, const TileId& tile)
 {
@@ -16,35 +20,41 @@ inline std::ostream& operator<<(std::ostream& os, const TileId& tile)
 
 TileService::TileService(const std::string& url, const UrlPattern& url_pattern, const std::string& filetype,
                          const std::string& dir)
-    : m_url(url), m_url_pattern(url_pattern), m_filetype(filetype), m_thread_pool(NUM_THREADS), m_cache_dir(dir)
+    : TileService(TileServiceConfig{url, url_pattern, filetype, dir})
 {
-#if CACHE_ON_DISK
-  if (!std::filesystem::exists(m_cache_dir)) {
+}
+
+TileService::TileService(const TileServiceConfig& config) : TileService(config, create_tile_source(config)) {}
+
+TileService::TileService(const TileServiceConfig& config, std::unique_ptr<TileSource> source)
+    : m_source(std::move(source)),
+      m_cache_on_disk(CACHE_ON_DISK && !m_source->is_local()),
+      m_cache_dir(config.cache_dir),
+      m_bundle_dir(config.bundle_dir),
+      m_max_concurrent_requests(std::max(config.max_concurrent_requests, 1U)),
+      m_max_age(config.max_age),
+      m_thread_pool(m_max_concurrent_requests)
+{
+  if (m_cache_on_disk && !std::filesystem::exists(m_cache_dir)) {
     std::filesystem::create_directories(m_cache_dir);
   }
-#endif
 }
 
-std::string TileService::tile_url(const TileId& tile) const
+std::unique_ptr<TileSource> create_tile_source(const TileServiceConfig& config)
 {
-  const unsigned num_y_tiles = (1 << tile.zoom);
-
-  switch (m_url_pattern) {
-    case ZXY_Y_NORTH: {
-      return fmt::format("{}/{}/{}/{}{}", m_url, tile.zoom, tile.x, (num_y_tiles - tile.y - 1), m_filetype);
-    }
-    case ZYX_Y_NORTH: {
-      return fmt::format("{}/{}/{}/{}{}", m_url, tile.zoom, (num_y_tiles - tile.y - 1), tile.x, m_filetype);
-    }
-    case ZYX_Y_SOUTH: {
-      return fmt::format("{}/{}/{}/{}{}", m_url, tile.zoom, tile.y, tile.x, m_filetype);
-    }
-    case ZXY_Y_SOUTH: {
-      return fmt::format("{}/{}/{}/{}{}", m_url, tile.zoom, tile.x, tile.y, m_filetype);
-    }
+  switch (config.source) {
+    case TileSourceType::HTTP:
+      return std::make_unique<HttpTileSource>(config.url, config.url_pattern, config.filetype, config.timeout,
+                                              config.connect_timeout);
+    case TileSourceType::DIRECTORY:
+      return std::make_unique<DirectoryTileSource>(config.url, config.url_pattern, config.filetype);
+    case TileSourceType::MBTILES:
+      return std::make_unique<MBTilesTileSource>(config.url);
+    case TileSourceType::GEOTIFF:
+      return std::make_unique<GeoTiffTileSource>(config.url);
     default:
       assert(false);
-      return "";
+      return nullptr;
   }
 }
 
@@ -53,13 +63,42 @@ std::string TileService::tile_filename(const TileId& tile) const
   return fmt::format("{}/{}.png", m_cache_dir, tile.to_string());
 }
 
+std::string TileService::bundled_filename(const TileId& tile) const
+{
+  return fmt::format("{}/{}.png", m_bundle_dir, tile.to_string());
+}
+
+std::string TileService::validators_filename(const TileId& tile) const
+{
+  return fmt::format("{}/{}.etag", m_cache_dir, tile.to_string());
+}
+
+std::string TileService::not_available_filename(const TileId& tile) const
+{
+  return fmt::format("{}/{}.missing", m_cache_dir, tile.to_string());
+}
+
+bool TileService::needs_revalidation(const std::string& filename) const
+{
+  if (m_max_age == std::chrono::seconds::zero()) {
+    return false;
+  }
+
+  std::error_code error;
+  auto modified = std::filesystem::last_write_time(filename, error);
+  return error || m_max_age < std::chrono::file_clock::now() - modified;
+}
+
 Image* TileService::get_tile(const TileId& tile)
 {
-  if (m_ram_cache.contains(tile)) {
-    return m_ram_cache[tile].get();
+  std::unique_lock lock(m_mutex);
+  TileEntry& entry = m_tiles[tile];
+
+  if (entry.state == TileState::RESIDENT) {
+    return entry.image.get();
   }
 
-  if (!m_already_requested.contains(tile)) {
+  if (should_request(entry)) {
     request_tile(tile);
   }
   return nullptr;
@@ -67,93 +106,294 @@ Image* TileService::get_tile(const TileId& tile)
 
 Image* TileService::get_tile_sync(const TileId& tile)
 {
-  if (m_ram_cache.contains(tile)) {
-    return m_ram_cache[tile].get();
+  std::unique_lock lock(m_mutex);
+  TileEntry& entry = m_tiles[tile];
+
+  if (entry.state == TileState::RESIDENT) {
+    return entry.image.get();
   }
 
-  auto image = download_tile(tile);
+  if (entry.state == TileState::IN_FLIGHT) {
+    std::shared_future<Image*> request = entry.request;
+    lock.unlock();
+    return request.get();
+  }
 
-  if (!image) {
+  if (!should_request(entry)) {
     return nullptr;
   }
 
-  m_ram_cache[tile] = std::move(image);
-  return m_ram_cache[tile].get();
+  // download on this thread, the workers might be busy
+  auto promise = begin_request(entry);
+  lock.unlock();
+
+  bool not_available = false;
+  auto image = download_tile(tile, nullptr, &not_available);
+
+  Image* result = finish_request(tile, std::move(image), not_available);
+  promise->set_value(result);
+  return result;
 }
 
 Image* TileService::get_tile_cached(const TileId& tile)
 {
-  if (m_ram_cache.contains(tile)) {
-    return m_ram_cache[tile].get();
+  std::unique_lock lock(m_mutex);
+  auto it = m_tiles.find(tile);
+
+  if (it != m_tiles.end() && it->second.state == TileState::RESIDENT) {
+    return it->second.image.get();
   } else {
     return nullptr;
   }
 }
 
-void TileService::request_tile(const TileId& tile)
+TileState TileService::tile_state(const TileId& tile)
+{
+  std::unique_lock lock(m_mutex);
+  auto it = m_tiles.find(tile);
+  return it != m_tiles.end() ? it->second.state : TileState::ABSENT;
+}
+
+TileServiceStats TileService::stats()
+{
+  TileServiceStats stats;
+  stats.requested = m_source_requests;
+  stats.downloaded_bytes = m_downloaded_bytes;
+
+  std::unique_lock lock(m_mutex);
+  stats.resident = m_state_counts[size_t(TileState::RESIDENT)];
+  stats.in_flight = m_state_counts[size_t(TileState::IN_FLIGHT)];
+  stats.failed = m_state_counts[size_t(TileState::FAILED)];
+  stats.not_available = m_state_counts[size_t(TileState::NOT_AVAILABLE)];
+
+  return stats;
+}
+
+void TileService::prefetch(const std::vector<TileId>& tiles)
+{
+  std::unique_lock lock(m_mutex);
+
+  // token bucket, allows bursts of up to one second of bandwidth
+  auto now = prefetch_clock();
+  float elapsed = m_last_prefetch ? std::chrono::duration<float>(now - *m_last_prefetch).count() : 0.0f;
+  m_last_prefetch = now;
+
+  m_prefetch_budget = std::min(m_prefetch_budget + prefetch_bandwidth * elapsed, prefetch_bandwidth);
+
+  // every request pays its estimated size up front, so a small budget is not spent several times
+  for (const auto& tile : tiles) {
+    if (m_pending_requests >= m_max_concurrent_requests || m_prefetch_budget <= 0.0f) {
+      break;
+    }
+
+    auto it = m_tiles.find(tile);
+
+    if (it == m_tiles.end() || should_request(it->second)) {
+      request_tile(tile, true);
+    }
+  }
+}
+
+bool TileService::should_request(const TileEntry& entry) const
+{
+  switch (entry.state) {
+    case TileState::ABSENT:
+      return true;
+    case TileState::FAILED:
+      return entry.retry_after <= Clock::now();
+    default:
+      return false;
+  }
+}
+
+void TileService::set_state(TileEntry& entry, TileState state)
+{
+  if (entry.state != TileState::ABSENT) m_state_counts[size_t(entry.state)]--;
+  if (state != TileState::ABSENT) m_state_counts[size_t(state)]++;
+  entry.state = state;
+}
+
+std::shared_ptr<std::promise<Image*>> TileService::begin_request(TileEntry& entry)
+{
+  auto promise = std::make_shared<std::promise<Image*>>();
+  set_state(entry, TileState::IN_FLIGHT);
+  entry.request = promise->get_future().share();
+  return promise;
+}
+
+Image* TileService::finish_request(const TileId& tile, std::unique_ptr<Image> image, bool not_available)
+{
+  std::unique_lock lock(m_mutex);
+  TileEntry& entry = m_tiles[tile];
+  entry.request = {};
+
+  if (image) {
+    set_state(entry, TileState::RESIDENT);
+    entry.image = std::move(image);
+    entry.failures = 0;
+  } else if (not_available) {
+    set_state(entry, TileState::NOT_AVAILABLE);
+  } else {
+    auto delay = std::min(RETRY_DELAY * (1 << std::min(entry.failures, 16U)), MAX_RETRY_DELAY);
+    set_state(entry, TileState::FAILED);
+    entry.retry_after = Clock::now() + delay;
+    entry.failures++;
+  }
+
+  return entry.image.get();
+}
+
+void TileService::finish_prefetch(float reserved_bytes, size_t downloaded_bytes)
+{
+  std::unique_lock lock(m_mutex);
+  m_prefetch_budget += reserved_bytes - float(downloaded_bytes);
+
+  // tiles from the disk cache are free and say nothing about the size of a download
+  if (downloaded_bytes > 0) {
+    m_prefetch_tile_size = 0.8f * m_prefetch_tile_size + 0.2f * float(downloaded_bytes);
+  }
+}
+
+void TileService::request_tile(const TileId& tile, bool prefetch)
 {
-  m_already_requested.insert(tile);
+  auto promise = begin_request(m_tiles[tile]);
+  m_pending_requests++;
 
-  auto tile_request = [this, tile]() {
-    auto image = download_tile(tile);
-    if (image) m_ram_cache[tile] = std::move(image);
+  float reserved_bytes = prefetch ? m_prefetch_tile_size : 0.0f;
+  m_prefetch_budget -= reserved_bytes;
+
+  auto tile_request = [this, tile, prefetch, reserved_bytes, promise]() {
+    size_t downloaded_bytes = 0;
+    bool not_available = false;
+    auto image = download_tile(tile, &downloaded_bytes, &not_available);
+
+    Image* result = finish_request(tile, std::move(image), not_available);
+
+    // before the waiting threads continue, so they see the worker idle and the bytes spent
+    if (prefetch) finish_prefetch(reserved_bytes, downloaded_bytes);
+    m_pending_requests--;
+
+    promise->set_value(result);
   };
 
   m_thread_pool.assign_work(tile_request);
 }
 
-std::unique_ptr<Image> TileService::download_tile(const TileId& tile)
+std::unique_ptr<Image> TileService::download_tile(const TileId& tile, size_t* downloaded_bytes, bool* not_available)
 {
-#if CACHE_ON_DISK
-  if (is_saved_on_disk(tile)) {
-    auto image = load_from_disk(tile);
+  TileValidators validators;
+  bool revalidate = false;
+
+  if (m_cache_on_disk) {
+    if (is_marked_not_available(tile)) {
+      if (not_available) *not_available = true;
+      return nullptr;
+    }
 
-    if (image) {
+    if (is_saved_on_disk(tile)) {
+      if (needs_revalidation(tile_filename(tile))) {
+        // only download the tile again if it changed on the server
+        std::ifstream file(validators_filename(tile));
+        std::getline(file, validators.etag);
+        std::getline(file, validators.last_modified);
+        revalidate = true;
+      } else {
+        auto image = load_from_disk(tile_filename(tile));
+
+        if (image) {
 #if LOG_REQUESTS
-      std::cout << "Load from disk: " << m_cache_dir << " " << tile << "\n";
+          std::cout << "Load from disk: " << m_cache_dir << " " << tile << "\n";
 #endif
-      return image;
+          return image;
+        }
+      }
     }
   }
-#endif
 
-  auto url = tile_url(tile);
-  cpr::Response r = cpr::Get(cpr::Url{url});
+  if (!revalidate && !m_bundle_dir.empty() && std::filesystem::exists(bundled_filename(tile))) {
+    auto image = load_from_disk(bundled_filename(tile));
+    if (image) return image;
+  }
 
-  if (r.status_code != 200) {
-    std::cerr << "Error " << r.status_code << " " << std::quoted(url) << "\n";
+  FetchResult result = m_source->fetch(tile, revalidate ? &validators : nullptr);
+  m_source_requests++;
+  m_downloaded_bytes += result.bytes.size();
+
+  if (revalidate && result.status != FetchStatus::OK) {
+    if (result.status == FetchStatus::NOT_MODIFIED) {
+      std::error_code error;
+      std::filesystem::last_write_time(tile_filename(tile), std::chrono::file_clock::now(), error);
+    } else {
+      // an outdated tile is still better than no tile
+      std::cerr << "Could not revalidate " << tile << "\n";
+    }
+    return load_from_disk(tile_filename(tile));
+  }
+
+  if (result.status == FetchStatus::NOT_AVAILABLE) {
+    if (m_cache_on_disk) {
+      std::ofstream marker(not_available_filename(tile));
+    }
+    if (not_available) *not_available = true;
+    return nullptr;
+  }
+
+  // the source reports its errors
+  if (result.status != FetchStatus::OK) {
     return nullptr;
   }
 
 #if LOG_REQUESTS
-  std::cout << "Load from web: " << tile << "\n";
+  std::cout << "Load from source: " << tile << "\n";
 #endif
 
+  if (downloaded_bytes) {
+    *downloaded_bytes = result.bytes.size();
+  }
+
   auto image = std::make_unique<Image>();
-  image->read_from_buffer(reinterpret_cast<unsigned char*>(r.text.data()), int(r.text.size()));
+  image->read_from_buffer(result.bytes.data(), int(result.bytes.size()));
 
   if (!image->loaded()) {
     std::cerr << "Could not read " << tile << "\n";
     return nullptr;
   }
 
-#if CACHE_ON_DISK
-  save_to_disk(tile, image.get());
-#endif
+  if (m_cache_on_disk) {
+    save_to_disk(tile, image.get());
+
+    if (!result.validators.empty()) {
+      std::ofstream file(validators_filename(tile));
+      file << result.validators.etag << "\n" << result.validators.last_modified << "\n";
+    }
+  }
 
   return image;
 }
 
+bool TileService::download_to_disk(const TileId& tile, size_t* downloaded_bytes)
+{
+  if (is_saved_on_disk(tile)) {
+    return true;
+  }
+
+  auto image = download_tile(tile, downloaded_bytes);
+
+  // tiles of local sources are on disk already
+  if (image && !m_cache_on_disk && !m_source->is_local()) save_to_disk(tile, image.get());
+
+  return image != nullptr;
+}
 void TileService::save_to_disk(const TileId& tile, const Image* image) const
 {
   assert(image);
   image->write(tile_filename(tile));
 }
 
-std::unique_ptr<Image> TileService::load_from_disk(const TileId& tile) const
+std::unique_ptr<Image> TileService::load_from_disk(const std::string& filename) const
 {
   auto image = std::make_unique<Image>();
-  image->read(tile_filename(tile));
+  image->read(filename);
 
   if (!image->loaded()) {
     return nullptr;
@@ -163,3 +403,9 @@ std::unique_ptr<Image> TileService::load_from_disk(const TileId& tile) const
 }
 
 bool TileService::is_saved_on_disk(const TileId& tile) const { return std::filesystem::exists(tile_filename(tile)); }
+
+bool TileService::is_marked_not_available(const TileId& tile) const
+{
+  auto filename = not_available_filename(tile);
+  return std::filesystem::exists(filename) && !needs_revalidation(filename);
+}
@@ -1,55 +1,167 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
 #include <iostream>
-#include <set>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <unordered_map>
 
 #include "../gfx/image.h"
 #include "Threading.h"
+#include "TileSource.h"
 #include "TileUtils.h"
 
 using namespace gfx;
 
-enum UrlPattern {
-  ZXY_Y_NORTH,
-  ZXY_Y_SOUTH,
-  ZYX_Y_NORTH,
-  ZYX_Y_SOUTH,
+enum class TileState {
+  ABSENT,         // never requested
+  IN_FLIGHT,      // download or disk read in progress
+  RESIDENT,       // in memory
+  FAILED,         // transient error, retried after a delay
+  NOT_AVAILABLE,  // the server does not have this tile
 };
 
+struct TileServiceStats {
+  size_t requested{0};  // requests to the tile source
+  size_t downloaded_bytes{0};
+  size_t resident{0}, in_flight{0}, failed{0}, not_available{0};
+};
+
+struct TileServiceConfig {
+  std::string url;  // or the directory or file of a local source
+  UrlPattern url_pattern;
+  std::string filetype, cache_dir;
+
+  // read-only tiles shipped with the application, e.g. a low zoom base pyramid
+  // created with the seed tool. Used if a tile is not in the cache.
+  std::string bundle_dir;
+
+  // number of worker threads, every worker keeps one connection alive
+  unsigned max_concurrent_requests{3};
+
+  std::chrono::milliseconds timeout{10000}, connect_timeout{3000};
+
+  // tiles on disk that are older than this are revalidated with the server, zero disables revalidation
+  std::chrono::seconds max_age{0};
+
+  TileSourceType source{TileSourceType::HTTP};
+};
+
+std::unique_ptr<TileSource> create_tile_source(const TileServiceConfig&);
+
 class TileService
 {
  public:
   TileService(const std::string& url, const UrlPattern& url_pattern, const std::string& filetype = "png",
               const std::string& cache_dir = "");
 
+  explicit TileService(const TileServiceConfig&);
+
+  // Tiles come from the given source, the url and source type of the config are not used.
+  TileService(const TileServiceConfig&, std::unique_ptr<TileSource>);
+
   // If tile in cache, return tile. If not, request it for download and return nullptr.
   Image* get_tile(const TileId&);
 
-  // Download tile and return it.
+  // Download tile and return it. If the tile is already requested, wait for
+  // that request instead of downloading it twice.
   Image* get_tile_sync(const TileId&);
 
   Image* get_tile_cached(const TileId&);
 
+  TileState tile_state(const TileId&);
+
+  TileServiceStats stats();
+
+  // Request tiles that will probably be needed soon, most urgent first. Tiles
+  // are only prefetched while some workers are idle, so regular requests are
+  // not delayed.
+  void prefetch(const std::vector<TileId>&);
+
+  // Download tile into the disk cache without keeping it in memory. Returns
+  // true if the tile is on disk afterwards, for local sources if the source
+  // has it. Safe to call from any thread.
+  bool download_to_disk(const TileId&, size_t* downloaded_bytes = nullptr);
+
+  bool is_saved_on_disk(const TileId&) const;
+
+  // the source did not have this tile before
+  bool is_marked_not_available(const TileId&) const;
+
+  inline const std::string& cache_dir() const { return m_cache_dir; }
+
+  // bytes per second that may be downloaded by prefetching
+  float prefetch_bandwidth{1e6f};
+
+  // the time the prefetch bandwidth is measured in, tests advance it by hand
+  std::function<std::chrono::steady_clock::time_point()> prefetch_clock{std::chrono::steady_clock::now};
+
  private:
-  const UrlPattern m_url_pattern;
-  const std::string m_url, m_filetype, m_cache_dir;
-  ThreadPool m_thread_pool;
-  std::set<TileId> m_already_requested;
-  std::unordered_map<TileId, std::unique_ptr<Image>> m_ram_cache;
+  using Clock = std::chrono::steady_clock;
+
+  struct TileEntry {
+    TileState state{TileState::ABSENT};
+    std::unique_ptr<Image> image;
+    std::shared_future<Image*> request;  // valid while in flight
+    unsigned failures{0};
+    Clock::time_point retry_after;
+  };
+
+  const std::unique_ptr<TileSource> m_source;
+  const bool m_cache_on_disk;  // tiles of local sources are not copied
+  const std::string m_cache_dir, m_bundle_dir;
+  const unsigned m_max_concurrent_requests;
+  const std::chrono::seconds m_max_age;
+  std::mutex m_mutex;
+  std::unordered_map<TileId, TileEntry> m_tiles;
+  std::array<size_t, 5> m_state_counts{};  // entries of m_tiles per TileState, ABSENT is not counted
+  std::atomic<unsigned> m_pending_requests{0};
+  std::atomic<size_t> m_source_requests{0}, m_downloaded_bytes{0};
+
+  // token bucket of the prefetch bandwidth in bytes, m_mutex must be locked
+  float m_prefetch_budget{0.0f};
+  float m_prefetch_tile_size{16384.0f};  // estimated, paid when a tile is requested
+  std::optional<Clock::time_point> m_last_prefetch;
+  ThreadPool m_thread_pool;  // last, so the workers are joined before the tiles are destroyed
+
+  // true if the tile should be requested now, m_mutex must be locked
+  bool should_request(const TileEntry&) const;
+
+  // keeps m_state_counts up to date, m_mutex must be locked
+  void set_state(TileEntry&, TileState);
 
-  void request_tile(const TileId&);
+  // mark the tile as in flight, m_mutex must be locked
+  std::shared_ptr<std::promise<Image*>> begin_request(TileEntry&);
 
-  std::unique_ptr<Image> download_tile(const TileId&);
+  Image* finish_request(const TileId&, std::unique_ptr<Image>, bool not_available);
 
-  std::string tile_url(const TileId&) const;
+  // replace the estimated size of a prefetched tile with what it really cost
+  void finish_prefetch(float reserved_bytes, size_t downloaded_bytes);
+
+  // m_mutex must be locked
+  void request_tile(const TileId&, bool prefetch = false);
+
+  std::unique_ptr<Image> download_tile(const TileId&, size_t* downloaded_bytes = nullptr, bool* not_available = nullptr);
 
   std::string tile_filename(const TileId&) const;
 
-  void save_to_disk(const TileId&, const Image*) const;
+  std::string bundled_filename(const TileId&) const;
 
-  std::unique_ptr<Image> load_from_disk(const TileId&) const;
+  // ETag and Last-Modified of the tile on disk
+  std::string validators_filename(const TileId&) const;
 
-  bool is_saved_on_disk(const TileId&) const;
+  // marks a tile the server does not have
+  std::string not_available_filename(const TileId&) const;
+
+  // file is older than max_age
+  bool needs_revalidation(const std::string& filename) const;
+
+  void save_to_disk(const TileId&, const Image*) const;
+
+  std::unique_ptr<Image> load_from_disk(const std::string& filename) const;
 };
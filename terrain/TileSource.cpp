@@ -0,0 +1,548 @@
+#include "TileSource.h"
+
+#include <cpr/cpr.h>
+#include <fmt/core.h>
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <iomanip>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// web mercator is 2 * pi * 6378137 meters wide and high
+#define MERCATOR_WIDTH 40075016.685578488
+
+// overviews and tiles of a GeoTIFF have to line up with the tile grid within this fraction of a tile
+#define GRID_TOLERANCE 1e-3
+
+static std::string tile_path(const std::string& base, UrlPattern url_pattern, const TileId& tile,
+                             const std::string& filetype)
+{
+  const unsigned num_y_tiles = (1 << tile.zoom);
+
+  switch (url_pattern) {
+    case ZXY_Y_NORTH: {
+      return fmt::format("{}/{}/{}/{}{}", base, tile.zoom, tile.x, (num_y_tiles - tile.y - 1), filetype);
+    }
+    case ZYX_Y_NORTH: {
+      return fmt::format("{}/{}/{}/{}{}", base, tile.zoom, (num_y_tiles - tile.y - 1), tile.x, filetype);
+    }
+    case ZYX_Y_SOUTH: {
+      return fmt::format("{}/{}/{}/{}{}", base, tile.zoom, tile.y, tile.x, filetype);
+    }
+    case ZXY_Y_SOUTH: {
+      return fmt::format("{}/{}/{}/{}{}", base, tile.zoom, tile.x, tile.y, filetype);
+    }
+    default:
+      assert(false);
+      return "";
+  }
+}
+
+HttpTileSource::HttpTileSource(const std::string& url, UrlPattern url_pattern, const std::string& filetype,
+                               std::chrono::milliseconds timeout, std::chrono::milliseconds connect_timeout)
+    : m_url(url),
+      m_filetype(filetype),
+      m_url_pattern(url_pattern),
+      m_timeout(timeout),
+      m_connect_timeout(connect_timeout)
+{
+}
+
+// cpr sessions are not thread safe, so every thread keeps its own. Reusing
+// the session keeps the connection alive between requests.
+static cpr::Session& thread_session()
+{
+  thread_local cpr::Session session;
+  return session;
+}
+
+std::string HttpTileSource::tile_url(const TileId& tile) const
+{
+  return tile_path(m_url, m_url_pattern, tile, m_filetype);
+}
+
+FetchResult HttpTileSource::fetch(const TileId& tile, const TileValidators* validators)
+{
+  cpr::Header header;
+
+  if (validators) {
+    if (!validators->etag.empty()) header["If-None-Match"] = validators->etag;
+    if (!validators->last_modified.empty()) header["If-Modified-Since"] = validators->last_modified;
+  }
+
+  auto url = tile_url(tile);
+
+  cpr::Session& session = thread_session();
+  session.SetUrl(cpr::Url{url});
+  session.SetHeader(header);
+  session.SetTimeout(cpr::Timeout{m_timeout});
+  session.SetConnectTimeout(cpr::ConnectTimeout{m_connect_timeout});
+  // falls back to HTTP/1.1 if the server does not support HTTP/2
+  session.SetHttpVersion(cpr::HttpVersion{cpr::HttpVersionCode::VERSION_2_0_TLS});
+
+  cpr::Response r = session.Get();
+  FetchResult result;
+
+  if (r.status_code == 200) {
+    result.status = FetchStatus::OK;
+    result.bytes.assign(r.text.begin(), r.text.end());
+    if (r.header.contains("ETag")) result.validators.etag = r.header["ETag"];
+    if (r.header.contains("Last-Modified")) result.validators.last_modified = r.header["Last-Modified"];
+  } else if (r.status_code == 304 && validators) {
+    result.status = FetchStatus::NOT_MODIFIED;
+  } else if (r.status_code == 404 || r.status_code == 410) {
+    result.status = FetchStatus::NOT_AVAILABLE;
+  } else {
+    std::cerr << "Error " << r.status_code << " " << std::quoted(url) << " " << r.error.message << "\n";
+  }
+
+  return result;
+}
+
+DirectoryTileSource::DirectoryTileSource(const std::string& dir, UrlPattern url_pattern, const std::string& filetype)
+    : m_dir(dir), m_filetype(filetype), m_url_pattern(url_pattern)
+{
+  if (!std::filesystem::is_directory(m_dir)) {
+    std::cerr << "Tile directory " << std::quoted(m_dir) << " does not exist\n";
+  }
+}
+
+std::string DirectoryTileSource::tile_filename(const TileId& tile) const
+{
+  return tile_path(m_dir, m_url_pattern, tile, m_filetype);
+}
+
+FetchResult DirectoryTileSource::fetch(const TileId& tile, const TileValidators*)
+{
+  // one open and one read, tiles are too small for mapping them to pay off
+  std::ifstream file(tile_filename(tile), std::ios::binary | std::ios::ate);
+
+  if (!file) {
+    return {FetchStatus::NOT_AVAILABLE};
+  }
+
+  FetchResult result;
+  result.bytes.resize(size_t(file.tellg()));
+  file.seekg(0);
+
+  if (file.read(reinterpret_cast<char*>(result.bytes.data()), std::streamsize(result.bytes.size()))) {
+    result.status = FetchStatus::OK;
+  } else {
+    std::cerr << "Could not read " << std::quoted(tile_filename(tile)) << "\n";
+    result.bytes.clear();
+  }
+
+  return result;
+}
+
+MBTilesTileSource::MBTilesTileSource(const std::string& filename)
+{
+  // the connection is only used with m_mutex locked, so sqlite does not need to lock it again
+  int status = sqlite3_open_v2(filename.c_str(), &m_db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+
+  if (status == SQLITE_OK) {
+    status = sqlite3_prepare_v2(m_db,
+                                "SELECT tile_data FROM tiles WHERE zoom_level = ?1 AND tile_column = ?2 AND "
+                                "tile_row = ?3",
+                                -1, &m_statement, nullptr);
+  }
+
+  if (status != SQLITE_OK) {
+    std::cerr << "Could not open " << std::quoted(filename) << ": " << sqlite3_errmsg(m_db) << "\n";
+  }
+}
+
+MBTilesTileSource::~MBTilesTileSource()
+{
+  sqlite3_finalize(m_statement);
+  sqlite3_close(m_db);
+}
+
+FetchResult MBTilesTileSource::fetch(const TileId& tile, const TileValidators*)
+{
+  if (!m_statement) {
+    return {FetchStatus::FAILED};
+  }
+
+  const int64_t row = (int64_t(1) << tile.zoom) - 1 - int64_t(tile.y);
+
+  std::unique_lock lock(m_mutex);
+  sqlite3_bind_int(m_statement, 1, int(tile.zoom));
+  sqlite3_bind_int64(m_statement, 2, int64_t(tile.x));
+  sqlite3_bind_int64(m_statement, 3, row);
+
+  FetchResult result;
+  int status = sqlite3_step(m_statement);
+
+  if (status == SQLITE_ROW) {
+    auto data = static_cast<const uint8_t*>(sqlite3_column_blob(m_statement, 0));
+    result.bytes.assign(data, data + sqlite3_column_bytes(m_statement, 0));
+    result.status = FetchStatus::OK;
+  } else if (status == SQLITE_DONE) {
+    result.status = FetchStatus::NOT_AVAILABLE;
+  } else {
+    std::cerr << "Could not read tile " << tile.to_string() << ": " << sqlite3_errmsg(m_db) << "\n";
+  }
+
+  sqlite3_reset(m_statement);
+  return result;
+}
+
+// TIFF and GeoTIFF tags
+enum TiffTag : uint16_t {
+  NEW_SUBFILE_TYPE = 254,
+  IMAGE_WIDTH = 256,
+  IMAGE_LENGTH = 257,
+  COMPRESSION = 259,
+  TILE_WIDTH = 322,
+  TILE_LENGTH = 323,
+  TILE_OFFSETS = 324,
+  TILE_BYTE_COUNTS = 325,
+  JPEG_TABLES = 347,
+  MODEL_PIXEL_SCALE = 33550,
+  MODEL_TIEPOINT = 33922,
+  GEO_KEY_DIRECTORY = 34735,
+};
+
+#define TIFF_COMPRESSION_JPEG     7
+#define TIFF_SUBFILE_MASK         4
+#define GEO_KEY_PROJECTED_CS_TYPE 3072
+#define EPSG_WEB_MERCATOR         3857
+
+// bytes per value of the TIFF field types, zero for unknown types
+static unsigned tiff_type_size(unsigned type)
+{
+  static const unsigned sizes[] = {0, 1, 1, 2, 4, 8, 1, 1, 2, 4, 8, 4, 8, 0, 0, 0, 8, 8, 8};
+  return type < std::size(sizes) ? sizes[type] : 0;
+}
+
+GeoTiffTileSource::GeoTiffTileSource(const std::string& filename)
+{
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  m_file = file != INVALID_HANDLE_VALUE ? file : nullptr;
+  if (!m_file) {
+#else
+  m_file = open(filename.c_str(), O_RDONLY);
+  if (m_file < 0) {
+#endif
+    std::cerr << "Could not open " << std::quoted(filename) << "\n";
+    return;
+  }
+
+  if (!read_index()) {
+    std::cerr << "Could not read tiles of " << std::quoted(filename) << "\n";
+    m_levels.clear();
+  }
+}
+
+std::vector<unsigned> GeoTiffTileSource::zoom_levels() const
+{
+  std::vector<unsigned> zoom_levels;
+  for (const Level& level : m_levels) zoom_levels.push_back(level.zoom);
+  return zoom_levels;
+}
+
+GeoTiffTileSource::~GeoTiffTileSource()
+{
+#ifdef _WIN32
+  if (m_file) CloseHandle(m_file);
+#else
+  if (m_file >= 0) close(m_file);
+#endif
+}
+
+bool GeoTiffTileSource::read(uint64_t offset, void* data, size_t size) const
+{
+  uint8_t* bytes = static_cast<uint8_t*>(data);
+
+  // a read may return fewer bytes than asked for
+  while (size > 0) {
+#ifdef _WIN32
+    if (!m_file) return false;
+
+    OVERLAPPED position{};
+    position.Offset = DWORD(offset & 0xffffffff);
+    position.OffsetHigh = DWORD(offset >> 32);
+
+    DWORD count = 0;
+    const DWORD chunk = DWORD(std::min<size_t>(size, 1U << 30));
+    if (!ReadFile(m_file, bytes, chunk, &count, &position) || count == 0) return false;
+#else
+    const ssize_t count = pread(m_file, bytes, size, off_t(offset));
+    if (count <= 0) return false;
+#endif
+    bytes += count;
+    offset += uint64_t(count);
+    size -= size_t(count);
+  }
+
+  return true;
+}
+
+uint64_t GeoTiffTileSource::read_uint(uint64_t offset, unsigned size) const
+{
+  assert(size <= 8);
+  uint8_t bytes[8] = {};
+  if (!read(offset, bytes, size)) return 0;
+
+  uint64_t value = 0;
+  for (unsigned i = 0; i < size; ++i) {
+    value |= uint64_t(bytes[m_little_endian ? i : size - 1 - i]) << (8 * i);
+  }
+  return value;
+}
+
+uint64_t GeoTiffTileSource::array_element(const TiffArray& array, uint64_t index) const
+{
+  if (!array.values.empty()) {
+    return index < array.values.size() ? array.values[index] : 0;
+  }
+
+  return read_uint(array.offset + index * array.element_size, array.element_size);
+}
+
+bool GeoTiffTileSource::read_index()
+{
+  char byte_order[2];
+  if (!read(0, byte_order, 2)) return false;
+
+  if (byte_order[0] == 'I' && byte_order[1] == 'I') {
+    m_little_endian = true;
+  } else if (byte_order[0] == 'M' && byte_order[1] == 'M') {
+    m_little_endian = false;
+  } else {
+    return false;
+  }
+
+  const uint64_t version = read_uint(2, 2);
+  if (version != 42 && version != 43) return false;
+
+  // BigTIFF has 64 bit offsets and counts
+  m_big_tiff = version == 43;
+  const unsigned offset_size = m_big_tiff ? 8 : 4;
+  uint64_t ifd = read_uint(m_big_tiff ? 8 : 4, offset_size);
+
+  struct Field {
+    unsigned type{0};
+    uint64_t count{0}, offset{0};  // offset of the values, which might be in the IFD itself
+  };
+
+  // georeferencing of the full resolution image, the overviews only have their size
+  double scale = 0.0, origin_x = 0.0, origin_y = 0.0, full_width = 0.0;
+
+  for (unsigned image = 0; ifd != 0 && image < 64; ++image) {
+    const uint64_t num_fields = read_uint(ifd, m_big_tiff ? 8 : 2);
+    const uint64_t first_field = ifd + (m_big_tiff ? 8 : 2);
+    const unsigned field_size = m_big_tiff ? 20 : 12;
+    if (num_fields == 0 || num_fields > 4096) return false;
+
+    std::unordered_map<uint16_t, Field> fields;
+
+    for (uint64_t i = 0; i < num_fields; ++i) {
+      const uint64_t entry = first_field + i * field_size;
+      Field field;
+      field.type = unsigned(read_uint(entry + 2, 2));
+      field.count = read_uint(entry + 4, offset_size);
+      field.offset = entry + 4 + offset_size;
+
+      if (tiff_type_size(field.type) * field.count > offset_size) {
+        field.offset = read_uint(field.offset, offset_size);
+      }
+
+      fields[uint16_t(read_uint(entry, 2))] = field;
+    }
+
+    ifd = read_uint(first_field + num_fields * field_size, offset_size);
+
+    auto value = [&](uint16_t tag, uint64_t index = 0) -> uint64_t {
+      auto it = fields.find(tag);
+      if (it == fields.end() || it->second.count <= index) return 0;
+      const unsigned size = tiff_type_size(it->second.type);
+      return read_uint(it->second.offset + index * size, size);
+    };
+
+    auto real = [&](uint16_t tag, uint64_t index) { return std::bit_cast<double>(value(tag, index)); };
+
+    auto array = [&](uint16_t tag) {
+      TiffArray array;
+      const Field& field = fields[tag];
+      array.element_size = tiff_type_size(field.type);
+
+      if (array.element_size * field.count <= offset_size) {
+        for (uint64_t i = 0; i < field.count; ++i) array.values.push_back(value(tag, i));
+      } else {
+        array.offset = field.offset;
+      }
+      return array;
+    };
+
+    if (value(NEW_SUBFILE_TYPE) & TIFF_SUBFILE_MASK) continue;
+
+    if (!fields.contains(TILE_WIDTH) || !fields.contains(TILE_OFFSETS) || !fields.contains(TILE_BYTE_COUNTS)) {
+      std::cerr << "GeoTIFF is not tiled\n";
+      return false;
+    }
+
+    const uint64_t width = value(IMAGE_WIDTH), height = value(IMAGE_LENGTH);
+    const uint64_t tile_width = value(TILE_WIDTH), tile_height = value(TILE_LENGTH);
+    if (width == 0 || height == 0 || tile_width == 0 || tile_width != tile_height) return false;
+
+    if (scale == 0.0) {
+      if (!fields.contains(MODEL_PIXEL_SCALE) || !fields.contains(MODEL_TIEPOINT)) {
+        std::cerr << "GeoTIFF is not georeferenced\n";
+        return false;
+      }
+
+      // keys of four shorts after a header of the same size
+      if (fields.contains(GEO_KEY_DIRECTORY)) {
+        for (uint64_t key = 1; key <= value(GEO_KEY_DIRECTORY, 3); ++key) {
+          if (value(GEO_KEY_DIRECTORY, key * 4) == GEO_KEY_PROJECTED_CS_TYPE &&
+              value(GEO_KEY_DIRECTORY, key * 4 + 3) != EPSG_WEB_MERCATOR) {
+            std::cerr << "GeoTIFF is not in EPSG:3857\n";
+            return false;
+          }
+        }
+      }
+
+      scale = real(MODEL_PIXEL_SCALE, 0);
+      origin_x = real(MODEL_TIEPOINT, 3) - real(MODEL_TIEPOINT, 0) * scale;
+      origin_y = real(MODEL_TIEPOINT, 4) + real(MODEL_TIEPOINT, 1) * scale;
+      full_width = double(width);
+      if (!(scale > 0.0)) return false;
+    }
+
+    // Overviews halve the size, rounded up, so their scale is only approximately a power of two. The zoom
+    // level of the full resolution image has to match exactly.
+    const double reduction = std::round(std::log2(full_width / double(width)));
+    const double zoom = std::log2(MERCATOR_WIDTH / (scale * double(tile_width))) - reduction;
+    const double tile_size = MERCATOR_WIDTH / std::exp2(std::round(zoom));
+    const double first_x = (origin_x + MERCATOR_WIDTH / 2.0) / tile_size;
+    const double first_y = (MERCATOR_WIDTH / 2.0 - origin_y) / tile_size;
+
+    auto aligned = [](double value) { return std::abs(value - std::round(value)) < GRID_TOLERANCE; };
+
+    if (!aligned(zoom) || !aligned(first_x) || !aligned(first_y) || std::round(zoom) < 0.0 ||
+        TileId::MAX_ZOOM < std::round(zoom) || std::round(first_x) < 0.0 || std::round(first_y) < 0.0) {
+      std::cerr << "Skipped image " << image << " of the GeoTIFF, its tiles do not line up with the tile grid\n";
+      continue;
+    }
+
+    if (value(COMPRESSION) != TIFF_COMPRESSION_JPEG) {
+      std::cerr << "Skipped image " << image << " of the GeoTIFF, compression " << value(COMPRESSION)
+                << " is not supported\n";
+      continue;
+    }
+
+    Level level;
+    level.zoom = unsigned(std::round(zoom));
+    level.first_x = uint64_t(std::round(first_x));
+    level.first_y = uint64_t(std::round(first_y));
+    level.tiles_across = (width + tile_width - 1) / tile_width;
+    level.tiles_down = (height + tile_height - 1) / tile_height;
+    level.offsets = array(TILE_OFFSETS);
+    level.byte_counts = array(TILE_BYTE_COUNTS);
+
+    if (fields[TILE_OFFSETS].count < level.tiles_across * level.tiles_down ||
+        fields[TILE_BYTE_COUNTS].count < level.tiles_across * level.tiles_down) {
+      return false;
+    }
+
+    if (fields.contains(JPEG_TABLES)) {
+      level.jpeg_tables.resize(fields[JPEG_TABLES].count);
+      if (!read(fields[JPEG_TABLES].offset, level.jpeg_tables.data(), level.jpeg_tables.size())) return false;
+    }
+
+    m_levels.push_back(std::move(level));
+  }
+
+  return !m_levels.empty();
+}
+
+FetchResult GeoTiffTileSource::fetch(const TileId& tile, const TileValidators*)
+{
+  for (const Level& level : m_levels) {
+    if (level.zoom != tile.zoom) continue;
+
+    if (tile.x < level.first_x || tile.y < level.first_y || level.first_x + level.tiles_across <= tile.x ||
+        level.first_y + level.tiles_down <= tile.y) {
+      return {FetchStatus::NOT_AVAILABLE};
+    }
+
+    const uint64_t index = (tile.y - level.first_y) * level.tiles_across + (tile.x - level.first_x);
+
+    const uint64_t offset = array_element(level.offsets, index);
+    const uint64_t size = array_element(level.byte_counts, index);
+
+    // sparse files leave out empty tiles
+    if (size == 0) {
+      return {FetchStatus::NOT_AVAILABLE};
+    }
+
+    // An abbreviated JPEG stream, the tables go between its start of image marker and the rest. They have
+    // their own start and end of image markers.
+    const size_t tables = level.jpeg_tables.size() >= 4 ? level.jpeg_tables.size() - 4 : 0;
+
+    FetchResult result;
+    result.bytes.resize(tables + size);
+
+    if (size < 2 || !read(offset, result.bytes.data() + tables, size)) {
+      std::cerr << "Could not read tile " << tile.to_string() << " of the GeoTIFF\n";
+      return {FetchStatus::FAILED};
+    }
+
+    if (tables > 0) {
+      std::copy_n(result.bytes.begin() + tables, 2, result.bytes.begin());
+      std::copy_n(level.jpeg_tables.begin() + 2, tables, result.bytes.begin() + 2);
+    }
+
+    result.status = FetchStatus::OK;
+    return result;
+  }
+
+  return {FetchStatus::NOT_AVAILABLE};
+}
+
+std::optional<TileSourceType> parse_tile_source_type(const std::string& name)
+{
+  if (name == "http") return TileSourceType::HTTP;
+  if (name == "directory") return TileSourceType::DIRECTORY;
+  if (name == "mbtiles") return TileSourceType::MBTILES;
+  if (name == "geotiff") return TileSourceType::GEOTIFF;
+  return std::nullopt;
+}
+
+TileSourceType guess_tile_source_type(const std::string& location)
+{
+  if (location.starts_with("http://") || location.starts_with("https://")) {
+    return TileSourceType::HTTP;
+  }
+
+  std::string extension = std::filesystem::path(location).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return char(std::tolower(c)); });
+
+  if (extension == ".mbtiles") return TileSourceType::MBTILES;
+  if (extension == ".tif" || extension == ".tiff") return TileSourceType::GEOTIFF;
+
+  std::error_code error;
+  if (std::filesystem::is_directory(location, error)) return TileSourceType::DIRECTORY;
+
+  return TileSourceType::HTTP;
+}
@@ -0,0 +1,174 @@
+/*
+  Where a TileService gets its tiles from: a tile server, or local data for
+  offline use and benchmarks. fetch() is called by the workers of the
+  TileService, which makes it asynchronous, so sources block and have to be
+  thread safe.
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "TileUtils.h"
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+enum UrlPattern {
+  ZXY_Y_NORTH,
+  ZXY_Y_SOUTH,
+  ZYX_Y_NORTH,
+  ZYX_Y_SOUTH,
+};
+
+enum class TileSourceType {
+  HTTP,       // tile server, {url}/{z}/{x}/{y}{filetype} in the order of the url pattern
+  DIRECTORY,  // the same layout in a local directory
+  MBTILES,    // SQLite database in the MBTiles format
+  GEOTIFF,    // tiled GeoTIFF or Cloud Optimized GeoTIFF in web mercator
+};
+
+enum class FetchStatus {
+  OK,
+  NOT_MODIFIED,   // revalidated, the tile did not change
+  NOT_AVAILABLE,  // the source does not have this tile
+  FAILED,         // might succeed when retried
+};
+
+// ETag and Last-Modified of a tile from a tile server
+struct TileValidators {
+  std::string etag, last_modified;
+
+  inline bool empty() const { return etag.empty() && last_modified.empty(); }
+};
+
+struct FetchResult {
+  FetchStatus status{FetchStatus::FAILED};
+  std::vector<uint8_t> bytes;  // encoded image, e.g. PNG or JPEG
+  TileValidators validators;
+};
+
+class TileSource
+{
+ public:
+  virtual ~TileSource() = default;
+
+  // With validators, the tile is only fetched if it changed since, NOT_MODIFIED otherwise.
+  virtual FetchResult fetch(const TileId&, const TileValidators* validators = nullptr) = 0;
+
+  // Local sources are as fast as the disk cache, their tiles are neither cached nor revalidated.
+  virtual bool is_local() const = 0;
+};
+
+class HttpTileSource : public TileSource
+{
+ public:
+  HttpTileSource(const std::string& url, UrlPattern, const std::string& filetype,
+                 std::chrono::milliseconds timeout = std::chrono::milliseconds(10000),
+                 std::chrono::milliseconds connect_timeout = std::chrono::milliseconds(3000));
+
+  FetchResult fetch(const TileId&, const TileValidators* validators = nullptr) override;
+
+  inline bool is_local() const override { return false; }
+
+  std::string tile_url(const TileId&) const;
+
+ private:
+  const std::string m_url, m_filetype;
+  const UrlPattern m_url_pattern;
+  const std::chrono::milliseconds m_timeout, m_connect_timeout;
+};
+
+class DirectoryTileSource : public TileSource
+{
+ public:
+  DirectoryTileSource(const std::string& dir, UrlPattern, const std::string& filetype);
+
+  FetchResult fetch(const TileId&, const TileValidators* validators = nullptr) override;
+
+  inline bool is_local() const override { return true; }
+
+  std::string tile_filename(const TileId&) const;
+
+ private:
+  const std::string m_dir, m_filetype;
+  const UrlPattern m_url_pattern;
+};
+
+// Rows are flipped, MBTiles counts them from the south like TMS.
+class MBTilesTileSource : public TileSource
+{
+ public:
+  explicit MBTilesTileSource(const std::string& filename);
+  ~MBTilesTileSource() override;
+
+  FetchResult fetch(const TileId&, const TileValidators* validators = nullptr) override;
+
+  inline bool is_local() const override { return true; }
+
+ private:
+  sqlite3* m_db{nullptr};
+  sqlite3_stmt* m_statement{nullptr};  // prepared once, m_mutex must be locked to use it
+  std::mutex m_mutex;
+};
+
+// Reads the tiles of a GeoTIFF in EPSG:3857 whose tiles line up with the tile grid, e.g. a COG created by
+// GDAL with TILING_SCHEME=GoogleMapsCompatible. Every overview is one zoom level, overviews that do not line
+// up are skipped (see ALIGNED_LEVELS of GDAL). Only the index of the image is read on open, tiles are read
+// with one range read each, so large files open instantly. Only JPEG compressed tiles are supported, they
+// are returned without decoding.
+class GeoTiffTileSource : public TileSource
+{
+ public:
+  explicit GeoTiffTileSource(const std::string& filename);
+  ~GeoTiffTileSource() override;
+
+  FetchResult fetch(const TileId&, const TileValidators* validators = nullptr) override;
+
+  inline bool is_local() const override { return true; }
+
+  // zoom levels in the file
+  std::vector<unsigned> zoom_levels() const;
+
+ private:
+  // TileOffsets or TileByteCounts, read on demand unless stored in the IFD itself
+  struct TiffArray {
+    uint64_t offset{0};
+    unsigned element_size{0};
+    std::vector<uint64_t> values;
+  };
+
+  struct Level {
+    unsigned zoom{0};
+    uint64_t first_x{0}, first_y{0};  // tile of the upper left corner of the image
+    uint64_t tiles_across{0}, tiles_down{0};
+    TiffArray offsets, byte_counts;
+    std::vector<uint8_t> jpeg_tables;  // shared quantization and huffman tables
+  };
+
+  // read at an offset with pread or ReadFile, so the workers fetch tiles in parallel without a lock
+#ifdef _WIN32
+  void* m_file{nullptr};  // HANDLE
+#else
+  int m_file{-1};
+#endif
+  bool m_little_endian{true}, m_big_tiff{false};
+  std::vector<Level> m_levels;
+
+  bool read_index();
+
+  bool read(uint64_t offset, void* data, size_t size) const;
+  uint64_t read_uint(uint64_t offset, unsigned size) const;
+  uint64_t array_element(const TiffArray&, uint64_t index) const;
+};
+
+// http, directory, mbtiles or geotiff
+std::optional<TileSourceType> parse_tile_source_type(const std::string& name);
+
+// MBTILES for *.mbtiles, GEOTIFF for *.tif and *.tiff, DIRECTORY for existing directories, HTTP otherwise
+TileSourceType guess_tile_source_type(const std::string& location);
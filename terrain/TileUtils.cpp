@@ -0,0 +1,241 @@
+#include "TileUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define TILE_UTILS_SIMD 1
+#else
+#define TILE_UTILS_SIMD 0
+#endif
+
+// tile edges are looked up down to this zoom level and computed below it, the table has 2^zoom + 1 rows
+#define LATITUDE_TABLE_ZOOM 16
+
+// the mercator projection ends here, the map is square
+static constexpr float MAX_LATITUDE = 85.0511287798f;
+
+// in radians, computed in double so the table is exact to float precision
+static double edge_latitude(double y, unsigned zoom)
+{
+  const double n = std::numbers::pi * (1.0 - 2.0 * y / double(uint64_t(1) << zoom));
+  return std::atan(std::sinh(n));
+}
+
+struct LatitudeTable {
+  std::vector<float> lat, cos;  // of the north edge of every row, the last one is the south edge of the map
+
+  LatitudeTable() : lat((1U << LATITUDE_TABLE_ZOOM) + 1U), cos(lat.size())
+  {
+    for (size_t y = 0; y < lat.size(); ++y) {
+      const double latrad = edge_latitude(double(y), LATITUDE_TABLE_ZOOM);
+      lat[y] = float(latrad * 180.0 / std::numbers::pi);
+      cos[y] = float(std::cos(latrad));
+    }
+  }
+};
+
+static const LatitudeTable& latitude_table()
+{
+  static const LatitudeTable table;
+  return table;
+}
+
+// rows outside of the map and below the table are computed
+static inline bool in_table(unsigned y, unsigned zoom)
+{
+  return zoom <= LATITUDE_TABLE_ZOOM && y <= (1U << zoom);
+}
+
+template <>
+float wms::tiley2lat<float>(unsigned y, unsigned zoom)
+{
+  if (!in_table(y, zoom)) {
+    return float(edge_latitude(double(y), zoom) * 180.0 / std::numbers::pi);
+  }
+
+  return latitude_table().lat[size_t(y) << (LATITUDE_TABLE_ZOOM - zoom)];
+}
+
+template <>
+double wms::tiley2lat<double>(unsigned y, unsigned zoom)
+{
+  return edge_latitude(double(y), zoom) * 180.0 / std::numbers::pi;
+}
+
+float wms::tiley2cos(unsigned y, unsigned zoom)
+{
+  if (!in_table(y, zoom)) {
+    return float(std::cos(edge_latitude(double(y), zoom)));
+  }
+
+  return latitude_table().cos[size_t(y) << (LATITUDE_TABLE_ZOOM - zoom)];
+}
+
+#if TILE_UTILS_SIMD
+// Cephes polynomials, relative error around 1e-7 in their ranges.
+
+// e^x for |x| < 88
+static inline __m128 exp4(__m128 x)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+
+  // x = n * ln(2) + r, with ln(2) split in two so r keeps its precision
+  __m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f));
+  __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+  fx = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, fx), one));  // floor
+  x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(0.693359375f)));
+  x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(-2.12194440e-4f)));
+
+  const __m128 z = _mm_mul_ps(x, x);
+  __m128 y = _mm_set1_ps(1.9875691500e-4f);
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+  y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, z), x), one);
+
+  // 2^n straight into the exponent bits
+  const __m128i n = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(fx), _mm_set1_epi32(127)), 23);
+  return _mm_mul_ps(y, _mm_castsi128_ps(n));
+}
+
+// natural logarithm for x > 0
+static inline __m128 log4(__m128 x)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+
+  // x = m * 2^e with m in [sqrt(0.5), sqrt(2))
+  const __m128i bits = _mm_castps_si128(x);
+  __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+  x = _mm_or_ps(_mm_and_ps(x, _mm_castsi128_ps(_mm_set1_epi32(~0x7f800000))), _mm_set1_ps(0.5f));
+
+  const __m128 small = _mm_cmplt_ps(x, _mm_set1_ps(0.707106781186547524f));
+  e = _mm_sub_ps(e, _mm_and_ps(one, small));
+  x = _mm_add_ps(_mm_sub_ps(x, one), _mm_and_ps(x, small));
+
+  const __m128 z = _mm_mul_ps(x, x);
+  __m128 y = _mm_set1_ps(7.0376836292e-2f);
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.1514610310e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.1676998740e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.2420140846e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.4249322787e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-1.6668057665e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(2.0000714765e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(-2.4999993993e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(3.3333331174e-1f));
+  y = _mm_mul_ps(_mm_mul_ps(y, x), z);
+
+  y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(-2.12194440e-4f)));
+  y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+  return _mm_add_ps(_mm_add_ps(x, y), _mm_mul_ps(e, _mm_set1_ps(0.693359375f)));
+}
+
+// arc tangent for |x| <= 1
+static inline __m128 atan4(__m128 x)
+{
+  const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(int(0x80000000)));
+  const __m128 one = _mm_set1_ps(1.0f);
+
+  const __m128 sign = _mm_and_ps(x, sign_mask);
+  x = _mm_andnot_ps(sign_mask, x);
+
+  // above tan(pi / 8): atan(x) = pi / 4 + atan((x - 1) / (x + 1))
+  const __m128 large = _mm_cmpgt_ps(x, _mm_set1_ps(0.4142135623730950f));
+  const __m128 reduced = _mm_div_ps(_mm_sub_ps(x, one), _mm_add_ps(x, one));
+  x = _mm_or_ps(_mm_and_ps(large, reduced), _mm_andnot_ps(large, x));
+  const __m128 offset = _mm_and_ps(large, _mm_set1_ps(0.785398163397448309f));
+
+  const __m128 z = _mm_mul_ps(x, x);
+  __m128 y = _mm_set1_ps(8.05374449538e-2f);
+  y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(-1.38776856032e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(1.99777106478e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, z), _mm_set1_ps(-3.33329491539e-1f));
+  y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, z), x), x), offset);
+
+  return _mm_or_ps(y, sign);
+}
+
+// y = (1 - asinh(tan(lat)) / pi) / 2 * 2^zoom. With the half angle a, asinh(tan(lat)) = log((cos a + sin a) /
+// (cos a - sin a)), and |a| < pi / 4 is the range of the sin and cos polynomials.
+static inline __m128 lat2tiley4(__m128 lat, __m128 scale)
+{
+  lat = _mm_min_ps(_mm_max_ps(lat, _mm_set1_ps(-MAX_LATITUDE)), _mm_set1_ps(MAX_LATITUDE));
+  const __m128 a = _mm_mul_ps(lat, _mm_set1_ps(wms::PI / 360.0f));
+  const __m128 z = _mm_mul_ps(a, a);
+
+  __m128 s = _mm_set1_ps(-1.9515295891e-4f);
+  s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(8.3321608736e-3f));
+  s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(-1.6666654611e-1f));
+  s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), a), a);
+
+  __m128 c = _mm_set1_ps(2.443315711809948e-5f);
+  c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(-1.388731625493765e-3f));
+  c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(4.166664568298827e-2f));
+  c = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(c, z), z), _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+  const __m128 mercator = log4(_mm_div_ps(_mm_add_ps(c, s), _mm_sub_ps(c, s)));
+  return _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(0.5f), _mm_mul_ps(mercator, _mm_set1_ps(0.5f / wms::PI))), scale);
+}
+
+// lat = atan(sinh(n)) = 2 * atan(tanh(n / 2)), with n = pi * (1 - 2 * y / 2^zoom)
+static inline __m128 tiley2lat4(__m128 y, __m128 inv_scale)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 n = _mm_mul_ps(_mm_set1_ps(wms::PI), _mm_sub_ps(one, _mm_mul_ps(_mm_add_ps(y, y), inv_scale)));
+  const __m128 e = exp4(_mm_min_ps(_mm_max_ps(n, _mm_set1_ps(-80.0f)), _mm_set1_ps(80.0f)));
+  const __m128 t = _mm_div_ps(_mm_sub_ps(e, one), _mm_add_ps(e, one));
+  return _mm_mul_ps(atan4(t), _mm_set1_ps(360.0f / wms::PI));
+}
+
+// The last few values go through the same kernel, so all of them have the same precision.
+template <typename Kernel>
+static void for_each4(const float* in, float* out, size_t count, Kernel kernel)
+{
+  size_t i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(out + i, kernel(_mm_loadu_ps(in + i)));
+  }
+
+  if (i < count) {
+    float padded[4] = {};
+    std::copy(in + i, in + count, padded);
+    _mm_storeu_ps(padded, kernel(_mm_loadu_ps(padded)));
+    std::copy(padded, padded + (count - i), out + i);
+  }
+}
+#endif
+
+void wms::lat2tiley(const float* lat, float* y, size_t count, unsigned zoom)
+{
+  const float scale = float(1 << zoom);
+
+#if TILE_UTILS_SIMD
+  const __m128 scale4 = _mm_set1_ps(scale);
+  for_each4(lat, y, count, [&](__m128 v) { return lat2tiley4(v, scale4); });
+#else
+  for (size_t i = 0; i < count; ++i) {
+    const float latrad = std::clamp(lat[i], -MAX_LATITUDE, MAX_LATITUDE) * PI / 180.0f;
+    y[i] = (1.0f - std::asinh(std::tan(latrad)) / PI) / 2.0f * scale;
+  }
+#endif
+}
+
+void wms::tiley2lat(const float* y, float* lat, size_t count, unsigned zoom)
+{
+  const float inv_scale = 1.0f / float(1 << zoom);
+
+#if TILE_UTILS_SIMD
+  const __m128 inv_scale4 = _mm_set1_ps(inv_scale);
+  for_each4(y, lat, count, [&](__m128 v) { return tiley2lat4(v, inv_scale4); });
+#else
+  for (size_t i = 0; i < count; ++i) {
+    const float n = PI - 2.0f * PI * y[i] * inv_scale;
+    lat[i] = 180.0f / PI * std::atan(std::sinh(n));
+  }
+#endif
+}
@@ -3,12 +3,19 @@
 #include <fmt/core.h>
 
 #include <array>
+#include <cassert>
+#include <compare>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
 #include <numbers>
 #include <string>
 
 #include "Common.h"
 
 // https://wiki.openstreetmap.org/wiki/Slippy_map_tilenames
+// The conversions are templated on the precision. Float can no longer tell
+// the tiles apart beyond zoom 16, so deeper tiles need double.
 namespace wms
 {
 constexpr float PI = std::numbers::pi_v<float>;
@@ -17,31 +24,60 @@ constexpr float EARTH_RADIUS = 6378137.0f;
 
 constexpr float EQUATORIAL_CIRCUMFERENCE = 2.0f * PI * EARTH_RADIUS;
 
-inline unsigned lon2tilex(float lon, unsigned zoom)
+template <std::floating_point T>
+inline unsigned lon2tilex(T lon, unsigned zoom)
 {
-  return (unsigned)(std::floor((lon + 180.0f) / 360.0f * (1 << zoom)));
+  return (unsigned)(std::floor((lon + T(180)) / T(360) * T(1U << zoom)));
 }
 
-inline unsigned lat2tiley(float lat, unsigned zoom)
+template <std::floating_point T>
+inline unsigned lat2tiley(T lat, unsigned zoom)
 {
-  float latrad = lat * PI / 180.0f;
-  return (unsigned)(std::floor((1.0f - std::asinh(std::tan(latrad)) / PI) / 2.0f * (1 << zoom)));
+  const T pi = std::numbers::pi_v<T>;
+  T latrad = lat * pi / T(180);
+  return (unsigned)(std::floor((T(1) - std::asinh(std::tan(latrad)) / pi) / T(2) * T(1U << zoom)));
 }
 
-inline float tilex2lon(unsigned x, unsigned zoom) { return x / (float)(1 << zoom) * 360.0f - 180.0f; }
-
-inline float tiley2lat(unsigned y, unsigned zoom)
+template <std::floating_point T = float>
+inline T tilex2lon(unsigned x, unsigned zoom)
 {
-  float n = PI - 2.0f * PI * y / (float)(1 << zoom);
-  return 180.0f / PI * std::atan(0.5f * (std::exp(n) - std::exp(-n)));
+  return T(x) / T(1U << zoom) * T(360) - T(180);
 }
 
+// Latitude of the north edge of tile row y, y == 1 << zoom is the south edge of the map. Float is looked up in
+// a table of the edges, double is computed, see TileUtils.cpp.
+template <std::floating_point T = float>
+T tiley2lat(unsigned y, unsigned zoom);
+
+template <>
+float tiley2lat<float>(unsigned y, unsigned zoom);
+
+template <>
+double tiley2lat<double>(unsigned y, unsigned zoom);
+
+// cos of tiley2lat, from the same table
+float tiley2cos(unsigned y, unsigned zoom);
+
+// Fractional tile rows of count latitudes, without rounding down. Polynomial approximations, four at a time.
+void lat2tiley(const float* lat, float* y, size_t count, unsigned zoom);
+
+// Latitudes of count fractional tile rows, the inverse of the above.
+void tiley2lat(const float* y, float* lat, size_t count, unsigned zoom);
+
 // width of tile in meters
 // https://wiki.openstreetmap.org/wiki/Zoom_levels
-inline float tile_width(float lat, unsigned zoom)
+template <std::floating_point T>
+inline T tile_width(T lat, unsigned zoom)
+{
+  const T pi = std::numbers::pi_v<T>;
+  T latrad = lat * pi / T(180);
+  return std::abs(T(2) * pi * T(EARTH_RADIUS) * std::cos(latrad) / T(1U << zoom));
+}
+
+// width in meters of the tiles in row y, at their north edge
+inline float tile_row_width(unsigned y, unsigned zoom)
 {
-  float latrad = lat * PI / 180.0f;
-  return std::abs(EQUATORIAL_CIRCUMFERENCE * std::cos(latrad) / (1 << zoom));
+  return EQUATORIAL_CIRCUMFERENCE * tiley2cos(y, zoom) / float(1 << zoom);
 }
 
 // https://en.wikipedia.org/wiki/Horizon#Derivation
@@ -57,62 +93,167 @@ inline float geographical_distance_to_horizon(float altitude)
 }
 };  // namespace wms
 
-struct Coordinate {
-  float lat, lon;
-  Coordinate(float lat_, float lon_) : lat(lat_), lon(lon_) {}
-  Coordinate(const glm::vec2& lat_lon) : Coordinate(lat_lon.y, lat_lon.x) {}
-  glm::vec2 to_vec2() const { return {lon, lat}; }
-  operator glm::vec2() const { return glm::vec2(lon, lat); }
+// Z-order curve, https://en.wikipedia.org/wiki/Z-order_curve
+namespace morton
+{
+// the lower 32 bits of x into the even bits
+constexpr uint64_t spread_bits(uint64_t x)
+{
+  x &= 0xffffffffULL;
+  x = (x | (x << 16)) & 0x0000ffff0000ffffULL;
+  x = (x | (x << 8)) & 0x00ff00ff00ff00ffULL;
+  x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  x = (x | (x << 2)) & 0x3333333333333333ULL;
+  x = (x | (x << 1)) & 0x5555555555555555ULL;
+  return x;
+}
+
+// the even bits of x back into the lower 32 bits
+constexpr uint64_t compact_bits(uint64_t x)
+{
+  x &= 0x5555555555555555ULL;
+  x = (x | (x >> 1)) & 0x3333333333333333ULL;
+  x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+  x = (x | (x >> 4)) & 0x00ff00ff00ff00ffULL;
+  x = (x | (x >> 8)) & 0x0000ffff0000ffffULL;
+  x = (x | (x >> 16)) & 0x00000000ffffffffULL;
+  return x;
+}
+
+constexpr uint64_t encode(uint64_t x, uint64_t y) { return spread_bits(x) | (spread_bits(y) << 1); }
+};  // namespace morton
+
+template <std::floating_point T>
+struct BasicCoordinate {
+  T lat, lon;
+  BasicCoordinate(T lat_, T lon_) : lat(lat_), lon(lon_) {}
+  BasicCoordinate(const glm::vec<2, T>& lat_lon) : BasicCoordinate(lat_lon.y, lat_lon.x) {}
+
+  // implicit to double, explicit back to float
+  template <std::floating_point U>
+  explicit(sizeof(U) > sizeof(T)) BasicCoordinate(const BasicCoordinate<U>& other)
+      : lat(T(other.lat)), lon(T(other.lon))
+  {
+  }
+
+  glm::vec<2, T> to_vec2() const { return {lon, lat}; }
+  operator glm::vec<2, T>() const { return glm::vec<2, T>(lon, lat); }
 };
 
+using Coordinate = BasicCoordinate<float>;
+using DCoordinate = BasicCoordinate<double>;
+
 // y-axis points south, so y=0 is the northern most tile.
 struct TileId {
   unsigned zoom, x, y;
-  static const unsigned MAX_ZOOM{16U};
+  static const unsigned MAX_ZOOM{22U};
   static const unsigned MAX_X{1 << MAX_ZOOM};
   static const unsigned MAX_Y{1 << MAX_ZOOM};
 
-  TileId() : TileId(0U, 0U, 0U) {}
+  // bits of the key that hold the zoom level
+  static const unsigned ZOOM_BITS{5U};
+
+  constexpr TileId() : TileId(0U, 0U, 0U) {}
+
+  constexpr explicit TileId(unsigned zoom_, unsigned x_, unsigned y_) : zoom(zoom_), x(x_), y(y_) {}
+
+  template <std::floating_point T>
+  explicit TileId(T lat, T lon, unsigned zoom_) : TileId(zoom_, wms::lon2tilex(lon, zoom_), wms::lat2tiley(lat, zoom_))
+  {
+  }
+
+  // use a DCoordinate beyond zoom 16
+  template <std::floating_point T>
+  explicit TileId(const BasicCoordinate<T>& coord, unsigned zoom_) : TileId(coord.lat, coord.lon, zoom_)
+  {
+  }
+
+  // Tiles are ordered by their key, so sorted containers keep siblings and descendants together.
+  constexpr std::strong_ordering operator<=>(const TileId& other) const { return key() <=> other.key(); }
 
-  explicit TileId(unsigned zoom_, unsigned x_, unsigned y_) : zoom(zoom_), x(x_), y(y_) {}
+  constexpr bool operator==(const TileId&) const = default;
 
-  explicit TileId(float lat, float lon, unsigned zoom_)
-      : TileId(zoom_, wms::lon2tilex(lon, zoom_), wms::lat2tiley(lat, zoom_))
+  // Z-order key: the interleaved bits of x and y scaled to MAX_ZOOM, the zoom level in the lowest bits. Siblings
+  // are next to each other and the descendants of a tile are the keys right after it, up to end_key().
+  constexpr uint64_t key() const
   {
+    assert(zoom <= MAX_ZOOM);
+    const unsigned shift = MAX_ZOOM - zoom;
+    return (morton::encode(uint64_t(x) << shift, uint64_t(y) << shift) << ZOOM_BITS) | zoom;
   }
 
-  explicit TileId(const Coordinate& coord, unsigned zoom_) : TileId(coord.lat, coord.lon, zoom_) {}
+  // first key after all descendants of the tile
+  constexpr uint64_t end_key() const
+  {
+    const unsigned shift = MAX_ZOOM - zoom;
+    return (morton::encode(uint64_t(x) << shift, uint64_t(y) << shift) + (uint64_t(1) << (2 * shift))) << ZOOM_BITS;
+  }
 
-  auto operator<=>(const TileId&) const = default;
+  static constexpr TileId from_key(uint64_t key)
+  {
+    const unsigned zoom = unsigned(key & ((1U << ZOOM_BITS) - 1U));
+    const unsigned shift = MAX_ZOOM - zoom;
+    const uint64_t code = key >> ZOOM_BITS;
+    const uint64_t x = morton::compact_bits(code) >> shift, y = morton::compact_bits(code >> 1) >> shift;
+    return TileId(zoom, unsigned(x), unsigned(y));
+  }
 
   inline std::string to_string() const { return fmt::format("{}-{}-{}", zoom, x, y); }
 
-  inline Bounds<Coordinate> bounds() const
+  template <std::floating_point T = float>
+  inline Bounds<BasicCoordinate<T>> bounds() const
   {
-    Coordinate min(wms::tiley2lat(y + 0U, zoom), wms::tilex2lon(x + 0U, zoom));
-    Coordinate max(wms::tiley2lat(y + 1U, zoom), wms::tilex2lon(x + 1U, zoom));
+    BasicCoordinate<T> min(wms::tiley2lat<T>(y + 0U, zoom), wms::tilex2lon<T>(x + 0U, zoom));
+    BasicCoordinate<T> max(wms::tiley2lat<T>(y + 1U, zoom), wms::tilex2lon<T>(x + 1U, zoom));
     return {min, max};
   }
 
-  inline float width_in_meters() const { return wms::tile_width(wms::tiley2lat(y, zoom), zoom); }
+  inline float width_in_meters() const { return wms::tile_row_width(y, zoom); }
+
+  constexpr TileId parent() const { return TileId(zoom - 1U, x >> 1U, y >> 1U); }
+
+  constexpr TileId ancestor(unsigned ancestor_zoom) const
+  {
+    assert(ancestor_zoom <= zoom);
+    const unsigned shift = zoom - ancestor_zoom;
+    return TileId(ancestor_zoom, x >> shift, y >> shift);
+  }
+
+  // the tile itself or one of its descendants
+  constexpr bool contains(const TileId& other) const { return key() <= other.key() && other.key() < end_key(); }
 
-  inline TileId parent() const { return TileId(zoom - 1U, x / 2U, y / 2U); }
+  // Tile on the same zoom level, offset by dx and dy. Does not wrap around.
+  constexpr TileId neighbour(int dx, int dy) const { return TileId(zoom, x + dx, y + dy); }
 
   // https://wiki.openstreetmap.org/wiki/Slippy_map_tilenames#Subtiles
-  inline std::array<TileId, 4> children() const
+  constexpr std::array<TileId, 4> children() const
   {
     unsigned child_zoom = zoom + 1U;
 
     return std::array<TileId, 4>({
-        TileId(child_zoom, 2U * x, 2U * y),
-        TileId(child_zoom, 2U * x + 1U, 2U * y),
-        TileId(child_zoom, 2U * x + 1U, 2U * y + 1U),
-        TileId(child_zoom, 2U * x, 2U * y + 1U),
+        TileId(child_zoom, x << 1U, y << 1U),
+        TileId(child_zoom, (x << 1U) | 1U, y << 1U),
+        TileId(child_zoom, (x << 1U) | 1U, (y << 1U) | 1U),
+        TileId(child_zoom, x << 1U, (y << 1U) | 1U),
     });
   }
 };
 
+// Where a tile is in world space, given where one of its ancestors or the tile itself is.
+inline Bounds<glm::vec2> descendant_bounds(const TileId& ancestor, const Bounds<glm::vec2>& ancestor_bounds,
+                                           const TileId& tile)
+{
+  assert(ancestor.contains(tile));
+
+  const unsigned n = 1U << (tile.zoom - ancestor.zoom);
+  const glm::vec2 size = ancestor_bounds.size() / float(n);
+  const glm::vec2 offset(float(tile.x - ancestor.x * n), float(tile.y - ancestor.y * n));
+  const glm::vec2 min = ancestor_bounds.min + size * offset;
+
+  return Bounds<glm::vec2>(min, min + size);
+}
+
 template <>
 struct std::hash<TileId> {
-  std::size_t operator()(const TileId& t) const noexcept { return std::hash<std::string>{}(t.to_string()); }
+  std::size_t operator()(const TileId& t) const noexcept { return std::hash<uint64_t>{}(t.key()); }
 };
@@ -13,7 +13,6 @@ uniform vec3 u_fog_color;
 uniform float u_fog_near;
 uniform float u_fog_far;
 uniform float u_fog_density;
-uniform vec3 u_camera_position;
 uniform uint u_zoom;
 uniform bool u_debug_view;
 uniform bool u_shading;
@@ -87,8 +86,9 @@ void main() {
   }
 #endif
 #if 1
-  vec3 camera_dir = normalize(u_camera_position - world_pos.xyz);
-  float camera_dist = length(world_pos.xyz - u_camera_position);
+  // world_pos is relative to the camera
+  vec3 camera_dir = normalize(-world_pos.xyz);
+  float camera_dist = length(world_pos.xyz);
   float dist_ratio = 4.0 * camera_dist / u_fog_far;
   float fog_factor = 1.0 - exp(-dist_ratio * u_fog_density);
 
@@ -2,16 +2,25 @@
 layout (location = 0) in vec3 a_pos;
 layout (location = 1) in vec2 a_tex;
 
+// u_model and u_view are relative to u_origin, the camera, so the GPU never works with large coordinates
 uniform mat4 u_model;
 uniform mat4 u_view;
 uniform mat4 u_proj;
+uniform vec3 u_origin;
 uniform float u_height_scaling_factor;
 uniform float u_terrain_scaling_factor;
+// curved earth: the terrain drops away from the camera and heights are scaled for their own latitude
+uniform bool u_curved_earth;
+uniform float u_earth_radius;  // in meters
+uniform vec2 u_mercator_z;     // world z of the north and south edge of the root tile
+uniform vec2 u_mercator_n;     // mercator n = PI - 2 PI y / 2^zoom there
 uniform vec2 u_height_uv_min;
 uniform vec2 u_height_uv_max;
 uniform sampler2D u_height_texture;
+uniform vec2 u_normal_uv_min;
+uniform vec2 u_normal_uv_max;
+uniform sampler2D u_normal_texture;
 uniform uint u_zoom;
-uniform float u_pixel_resolution;
 
 out vec2 uv;
 out vec4 world_pos;
@@ -30,21 +39,21 @@ vec2 map_range(vec2 value, vec2 in_min, vec2 in_max, vec2 out_min, vec2 out_max)
   return out_min + (value - in_min) * (out_max - out_min) / (in_max - in_min);
 }
 
-vec3 compute_normal(vec2 uv) {
-  // https://stackoverflow.com/a/5284527/11009152
-  // https://stackoverflow.com/a/5282364/11009152
-
-  vec2 size = vec2(u_pixel_resolution, 0.0);
-
-  float h00 = altitude_from_color(textureOffset(u_height_texture, uv, ivec2(-1,0)));
-  float h01 = altitude_from_color(textureOffset(u_height_texture, uv, ivec2(+1,0)));
-  float h10 = altitude_from_color(textureOffset(u_height_texture, uv, ivec2(0,-1)));
-  float h11 = altitude_from_color(textureOffset(u_height_texture, uv, ivec2(0,+1)));
-
-  vec3 va = normalize(vec3(size.x, h00 - h01, size.y));      
-  vec3 vb = normalize(vec3(size.y, h10 - h11, -size.x));
+// World units per meter at a world z. u_terrain_scaling_factor is for the north edge, the cosine of the latitude
+// is 1 / cosh(n) in mercator.
+float terrain_scaling_factor(float z) {
+  float n = mix(u_mercator_n.x, u_mercator_n.y, (z - u_mercator_z.x) / (u_mercator_z.y - u_mercator_z.x));
+  return u_terrain_scaling_factor * cosh(n) / cosh(u_mercator_n.x);
+}
 
-  return cross(va, vb);
+// normals are precomputed per height tile, see NormalMap.h
+vec3 decode_octahedral(vec2 encoded) {
+  vec2 e = encoded * 2.0 - 1.0;
+  vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+  float t = max(-n.y, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.z += n.z >= 0.0 ? -t : t;
+  return normalize(n);
 }
 
 void main() {
@@ -56,15 +65,24 @@ void main() {
 
   vec4 height_sample = texture(u_height_texture, scaled_uv);
 
-  normal = compute_normal(scaled_uv);
+  vec2 normal_uv = map_range(uv, vec2(0), vec2(1), u_normal_uv_min, u_normal_uv_max);
 
-  float height = altitude_from_color(height_sample) * u_terrain_scaling_factor;
+  normal = decode_octahedral(texture(u_normal_texture, normal_uv).rg);
 
-  world_pos.y = height;
+  float scaling_factor = u_curved_earth ? terrain_scaling_factor(world_pos.z + u_origin.z) : u_terrain_scaling_factor;
+  float height = altitude_from_color(height_sample) * scaling_factor;
+
+  world_pos.y = height - u_origin.y;
 
   // skirts on tiles
   if (uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0) {
-    world_pos.y = -2.0;
+    world_pos.y = -2.0 - u_origin.y;
+  }
+
+  // https://en.wikipedia.org/wiki/Horizon#Curvature
+  if (u_curved_earth) {
+    float distance = length(world_pos.xz) / scaling_factor;
+    world_pos.y -= distance * distance / (2.0 * u_earth_radius) * scaling_factor;
   }
 
   gl_Position = u_proj * u_view * world_pos;
@@ -0,0 +1,244 @@
+/*
+  Minimal HTTP/1.1 tile server for tests and benchmarks. Serves small
+  generated PNG tiles for any /{z}/{x}/{y}.png path. Only available on
+  POSIX systems.
+*/
+#pragma once
+
+#ifndef _WIN32
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TileUtils.h"
+
+#define MOCK_TILE_SERVER 1
+
+// Encode an RGB image as PNG with uncompressed deflate blocks.
+inline std::string encode_png(int width, int height, const std::vector<uint8_t>& rgb)
+{
+  auto crc32 = [](const std::string& data) {
+    uint32_t crc = 0xffffffffu;
+    for (unsigned char c : data) {
+      crc ^= c;
+      for (int k = 0; k < 8; ++k) crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1u)));
+    }
+    return crc ^ 0xffffffffu;
+  };
+
+  auto be32 = [](uint32_t v) {
+    return std::string{char(v >> 24), char((v >> 16) & 0xff), char((v >> 8) & 0xff), char(v & 0xff)};
+  };
+
+  auto chunk = [&](const std::string& type, const std::string& data) {
+    return be32(uint32_t(data.size())) + type + data + be32(crc32(type + data));
+  };
+
+  // every row starts with filter type 0
+  std::string raw;
+  for (int y = 0; y < height; ++y) {
+    raw.push_back('\0');
+    raw.append(reinterpret_cast<const char*>(rgb.data()) + std::size_t(y) * width * 3, std::size_t(width) * 3);
+  }
+
+  std::string zlib = {char(0x78), char(0x01)};
+  for (std::size_t offset = 0; offset < raw.size() || offset == 0; offset += 0xffff) {
+    std::size_t length = std::min<std::size_t>(0xffff, raw.size() - offset);
+    bool last = offset + length >= raw.size();
+    zlib.push_back(char(last ? 1 : 0));
+    zlib.push_back(char(length & 0xff));
+    zlib.push_back(char(length >> 8));
+    zlib.push_back(char(~length & 0xff));
+    zlib.push_back(char((~length >> 8) & 0xff));
+    zlib.append(raw, offset, length);
+    if (last) break;
+  }
+
+  uint32_t a = 1, b = 0;
+  for (unsigned char c : raw) {
+    a = (a + c) % 65521u;
+    b = (b + a) % 65521u;
+  }
+  zlib += be32((b << 16) | a);
+
+  std::string ihdr = be32(uint32_t(width)) + be32(uint32_t(height)) + std::string{8, 2, 0, 0, 0};
+
+  return std::string("\x89PNG\r\n\x1a\n", 8) + chunk("IHDR", ihdr) + chunk("IDAT", zlib) + chunk("IEND", "");
+}
+
+class MockTileServer
+{
+ public:
+  // Tiles are served as /{z}/{x}/{y}.png, y pointing south.
+  MockTileServer(int tile_size = 16) : m_tile_size(tile_size)
+  {
+    m_socket = socket(AF_INET, SOCK_STREAM, 0);
+
+    int enable = 1;
+    setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;  // any free port
+
+    bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    listen(m_socket, 64);
+
+    socklen_t length = sizeof(address);
+    getsockname(m_socket, reinterpret_cast<sockaddr*>(&address), &length);
+    m_port = ntohs(address.sin_port);
+
+    m_accept_thread = std::thread([this]() { accept_connections(); });
+  }
+
+  ~MockTileServer()
+  {
+    m_stop = true;
+    shutdown(m_socket, SHUT_RDWR);
+    close(m_socket);
+    m_accept_thread.join();
+
+    std::unique_lock lock(m_mutex);
+    for (int connection : m_connections) shutdown(connection, SHUT_RDWR);
+    lock.unlock();
+
+    for (auto& thread : m_connection_threads) thread.join();
+  }
+
+  std::string url() const { return "http://127.0.0.1:" + std::to_string(m_port); }
+
+  // these tiles respond with 404
+  void set_missing(const std::set<TileId>& tiles)
+  {
+    std::unique_lock lock(m_mutex);
+    m_missing = tiles;
+  }
+
+  // artificial delay before every response
+  std::atomic<int> latency_ms{0};
+
+  // respond with 503 to every request
+  std::atomic<bool> unavailable{false};
+
+  std::atomic<unsigned> requests{0}, connections{0}, not_modified{0};
+
+ private:
+  const int m_tile_size;
+  int m_socket{-1};
+  int m_port{0};
+  std::atomic<bool> m_stop{false};
+  std::thread m_accept_thread;
+  std::mutex m_mutex;
+  std::set<TileId> m_missing;
+  std::set<int> m_connections;
+  std::vector<std::thread> m_connection_threads;
+
+  void accept_connections()
+  {
+    while (!m_stop) {
+      int connection = accept(m_socket, nullptr, nullptr);
+      if (connection < 0) break;
+
+      int enable = 1;
+      setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+      connections++;
+      std::unique_lock lock(m_mutex);
+      m_connections.insert(connection);
+      m_connection_threads.push_back(std::thread([this, connection]() { serve(connection); }));
+    }
+  }
+
+  void serve(int connection)
+  {
+    std::string buffer;
+    std::array<char, 4096> chunk;
+
+    while (!m_stop) {
+      auto header_end = buffer.find("\r\n\r\n");
+
+      if (header_end == std::string::npos) {
+        ssize_t received = recv(connection, chunk.data(), chunk.size(), 0);
+        if (received <= 0) break;
+        buffer.append(chunk.data(), std::size_t(received));
+        continue;
+      }
+
+      std::string request = buffer.substr(0, header_end);
+      buffer.erase(0, header_end + 4);
+      requests++;
+
+      if (latency_ms > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(latency_ms.load()));
+      }
+
+      std::string response = respond(request);
+      if (send(connection, response.data(), response.size(), MSG_NOSIGNAL) < 0) break;
+      if (request.find("Connection: close") != std::string::npos) break;
+    }
+
+    std::unique_lock lock(m_mutex);
+    m_connections.erase(connection);
+    close(connection);
+  }
+
+  std::string respond(const std::string& request)
+  {
+    unsigned zoom = 0, x = 0, y = 0;
+
+    if (std::sscanf(request.c_str(), "GET /%u/%u/%u.png", &zoom, &x, &y) != 3 || TileId::MAX_ZOOM < zoom) {
+      return "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+    }
+
+    TileId tile(zoom, x, y);
+
+    if (unavailable) {
+      return "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+    }
+
+    {
+      std::unique_lock lock(m_mutex);
+      if (m_missing.contains(tile)) {
+        return "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+      }
+    }
+
+    // tiles never change, the ETag only depends on the tile
+    std::string etag = "\"" + tile.to_string() + "\"";
+
+    if (request.find("If-None-Match: " + etag) != std::string::npos) {
+      not_modified++;
+      return "HTTP/1.1 304 Not Modified\r\nETag: " + etag + "\r\nContent-Length: 0\r\n\r\n";
+    }
+
+    // a different color for every tile
+    std::vector<uint8_t> rgb(std::size_t(m_tile_size) * m_tile_size * 3);
+    for (std::size_t i = 0; i < rgb.size(); i += 3) {
+      rgb[i + 0] = uint8_t(zoom * 16);
+      rgb[i + 1] = uint8_t(x);
+      rgb[i + 2] = uint8_t(y);
+    }
+
+    std::string png = encode_png(m_tile_size, m_tile_size, rgb);
+
+    return "HTTP/1.1 200 OK\r\nContent-Type: image/png\r\nETag: " + etag +
+           "\r\nContent-Length: " + std::to_string(png.size()) + "\r\n\r\n" + png;
+  }
+};
+
+#endif
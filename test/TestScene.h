@@ -0,0 +1,49 @@
+/*
+  The scene the frame preparation tests run in: the same setup as the app,
+  without a window or GL context. The root tile is at zoom 6 and the terrain
+  is flat at 500 m unless a test asks for something else.
+*/
+#pragma once
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Common.h"
+#include "FramePacket.h"
+#include "TileUtils.h"
+
+struct TestScene {
+  const TileId root_tile;
+  const float width;
+  const Bounds<glm::vec2> bounds;
+  const float scaling_factor;
+
+  FramePreparer::ElevationFunction elevation{[](const glm::vec2&) { return 500.0f; }};
+  HeightRangeFunction height_range{nullptr};
+  float field_of_view{45.0f};
+
+  explicit TestScene(unsigned root_zoom = 6)
+      : root_tile(Coordinate(47.2692f, 11.4041f), root_zoom),
+        width(wms::tile_width(47.2692f, root_zoom) * 0.01f),
+        bounds(glm::vec2(-width / 2.0f), glm::vec2(width / 2.0f)),
+        scaling_factor(width / root_tile.width_in_meters())
+  {
+  }
+
+  Bounds<glm::vec2> tile_bounds(const TileId& tile) const { return descendant_bounds(root_tile, bounds, tile); }
+
+  FramePreparer preparer() const
+  {
+    return FramePreparer(root_tile, 8, bounds, scaling_factor, elevation, nullptr, height_range);
+  }
+
+  FrameInput input(const glm::vec3& position, const glm::vec3& forward) const
+  {
+    FrameInput input;
+    input.position = position;
+    input.forward = forward;
+    input.view = glm::lookAt(position, position + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+    input.projection = glm::perspective(glm::radians(field_of_view), 16.0f / 9.0f, 1.0f, 100000.0f);
+    input.dt = 1.0f / 60.0f;
+    return input;
+  }
+};
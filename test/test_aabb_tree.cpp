@@ -0,0 +1,336 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <set>
+
+#include "AABBTree.h"
+
+// objects of a few meters, scattered over an area of extent x extent meters
+static std::vector<AABB> random_objects(size_t count, float extent, unsigned seed)
+{
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> position(0.0f, extent), size(0.5f, 5.0f), height(0.0f, 50.0f);
+  std::vector<AABB> boxes;
+  boxes.reserve(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    glm::vec3 center(position(gen), height(gen), position(gen));
+    boxes.push_back(AABB::from_center_and_size(center, glm::vec3(size(gen), size(gen), size(gen))));
+  }
+
+  return boxes;
+}
+
+template <class Test>
+static std::set<int> brute_force(const AABBTree& tree, const std::vector<int>& proxies, Test&& test)
+{
+  std::set<int> result;
+  for (int proxy : proxies) {
+    if (test(tree.fat_aabb(proxy))) result.insert(proxy);
+  }
+  return result;
+}
+
+static std::vector<std::pair<int, int>> all_pairs(const AABBTree& tree, const std::vector<int>& proxies)
+{
+  std::vector<std::pair<int, int>> pairs;
+  for (size_t i = 0; i < proxies.size(); ++i) {
+    for (size_t j = i + 1; j < proxies.size(); ++j) {
+      if (aabb_vs_aabb(tree.fat_aabb(proxies[i]), tree.fat_aabb(proxies[j]))) {
+        pairs.emplace_back(std::min(proxies[i], proxies[j]), std::max(proxies[i], proxies[j]));
+      }
+    }
+  }
+  std::sort(pairs.begin(), pairs.end());
+  return pairs;
+}
+
+TEST_CASE("AABB vs AABB")
+{
+  AABB a(glm::vec3(0.0f), glm::vec3(2.0f));
+
+  CHECK(aabb_vs_aabb(a, AABB(glm::vec3(1.0f), glm::vec3(3.0f))));
+  CHECK(aabb_vs_aabb(a, AABB(glm::vec3(0.5f), glm::vec3(1.0f))));
+  CHECK(aabb_vs_aabb(a, AABB(glm::vec3(2.0f, 0.0f, 0.0f), glm::vec3(3.0f, 1.0f, 1.0f))));  // touching
+  CHECK(!aabb_vs_aabb(a, AABB(glm::vec3(2.5f, 0.0f, 0.0f), glm::vec3(3.0f, 1.0f, 1.0f))));
+  CHECK(!aabb_vs_aabb(a, AABB(glm::vec3(0.0f, -3.0f, 0.0f), glm::vec3(1.0f, -1.0f, 1.0f))));
+}
+
+TEST_CASE("Ray vs AABB")
+{
+  AABB box(glm::vec3(-1.0f), glm::vec3(1.0f));
+  float t = -1.0f;
+
+  CHECK(ray_vs_aabb(Ray(glm::vec3(-5.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f)), box, t));
+  CHECK(t == 4.0f);
+
+  CHECK(ray_vs_aabb(Ray(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)), box, t));
+  CHECK(t == 0.0f);
+
+  CHECK(!ray_vs_aabb(Ray(glm::vec3(-5.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f)), box, t));
+  CHECK(!ray_vs_aabb(Ray(glm::vec3(-5.0f, 2.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f)), box, t));
+}
+
+TEST_CASE("AABBTree")
+{
+  AABBTree tree(0.2f);
+  std::vector<AABB> boxes = random_objects(2000, 500.0f, 1);
+  std::vector<int> proxies;
+
+  for (size_t i = 0; i < boxes.size(); ++i) proxies.push_back(tree.insert(boxes[i], i));
+
+  REQUIRE(tree.validate());
+  CHECK(tree.size() == boxes.size());
+  CHECK(tree.fat_aabb(proxies[10]).contains(boxes[10]));
+  CHECK(tree.user_data(proxies[10]) == 10);
+  // a balanced tree has a height of 11
+  CHECK(tree.height() < 30);
+
+  std::mt19937 gen(2);
+
+  auto check_queries = [&]() {
+    std::uniform_real_distribution<float> position(0.0f, 500.0f);
+
+    for (int i = 0; i < 50; ++i) {
+      glm::vec3 center(position(gen), 25.0f, position(gen));
+      AABB area = AABB::from_center_and_size(center, glm::vec3(40.0f));
+
+      std::set<int> found;
+      tree.query(area, [&](int proxy) { return found.insert(proxy).second; });
+      CHECK(found == brute_force(tree, proxies, [&](const AABB& fat) { return aabb_vs_aabb(fat, area); }));
+
+      glm::vec3 target(position(gen), 0.0f, position(gen));
+      glm::mat4 view = glm::lookAt(center, target, glm::vec3(0.0f, 1.0f, 0.0f));
+      Frustum frustum(glm::perspective(glm::radians(45.0f), 1.5f, 1.0f, 200.0f) * view);
+
+      found.clear();
+      tree.query(frustum, [&](int proxy) { return found.insert(proxy).second; });
+      CHECK(found == brute_force(tree, proxies, [&](const AABB& fat) { return aabb_vs_frustum(fat, frustum); }));
+
+      Ray ray = Ray::between_points(center, target);
+      const float max_t = 300.0f;
+
+      found.clear();
+      tree.ray_cast(ray, max_t, [&](int proxy) {
+        found.insert(proxy);
+        return max_t;
+      });
+      CHECK(found == brute_force(tree, proxies, [&](const AABB& fat) {
+              float t;
+              return ray_vs_aabb(ray, fat, t) && t <= max_t;
+            }));
+
+      // closest hit
+      float closest = max_t;
+      int closest_proxy = AABBTree::NULL_NODE;
+      tree.ray_cast(ray, max_t, [&](int proxy) {
+        float t;
+        if (ray_vs_aabb(ray, tree.fat_aabb(proxy), t) && t < closest) {
+          closest = t;
+          closest_proxy = proxy;
+        }
+        return closest;
+      });
+
+      for (int proxy : found) {
+        float t;
+        ray_vs_aabb(ray, tree.fat_aabb(proxy), t);
+        CHECK(closest <= t);
+      }
+      CHECK((found.empty() || found.contains(closest_proxy)));
+    }
+  };
+
+  SECTION("queries match testing all boxes")
+  {
+    check_queries();
+
+    std::vector<std::pair<int, int>> pairs;
+    tree.find_pairs(pairs);
+    CHECK(pairs == all_pairs(tree, proxies));
+    CHECK(!pairs.empty());
+
+    // nothing moved
+    tree.find_pairs(pairs);
+    CHECK(pairs.empty());
+  }
+
+  SECTION("moving and removing")
+  {
+    std::vector<std::pair<int, int>> pairs;
+    tree.find_pairs(pairs);
+
+    std::uniform_real_distribution<float> step(-1.0f, 1.0f);
+    std::set<int> moved;
+    int reinserted = 0;
+
+    for (int frame = 0; frame < 20; ++frame) {
+      for (size_t i = 0; i < proxies.size(); i += 3) {
+        glm::vec3 displacement(step(gen), 0.0f, step(gen));
+        boxes[i] = AABB(boxes[i].min + displacement, boxes[i].max + displacement);
+        if (tree.update(proxies[i], boxes[i], displacement)) {
+          moved.insert(proxies[i]);
+          reinserted++;
+        }
+        CHECK(tree.fat_aabb(proxies[i]).contains(boxes[i]));
+      }
+    }
+
+    REQUIRE(tree.validate());
+    // most updates do not need a reinsertion
+    CHECK(reinserted < 20 * int(proxies.size()) / 3);
+
+    tree.find_pairs(pairs);
+    std::vector<std::pair<int, int>> expected;
+    for (const auto& pair : all_pairs(tree, proxies)) {
+      if (moved.contains(pair.first) || moved.contains(pair.second)) expected.push_back(pair);
+    }
+    CHECK(pairs == expected);
+
+    std::vector<int> remaining;
+    for (size_t i = 0; i < proxies.size(); ++i) {
+      if (i % 2 == 0) {
+        tree.remove(proxies[i]);
+      } else {
+        remaining.push_back(proxies[i]);
+      }
+    }
+    proxies = remaining;
+    REQUIRE(tree.validate());
+    CHECK(tree.size() == proxies.size());
+
+    // freed nodes are reused
+    proxies.push_back(tree.insert(boxes[0]));
+    REQUIRE(tree.validate());
+
+    check_queries();
+  }
+
+  SECTION("rebuild")
+  {
+    float ratio = tree.area_ratio();
+    tree.rebuild();
+
+    REQUIRE(tree.validate());
+    CHECK(tree.size() == boxes.size());
+    CHECK(tree.user_data(proxies[10]) == 10);
+    CHECK(tree.area_ratio() < ratio * 1.5f);
+
+    check_queries();
+  }
+
+  SECTION("empty")
+  {
+    for (int proxy : proxies) tree.remove(proxy);
+    proxies.clear();
+
+    REQUIRE(tree.validate());
+    CHECK(tree.size() == 0);
+    CHECK(tree.height() == 0);
+
+    tree.query(AABB(glm::vec3(-1000.0f), glm::vec3(1000.0f)), [](int) {
+      FAIL();
+      return true;
+    });
+
+    tree.rebuild();
+    REQUIRE(tree.validate());
+  }
+}
+
+TEST_CASE("AABBTree benchmark", "[.][benchmark]")
+{
+  using Clock = std::chrono::steady_clock;
+  auto ms_since = [](Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  };
+
+  for (size_t count : {size_t(1000), size_t(10000), size_t(100000), size_t(1000000)}) {
+    // the same density of objects for all counts
+    const float extent = 20.0f * std::sqrt(float(count));
+    std::vector<AABB> boxes = random_objects(count, extent, 3);
+
+    AABBTree tree(0.2f);
+    std::vector<int> proxies;
+    proxies.reserve(count);
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < count; ++i) proxies.push_back(tree.insert(boxes[i], i));
+    double insert_ms = ms_since(start);
+    float insert_ratio = tree.area_ratio();
+    int insert_height = tree.height();
+
+    start = Clock::now();
+    tree.rebuild();
+    double rebuild_ms = ms_since(start);
+
+    // all objects are new
+    std::vector<std::pair<int, int>> pairs;
+    start = Clock::now();
+    tree.find_pairs(pairs);
+    double all_pairs_ms = ms_since(start);
+    size_t num_all_pairs = pairs.size();
+
+    // a tenth of the objects move by up to a meter
+    std::mt19937 gen(4);
+    std::uniform_real_distribution<float> step(-1.0f, 1.0f);
+    start = Clock::now();
+    for (size_t i = 0; i < count; i += 10) {
+      glm::vec3 displacement(step(gen), 0.0f, step(gen));
+      boxes[i] = AABB(boxes[i].min + displacement, boxes[i].max + displacement);
+      tree.update(proxies[i], boxes[i], displacement);
+    }
+    double update_ms = ms_since(start);
+
+    start = Clock::now();
+    tree.find_pairs(pairs);
+    double pairs_ms = ms_since(start);
+    size_t num_pairs = pairs.size();
+
+    const int num_queries = 1000;
+    std::uniform_real_distribution<float> position(0.0f, extent);
+    size_t found = 0;
+    start = Clock::now();
+    for (int i = 0; i < num_queries; ++i) {
+      AABB area = AABB::from_center_and_size(glm::vec3(position(gen), 25.0f, position(gen)), glm::vec3(50.0f));
+      tree.query(area, [&](int) { return ++found; });
+    }
+    double query_us = ms_since(start) * 1000.0 / num_queries;
+
+    start = Clock::now();
+    for (int i = 0; i < num_queries; ++i) {
+      glm::vec3 origin(position(gen), 30.0f, position(gen));
+      Ray ray = Ray::between_points(origin, origin + glm::vec3(step(gen), -0.2f, step(gen)));
+      tree.ray_cast(ray, 1000.0f, [&](int proxy) {
+        float t;
+        return ray_vs_aabb(ray, tree.fat_aabb(proxy), t) ? t : 1000.0f;
+      });
+    }
+    double ray_us = ms_since(start) * 1000.0 / num_queries;
+
+    start = Clock::now();
+    for (int i = 0; i < 100; ++i) {
+      glm::vec3 origin(position(gen), 30.0f, position(gen));
+      glm::mat4 view = glm::lookAt(origin, origin + glm::vec3(step(gen), -0.3f, step(gen)), glm::vec3(0, 1, 0));
+      Frustum frustum(glm::perspective(glm::radians(45.0f), 1.5f, 1.0f, 500.0f) * view);
+      tree.query(frustum, [&](int) { return ++found; });
+    }
+    double frustum_us = ms_since(start) * 1000.0 / 100;
+
+    std::cout << count << " objects: insert " << insert_ms << " ms (height " << insert_height << ", area ratio "
+              << insert_ratio << "), rebuild " << rebuild_ms << " ms (height " << tree.height() << ", area ratio "
+              << tree.area_ratio() << "), all pairs " << all_pairs_ms << " ms (" << num_all_pairs << "), update 10% "
+              << update_ms << " ms, pairs of moved " << pairs_ms << " ms (" << num_pairs << "), box query " << query_us
+              << " us, ray " << ray_us << " us, frustum " << frustum_us << " us (" << found << ")\n";
+
+    if (count <= 10000) {
+      start = Clock::now();
+      size_t brute_pairs = 0;
+      for (size_t i = 0; i < count; ++i) {
+        for (size_t j = i + 1; j < count; ++j) brute_pairs += aabb_vs_aabb(boxes[i], boxes[j]);
+      }
+      std::cout << "  all pairs without the tree: " << ms_since(start) << " ms (" << brute_pairs << ")\n";
+    }
+  }
+}
@@ -1,5 +1,7 @@
 #include <catch2/catch_approx.hpp>
 #include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <random>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
@@ -53,6 +55,26 @@ TEST_CASE("Create AABB from points")
 {
   std::vector points = {glm::vec3(7.0f, 0.0f, 1.0f), glm::vec3(-1.0f, 5.0f, 2.0f), glm::vec3(-1.0f, -5.0f, -2.0f)};
   AABB bb = AABB::from_points(points.begin(), points.end());
+  CHECK(bb.min == glm::vec3(-1.0f, -5.0f, -2.0f));
+  CHECK(bb.max == glm::vec3(7.0f, 5.0f, 2.0f));
+
+  // all negative
+  std::vector below = {glm::vec3(-7.0f, -1.0f, -1.0f), glm::vec3(-1.0f, -5.0f, -2.0f)};
+  CHECK(AABB::from_points(below.begin(), below.end()).max == glm::vec3(-1.0f, -1.0f, -1.0f));
+}
+
+TEST_CASE("AABB vertices")
+{
+  AABB bb(glm::vec3(-1.0f, -2.0f, -3.0f), glm::vec3(1.0f, 2.0f, 3.0f));
+  auto vertices = bb.vertices();
+
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    CHECK(glm::abs(vertices[i]) == glm::vec3(1.0f, 2.0f, 3.0f));
+    for (size_t j = 0; j < i; ++j) CHECK(vertices[i] != vertices[j]);
+  }
+
+  CHECK(bb.positive_vertex(glm::vec3(1.0f, -1.0f, 0.0f)) == glm::vec3(1.0f, -2.0f, 3.0f));
+  CHECK(bb.negative_vertex(glm::vec3(1.0f, -1.0f, 0.0f)) == glm::vec3(-1.0f, 2.0f, -3.0f));
 }
 
 TEST_CASE("Point vs Plane")
@@ -173,4 +195,118 @@ TEST_CASE("AABB vs Frustum")
 
     REQUIRE(aabb_vs_frustum(bb, frustum) == false);
   }
-}
\ No newline at end of file
+}
+
+// all 8 corners against all 6 planes, what aabb_vs_frustum did before
+static Containment classify_reference(const AABB& aabb, const Frustum& frustum)
+{
+  Containment result = Containment::INSIDE;
+
+  for (const Plane& plane : frustum.planes) {
+    int out = 0;
+    for (const glm::vec3& corner : aabb.vertices()) {
+      if (plane.signed_distance(corner) < 0.0f) out++;
+    }
+
+    if (out == 8) return Containment::OUTSIDE;
+    if (out > 0) result = Containment::INTERSECTING;
+  }
+
+  return result;
+}
+
+static std::vector<AABB> random_boxes(size_t count, unsigned seed)
+{
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> position(-200.0f, 200.0f), size(0.1f, 50.0f);
+  std::vector<AABB> boxes;
+
+  for (size_t i = 0; i < count; ++i) {
+    glm::vec3 center(position(gen), position(gen), position(gen) - 150.0f);
+    boxes.push_back(AABB::from_center_and_size(center, glm::vec3(size(gen), size(gen), size(gen))));
+  }
+
+  return boxes;
+}
+
+TEST_CASE("Classify AABB vs Frustum")
+{
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.3f, -0.2f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  glm::mat4 proj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 1.0f, 300.0f);
+  Frustum frustum(proj * view);
+
+  SECTION("inside, intersecting and outside")
+  {
+    Frustum straight(glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 1.0f, 1000.0f));
+
+    CHECK(classify_aabb_vs_frustum(AABB::from_center_and_size(glm::vec3(0.0f, 0.0f, -50.0f), glm::vec3(1.0f)),
+                                   straight) == Containment::INSIDE);
+    CHECK(classify_aabb_vs_frustum(AABB::from_center_and_size(glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(1.0f)),
+                                   straight) == Containment::INTERSECTING);
+    CHECK(classify_aabb_vs_frustum(AABB::from_center_and_size(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(1.0f)),
+                                   straight) == Containment::OUTSIDE);
+  }
+
+  SECTION("the rejecting plane is remembered")
+  {
+    Frustum straight(glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 1.0f, 1000.0f));
+    AABB beyond = AABB::from_center_and_size(glm::vec3(0.0f, 0.0f, -2000.0f), glm::vec3(1.0f));
+    AABB inside = AABB::from_center_and_size(glm::vec3(0.0f, 0.0f, -50.0f), glm::vec3(1.0f));
+
+    std::size_t hint = Frustum::NEAR;
+    CHECK(classify_aabb_vs_frustum(beyond, straight, &hint) == Containment::OUTSIDE);
+    CHECK(hint == Frustum::FAR);
+
+    // not changed if nothing rejects
+    CHECK(classify_aabb_vs_frustum(inside, straight, &hint) == Containment::INSIDE);
+    CHECK(hint == Frustum::FAR);
+  }
+
+  SECTION("matches testing all corners")
+  {
+    std::vector<AABB> boxes = random_boxes(20000, 7);
+    std::size_t hint = 0;
+    int outside = 0, intersecting = 0, inside = 0;
+
+    for (const AABB& box : boxes) {
+      Containment expected = classify_reference(box, frustum);
+      CHECK(classify_aabb_vs_frustum(box, frustum) == expected);
+      CHECK(classify_aabb_vs_frustum(box, frustum, &hint) == expected);
+      CHECK(aabb_vs_frustum(box, frustum) == (expected != Containment::OUTSIDE));
+
+      outside += expected == Containment::OUTSIDE;
+      intersecting += expected == Containment::INTERSECTING;
+      inside += expected == Containment::INSIDE;
+    }
+
+    // all cases are covered
+    CHECK(outside > 100);
+    CHECK(intersecting > 100);
+    CHECK(inside > 100);
+  }
+}
+
+TEST_CASE("AABB vs Frustum benchmark", "[.][benchmark]")
+{
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.3f, -0.2f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  glm::mat4 proj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 1.0f, 300.0f);
+  Frustum frustum(proj * view);
+
+  // boxes next to each other, like the tiles of a quad tree, so consecutive boxes are rejected by the same plane
+  std::vector<AABB> boxes = random_boxes(200000, 8);
+  std::sort(boxes.begin(), boxes.end(), [](const AABB& a, const AABB& b) { return a.min.x < b.min.x; });
+
+  auto measure = [&](const char* name, auto&& test) {
+    int result = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const AABB& box : boxes) result += test(box);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << ns / double(boxes.size()) << " ns per box (" << result << ")\n";
+  };
+
+  std::size_t hint = 0;
+  measure("all corners", [&](const AABB& box) { return int(classify_reference(box, frustum)); });
+  measure("p-vertex", [&](const AABB& box) { return int(aabb_vs_frustum(box, frustum)); });
+  measure("p/n-vertex", [&](const AABB& box) { return int(classify_aabb_vs_frustum(box, frustum)); });
+  measure("p/n-vertex with hint", [&](const AABB& box) { return int(classify_aabb_vs_frustum(box, frustum, &hint)); });
+}
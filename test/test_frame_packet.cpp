@@ -0,0 +1,220 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cmath>
+#include <iostream>
+#include <set>
+
+#include "Common.h"
+#include "FramePacket.h"
+#include "TaskScheduler.h"
+#include "TestScene.h"
+#include "TileUtils.h"
+
+static bool same_draws(const FramePacket& a, const FramePacket& b)
+{
+  if (a.draws.size() != b.draws.size()) return false;
+  for (size_t i = 0; i < a.draws.size(); ++i) {
+    if (a.draws[i].tile != b.draws[i].tile) return false;
+  }
+  return true;
+}
+
+TEST_CASE("FramePreparer")
+{
+  TestScene scene;
+  FramePreparer preparer = scene.preparer();
+  const glm::vec3 forward = glm::normalize(glm::vec3(1.0f, -0.3f, 0.2f));
+  const FrameInput input = scene.input(glm::vec3(0.0f, 3000.0f * scene.scaling_factor, 0.0f), forward);
+
+  FramePacket packet;
+  preparer.prepare(input, packet);
+
+  SECTION("visible tiles")
+  {
+    REQUIRE(!packet.draws.empty());
+    CHECK(packet.frame == 0);
+    CHECK(packet.max_zoom > packet.min_zoom);
+    CHECK(packet.nodes_visited > int64_t(packet.draws.size()));
+    CHECK(packet.nodes_culled > 0);
+
+    for (size_t i = 0; i < packet.draws.size(); ++i) {
+      const DrawItem& item = packet.draws[i];
+      CHECK(int(item.tile.zoom) >= packet.min_zoom);
+      CHECK(int(item.tile.zoom) <= packet.max_zoom);
+      CHECK(item.tile.zoom == scene.root_tile.zoom + item.depth);
+      if (i > 0) CHECK(packet.draws[i - 1].depth >= item.depth);
+    }
+  }
+
+  SECTION("deterministic")
+  {
+    FramePreparer other = scene.preparer();
+    FramePacket other_packet;
+    other.prepare(input, other_packet);
+    CHECK(same_draws(packet, other_packet));
+
+    TaskScheduler scheduler(4);
+    FramePacket parallel_packet;
+    other.prepare(input, parallel_packet, &scheduler);
+    CHECK(parallel_packet.frame == 1);
+    CHECK(same_draws(packet, parallel_packet));
+    CHECK(packet.nodes_visited == parallel_packet.nodes_visited);
+    CHECK(packet.nodes_culled == parallel_packet.nodes_culled);
+  }
+
+  SECTION("culling")
+  {
+    FrameInput no_culling = input;
+    no_culling.frustum_culling = false;
+
+    FramePacket all;
+    preparer.prepare(no_culling, all);
+    CHECK(all.draws.size() > packet.draws.size());
+    CHECK(all.nodes_culled == 0);
+  }
+
+  SECTION("manual zoom")
+  {
+    FrameInput manual = input;
+    manual.manual_zoom = true;
+    manual.min_zoom = int(scene.root_tile.zoom) + 1;
+    manual.max_zoom = int(scene.root_tile.zoom) + 3;
+
+    preparer.prepare(manual, packet);
+    CHECK(packet.min_zoom == manual.min_zoom);
+    CHECK(packet.max_zoom == manual.max_zoom);
+    for (const DrawItem& item : packet.draws) {
+      CHECK(int(item.tile.zoom) >= manual.min_zoom);
+      CHECK(int(item.tile.zoom) <= manual.max_zoom);
+    }
+  }
+
+  SECTION("prefetch while moving")
+  {
+    FrameInput moving = input;
+    for (int i = 0; i < 30; ++i) {
+      moving.position += glm::vec3(2.0f, 0.0f, 0.0f);
+      preparer.prepare(moving, packet);
+    }
+    CHECK(!packet.prefetch.empty());
+
+    moving.prefetching = false;
+    preparer.prepare(moving, packet);
+    CHECK(packet.prefetch.empty());
+  }
+}
+
+TEST_CASE("FramePreparer on a curved earth")
+{
+  // a root tile thousands of kilometers wide, the camera 10 km above the middle of it
+  TestScene scene(3);
+  scene.elevation = [](const glm::vec2&) { return 0.0f; };
+  FramePreparer preparer = scene.preparer();
+
+  const glm::vec3 eye(0.0f, 10000.0f * scene.scaling_factor, 0.0f);
+  FrameInput input = scene.input(eye, glm::normalize(glm::vec3(1.0f, -0.05f, 0.2f)));
+  input.curved_earth = true;
+
+  FramePacket curved, flat;
+  preparer.prepare(input, curved);
+  input.curved_earth = false;
+  preparer.prepare(input, flat);
+
+  REQUIRE(!curved.draws.empty());
+  CHECK(curved.nodes_beyond_horizon > 0);
+  CHECK(flat.nodes_beyond_horizon == 0);
+  CHECK(curved.draws.size() < flat.draws.size());
+
+  // 10 km up the horizon is 357 km away, and the highest mountains can be seen from 336 km further
+  const float max_distance = (357000.0f + 336000.0f) * scene.scaling_factor * 1.1f;
+  for (const DrawItem& item : curved.draws) {
+    const glm::vec2 closest = glm::clamp(glm::vec2(eye.x, eye.z), item.min, item.max);
+    CHECK(glm::length(closest) < max_distance);
+  }
+}
+
+TEST_CASE("Curved earth benchmark", "[.][benchmark]")
+{
+  TestScene scene(3);
+  scene.elevation = [](const glm::vec2&) { return 0.0f; };
+  FramePreparer preparer = scene.preparer();
+  FramePacket packet;
+  const int frames = 100;
+
+  for (float altitude : {1000.0f, 10000.0f, 100000.0f}) {
+    int64_t drawn = 0, drawn_flat = 0, beyond = 0;
+    double prepare_ms = 0.0, prepare_flat_ms = 0.0;
+
+    for (int i = 0; i < frames; ++i) {
+      const float yaw = float(i) / float(frames) * 6.28f;
+      FrameInput input = scene.input(glm::vec3(0.0f, altitude * scene.scaling_factor, 0.0f),
+                                     glm::normalize(glm::vec3(std::cos(yaw), -0.05f, std::sin(yaw))));
+      input.curved_earth = true;
+      preparer.prepare(input, packet);
+      drawn += int64_t(packet.draws.size());
+      beyond += packet.nodes_beyond_horizon;
+      prepare_ms += packet.prepare_ms;
+
+      input.curved_earth = false;
+      preparer.prepare(input, packet);
+      drawn_flat += int64_t(packet.draws.size());
+      prepare_flat_ms += packet.prepare_ms;
+    }
+
+    std::cout << "curved earth at " << altitude << " m: " << double(drawn) / frames << " instead of "
+              << double(drawn_flat) / frames << " tiles, " << double(beyond) / frames << " beyond the horizon, "
+              << prepare_ms / frames << " ms per frame (flat " << prepare_flat_ms / frames << " ms)\n";
+  }
+}
+
+TEST_CASE("FramePreparer with several root tiles")
+{
+  TestScene scene;
+  FramePreparer preparer = scene.preparer();
+  RootGrid grid(scene.root_tile, scene.bounds);
+  preparer.set_roots(grid.roots());
+
+  // close to the east edge of the center tile, looking east
+  const glm::vec3 forward = glm::normalize(glm::vec3(1.0f, -0.2f, 0.1f));
+  const glm::vec3 eye(scene.bounds.max.x * 0.9f, 3000.0f * scene.scaling_factor, 0.0f);
+
+  FramePacket packet;
+  preparer.prepare(scene.input(eye, forward), packet);
+
+  std::set<TileId> roots;
+  for (const DrawItem& item : packet.draws) {
+    const RootTile* root = grid.find(item.tile);
+    REQUIRE(root != nullptr);
+    roots.insert(root->id);
+
+    // drawn where the root tile is
+    CHECK(contains(item.min, root->bounds));
+    CHECK(contains(item.max, root->bounds));
+  }
+  CHECK(roots.count(scene.root_tile) == 1);
+  CHECK(roots.count(scene.root_tile.neighbour(1, 0)) == 1);
+
+  SECTION("the same tiles after rebasing")
+  {
+    // across the edge, in the world space of the center tile and rebased onto the east tile
+    const glm::vec3 across = eye + glm::vec3(scene.bounds.size().x * 0.2f, 0.0f, 0.0f);
+    FramePacket before, after;
+    preparer.prepare(scene.input(across, forward), before);
+
+    const RootGrid old_grid = grid;
+    const glm::vec2 offset = grid.update(glm::vec2(across.x, across.z));
+    REQUIRE(offset == glm::vec2(scene.bounds.size().x, 0.0f));
+    preparer.set_roots(grid.roots(), offset);
+    preparer.prepare(scene.input(across - glm::vec3(offset.x, 0.0f, offset.y), forward), after);
+
+    // the root tiles in both windows
+    std::set<TileId> tiles_before, tiles_after;
+    for (const DrawItem& item : before.draws) {
+      if (grid.find(item.tile)) tiles_before.insert(item.tile);
+    }
+    for (const DrawItem& item : after.draws) {
+      if (old_grid.find(item.tile)) tiles_after.insert(item.tile);
+    }
+    CHECK(!tiles_after.empty());
+    CHECK(tiles_before == tiles_after);
+  }
+}
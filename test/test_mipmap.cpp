@@ -0,0 +1,182 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <random>
+
+#include "Mipmap.h"
+#include "TileCache.h"
+
+static std::vector<uint8_t> random_pixels(int width, int height, int channels, unsigned seed)
+{
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> dist(0, 255);
+  std::vector<uint8_t> pixels(size_t(width) * height * channels);
+  for (auto& p : pixels) p = uint8_t(dist(gen));
+  return pixels;
+}
+
+TEST_CASE("Mip chain sizes")
+{
+  std::vector<uint8_t> pixels = random_pixels(13, 6, 3, 1);
+  MipChain chain = generate_mipmaps(pixels.data(), 13, 6, 3, MipFilter::LINEAR);
+
+  REQUIRE(chain.levels.size() == 4);  // 13x6, 6x3, 3x1, 1x1
+  CHECK(chain.levels[0] == pixels);
+  CHECK(chain.levels[1].size() == 6 * 3 * 3);
+  CHECK(chain.levels[2].size() == 3 * 1 * 3);
+  CHECK(chain.levels[3].size() == 3);
+  CHECK(chain.size() == (78 + 18 + 3 + 1) * 3);
+
+  CHECK(generate_mipmaps(pixels.data(), 256, 1, 1, MipFilter::LINEAR).levels.size() == 9);
+}
+
+TEST_CASE("Mip filters")
+{
+  SECTION("linear matches the straightforward box filter")
+  {
+    // not a multiple of the SIMD width
+    const int width = 37, height = 21, channels = 3;
+    std::vector<uint8_t> pixels = random_pixels(width, height, channels, 2);
+    std::vector<uint8_t> result = downsample(pixels.data(), width, height, channels, MipFilter::LINEAR);
+
+    auto at = [&](int x, int y, int c) { return int(pixels[(size_t(y) * width + x) * channels + c]); };
+
+    for (int y = 0; y < height / 2; ++y) {
+      for (int x = 0; x < width / 2; ++x) {
+        for (int c = 0; c < channels; ++c) {
+          int sum = at(2 * x, 2 * y, c) + at(2 * x + 1, 2 * y, c) + at(2 * x, 2 * y + 1, c) + at(2 * x + 1, 2 * y + 1, c);
+          CHECK(int(result[(size_t(y) * (width / 2) + x) * channels + c]) == (sum + 2) / 4);
+        }
+      }
+    }
+  }
+
+  SECTION("srgb averages in linear space")
+  {
+    const uint8_t checker[] = {0, 0, 0, 255, 255, 255, 255, 255, 255, 0, 0, 0};
+    CHECK(downsample(checker, 2, 2, 3, MipFilter::LINEAR)[0] == 128);
+    CHECK(downsample(checker, 2, 2, 3, MipFilter::SRGB)[0] == 188);
+
+    // alpha is not gamma encoded
+    const uint8_t transparent[] = {0, 0, 0, 0, 255, 255, 255, 255, 0, 0, 0, 0, 255, 255, 255, 255};
+    std::vector<uint8_t> result = downsample(transparent, 2, 2, 4, MipFilter::SRGB);
+    CHECK(result[0] == 188);
+    CHECK(result[3] == 128);
+  }
+
+  SECTION("uniform colors are kept")
+  {
+    for (int value = 0; value < 256; ++value) {
+      std::vector<uint8_t> pixels(4 * 4 * 3, uint8_t(value));
+      MipChain chain = generate_mipmaps(pixels.data(), 4, 4, 3, MipFilter::SRGB);
+      CHECK(int(chain.levels.back()[0]) == value);
+    }
+  }
+
+  SECTION("max keeps peaks and whole pixels")
+  {
+    std::vector<uint8_t> heights(64 * 64 * 3, 0);
+    // the larger first channel wins, even if the last one is smaller
+    heights[(10 * 64 + 20) * 3 + 0] = 200;
+    heights[(10 * 64 + 20) * 3 + 2] = 1;
+    heights[(11 * 64 + 21) * 3 + 0] = 199;
+    heights[(11 * 64 + 21) * 3 + 2] = 255;
+
+    MipChain chain = generate_mipmaps(heights.data(), 64, 64, 3, MipFilter::MAX);
+    REQUIRE(chain.levels.size() == 7);
+
+    for (size_t level = 1; level < chain.levels.size(); ++level) {
+      int x = 20 >> level, y = 10 >> level, w = mip_size(64, level);
+      const uint8_t* pixel = &chain.levels[level][(size_t(y) * w + x) * 3];
+      CHECK(int(pixel[0]) == 200);
+      CHECK(int(pixel[2]) == 1);
+    }
+  }
+}
+
+TEST_CASE("Parent synthesis")
+{
+  // the children are the quadrants of a larger image, the parent is that image downsampled like a server would
+  const int size = 64, channels = 3;
+  std::vector<uint8_t> full = random_pixels(2 * size, 2 * size, channels, 4);
+  const TileId parent_tile(3U, 2U, 5U);
+  const std::array<TileId, 4> child_tiles = parent_tile.children();
+
+  std::array<std::vector<uint8_t>, 4> quadrants;
+  std::array<ImageView, 4> children;
+
+  for (size_t i = 0; i < child_tiles.size(); ++i) {
+    int offset_x = int(child_tiles[i].x - 2 * parent_tile.x) * size;
+    int offset_y = int(child_tiles[i].y - 2 * parent_tile.y) * size;  // y points south, like image rows
+
+    for (int y = 0; y < size; ++y) {
+      const uint8_t* row = &full[(size_t(offset_y + y) * 2 * size + offset_x) * channels];
+      quadrants[i].insert(quadrants[i].end(), row, row + size * channels);
+    }
+
+    children[i] = ImageView(quadrants[i].data(), size, size, channels);
+  }
+
+  for (MipFilter filter : {MipFilter::LINEAR, MipFilter::SRGB, MipFilter::MAX}) {
+    CHECK(synthesize_parent(children, filter) == downsample(full.data(), 2 * size, 2 * size, channels, filter));
+  }
+}
+
+static double psnr(const uint8_t* a, const uint8_t* b, size_t size)
+{
+  double error = 0.0;
+  for (size_t i = 0; i < size; ++i) error += (double(a[i]) - double(b[i])) * (double(a[i]) - double(b[i]));
+  return 10.0 * std::log10(255.0 * 255.0 / (error / double(size)));
+}
+
+TEST_CASE("Synthesized parents match downloaded ones", "[.][network]")
+{
+  TileServiceConfig config = ORTHO_TILE_SERVICE;
+  config.cache_dir = "tiles/synthesis-test";
+  config.bundle_dir = "";
+  TileService service(config);
+
+  for (unsigned zoom : {8U, 12U, 15U}) {
+    const TileId parent_tile(Coordinate(47.2692f, 11.4041f), zoom);
+
+    std::array<ImageView, 4> children;
+    for (size_t i = 0; i < children.size(); ++i) {
+      Image* image = service.get_tile_sync(parent_tile.children()[i]);
+      REQUIRE((image && image->loaded()));
+      children[i] = ImageView(image->data(), image->width(), image->height(), image->channels());
+    }
+
+    Image* parent = service.get_tile_sync(parent_tile);
+    REQUIRE((parent && parent->loaded()));
+    REQUIRE(parent->width() == children[0].width);
+
+    std::vector<uint8_t> synthesized = synthesize_parent(children, MipFilter::SRGB);
+    REQUIRE(synthesized.size() == size_t(parent->width()) * parent->height() * parent->channels());
+
+    // different resampling and JPEG artifacts, but the same picture
+    double quality = psnr(synthesized.data(), parent->data(), synthesized.size());
+    std::cout << parent_tile.to_string() << ": " << quality << " dB PSNR\n";
+    CHECK(quality > 25.0);
+  }
+
+  std::filesystem::remove_all(config.cache_dir);
+}
+
+TEST_CASE("Mip chain benchmark", "[.][benchmark]")
+{
+  const int size = 256, iterations = 200;
+  std::vector<uint8_t> pixels = random_pixels(size, size, 3, 3);
+
+  for (MipFilter filter : {MipFilter::LINEAR, MipFilter::SRGB, MipFilter::MAX}) {
+    auto start = std::chrono::steady_clock::now();
+    size_t bytes = 0;
+    for (int i = 0; i < iterations; ++i) bytes += generate_mipmaps(pixels.data(), size, size, 3, filter).size();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const char* names[] = {"linear", "srgb", "max"};
+    std::cout << names[int(filter)] << ": " << ms / iterations << " ms per 256x256 RGB tile, " << bytes / iterations
+              << " bytes\n";
+  }
+}
@@ -0,0 +1,128 @@
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+
+#include "NormalMap.h"
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/io.hpp>
+
+static std::vector<uint8_t> random_heights(int width, int height, unsigned seed)
+{
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> dist(0, 255);
+  std::vector<uint8_t> heights(std::size_t(width) * height);
+  for (auto& h : heights) h = uint8_t(dist(gen));
+  return heights;
+}
+
+static int max_difference(const NormalMap& a, const NormalMap& b)
+{
+  int max_diff = 0;
+  for (std::size_t i = 0; i < a.data.size(); ++i) {
+    max_diff = std::max(max_diff, std::abs(int(a.data[i]) - int(b.data[i])));
+  }
+  return max_diff;
+}
+
+TEST_CASE("Octahedral encoding")
+{
+  std::vector normals = {
+      glm::vec3(0.0f, 1.0f, 0.0f),
+      glm::vec3(0.0f, -1.0f, 0.0f),
+      glm::vec3(1.0f, 0.0f, 0.0f),
+      glm::vec3(0.0f, 0.0f, -1.0f),
+      glm::normalize(glm::vec3(1.0f, 2.0f, 3.0f)),
+      glm::normalize(glm::vec3(-1.0f, -2.0f, 0.5f)),
+  };
+
+  for (const auto& normal : normals) {
+    glm::vec3 decoded = decode_octahedral(encode_octahedral(normal));
+    CHECK(glm::all(glm::epsilonEqual(normal, decoded, 0.001f)));
+  }
+}
+
+TEST_CASE("Normal map")
+{
+  const int size = 37;  // not a multiple of the SIMD width
+  const float height_scaling_factor = 3795.0f, pixel_size = 30.0f;
+  const std::array<HeightView, 4> no_neighbours{};
+
+  SECTION("flat terrain points up")
+  {
+    std::vector<uint8_t> heights(size * size, 100);
+    NormalMap normal_map = compute_normal_map(HeightView(heights.data(), size, size, 1), no_neighbours,
+                                              height_scaling_factor, pixel_size);
+
+    REQUIRE(normal_map.data.size() == size * size * 2);
+
+    for (int y = 0; y < size; ++y) {
+      for (int x = 0; x < size; ++x) {
+        CHECK(glm::all(glm::epsilonEqual(normal_map.normal(x, y), glm::vec3(0.0f, 1.0f, 0.0f), 0.01f)));
+      }
+    }
+  }
+
+  SECTION("slope rising towards east tilts normal west")
+  {
+    std::vector<uint8_t> heights(size * size);
+    for (int y = 0; y < size; ++y) {
+      for (int x = 0; x < size; ++x) heights[y * size + x] = uint8_t(x * 2);
+    }
+
+    NormalMap normal_map = compute_normal_map(HeightView(heights.data(), size, size, 1), no_neighbours,
+                                              height_scaling_factor, pixel_size);
+
+    // the border is extrapolated, so it has the same slope as the interior
+    glm::vec3 border = normal_map.normal(0, size / 2);
+    glm::vec3 interior = normal_map.normal(size / 2, size / 2);
+
+    CHECK(interior.x < 0.0f);
+    CHECK(glm::all(glm::epsilonEqual(border, interior, 0.01f)));
+  }
+
+  SECTION("vectorized matches reference")
+  {
+    auto center = random_heights(size, size, 1);
+    auto west = random_heights(size, size, 2);
+    auto north = random_heights(size, size, 3);
+
+    std::array<HeightView, 4> neighbours{};
+    neighbours[NormalMap::WEST] = HeightView(west.data(), size, size, 1);
+    neighbours[NormalMap::NORTH] = HeightView(north.data(), size, size, 1);
+
+    HeightView view(center.data(), size, size, 1);
+
+    for (float scale : {1.0f, 100.0f, 3795.0f}) {
+      NormalMap fast = compute_normal_map(view, neighbours, scale, pixel_size);
+      NormalMap reference = compute_normal_map_reference(view, neighbours, scale, pixel_size);
+      REQUIRE(fast.data.size() == reference.data.size());
+      CHECK(max_difference(fast, reference) <= 1);
+    }
+  }
+
+  SECTION("borders are seamless with neighbours")
+  {
+    // one continuous ramp split into two tiles
+    std::vector<uint8_t> west(size * size), east(size * size);
+    for (int y = 0; y < size; ++y) {
+      for (int x = 0; x < size; ++x) {
+        west[y * size + x] = uint8_t((x * x) / 32);
+        east[y * size + x] = uint8_t(((x + size) * (x + size)) / 32);
+      }
+    }
+
+    std::array<HeightView, 4> west_neighbours{}, east_neighbours{};
+    west_neighbours[NormalMap::EAST] = HeightView(east.data(), size, size, 1);
+    east_neighbours[NormalMap::WEST] = HeightView(west.data(), size, size, 1);
+
+    NormalMap west_normals =
+        compute_normal_map(HeightView(west.data(), size, size, 1), west_neighbours, 100.0f, pixel_size);
+    NormalMap east_normals =
+        compute_normal_map(HeightView(east.data(), size, size, 1), east_neighbours, 100.0f, pixel_size);
+
+    // the step between the two border pixels should be no larger than between interior ones
+    float step_across = glm::distance(west_normals.normal(size - 1, 0), east_normals.normal(0, 0));
+    float step_inside = glm::distance(east_normals.normal(0, 0), east_normals.normal(1, 0));
+    CHECK(step_across <= step_inside + 0.01f);
+  }
+}
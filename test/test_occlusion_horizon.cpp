@@ -0,0 +1,181 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <iostream>
+#include <set>
+
+#include "FramePacket.h"
+#include "OcclusionHorizon.h"
+#include "ResidentHeights.h"
+#include "TestScene.h"
+
+TEST_CASE("Occlusion horizon")
+{
+  OcclusionHorizon horizon;
+  horizon.reset(glm::vec3(0.0f));
+
+  // a block 10 units away, 20 high
+  const Bounds<glm::vec2> block(glm::vec2(10.0f, -2.0f), glm::vec2(12.0f, 2.0f));
+  horizon.add_occluder(block, 20.0f);
+
+  SECTION("behind the block")
+  {
+    const Bounds<glm::vec2> behind(glm::vec2(30.0f, -1.0f), glm::vec2(32.0f, 1.0f));
+    CHECK(horizon.is_occluded(behind, 40.0f));
+    CHECK(!horizon.is_occluded(behind, 60.0f));
+  }
+
+  SECTION("beside the block")
+  {
+    CHECK(!horizon.is_occluded(Bounds<glm::vec2>(glm::vec2(30.0f, 10.0f), glm::vec2(32.0f, 12.0f)), 0.0f));
+    CHECK(!horizon.is_occluded(Bounds<glm::vec2>(glm::vec2(-32.0f, -1.0f), glm::vec2(-30.0f, 1.0f)), 0.0f));
+
+    // partly behind it
+    CHECK(!horizon.is_occluded(Bounds<glm::vec2>(glm::vec2(30.0f, -1.0f), glm::vec2(32.0f, 20.0f)), 0.0f));
+  }
+
+  SECTION("around the eye")
+  {
+    CHECK(!horizon.is_occluded(Bounds<glm::vec2>(glm::vec2(-1.0f), glm::vec2(1.0f)), -100.0f));
+
+    // the direction of the block wraps around from -pi to pi
+    horizon.add_occluder(Bounds<glm::vec2>(glm::vec2(-12.0f, -2.0f), glm::vec2(-10.0f, 2.0f)), 20.0f);
+    CHECK(horizon.is_occluded(Bounds<glm::vec2>(glm::vec2(-32.0f, -1.0f), glm::vec2(-30.0f, 1.0f)), 40.0f));
+  }
+
+  SECTION("looking down")
+  {
+    horizon.reset(glm::vec3(0.0f, 100.0f, 0.0f));
+    horizon.add_occluder(block, 0.0f);
+    CHECK(!horizon.is_occluded(Bounds<glm::vec2>(glm::vec2(30.0f, -1.0f), glm::vec2(32.0f, 1.0f)), 0.0f));
+  }
+}
+
+// A flat valley between two ridges that run from south to north, the camera flies along it. Only the
+// height ranges of the tiles are used, so they are exact.
+struct ValleyScene : TestScene {
+  const float valley_width{width * 0.01f}, ridge_width{width * 0.05f}, ridge_height{width * 0.005f};
+
+  ValleyScene()
+  {
+    elevation = [](const glm::vec2&) { return 0.0f; };
+    height_range = [this](const TileId& tile) { return ridge_range(tile); };
+    field_of_view = 60.0f;
+  }
+
+  // height_range points at this scene
+  ValleyScene(const ValleyScene&) = delete;
+
+  // the ridges are where ridge_min <= |x| <= ridge_max
+  std::optional<Bounds<float>> ridge_range(const TileId& tile) const
+  {
+    Bounds<glm::vec2> area = tile_bounds(tile);
+    float near = std::min(std::abs(area.min.x), std::abs(area.max.x));
+    float far = std::max(std::abs(area.min.x), std::abs(area.max.x));
+    if (area.min.x <= 0.0f && 0.0f <= area.max.x) near = 0.0f;
+
+    const float ridge_min = valley_width / 2.0f, ridge_max = ridge_min + ridge_width;
+    bool all_ridge = ridge_min <= near && far <= ridge_max;
+    bool some_ridge = near <= ridge_max && ridge_min <= far;
+    return Bounds<float>(all_ridge ? ridge_height : 0.0f, some_ridge ? ridge_height : 0.0f);
+  }
+};
+
+TEST_CASE("Occlusion culling in a valley")
+{
+  ValleyScene scene;
+  FramePreparer preparer = scene.preparer();
+
+  // low in the valley, looking across the eastern ridge
+  const glm::vec3 eye(0.0f, scene.ridge_height * 0.2f, 0.0f);
+  const FrameInput input = scene.input(eye, glm::normalize(glm::vec3(1.0f, 0.05f, 0.3f)));
+
+  FramePacket packet, all;
+  preparer.prepare(input, packet);
+
+  FrameInput no_occlusion = input;
+  no_occlusion.occlusion_culling = false;
+  preparer.prepare(no_occlusion, all);
+
+  REQUIRE(!packet.draws.empty());
+  CHECK(packet.nodes_occluded > 0);
+  CHECK(all.nodes_occluded == 0);
+  CHECK(packet.draws.size() + size_t(packet.nodes_occluded) == all.draws.size());
+  CHECK(packet.prefetch.size() < all.prefetch.size());
+  CHECK(packet.occlusion_ms > 0.0);
+
+  // only tiles completely behind the ridge are hidden
+  std::set<TileId> drawn;
+  for (const DrawItem& item : packet.draws) drawn.insert(item.tile);
+
+  for (const DrawItem& item : all.draws) {
+    if (drawn.count(item.tile)) continue;
+    CHECK(std::abs(item.min.x) >= scene.valley_width / 2.0f);
+    CHECK(std::abs(item.max.x) >= scene.valley_width / 2.0f);
+    CHECK(item.min.x * item.max.x >= 0.0f);
+  }
+
+  SECTION("high above the ridges nothing is hidden")
+  {
+    FrameInput above = scene.input(glm::vec3(0.0f, scene.ridge_height * 10.0f, 0.0f),
+                                   glm::normalize(glm::vec3(1.0f, -0.5f, 0.3f)));
+    preparer.prepare(above, packet);
+    CHECK(packet.nodes_occluded == 0);
+  }
+}
+
+TEST_CASE("Occlusion culling benchmark", "[.][benchmark]")
+{
+  ValleyScene scene;
+
+  // The ranges come from the resident index like in the renderer, the tiles down to four levels below the
+  // root are resident.
+  ResidentHeights resident;
+  const float height_scale = scene.ridge_height / 255.0f;
+  std::vector<TileId> tiles = {scene.root_tile};
+
+  for (size_t i = 0; i < tiles.size(); ++i) {
+    const Bounds<float> range = *scene.ridge_range(tiles[i]);
+    resident.insert(tiles[i], {uint8_t(range.min / height_scale + 0.5f), uint8_t(range.max / height_scale + 0.5f)});
+    if (tiles[i].zoom < scene.root_tile.zoom + 4) {
+      for (const TileId& child : tiles[i].children()) tiles.push_back(child);
+    }
+  }
+
+  scene.height_range = [&](const TileId& tile) -> std::optional<Bounds<float>> {
+    auto range = resident.height_range(tile, scene.root_tile.zoom);
+    if (!range) return std::nullopt;
+    return Bounds<float>(float(range->first) * height_scale, float(range->second) * height_scale);
+  };
+  FramePreparer preparer = scene.preparer();
+  FramePacket packet;
+
+  int64_t drawn = 0, occluded = 0, prefetched = 0, prefetched_all = 0;
+  double occlusion_ms = 0.0, prepare_ms = 0.0, prepare_all_ms = 0.0;
+  const int frames = 600;
+
+  // along the valley, looking around
+  for (int i = 0; i < frames; ++i) {
+    float t = float(i) / float(frames);
+    glm::vec3 eye(0.0f, scene.ridge_height * 0.3f, scene.bounds.min.y * 0.8f + scene.bounds.size().y * 0.8f * t);
+    float yaw = t * 12.0f;
+    FrameInput input = scene.input(eye, glm::normalize(glm::vec3(std::cos(yaw), 0.05f, std::sin(yaw))));
+
+    preparer.prepare(input, packet);
+    drawn += int64_t(packet.draws.size());
+    occluded += packet.nodes_occluded;
+    prefetched += int64_t(packet.prefetch.size());
+    occlusion_ms += packet.occlusion_ms;
+    prepare_ms += packet.prepare_ms;
+
+    input.occlusion_culling = false;
+    preparer.prepare(input, packet);
+    prefetched_all += int64_t(packet.prefetch.size());
+    prepare_all_ms += packet.prepare_ms;
+  }
+
+  std::cout << "occlusion culling: " << 100.0 * double(occluded) / double(drawn + occluded) << "% of "
+            << double(drawn + occluded) / frames << " tiles hidden, prefetch " << double(prefetched) / frames
+            << " instead of " << double(prefetched_all) / frames << " tiles, " << occlusion_ms / frames
+            << " ms per frame (prepare " << prepare_ms / frames << " ms, without " << prepare_all_ms / frames
+            << " ms)\n";
+}
@@ -0,0 +1,146 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+#include "Common.h"
+#include "MockTileServer.h"
+#include "Prefetcher.h"
+#include "QuadTree.h"
+#include "TileService.h"
+#include "TileUtils.h"
+
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/io.hpp>
+
+static bool equal(const glm::vec3& a, const glm::vec3& b, float epsilon = 0.01f)
+{
+  return glm::all(glm::epsilonEqual(a, b, epsilon));
+}
+
+TEST_CASE("Prefetcher")
+{
+  const float dt = 1.0f / 60.0f;
+
+  SECTION("straight flight")
+  {
+    Prefetcher prefetcher(3.0f, 3);
+    glm::vec3 velocity(10.0f, 0.0f, -5.0f), forward(1.0f, 0.0f, 0.0f);
+
+    for (int i = 0; i < 120; ++i) {
+      prefetcher.update({velocity * (float(i) * dt), forward}, dt);
+    }
+
+    glm::vec3 position = velocity * (119.0f * dt);
+
+    CHECK(equal(prefetcher.velocity(), velocity));
+    CHECK(equal(prefetcher.predict(2.0f).position, position + velocity * 2.0f, 0.1f));
+    CHECK(equal(prefetcher.predict(2.0f).forward, forward));
+
+    auto poses = prefetcher.predict();
+    REQUIRE(poses.size() == 3);
+    CHECK(equal(poses.back().position, position + velocity * 3.0f, 0.1f));
+  }
+
+  SECTION("turning flight")
+  {
+    Prefetcher prefetcher;
+    const float turn_rate = glm::radians(30.0f);
+
+    for (int i = 0; i < 120; ++i) {
+      float yaw = turn_rate * float(i) * dt;
+      prefetcher.update({glm::vec3(0.0f), direction_from_spherical(0.0f, yaw)}, dt);
+    }
+
+    CHECK(std::abs(prefetcher.turn_rate() - turn_rate) < 0.01f);
+
+    // after three seconds we have turned by another 90 degrees
+    glm::vec3 forward = direction_from_spherical(0.0f, turn_rate * (119.0f * dt + 3.0f));
+    CHECK(equal(prefetcher.predict(3.0f).forward, forward));
+  }
+
+  SECTION("not initialized")
+  {
+    Prefetcher prefetcher;
+    CHECK(prefetcher.predict().empty());
+  }
+}
+
+#if MOCK_TILE_SERVER
+static std::vector<TileId> leaf_tiles(const glm::vec2& center, const Bounds<glm::vec2>& bounds, unsigned depth)
+{
+  QuadTree quad_tree(clamp_range(center, bounds), bounds.min, bounds.max, depth, TileId(6U, 34U, 22U));
+  std::vector<TileId> tiles;
+  for (Node* node : quad_tree.leaves()) tiles.push_back(node->id);
+  return tiles;
+}
+
+static void wait_for_requests(TileService& service)
+{
+  while (service.stats().in_flight > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+// The tiles come from a local tile server through the TileService. Visible
+// tiles are requested first, prefetching starts when they have arrived, and
+// the next frame starts when all requests are done. Returns the fraction of
+// frames where every leaf was rendered with its own tile.
+static float scripted_flight(const MockTileServer& server, bool prefetch)
+{
+  const Bounds<glm::vec2> bounds(glm::vec2(-500.0f), glm::vec2(500.0f));
+  const unsigned depth = 6, num_frames = 600;
+  const float dt = 1.0f / 60.0f, speed = 100.0f, turn_rate = 0.3f;
+
+  const std::string cache = "tiles/prefetcher-test";
+  std::filesystem::remove_all(cache);
+
+  TileServiceConfig config = {server.url(), UrlPattern::ZXY_Y_SOUTH, ".png", cache};
+  TileService service(config);
+  auto now = std::chrono::steady_clock::now();
+  service.prefetch_clock = [&]() { return now; };
+
+  Prefetcher prefetcher(2.0f, 4);
+
+  unsigned at_target_zoom = 0;
+  glm::vec3 position(0.0f, 100.0f, -400.0f);
+
+  for (unsigned frame = 0; frame < num_frames; ++frame) {
+    // fly a wide curve across the terrain
+    glm::vec3 forward = direction_from_spherical(0.0f, turn_rate * float(frame) * dt);
+    position += forward * speed * dt;
+    now += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(dt));
+
+    prefetcher.update({position, forward}, dt);
+
+    auto visible = leaf_tiles({position.x, position.z}, bounds, depth);
+
+    bool complete = true;
+    for (const auto& tile : visible) complete = complete && service.get_tile_cached(tile);
+    if (complete) at_target_zoom++;
+
+    for (const auto& tile : visible) (void)service.get_tile(tile);
+    wait_for_requests(service);
+
+    if (prefetch) {
+      for (const auto& pose : prefetcher.predict()) {
+        service.prefetch(leaf_tiles({pose.position.x, pose.position.z}, bounds, depth));
+      }
+      wait_for_requests(service);
+    }
+  }
+
+  std::filesystem::remove_all(cache);
+  return float(at_target_zoom) / float(num_frames);
+}
+
+TEST_CASE("Prefetching along scripted flight path")
+{
+  MockTileServer server;
+
+  float without_prefetch = scripted_flight(server, false);
+  float with_prefetch = scripted_flight(server, true);
+
+  CHECK(with_prefetch > without_prefetch);
+}
+#endif
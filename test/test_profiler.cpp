@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "Profiler.h"
+
+static std::string read_file(const std::string& filename)
+{
+  std::ifstream file(filename);
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  return buffer.str();
+}
+
+TEST_CASE("Profiler")
+{
+  Profiler profiler(3);
+
+  SECTION("scopes")
+  {
+    profiler.begin_frame();
+    {
+      auto outer = profiler.scope("outer");
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      for (int i = 0; i < 2; ++i) {
+        auto inner = profiler.scope("inner");
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+    profiler.end_frame();
+
+    const FrameStats& frame = profiler.last_frame();
+    REQUIRE(frame.scopes.size() == 3);
+    CHECK(frame.scopes[0].depth == 0);
+    CHECK(frame.scopes[1].depth == 1);
+    CHECK(frame.scopes[2].depth == 1);
+    CHECK(frame.cpu_ms("inner") >= 2.0);
+    CHECK(frame.cpu_ms("outer") >= frame.cpu_ms("inner") + 2.0);
+    CHECK(frame.duration_ms >= frame.cpu_ms("outer"));
+  }
+
+  SECTION("timings from other threads")
+  {
+    profiler.begin_frame();
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    profiler.record_cpu("prepare", 1.5);
+    profiler.end_frame();
+
+    const FrameStats& frame = profiler.last_frame();
+    REQUIRE(frame.scopes.size() == 1);
+    CHECK(frame.cpu_ms("prepare") == 1.5);
+    CHECK(frame.scopes[0].start_ms >= 0.5);
+  }
+
+  SECTION("counters and gauges")
+  {
+    profiler.begin_frame();
+    profiler.count("nodes");
+    profiler.count("nodes", 4);
+    profiler.set("resident", 10);
+    profiler.end_frame();
+
+    CHECK(profiler.last_frame().counters.at("nodes") == 5);
+    CHECK(profiler.last_frame().counters.at("resident") == 10);
+
+    profiler.begin_frame();
+    profiler.end_frame();
+
+    CHECK(!profiler.last_frame().counters.contains("nodes"));
+    CHECK(profiler.last_frame().counters.at("resident") == 10);
+  }
+
+  SECTION("history")
+  {
+    for (int i = 0; i < 5; ++i) {
+      profiler.begin_frame();
+      profiler.end_frame();
+    }
+
+    CHECK(profiler.history().size() == 3);
+    CHECK(profiler.history().front().index == 2);
+    CHECK(profiler.last_frame().index == 4);
+  }
+
+  SECTION("late gpu timings")
+  {
+    profiler.begin_frame();
+    uint64_t frame = profiler.frame_index();
+    profiler.end_frame();
+
+    profiler.begin_frame();
+    profiler.record_gpu("terrain", frame, 1.5);
+    profiler.end_frame();
+
+    CHECK(profiler.history().front().gpu_ms.at("terrain") == 1.5);
+    CHECK(profiler.last_frame().gpu_ms.empty());
+    CHECK(profiler.average_gpu_ms("terrain") == 1.5);
+  }
+
+  SECTION("disabled")
+  {
+    profiler.enabled = false;
+    profiler.begin_frame();
+    {
+      auto scope = profiler.scope("scope");
+      profiler.count("counter");
+    }
+    profiler.end_frame();
+
+    CHECK(profiler.last_frame().scopes.empty());
+    CHECK(profiler.last_frame().counters.empty());
+  }
+
+  SECTION("export")
+  {
+    for (int i = 0; i < 2; ++i) {
+      profiler.begin_frame();
+      {
+        auto scope = profiler.scope("quadtree");
+      }
+      profiler.count("nodes drawn", 7);
+      profiler.record_gpu("sky", profiler.frame_index(), 0.25);
+      profiler.end_frame();
+    }
+
+    REQUIRE(profiler.write_chrome_trace("profiler-test.json"));
+    std::string trace = read_file("profiler-test.json");
+    CHECK(trace.starts_with("{\"traceEvents\":["));
+    CHECK(trace.find("\"name\":\"quadtree\",\"ph\":\"X\"") != std::string::npos);
+    CHECK(trace.find("\"name\":\"sky\",\"ph\":\"X\",\"pid\":1,\"tid\":2") != std::string::npos);
+    CHECK(trace.find("\"name\":\"nodes drawn\",\"ph\":\"C\"") != std::string::npos);
+
+    REQUIRE(profiler.write_csv("profiler-test.csv"));
+    std::string csv = read_file("profiler-test.csv");
+    CHECK(csv.starts_with("frame,frame_ms,quadtree_ms,gpu sky_ms,nodes drawn\n"));
+    CHECK(std::count(csv.begin(), csv.end(), '\n') == 3);
+
+    std::filesystem::remove("profiler-test.json");
+    std::filesystem::remove("profiler-test.csv");
+  }
+}
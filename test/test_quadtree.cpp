@@ -1,11 +1,15 @@
 #include <catch2/catch_test_macros.hpp>
+#include <chrono>
 #include <iostream>
 
+#include "Collision.h"
 #include "Common.h"
 #include "QuadTree.h"
+#include "TaskScheduler.h"
 #include "TileUtils.h"
 
 #define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/io.hpp>
 
 void print(const std::vector<Node*> nodes)
@@ -59,3 +63,80 @@ TEST_CASE("Create QuadTree")
     // REQUIRE(nodes.size() == (1 + 4 + 4));
   }
 }
+
+// a camera looking over the terrain from the lod center, roughly what the renderer does
+static Frustum test_frustum(const glm::vec2& center)
+{
+  glm::vec3 eye(center.x, 50.0f, center.y);
+  glm::vec3 target(center.x + 100.0f, 0.0f, center.y + 100.0f);
+  glm::mat4 view = glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+  glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 10000.0f);
+  return Frustum(projection * view);
+}
+
+static bool is_visible_leaf(const Node* node, const Frustum& frustum)
+{
+  return node->is_leaf && aabb_vs_frustum(AABB({node->min.x, 0.0f, node->min.y}, {node->max.x, 100.0f, node->max.y}),
+                                          frustum);
+}
+
+TEST_CASE("Parallel QuadTree")
+{
+  const TileId root_tile = TileId(0U, 0U, 0U);
+  const auto bounds = Bounds<glm::vec2>(glm::vec2(0.0f), glm::vec2(10000.0f));
+  const glm::vec2 center(3210.0f, 4321.0f);
+  const Frustum frustum = test_frustum(center);
+  auto filter = [&frustum](Node* node) { return is_visible_leaf(node, frustum); };
+
+  TaskScheduler scheduler(4);
+
+  for (unsigned max_depth : {0U, 1U, 2U, 3U, 8U, 14U}) {
+    QuadTree serial(center, bounds.min, bounds.max, max_depth, root_tile);
+    QuadTree parallel(center, bounds.min, bounds.max, max_depth, root_tile, &scheduler);
+
+    auto serial_nodes = serial.nodes();
+    auto parallel_nodes = parallel.nodes();
+    REQUIRE(serial_nodes.size() == parallel_nodes.size());
+    for (size_t i = 0; i < serial_nodes.size(); ++i) {
+      CHECK(serial_nodes[i]->id == parallel_nodes[i]->id);
+    }
+
+    auto serial_selected = serial.select(filter);
+    auto parallel_selected = parallel.select(filter, &scheduler);
+    REQUIRE(serial_selected.size() == parallel_selected.size());
+    for (size_t i = 0; i < serial_selected.size(); ++i) {
+      CHECK(serial_selected[i]->id == parallel_selected[i]->id);
+    }
+  }
+}
+
+TEST_CASE("Parallel QuadTree benchmark", "[.][benchmark]")
+{
+  using Clock = std::chrono::steady_clock;
+  const TileId root_tile = TileId(0U, 0U, 0U);
+  const auto bounds = Bounds<glm::vec2>(glm::vec2(0.0f), glm::vec2(100000.0f));
+  const glm::vec2 center(32100.0f, 43210.0f);
+  const Frustum frustum = test_frustum(center);
+  auto filter = [&frustum](Node* node) { return is_visible_leaf(node, frustum); };
+  const int iterations = 200;
+
+  std::cout << "max depth, nodes, threads, build + cull ms\n";
+
+  for (unsigned max_depth : {8U, 12U, 16U, 20U}) {
+    for (size_t num_threads : {size_t(0), size_t(1), size_t(2), size_t(4), size_t(8)}) {
+      // 0 threads is the single threaded version without a scheduler
+      std::unique_ptr<TaskScheduler> scheduler;
+      if (num_threads > 0) scheduler = std::make_unique<TaskScheduler>(num_threads);
+
+      size_t num_nodes = 0;
+      auto start = Clock::now();
+      for (int i = 0; i < iterations; ++i) {
+        QuadTree quad_tree(center, bounds.min, bounds.max, max_depth, root_tile, scheduler.get());
+        num_nodes = quad_tree.select(filter, scheduler.get()).size();
+      }
+      float ms = std::chrono::duration<float, std::milli>(Clock::now() - start).count() / iterations;
+
+      std::cout << max_depth << ", " << num_nodes << ", " << num_threads << ", " << ms << "\n";
+    }
+  }
+}
@@ -0,0 +1,138 @@
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "CameraPath.h"
+#include "LodReplay.h"
+
+// hover over the terrain, then fly straight ahead
+static CameraPath test_path(size_t hover_frames, size_t flight_frames)
+{
+  CameraPath path;
+  path.root_tile = TileId(Coordinate(47.2692f, 11.4041f), 6);
+  path.max_zoom_level_range = 5;
+  float width = wms::tile_width(47.2692f, 6) * 0.01f;
+  path.bounds = Bounds<glm::vec2>(glm::vec2(-width / 2.0f), glm::vec2(width / 2.0f));
+
+  float scaling_factor = width / path.root_tile.width_in_meters();
+  glm::vec3 position(0.0f, 3000.0f * scaling_factor, 0.0f);
+  glm::vec3 forward = glm::normalize(glm::vec3(1.0f, -0.3f, 0.2f));
+  glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 1.0f, 100000.0f);
+
+  for (size_t i = 0; i < hover_frames + flight_frames; ++i) {
+    if (i >= hover_frames) position += glm::vec3(forward.x, 0.0f, forward.z) * 0.5f;
+    path.frames.push_back({1.0f / 60.0f, position, forward, projection, 800.0f});
+  }
+
+  return path;
+}
+
+TEST_CASE("CameraPath")
+{
+  CameraPath path = test_path(3, 2);
+  const std::string filename = "test_camera_path.txt";
+
+  REQUIRE(write_camera_path(filename, path));
+
+  CameraPath loaded;
+  REQUIRE(read_camera_path(filename, loaded));
+  std::filesystem::remove(filename);
+
+  CHECK(loaded.root_tile == path.root_tile);
+  CHECK(loaded.max_zoom_level_range == path.max_zoom_level_range);
+  CHECK(loaded.bounds.min == path.bounds.min);
+  CHECK(loaded.bounds.max == path.bounds.max);
+  REQUIRE(loaded.frames.size() == path.frames.size());
+
+  for (size_t i = 0; i < path.frames.size(); ++i) {
+    CHECK(loaded.frames[i].dt == path.frames[i].dt);
+    CHECK(loaded.frames[i].position == path.frames[i].position);
+    CHECK(loaded.frames[i].forward == path.frames[i].forward);
+    CHECK(loaded.frames[i].projection == path.frames[i].projection);
+    CHECK(loaded.frames[i].elevation == path.frames[i].elevation);
+  }
+
+  CHECK(!read_camera_path("does_not_exist.txt", loaded));
+}
+
+TEST_CASE("SimulatedTileSource")
+{
+  SimulatedTileSource source(2, 1);
+  const TileId a(1U, 0U, 0U), b(1U, 1U, 0U);
+
+  CHECK(!source.get_tile(a));
+  CHECK(!source.get_tile(b));
+  CHECK(!source.get_tile(a));
+  CHECK(source.num_requested() == 2);
+
+  // one request at a time, two frames each
+  source.update();
+  source.update();
+  CHECK(!source.is_resident(a));
+  source.update();
+  CHECK(source.is_resident(a));
+  CHECK(!source.is_resident(b));
+  source.update();
+  source.update();
+  CHECK(source.is_resident(b));
+  CHECK(source.num_pending() == 0);
+
+  // prefetching only while nothing is pending
+  const TileId c(1U, 0U, 1U), d(1U, 1U, 1U);
+  source.prefetch({c, d});
+  CHECK(source.num_prefetched() == 1);
+  CHECK(source.num_pending() == 1);
+}
+
+TEST_CASE("LodReplay")
+{
+  CameraPath path = test_path(240, 120);
+
+  ReplayConfig config;
+  std::vector<ReplayFrameStats> frames = LodReplay(path, config).run();
+  REQUIRE(frames.size() == path.frames.size());
+
+  for (const auto& frame : frames) {
+    CHECK(frame.tiles_drawn > 0);
+    CHECK(frame.tiles_fallback + frame.tiles_placeholder <= frame.tiles_drawn);
+  }
+
+  // nothing is loaded in the first frame
+  CHECK(frames.front().tiles_placeholder == frames.front().tiles_drawn);
+
+  // after hovering for a while all visible tiles are loaded
+  CHECK(frames[239].tiles_fallback == 0);
+  CHECK(frames[239].tiles_placeholder == 0);
+  CHECK(frames[239].tiles_requested == 0);
+
+  // the flight requests new tiles
+  size_t requested = 0;
+  for (size_t i = 240; i < frames.size(); ++i) requested += frames[i].tiles_requested;
+  CHECK(requested > 0);
+
+  SECTION("deterministic")
+  {
+    config.num_threads = 4;
+    std::vector<ReplayFrameStats> parallel = LodReplay(path, config).run();
+    REQUIRE(parallel.size() == frames.size());
+
+    for (size_t i = 0; i < frames.size(); ++i) {
+      CHECK(parallel[i].tiles_drawn == frames[i].tiles_drawn);
+      CHECK(parallel[i].tiles_requested == frames[i].tiles_requested);
+      CHECK(parallel[i].tiles_fallback == frames[i].tiles_fallback);
+      CHECK(parallel[i].max_fallback_depth == frames[i].max_fallback_depth);
+    }
+  }
+
+  SECTION("prefetching")
+  {
+    config.prefetching = false;
+    std::vector<ReplayFrameStats> without = LodReplay(path, config).run();
+
+    size_t prefetched = 0;
+    for (const auto& frame : frames) prefetched += frame.tiles_prefetched;
+    CHECK(prefetched > 0);
+
+    for (const auto& frame : without) CHECK(frame.tiles_prefetched == 0);
+  }
+}
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <set>
+#include <unordered_map>
+
+#include "ResidentHeights.h"
+#include "ResidentTiles.h"
+
+// what the renderer did before, walking up with a lookup per level
+static std::optional<TileId> walk_up(const std::set<TileId>& resident, TileId tile)
+{
+  while (true) {
+    if (resident.contains(tile)) return tile;
+    if (tile.zoom == 0) return std::nullopt;
+    tile = tile.parent();
+  }
+}
+
+static TileId random_tile(std::mt19937& gen, unsigned max_zoom)
+{
+  unsigned zoom = std::uniform_int_distribution<unsigned>(0, max_zoom)(gen);
+  // a small area, so the tiles are related
+  unsigned x = (1U << zoom) / 3 + std::uniform_int_distribution<unsigned>(0, 3)(gen);
+  unsigned y = (1U << zoom) / 5 + std::uniform_int_distribution<unsigned>(0, 3)(gen);
+  return TileId(zoom, x & ((1U << zoom) - 1), y & ((1U << zoom) - 1));
+}
+
+TEST_CASE("TileId keys")
+{
+  const TileId tile(10U, 549U, 358U);
+
+  static_assert(TileId(1U, 1U, 0U).parent() == TileId());
+  static_assert(TileId().children()[2] == TileId(1U, 1U, 1U));
+  static_assert(TileId::from_key(TileId(16U, 34567U, 23456U).key()) == TileId(16U, 34567U, 23456U));
+
+  CHECK(TileId::from_key(tile.key()) == tile);
+  CHECK(TileId::from_key(TileId().key()) == TileId());
+  CHECK(tile.ancestor(8) == tile.parent().parent());
+  CHECK(tile.ancestor(10) == tile);
+
+  for (const TileId& child : tile.children()) {
+    CHECK(child.parent() == tile);
+    CHECK(tile.contains(child));
+    CHECK(tile.contains(child.children()[3]));
+    CHECK(!child.contains(tile));
+    CHECK(!tile.neighbour(1, 0).contains(child));
+  }
+  CHECK(tile.contains(tile));
+
+  // a tile, its descendants, then the next sibling
+  std::vector<TileId> sorted = {tile.neighbour(1, 0), tile.children()[2].children()[0], tile.parent(), tile,
+                                tile.children()[0]};
+  std::sort(sorted.begin(), sorted.end());
+  CHECK(sorted == std::vector<TileId>{tile.parent(), tile, tile.children()[0], tile.children()[2].children()[0],
+                                      tile.neighbour(1, 0)});
+}
+
+TEST_CASE("ResidentTiles")
+{
+  ResidentTiles tiles;
+  const TileId tile(10U, 549U, 358U), sibling(10U, 548U, 358U);
+
+  CHECK(!tiles.resident_ancestor(tile));
+
+  tiles.insert(tile.parent().parent());
+  REQUIRE(tiles.resident_ancestor(tile));
+  CHECK(*tiles.resident_ancestor(tile) == tile.parent().parent());
+  CHECK(tiles.num_cached_answers() == 1);
+
+  // the cached answer is updated
+  tiles.insert(tile.parent());
+  CHECK(*tiles.resident_ancestor(tile) == tile.parent());
+
+  tiles.insert(tile);
+  CHECK(*tiles.resident_ancestor(tile) == tile);
+  CHECK(tiles.num_cached_answers() == 0);
+
+  // siblings are not affected
+  CHECK(*tiles.resident_ancestor(sibling) == tile.parent());
+
+  tiles.erase(tile.parent());
+  CHECK(*tiles.resident_ancestor(sibling) == tile.parent().parent());
+
+  tiles.erase(tile.parent().parent());
+  CHECK(!tiles.resident_ancestor(sibling));
+  CHECK(tiles.size() == 1);
+
+  SECTION("matches walking up")
+  {
+    std::mt19937 gen(42);
+    ResidentTiles random;
+    std::set<TileId> resident;
+    std::vector<TileId> asked;
+
+    for (int i = 0; i < 20000; ++i) {
+      TileId t = random_tile(gen, 16);
+      int action = std::uniform_int_distribution<int>(0, 9)(gen);
+
+      if (action < 2) {
+        random.insert(t);
+        resident.insert(t);
+      } else if (action < 3) {
+        random.erase(t);
+        resident.erase(t);
+      } else {
+        asked.push_back(t);
+        CHECK(random.resident_ancestor(t) == walk_up(resident, t));
+      }
+    }
+
+    // answers that were cached earlier are still correct
+    for (const auto& t : asked) CHECK(random.resident_ancestor(t) == walk_up(resident, t));
+
+    for (const auto& t : asked) {
+      std::vector<TileId> descendants;
+      for (const auto& r : resident) {
+        if (r != t && t.contains(r)) descendants.push_back(r);
+      }
+      CHECK(random.resident_descendants(t) == descendants);
+    }
+  }
+  SECTION("old answers are dropped")
+  {
+    CHECK(tiles.num_cached_answers() == 1);
+
+    for (unsigned frame = 0; frame < 10 * ResidentTiles::MAX_ANSWER_AGE; ++frame) {
+      CHECK(!tiles.resident_ancestor(TileId(12U, 2000U + frame, 1400U)));
+      (void)tiles.resident_ancestor(sibling);
+      tiles.end_frame();
+    }
+
+    // the tiles of the last frames and the one that is asked for every frame
+    CHECK(tiles.num_cached_answers() <= 2 * ResidentTiles::MAX_ANSWER_AGE + 1);
+    CHECK(!tiles.resident_ancestor(sibling));
+
+    for (unsigned frame = 0; frame < 2 * ResidentTiles::MAX_ANSWER_AGE; ++frame) tiles.end_frame();
+    CHECK(tiles.num_cached_answers() == 0);
+  }
+}
+
+TEST_CASE("ResidentHeights")
+{
+  ResidentHeights heights;
+  const TileId tile(10U, 549U, 358U);
+  const TileId deep = tile.children()[3].children()[1];
+
+  CHECK(!heights.has_resident_below(tile));
+
+  heights.insert(tile, {10, 50});
+  CHECK(heights.contains(tile));
+  CHECK(!heights.has_resident_below(tile));
+  CHECK(heights.has_resident_below(tile.parent()));
+
+  heights.insert(deep, {30, 40});
+  CHECK(heights.has_resident_below(tile));
+  CHECK(heights.has_resident_below(tile.children()[3]));
+  CHECK(!heights.has_resident_below(tile.children()[0]));
+  CHECK(!heights.has_resident_below(deep));
+  CHECK(!heights.has_resident_below(tile.neighbour(1, 0)));
+  CHECK(heights.size() == 2);
+
+  // from the tile itself, or its deepest resident ancestor
+  using Range = std::pair<uint8_t, uint8_t>;
+  CHECK(heights.height_range(deep) == Range(30, 40));
+  CHECK(heights.height_range(deep.children()[2]) == Range(30, 40));
+  CHECK(heights.height_range(tile.children()[3]) == Range(10, 50));
+  CHECK(!heights.height_range(tile.parent()));
+  CHECK(!heights.height_range(tile.children()[0], tile.zoom + 1));
+}
+
+TEST_CASE("ResidentTiles benchmark", "[.][benchmark]")
+{
+  // fast zoom in: the visible tiles are at zoom 13 to 16, but only the coarse levels are resident
+  std::mt19937 gen(1);
+  const TileId center(Coordinate(47.2692f, 11.4041f), 16);
+  const int frames = 200, tiles_per_frame = 300;
+
+  std::vector<std::vector<TileId>> frame_tiles(frames);
+  for (auto& tiles : frame_tiles) {
+    for (int i = 0; i < tiles_per_frame; ++i) {
+      unsigned zoom = std::uniform_int_distribution<unsigned>(13, 16)(gen);
+      int dx = std::uniform_int_distribution<int>(-8, 8)(gen), dy = std::uniform_int_distribution<int>(-8, 8)(gen);
+      unsigned shift = 16 - zoom;
+      tiles.push_back(TileId(zoom, (center.x >> shift) + dx, (center.y >> shift) + dy));
+    }
+  }
+
+  ResidentTiles resident;
+  std::unordered_map<std::string, int> textures;  // like TileCache::m_gpu_cache, keyed by name
+
+  for (unsigned zoom = 0; zoom <= 9; ++zoom) {
+    TileId tile(zoom, center.x >> (16 - zoom), center.y >> (16 - zoom));
+    resident.insert(tile);
+    textures[tile.to_string() + "+0"] = 1;
+  }
+
+  auto measure = [&](auto&& lookup) {
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& tiles : frame_tiles) {
+      for (const auto& tile : tiles) found += lookup(tile);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return std::make_pair(ms / frames, found);
+  };
+
+  auto [walk_ms, walk_found] = measure([&](TileId tile) {
+    while (tile.zoom > 0) {
+      tile = tile.parent();
+      if (textures.contains(tile.to_string() + "+0")) return 1;
+    }
+    return 0;
+  });
+
+  auto [index_ms, index_found] = measure([&](const TileId& tile) { return resident.resident_ancestor(tile) ? 1 : 0; });
+
+  CHECK(walk_found == index_found);
+  std::cout << "fallback lookups for " << tiles_per_frame << " tiles per frame: " << walk_ms
+            << " ms walking up with string keys, " << index_ms << " ms with ResidentTiles\n";
+}
+
+TEST_CASE("Z-order benchmark", "[.][benchmark]")
+{
+  // all tiles down to zoom 16 around a camera path are resident, the way they are after a flight along a valley
+  const TileId center(Coordinate(47.2692f, 11.4041f), 16);
+  ResidentTiles resident;
+  std::unordered_map<std::string, int> by_name;  // like TileCache::m_gpu_cache before
+
+  for (int dx = -64; dx < 64; ++dx) {
+    for (int dy = -4; dy < 4; ++dy) {
+      for (TileId tile = center.neighbour(dx, dy); tile.zoom > 5; tile = tile.parent()) {
+        resident.insert(tile);
+        by_name[tile.to_string() + "+0"] = 1;
+      }
+    }
+  }
+
+  std::vector<TileId> queries;
+  for (int dx = -64; dx < 64; dx += 4) queries.push_back(center.neighbour(dx, 0).ancestor(11));
+
+  auto time = [](auto&& f) {
+    auto start = std::chrono::steady_clock::now();
+    size_t found = f();
+    return std::make_pair(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(),
+                          found);
+  };
+
+  auto [range_ms, range_found] = time([&]() {
+    size_t found = 0;
+    for (const TileId& query : queries) found += resident.resident_descendants(query).size();
+    return found;
+  });
+
+  // what it takes without the ordering: visiting the subtree down to the deepest zoom level
+  auto [walk_ms, walk_found] = time([&]() {
+    size_t found = 0;
+    for (const TileId& query : queries) {
+      const auto children = query.children();
+      std::vector<TileId> stack(children.begin(), children.end());
+      while (!stack.empty()) {
+        const TileId tile = stack.back();
+        stack.pop_back();
+        if (!by_name.contains(tile.to_string() + "+0")) continue;
+        found++;
+        if (tile.zoom == 16) continue;
+        for (const TileId& child : tile.children()) stack.push_back(child);
+      }
+    }
+    return found;
+  });
+
+  CHECK(range_found == walk_found);
+
+  // a camera sweep along the row of tiles, looking up each one
+  std::vector<TileId> sweep;
+  for (int dx = -64; dx < 64; ++dx) {
+    for (int dy = -4; dy < 4; ++dy) sweep.push_back(center.neighbour(dx, dy));
+  }
+
+  auto [name_ms, name_found] = time([&]() {
+    size_t found = 0;
+    for (const TileId& tile : sweep) found += by_name.contains(tile.to_string() + "+0");
+    return found;
+  });
+  auto [key_ms, key_found] = time([&]() {
+    size_t found = 0;
+    for (const TileId& tile : sweep) found += resident.contains(tile);
+    return found;
+  });
+
+  CHECK(name_found == key_found);
+  std::cout << "resident descendants of " << queries.size() << " tiles: " << range_ms << " ms as a range of keys, "
+            << walk_ms << " ms walking the subtrees\n"
+            << "sweep over " << sweep.size() << " tiles: " << name_ms << " ms with string keys, " << key_ms
+            << " ms with Z-order keys\n";
+}
@@ -0,0 +1,130 @@
+#include <catch2/catch_test_macros.hpp>
+#include <set>
+
+#include "Common.h"
+#include "RootGrid.h"
+#include "TileUtils.h"
+
+static bool near(float a, float b, float epsilon = 1e-3f) { return std::abs(a - b) <= epsilon; }
+
+TEST_CASE("RootGrid")
+{
+  const TileId innsbruck(Coordinate(47.2692f, 11.4041f), 6);
+  const float width = 100.0f;
+  const Bounds<glm::vec2> bounds(glm::vec2(-width / 2.0f), glm::vec2(width / 2.0f));
+  RootGrid grid(innsbruck, bounds);
+
+  SECTION("window around the center")
+  {
+    REQUIRE(grid.roots().size() == 9);
+    CHECK(grid.roots().front().id == innsbruck);
+    CHECK(grid.roots().front().bounds.min == bounds.min);
+
+    std::set<TileId> ids;
+    for (const RootTile& root : grid.roots()) {
+      ids.insert(root.id);
+      CHECK(root.id.zoom == innsbruck.zoom);
+      CHECK(root.bounds.size() == bounds.size());
+      CHECK(grid.tile_bounds(root.id).min == root.bounds.min);
+
+      // east is +x and south is +z
+      const glm::vec2 offset = (root.bounds.min - bounds.min) / width;
+      CHECK(int(root.id.x) - int(innsbruck.x) == int(offset.x));
+      CHECK(int(root.id.y) - int(innsbruck.y) == int(offset.y));
+    }
+    CHECK(ids.size() == 9);
+
+    CHECK(grid.extent().min == bounds.min - width);
+    CHECK(grid.extent().max == bounds.max + width);
+  }
+
+  SECTION("tiles of the root tiles")
+  {
+    const TileId east = innsbruck.neighbour(1, 0);
+    const TileId child = east.children()[2].children()[0];
+    REQUIRE(grid.find(child) != nullptr);
+    CHECK(grid.find(child)->id == east);
+    CHECK(grid.find(innsbruck.parent()) == nullptr);
+    CHECK(grid.find(innsbruck.neighbour(3, 0)) == nullptr);
+
+    REQUIRE(grid.find(glm::vec2(width, 0.0f)) != nullptr);
+    CHECK(grid.find(glm::vec2(width, 0.0f))->id == east);
+    CHECK(grid.find(glm::vec2(width * 2.0f, 0.0f)) == nullptr);
+  }
+
+  SECTION("rebase onto another tile")
+  {
+    CHECK(grid.update(glm::vec2(width * 0.4f, -width * 0.4f)) == glm::vec2(0.0f));
+    CHECK(grid.center() == innsbruck);
+
+    const glm::vec2 point(width * 0.7f, -width * 0.6f);
+    const DCoordinate before = grid.point_to_coordinate(point);
+
+    const glm::vec2 offset = grid.update(point);
+    CHECK(offset == glm::vec2(width, -width));
+    CHECK(grid.center() == innsbruck.neighbour(1, -1));
+    CHECK(grid.roots().front().id == grid.center());
+    CHECK(grid.bounds().min == bounds.min);
+    CHECK(contains(point - offset, grid.bounds()));
+
+    const DCoordinate after = grid.point_to_coordinate(point - offset);
+    CHECK(near(before.lat, after.lat));
+    CHECK(near(before.lon, after.lon));
+
+    // and back
+    CHECK(grid.update(glm::vec2(-width * 0.7f, width * 0.6f)) == glm::vec2(-width, width));
+    CHECK(grid.center() == innsbruck);
+  }
+
+  SECTION("coordinates")
+  {
+    const Coordinate coord(47.5f, 18.0f);  // east of the center tile
+    const glm::vec2 point = grid.coordinate_to_point(coord);
+    CHECK(point.x > bounds.max.x);
+
+    const DCoordinate back = grid.point_to_coordinate(point);
+    CHECK(near(float(back.lat), coord.lat));
+    CHECK(near(float(back.lon), coord.lon));
+  }
+
+  SECTION("tiles at the deepest zoom level")
+  {
+    for (float x = -40.0f; x < 150.0f; x += 13.7f) {
+      const TileId tile(grid.point_to_coordinate(glm::vec2(x, x * 0.3f)), TileId::MAX_ZOOM);
+      const Bounds<DCoordinate> coords = tile.bounds<double>();
+      const glm::vec2 center = grid.coordinate_to_point(glm::mix(coords.min.to_vec2(), coords.max.to_vec2(), 0.5));
+      CHECK(TileId(grid.point_to_coordinate(center), TileId::MAX_ZOOM) == tile);
+    }
+  }
+}
+
+TEST_CASE("RootGrid at the edges of the map")
+{
+  const float width = 100.0f;
+  const Bounds<glm::vec2> bounds(glm::vec2(-width / 2.0f), glm::vec2(width / 2.0f));
+  const unsigned last = (1U << 6) - 1U;
+
+  SECTION("around the antimeridian")
+  {
+    RootGrid grid(TileId(6U, 0U, 20U), bounds);
+    REQUIRE(grid.find(glm::vec2(-width, 0.0f)) != nullptr);
+    CHECK(grid.find(glm::vec2(-width, 0.0f))->id == TileId(6U, last, 20U));
+
+    const glm::vec2 offset = grid.update(glm::vec2(-width * 0.8f, 0.0f));
+    CHECK(offset == glm::vec2(-width, 0.0f));
+    CHECK(grid.center() == TileId(6U, last, 20U));
+    CHECK(grid.find(glm::vec2(width, 0.0f))->id == TileId(6U, 0U, 20U));
+  }
+
+  SECTION("at the north edge")
+  {
+    RootGrid grid(TileId(6U, 10U, 0U), bounds);
+    CHECK(grid.roots().size() == 6);
+    CHECK(grid.update(glm::vec2(0.0f, -width * 0.8f)) == glm::vec2(0.0f));
+    CHECK(grid.clamp(glm::vec2(3.0f, -width * 3.0f)) == glm::vec2(3.0f, bounds.min.y));
+
+    RootGrid south(TileId(6U, 10U, last), bounds);
+    CHECK(south.roots().size() == 6);
+    CHECK(south.clamp(glm::vec2(0.0f, width * 3.0f)).y == bounds.max.y);
+  }
+}
@@ -0,0 +1,231 @@
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "TaskScheduler.h"
+#include "Threading.h"
+
+TEST_CASE("Task")
+{
+  SECTION("small buffer")
+  {
+    int calls = 0;
+    Task task([&calls]() { calls++; });
+    REQUIRE(task);
+
+    Task moved = std::move(task);
+    CHECK(!task);
+    moved();
+    CHECK(calls == 1);
+  }
+
+  SECTION("captures are destroyed")
+  {
+    auto counter = std::make_shared<int>(0);
+    {
+      Task task([counter]() { (*counter)++; });
+      CHECK(counter.use_count() == 2);
+      task();
+    }
+    CHECK(counter.use_count() == 1);
+    CHECK(*counter == 1);
+  }
+}
+
+TEST_CASE("ThreadedQueue")
+{
+  ThreadedQueue<int> queue;
+  const int value = 42;
+  queue.push(value);
+
+  int result = 0;
+  REQUIRE(queue.pop(result));
+  CHECK(result == 42);
+}
+
+// sum of 1..n, split recursively so the workers have to steal
+static void parallel_sum(TaskScheduler& scheduler, TaskGroup& group, std::atomic<int64_t>& sum, int64_t begin,
+                         int64_t end)
+{
+  if (end - begin <= 64) {
+    int64_t local = 0;
+    for (int64_t i = begin; i < end; ++i) local += i;
+    sum += local;
+    return;
+  }
+
+  int64_t middle = begin + (end - begin) / 2;
+  scheduler.run(group, [&scheduler, &group, &sum, begin, middle]() {
+    parallel_sum(scheduler, group, sum, begin, middle);
+  });
+  parallel_sum(scheduler, group, sum, middle, end);
+}
+
+TEST_CASE("TaskScheduler")
+{
+  TaskScheduler scheduler(4);
+
+  SECTION("task group")
+  {
+    TaskGroup group;
+    std::atomic<int> count{0};
+
+    for (int i = 0; i < 10000; ++i) {
+      scheduler.run(group, [&count]() { count++; });
+    }
+
+    scheduler.wait(group);
+    CHECK(count == 10000);
+    CHECK(group.pending() == 0);
+  }
+
+  SECTION("nested tasks")
+  {
+    TaskGroup group;
+    std::atomic<int64_t> sum{0};
+    const int64_t n = 1 << 16;
+
+    scheduler.run(group, [&]() { parallel_sum(scheduler, group, sum, 0, n); });
+    scheduler.wait(group);
+
+    CHECK(sum == n * (n - 1) / 2);
+  }
+
+  SECTION("continuation")
+  {
+    TaskGroup group;
+    std::atomic<int> count{0};
+    std::atomic<int> seen_by_continuation{-1};
+
+    for (int i = 0; i < 100; ++i) {
+      scheduler.run(group, [&count]() {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        count++;
+      });
+    }
+
+    scheduler.then(group, [&]() { seen_by_continuation = count.load(); });
+    scheduler.wait(group);
+
+    auto start = std::chrono::steady_clock::now();
+    while (seen_by_continuation < 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+      std::this_thread::yield();
+    }
+
+    CHECK(seen_by_continuation == 100);
+  }
+
+  SECTION("continuation of empty group")
+  {
+    TaskGroup group;
+    std::atomic<bool> ran{false};
+    scheduler.then(group, [&ran]() { ran = true; });
+
+    auto start = std::chrono::steady_clock::now();
+    while (!ran && std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+      std::this_thread::yield();
+    }
+    CHECK(ran);
+  }
+}
+
+TEST_CASE("TaskScheduler priorities")
+{
+  TaskScheduler scheduler(1);
+
+  // keep the only worker busy while the tasks are queued
+  std::atomic<bool> blocked{true};
+  TaskGroup blocker;
+  scheduler.run(blocker, [&blocked]() {
+    while (blocked) std::this_thread::yield();
+  });
+
+  std::mutex mutex;
+  std::vector<int> order;
+  TaskGroup group;
+
+  scheduler.run(group, [&]() { std::unique_lock lock(mutex); order.push_back(2); }, TaskPriority::LOW);
+  scheduler.run(group, [&]() { std::unique_lock lock(mutex); order.push_back(1); }, TaskPriority::NORMAL);
+  scheduler.run(group, [&]() { std::unique_lock lock(mutex); order.push_back(0); }, TaskPriority::HIGH);
+
+  // wait() would execute the queued tasks on this thread, so just spin until the worker is busy
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  blocked = false;
+
+  scheduler.wait(blocker);
+  scheduler.wait(group);
+
+  CHECK(order == std::vector<int>{0, 1, 2});
+}
+
+// Compares the single queue ThreadPool with the TaskScheduler for many tiny tasks.
+TEST_CASE("TaskScheduler contention benchmark", "[.][benchmark]")
+{
+  using Clock = std::chrono::steady_clock;
+  const int num_tasks = 100000;
+
+  std::cout << "threads, pool flat ms, scheduler flat ms, pool nested ms, scheduler nested ms\n";
+
+  for (size_t num_threads : {1, 2, 4, 8, 16, 32, 64}) {
+    std::atomic<int> remaining;
+    auto wait_until_done = [&]() {
+      while (remaining > 0) std::this_thread::yield();
+    };
+
+    float pool_flat, scheduler_flat, pool_nested, scheduler_nested;
+
+    {
+      ThreadPool pool(num_threads);
+      remaining = num_tasks;
+
+      auto start = Clock::now();
+      for (int i = 0; i < num_tasks; ++i) pool.assign_work([&remaining]() { remaining--; });
+      wait_until_done();
+      pool_flat = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+
+      // every task spawns the next ones from the workers
+      std::function<void(int)> spawn = [&](int depth) {
+        if (depth < 16) {
+          pool.assign_work([&spawn, depth]() { spawn(depth + 1); });
+          pool.assign_work([&spawn, depth]() { spawn(depth + 1); });
+        }
+        remaining--;
+      };
+
+      start = Clock::now();
+      remaining = (1 << 17) - 1;
+      pool.assign_work([&spawn]() { spawn(0); });
+      wait_until_done();
+      pool_nested = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+    }
+
+    {
+      TaskScheduler scheduler(num_threads);
+      TaskGroup group;
+
+      auto start = Clock::now();
+      for (int i = 0; i < num_tasks; ++i) scheduler.run(group, []() {});
+      scheduler.wait(group);
+      scheduler_flat = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+
+      std::function<void(int)> spawn = [&](int depth) {
+        if (depth < 16) {
+          scheduler.run(group, [&spawn, depth]() { spawn(depth + 1); });
+          scheduler.run(group, [&spawn, depth]() { spawn(depth + 1); });
+        }
+      };
+
+      start = Clock::now();
+      scheduler.run(group, [&spawn]() { spawn(0); });
+      scheduler.wait(group);
+      scheduler_nested = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+    }
+
+    std::cout << num_threads << ", " << pool_flat << ", " << scheduler_flat << ", " << pool_nested << ", "
+              << scheduler_nested << "\n";
+  }
+}
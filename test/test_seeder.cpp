@@ -0,0 +1,151 @@
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <tuple>
+
+#include "MockTileServer.h"
+#include "TileRegion.h"
+#include "TileSeeder.h"
+
+TEST_CASE("TileRegion")
+{
+  SECTION("whole world")
+  {
+    TileRegion region = TileRegion::from_bounds(-85.0f, -180.0f, 85.0f, 180.0f);
+    CHECK(region.tiles(0).size() == 1);
+    CHECK(region.tiles(2).size() == 16);
+    CHECK(region.tiles(0, 3).size() == 1 + 4 + 16 + 64);
+  }
+
+  SECTION("bounding box")
+  {
+    const Coordinate innsbruck(47.2692f, 11.4041f);
+    TileRegion region = TileRegion::from_bounds(47.0f, 11.0f, 47.5f, 12.0f);
+
+    for (unsigned zoom = 0; zoom <= 12; ++zoom) {
+      auto tiles = region.tiles(zoom);
+      REQUIRE(!tiles.empty());
+      CHECK(std::find(tiles.begin(), tiles.end(), TileId(innsbruck, zoom)) != tiles.end());
+      CHECK(std::is_sorted(tiles.begin(), tiles.end(), [](const TileId& a, const TileId& b) {
+        return std::tie(a.y, a.x) < std::tie(b.y, b.x);
+      }));
+    }
+  }
+
+  SECTION("polygon excludes tiles outside")
+  {
+    // triangle covering the lower left half of the bounding box
+    TileRegion box = TileRegion::from_bounds(47.0f, 11.0f, 48.0f, 12.0f);
+    TileRegion triangle({Coordinate(47.0f, 11.0f), Coordinate(47.0f, 12.0f), Coordinate(48.0f, 11.0f)});
+
+    auto box_tiles = box.tiles(12);
+    auto triangle_tiles = triangle.tiles(12);
+
+    CHECK(triangle_tiles.size() < box_tiles.size());
+    CHECK(triangle_tiles.size() > box_tiles.size() / 2);
+    CHECK(triangle.contains(Coordinate(47.2f, 11.2f)));
+    CHECK(!triangle.contains(Coordinate(47.8f, 11.8f)));
+    CHECK(!triangle.overlaps(TileId(Coordinate(47.9f, 11.9f), 12)));
+  }
+}
+
+#if MOCK_TILE_SERVER
+TEST_CASE("TileSeeder")
+{
+  MockTileServer server;
+
+  const std::string cache = "tiles/seed-test";
+  std::filesystem::remove_all(cache);
+
+  TileService service(server.url(), UrlPattern::ZXY_Y_SOUTH, ".png", cache);
+
+  TileRegion region = TileRegion::from_bounds(47.0f, 11.0f, 47.5f, 12.0f);
+  auto tiles = region.tiles(0, 10);
+
+  SECTION("download and resume")
+  {
+    TileSeeder seeder(service, 4);
+
+    size_t callbacks = 0;
+    SeedProgress progress = seeder.seed(tiles, [&](const SeedProgress& p) {
+      callbacks++;
+      CHECK(p.done() <= p.total);
+    });
+
+    CHECK(progress.total == tiles.size());
+    CHECK(progress.downloaded == tiles.size());
+    CHECK(progress.failed == 0);
+    CHECK(callbacks == tiles.size());
+    CHECK(server.requests == tiles.size());
+
+    for (const auto& tile : tiles) {
+      CHECK(service.is_saved_on_disk(tile));
+    }
+
+    // everything is on disk now, nothing is downloaded again
+    progress = seeder.seed(tiles);
+    CHECK(progress.skipped == tiles.size());
+    CHECK(server.requests == tiles.size());
+  }
+
+  SECTION("missing tiles")
+  {
+    server.set_missing({tiles[0], tiles[1]});
+
+    TileSeeder seeder(service, 2);
+    SeedProgress progress = seeder.seed(tiles);
+
+    CHECK(progress.not_available == 2);
+    CHECK(progress.failed == 0);
+    CHECK(progress.downloaded == tiles.size() - 2);
+
+    // remembered when resuming, not requested again
+    progress = seeder.seed(tiles);
+    CHECK(progress.not_available == 2);
+    CHECK(progress.failed == 0);
+    CHECK(progress.skipped == tiles.size() - 2);
+    CHECK(server.requests == tiles.size());
+  }
+
+  SECTION("rate limit")
+  {
+    const float rate = 50.0f;
+    std::vector<TileId> some_tiles(tiles.begin(), tiles.begin() + 10);
+
+    TileSeeder seeder(service, 4, rate);
+
+    auto start = std::chrono::steady_clock::now();
+    seeder.seed(some_tiles);
+    float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+
+    CHECK(elapsed >= float(some_tiles.size() - 1) / rate);
+  }
+
+  SECTION("size estimate")
+  {
+    TileSeeder seeder(service);
+    CHECK(seeder.estimate_size(tiles) == tiles.size() * TileSeeder::DEFAULT_TILE_SIZE);
+
+    seeder.seed(tiles);
+    size_t estimate = seeder.estimate_size(tiles);
+    CHECK(estimate > 0);
+    CHECK(estimate < tiles.size() * TileSeeder::DEFAULT_TILE_SIZE);
+
+    // between the smallest and largest tile, small files next to them are not sampled
+    std::ofstream(cache + "/marker.missing");
+    size_t smallest = SIZE_MAX, largest = 0;
+    for (const auto& tile : tiles) {
+      size_t tile_size = std::filesystem::file_size(cache + "/" + tile.to_string() + ".png");
+      smallest = std::min(smallest, tile_size);
+      largest = std::max(largest, tile_size);
+    }
+    CHECK(seeder.estimate_size(tiles) >= tiles.size() * smallest);
+    CHECK(seeder.estimate_size(tiles) <= tiles.size() * largest);
+  }
+
+  std::filesystem::remove_all(cache);
+}
+#endif
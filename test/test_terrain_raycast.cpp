@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <random>
+
+#include "TerrainRaycast.h"
+
+// rolling hills with a few sharp peaks
+static std::vector<uint8_t> terrain_heights(int width, int height, unsigned seed)
+{
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> phase(0.0f, 6.28f);
+  const float p1 = phase(gen), p2 = phase(gen);
+  std::vector<uint8_t> heights(size_t(width) * height);
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      float h = 100.0f + 50.0f * std::sin(0.11f * x + p1) * std::cos(0.07f * y + p2) + 20.0f * std::sin(0.5f * x + y);
+      heights[size_t(y) * width + x] = uint8_t(std::clamp(h, 0.0f, 255.0f));
+    }
+  }
+
+  for (int i = 0; i < 5; ++i) {
+    heights[std::uniform_int_distribution<size_t>(0, heights.size() - 1)(gen)] = 255;
+  }
+
+  return heights;
+}
+
+static bool near(float a, float b, float tolerance = 1e-3f) { return std::abs(a - b) <= tolerance; }
+
+template <typename T>
+static bool has_resident_below(const std::map<TileId, T>& resident, const TileId& tile)
+{
+  return std::any_of(resident.begin(), resident.end(),
+                     [&](const auto& item) { return item.first != tile && tile.contains(item.first); });
+}
+
+static std::optional<float> ray_vs_triangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& a,
+                                            const glm::vec3& b, const glm::vec3& c)
+{
+  glm::vec3 normal = glm::cross(b - a, c - a);
+  float denom = glm::dot(normal, direction);
+  if (denom == 0.0f) return std::nullopt;
+
+  float t = glm::dot(normal, a - origin) / denom;
+  glm::vec3 p = origin + direction * t;
+
+  // inside if p is on the same side of all edges
+  float d1 = glm::dot(glm::cross(b - a, p - a), normal);
+  float d2 = glm::dot(glm::cross(c - b, p - b), normal);
+  float d3 = glm::dot(glm::cross(a - c, p - c), normal);
+  if (d1 < 0.0f || d2 < 0.0f || d3 < 0.0f) return std::nullopt;
+
+  return t;
+}
+
+// every triangle of the heightfield
+static std::optional<float> raycast_reference(const HeightView& heights, const glm::vec3& origin,
+                                              const glm::vec3& direction, float t_min, float t_max)
+{
+  auto vertex = [&](int x, int y) { return glm::vec3(float(x), float(heights.at(x, y)), float(y)); };
+  std::optional<float> closest;
+
+  for (int y = 0; y + 1 < heights.height; ++y) {
+    for (int x = 0; x + 1 < heights.width; ++x) {
+      glm::vec3 a = vertex(x, y), b = vertex(x + 1, y), c = vertex(x + 1, y + 1), d = vertex(x, y + 1);
+
+      for (auto t : {ray_vs_triangle(origin, direction, a, b, c), ray_vs_triangle(origin, direction, a, c, d)}) {
+        if (t && t_min <= *t && *t <= t_max && (!closest || *t < *closest)) closest = t;
+      }
+    }
+  }
+
+  return closest;
+}
+
+TEST_CASE("Height pyramid")
+{
+  const int width = 37, height = 21;
+  std::vector<uint8_t> pixels = terrain_heights(width, height, 1);
+  HeightView heights(pixels.data(), width, height, 1);
+  HeightPyramid pyramid = build_height_pyramid(heights);
+
+  REQUIRE(pyramid.max_levels.size() == 6);  // blocks of 2, 4, 8, 16, 32 and 64 cells
+  CHECK(pyramid.max_levels.back().size() == 1);
+
+  for (size_t level = 0; level < pyramid.max_levels.size(); ++level) {
+    const int block = 2 << level, nx = pyramid.blocks_x(level), ny = pyramid.blocks_y(level);
+    REQUIRE(pyramid.max_levels[level].size() == size_t(nx) * ny);
+
+    for (int by = 0; by < ny; ++by) {
+      for (int bx = 0; bx < nx; ++bx) {
+        int hi = 0, lo = 255;
+        for (int y = by * block; y <= std::min((by + 1) * block, height - 1); ++y) {
+          for (int x = bx * block; x <= std::min((bx + 1) * block, width - 1); ++x) {
+            hi = std::max(hi, int(heights.at(x, y)));
+            lo = std::min(lo, int(heights.at(x, y)));
+          }
+        }
+
+        CHECK(int(pyramid.max_levels[level][size_t(by) * nx + bx]) == hi);
+        CHECK(int(pyramid.min_levels[level][size_t(by) * nx + bx]) == lo);
+      }
+    }
+  }
+
+  // ranges of cells contain the heights of their samples
+  std::mt19937 gen(4);
+  for (int i = 0; i < 100; ++i) {
+    glm::ivec2 min(std::uniform_int_distribution<int>(0, width - 2)(gen),
+                   std::uniform_int_distribution<int>(0, height - 2)(gen));
+    glm::ivec2 max(std::uniform_int_distribution<int>(min.x + 1, width - 1)(gen),
+                   std::uniform_int_distribution<int>(min.y + 1, height - 1)(gen));
+    auto [lo, hi] = height_range(pyramid, min, max);
+
+    for (int y = min.y; y <= max.y; ++y) {
+      for (int x = min.x; x <= max.x; ++x) {
+        REQUIRE(lo <= heights.at(x, y));
+        REQUIRE(heights.at(x, y) <= hi);
+      }
+    }
+  }
+
+  CHECK(height_range(pyramid, glm::ivec2(0), glm::ivec2(width - 1, height - 1)) ==
+        std::make_pair(pyramid.min_levels.back()[0], pyramid.max_levels.back()[0]));
+}
+
+TEST_CASE("Heightfield raycast")
+{
+  const int size = 65;
+  std::vector<uint8_t> pixels = terrain_heights(size, size, 2);
+  HeightView heights(pixels.data(), size, size, 1);
+  HeightPyramid pyramid = build_height_pyramid(heights);
+
+  SECTION("matches testing all triangles")
+  {
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<float> position(-10.0f, 74.0f), altitude(50.0f, 300.0f), angle(0.0f, 6.28f);
+    std::uniform_real_distribution<float> pitch(-1.5f, 0.1f);
+    int hits = 0;
+
+    for (int i = 0; i < 300; ++i) {
+      glm::vec3 origin(position(gen), altitude(gen), position(gen));
+      float a = angle(gen), p = pitch(gen);
+      glm::vec3 direction(std::cos(a) * std::cos(p), std::sin(p), std::sin(a) * std::cos(p));
+
+      auto expected = raycast_reference(heights, origin, direction, 0.0f, 1000.0f);
+      auto hit = raycast_heightfield(pyramid, origin, direction, 0.0f, 1000.0f);
+
+      REQUIRE(bool(hit) == bool(expected));
+      if (hit) {
+        CHECK(near(hit->t, *expected, 1e-2f));
+        CHECK(hit->normal.y > 0.0f);
+        hits++;
+      }
+    }
+
+    CHECK(hits > 50);
+  }
+
+  SECTION("straight down")
+  {
+    auto hit = raycast_heightfield(pyramid, glm::vec3(10.0f, 300.0f, 20.0f), glm::vec3(0.0f, -1.0f, 0.0f), 0.0f,
+                                   1000.0f);
+    REQUIRE(hit);
+    CHECK(near(hit->t, 300.0f - float(heights.at(10, 20))));
+
+    // the range is respected
+    CHECK(!raycast_heightfield(pyramid, glm::vec3(10.0f, 300.0f, 20.0f), glm::vec3(0.0f, -1.0f, 0.0f), 0.0f, 10.0f));
+  }
+
+  SECTION("above and below")
+  {
+    CHECK(!raycast_heightfield(pyramid, glm::vec3(10.0f, 300.0f, 20.0f), glm::vec3(1.0f, 0.0f, 0.0f), 0.0f, 1000.0f));
+
+    CHECK(!raycast_heightfield(pyramid, glm::vec3(10.0f, -5.0f, 20.0f), glm::vec3(1.0f, 0.0f, 0.0f), 0.0f, 1000.0f));
+
+    // up through the surface from below
+    auto hit = raycast_heightfield(pyramid, glm::vec3(10.0f, -5.0f, 20.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.0f, 1000.0f);
+    REQUIRE(hit);
+    CHECK(near(hit->t, 5.0f + float(heights.at(10, 20))));
+  }
+}
+
+TEST_CASE("Terrain raycaster")
+{
+  // the root tile is flat at 10, three of its children are flat at 50
+  const TileId root(2U, 1U, 2U);
+  const Bounds<glm::vec2> bounds(glm::vec2(-100.0f), glm::vec2(100.0f));
+  const float height_scale = 0.5f;
+
+  std::vector<uint8_t> low(16 * 16, 10), high(16 * 16, 50);
+  std::map<TileId, HeightView> resident = {{root, HeightView(low.data(), 16, 16, 1)}};
+  for (size_t i = 0; i < 3; ++i) resident[root.children()[i]] = HeightView(high.data(), 16, 16, 1);
+
+  TerrainRaycaster raycaster(
+      root, root.zoom + 4, bounds, height_scale,
+      [&](const TileId& tile) {
+        auto it = resident.find(tile);
+        return it != resident.end() ? it->second : HeightView();
+      },
+      [&](const TileId& tile) { return has_resident_below(resident, tile); });
+
+  const glm::vec3 down(0.0f, -1.0f, 0.0f);
+
+  // north west child
+  auto hit = raycaster.raycast(Ray(glm::vec3(-50.0f, 100.0f, -50.0f), down));
+  REQUIRE(hit);
+  CHECK(hit->tile == root.children()[0]);
+  CHECK(near(hit->position.y, 50.0f * height_scale));
+  CHECK(near(hit->distance, 100.0f - 50.0f * height_scale));
+  CHECK(near(hit->normal.y, 1.0f));
+
+  // the south west child is not resident, the root is used
+  hit = raycaster.raycast(Ray(glm::vec3(-50.0f, 100.0f, 50.0f), down));
+  REQUIRE(hit);
+  CHECK(hit->tile == root);
+  CHECK(near(hit->position.y, 10.0f * height_scale));
+
+  // a slanted ray from the south west hits the step up to the south east child
+  hit = raycaster.raycast(Ray(glm::vec3(-50.0f, 15.0f, 50.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
+  REQUIRE(hit);
+  CHECK(hit->tile == root.children()[2]);
+  CHECK(near(hit->position.x, 0.0f, 0.1f));
+
+  CHECK(!raycaster.raycast(Ray(glm::vec3(-50.0f, 100.0f, -50.0f), -down)));
+  CHECK(!raycaster.raycast(Ray(glm::vec3(-50.0f, 100.0f, -50.0f), down), 50.0f));
+  CHECK(!raycaster.raycast(Ray(glm::vec3(-500.0f, 100.0f, -50.0f), down)));
+  CHECK(raycaster.num_pyramids() == 4);
+}
+
+TEST_CASE("Terrain raycaster below non-resident levels")
+{
+  // only the root and a tile three levels below it are resident, like the leaves the quad tree requests
+  const TileId root(2U, 1U, 2U);
+  const TileId deep = root.children()[0].children()[2].children()[1];
+  const Bounds<glm::vec2> bounds(glm::vec2(-100.0f), glm::vec2(100.0f));
+
+  std::vector<uint8_t> low(16 * 16, 10), high(16 * 16, 80);
+  std::map<TileId, HeightView> resident = {{root, HeightView(low.data(), 16, 16, 1)},
+                                           {deep, HeightView(high.data(), 16, 16, 1)}};
+  size_t lookups = 0;
+
+  TerrainRaycaster raycaster(
+      root, root.zoom + 4, bounds, 1.0f,
+      [&](const TileId& tile) {
+        lookups++;
+        auto it = resident.find(tile);
+        return it != resident.end() ? it->second : HeightView();
+      },
+      [&](const TileId& tile) { return has_resident_below(resident, tile); });
+
+  const glm::vec3 down(0.0f, -1.0f, 0.0f);
+
+  // the middle of the deep tile, north west of the root and then south east and north east
+  lookups = 0;
+  auto hit = raycaster.raycast(Ray(glm::vec3(-12.5f, 100.0f, -37.5f), down));
+  REQUIRE(hit);
+  CHECK(hit->tile == deep);
+  CHECK(near(hit->position.y, 80.0f));
+
+  // only the root and the three tiles on the way down are looked up, not their siblings
+  CHECK(lookups == 4);
+
+  // next to it, the levels in between use the heights of the root
+  hit = raycaster.raycast(Ray(glm::vec3(-37.5f, 100.0f, -37.5f), down));
+  REQUIRE(hit);
+  CHECK(hit->tile == root);
+  CHECK(near(hit->position.y, 10.0f));
+}
+
+TEST_CASE("Terrain raycast benchmark", "[.][benchmark]")
+{
+  // 4x4 tiles of 256x256 below a root tile, like two zoom levels of the app
+  const TileId root(6U, 34U, 22U);
+  const Bounds<glm::vec2> bounds(glm::vec2(-4000.0f), glm::vec2(4000.0f));
+  const float height_scale = 4.0f;
+
+  std::map<TileId, std::vector<uint8_t>> pixels;
+  pixels[root] = terrain_heights(256, 256, 10);
+  for (const TileId& child : root.children()) {
+    for (const TileId& grand_child : child.children()) pixels[grand_child] = terrain_heights(256, 256, 11);
+  }
+
+  TerrainRaycaster raycaster(
+      root, root.zoom + 2, bounds, height_scale,
+      [&](const TileId& tile) {
+        auto it = pixels.find(tile);
+        return it != pixels.end() ? HeightView(it->second.data(), 256, 256, 1) : HeightView();
+      },
+      [&](const TileId& tile) { return tile.zoom < root.zoom + 2; });
+
+  // cameras above the terrain, looking at it from different angles like the app
+  std::mt19937 gen(4);
+  std::uniform_real_distribution<float> position(-3500.0f, 3500.0f), altitude(1100.0f, 3000.0f);
+  std::uniform_real_distribution<float> angle(0.0f, 6.28f), pitch(-1.2f, -0.1f);
+  const size_t num_rays = 1000000;
+  std::vector<Ray> rays;
+  rays.reserve(num_rays);
+
+  for (size_t i = 0; i < num_rays; ++i) {
+    float a = angle(gen), p = pitch(gen);
+    glm::vec3 direction(std::cos(a) * std::cos(p), std::sin(p), std::sin(a) * std::cos(p));
+    rays.emplace_back(glm::vec3(position(gen), altitude(gen), position(gen)), direction);
+  }
+
+  size_t hits = 0;
+  raycaster.raycast(rays[0]);  // builds the pyramids
+  auto start = std::chrono::steady_clock::now();
+  for (const Ray& ray : rays) hits += raycaster.raycast(ray) ? 1 : 0;
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  // marching in steps of half a cell and sampling the nearest height, which can step over thin peaks
+  const size_t num_marched = 20000;
+  const float cell = (bounds.size().x / 4.0f) / 255.0f;
+  size_t marched_hits = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < num_marched; ++i) {
+    const Ray& ray = rays[i];
+    for (float t = 0.0f; t < 20000.0f; t += cell / 2.0f) {
+      glm::vec3 p = ray.point_at(t);
+      if (p.x < bounds.min.x || p.x >= bounds.max.x || p.z < bounds.min.y || p.z >= bounds.max.y) break;
+      int gx = int((p.x - bounds.min.x) / cell), gy = int((p.z - bounds.min.y) / cell);
+      TileId tile(root.zoom + 2, root.x * 4 + gx / 256, root.y * 4 + gy / 256);
+      if (p.y <= height_scale * float(pixels[tile][size_t(gy % 256) * 256 + gx % 256])) {
+        marched_hits++;
+        break;
+      }
+    }
+  }
+  double marched_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << "terrain raycast: " << ms << " ms per million rays (" << hits << " hits), marching "
+            << marched_ms * double(num_rays) / double(num_marched) << " ms per million rays (" << marched_hits
+            << " of " << num_marched << " hit)\n";
+  CHECK(hits > num_rays / 2);
+}
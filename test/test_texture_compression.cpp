@@ -0,0 +1,159 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "TextureCompression.h"
+
+// something like an ortho photo, smooth areas with noise and a few sharp edges
+static std::vector<uint8_t> test_image(int width, int height, int channels)
+{
+  std::mt19937 random(42);
+  std::uniform_int_distribution<int> noise(-12, 12);
+  std::vector<uint8_t> pixels(size_t(width) * height * channels);
+
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      bool field = (x / 37 + y / 23) % 3 == 0;
+      int r = field ? 120 + x / 4 : 60 + y / 3;
+      int g = field ? 140 + y / 8 : 90 + x / 5;
+      int b = field ? 70 : 50 + (x + y) / 8;
+
+      uint8_t* pixel = &pixels[(size_t(y) * width + x) * channels];
+      pixel[0] = uint8_t(std::clamp(r + noise(random), 0, 255));
+      pixel[1] = uint8_t(std::clamp(g + noise(random), 0, 255));
+      pixel[2] = uint8_t(std::clamp(b + noise(random), 0, 255));
+      if (channels == 4) pixel[3] = 255;
+    }
+  }
+
+  return pixels;
+}
+
+static double psnr(const uint8_t* a, const uint8_t* b, size_t num_pixels, int channels_a)
+{
+  double sum = 0.0;
+  for (size_t i = 0; i < num_pixels; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      double d = double(a[i * channels_a + c]) - double(b[i * 3 + c]);
+      sum += d * d;
+    }
+  }
+  double mse = sum / double(num_pixels * 3);
+  return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 100.0;
+}
+
+TEST_CASE("BC1 block")
+{
+  SECTION("solid color is exact if it fits in RGB565")
+  {
+    uint8_t rgb[16 * 3], block[8], decoded[16 * 3];
+    for (int i = 0; i < 16; ++i) {
+      rgb[3 * i + 0] = 255;
+      rgb[3 * i + 1] = 0;
+      rgb[3 * i + 2] = 132;  // 16 << 3 | 16 >> 2
+    }
+
+    encode_bc1_block(rgb, block);
+    decode_bc1_block(block, decoded);
+    CHECK(std::equal(rgb, rgb + 48, decoded));
+  }
+
+  SECTION("two colors")
+  {
+    uint8_t rgb[16 * 3], block[8], decoded[16 * 3];
+    for (int i = 0; i < 16; ++i) {
+      uint8_t value = i % 2 ? 255 : 0;
+      rgb[3 * i + 0] = rgb[3 * i + 1] = rgb[3 * i + 2] = value;
+    }
+
+    encode_bc1_block(rgb, block);
+    decode_bc1_block(block, decoded);
+    CHECK(std::equal(rgb, rgb + 48, decoded));
+
+    // 4 color mode
+    uint16_t c0 = uint16_t(block[0] | (block[1] << 8)), c1 = uint16_t(block[2] | (block[3] << 8));
+    CHECK(c0 > c1);
+  }
+}
+
+TEST_CASE("BC1 image")
+{
+  const int width = 256, height = 256;
+
+  for (int channels : {3, 4}) {
+    auto pixels = test_image(width, height, channels);
+    CompressedImage image = compress_bc1(pixels.data(), width, height, channels);
+
+    REQUIRE(image.valid());
+    REQUIRE(image.levels.size() == 9);
+    CHECK(image.levels[0].size() == 64 * 64 * BC1_BLOCK_SIZE);
+    CHECK(image.levels[8].size() == BC1_BLOCK_SIZE);
+
+    // 4 instead of 24 bits per pixel, the smallest levels are padded to full blocks
+    CHECK(image.size() * 5 < size_t(width) * height * 3 * 4 / 3);
+
+    auto decoded = decompress_bc1(image);
+    CHECK(psnr(pixels.data(), decoded.data(), size_t(width) * height, channels) > 30.0);
+  }
+
+  SECTION("sizes that are not a multiple of 4")
+  {
+    auto pixels = test_image(13, 6, 3);
+    CompressedImage image = compress_bc1(pixels.data(), 13, 6, 3);
+
+    REQUIRE(image.levels.size() == 4);  // 13x6, 6x3, 3x1, 1x1
+    CHECK(image.levels[0].size() == 4 * 2 * BC1_BLOCK_SIZE);
+    CHECK(decompress_bc1(image, 3).size() == 3);
+    CHECK(psnr(pixels.data(), decompress_bc1(image).data(), 13 * 6, 3) > 30.0);
+  }
+
+  SECTION("disk cache")
+  {
+    auto pixels = test_image(64, 64, 3);
+    CompressedImage image = compress_bc1(pixels.data(), 64, 64, 3);
+    const std::string filename = "test_tile.bc1";
+
+    REQUIRE(write_compressed_image(filename, image));
+
+    CompressedImage loaded;
+    REQUIRE(read_compressed_image(filename, loaded));
+    CHECK(loaded.width == 64);
+    CHECK(loaded.height == 64);
+    CHECK(loaded.levels == image.levels);
+
+    // truncated files are rejected
+    std::filesystem::resize_file(filename, 100);
+    CHECK(!read_compressed_image(filename, loaded));
+    CHECK(!loaded.valid());
+
+    std::filesystem::remove(filename);
+    CHECK(!read_compressed_image(filename, loaded));
+  }
+}
+
+// Encoder throughput and quality for 256x256 tiles.
+TEST_CASE("BC1 benchmark", "[.][benchmark]")
+{
+  using Clock = std::chrono::steady_clock;
+  const int width = 256, height = 256, iterations = 50;
+  auto pixels = test_image(width, height, 3);
+
+  for (bool mipmaps : {false, true}) {
+    CompressedImage image;
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; ++i) image = compress_bc1(pixels.data(), width, height, 3, mipmaps);
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / iterations;
+
+    auto decoded = decompress_bc1(image);
+    double quality = psnr(pixels.data(), decoded.data(), size_t(width) * height, 3);
+    size_t uncompressed = size_t(width) * height * 4 * (mipmaps ? 4 : 3) / 3;  // drivers store RGB8 as RGBA8
+
+    std::cout << (mipmaps ? "with mipmaps: " : "level 0:      ") << ms << " ms per tile, "
+              << double(width) * height / ms / 1000.0 << " MPixel/s, " << quality << " dB PSNR, "
+              << image.size() / 1024 << " KB instead of " << uncompressed / 1024 << " KB\n";
+  }
+}
@@ -0,0 +1,376 @@
+#include <algorithm>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cpr/cpr.h>
+#include <filesystem>
+#include <fmt/core.h>
+#include <iostream>
+#include <thread>
+
+#include "MockTileServer.h"
+#include "TileRegion.h"
+#include "TileSeeder.h"
+#include "TileService.h"
+
+#if MOCK_TILE_SERVER
+static std::vector<TileId> test_tiles(unsigned zoom)
+{
+  return TileRegion::from_bounds(47.0f, 11.0f, 47.5f, 12.0f).tiles(zoom);
+}
+
+TEST_CASE("TileService connections")
+{
+  MockTileServer server;
+
+  const std::string cache = "tiles/service-test";
+  std::filesystem::remove_all(cache);
+
+  TileServiceConfig config = {server.url(), UrlPattern::ZXY_Y_SOUTH, ".png", cache};
+
+  SECTION("keep alive")
+  {
+    TileService service(config);
+    auto tiles = test_tiles(10);
+
+    for (const auto& tile : tiles) {
+      REQUIRE(service.download_to_disk(tile));
+    }
+
+    CHECK(server.requests == tiles.size());
+    CHECK(server.connections == 1);
+  }
+
+  SECTION("one connection per thread")
+  {
+    TileService service(config);
+    auto tiles = test_tiles(11);
+
+    TileSeeder seeder(service, 3);
+    seeder.seed(tiles);
+
+    CHECK(server.requests == tiles.size());
+    CHECK(server.connections <= 3);
+  }
+
+  SECTION("timeout")
+  {
+    config.timeout = std::chrono::milliseconds(50);
+    TileService service(config);
+
+    server.latency_ms = 500;
+    CHECK(service.get_tile_sync(TileId(0U, 0U, 0U)) == nullptr);
+  }
+
+  SECTION("revalidation")
+  {
+    const TileId tile(10U, 548U, 358U);
+
+    {
+      TileService service(config);
+      REQUIRE(service.get_tile_sync(tile) != nullptr);
+      CHECK(server.requests == 1);
+    }
+
+    {
+      // revalidation is disabled by default
+      TileService service(config);
+      REQUIRE(service.get_tile_sync(tile) != nullptr);
+      CHECK(server.requests == 1);
+    }
+
+    {
+      config.max_age = std::chrono::hours(1);
+      TileService service(config);
+
+      REQUIRE(service.get_tile_sync(tile) != nullptr);
+      CHECK(server.requests == 1);
+
+      // pretend the tile was downloaded a day ago
+      auto filename = cache + "/" + tile.to_string() + ".png";
+      std::filesystem::last_write_time(filename, std::chrono::file_clock::now() - std::chrono::hours(24));
+
+      TileService other_service(config);
+      REQUIRE(other_service.get_tile_sync(tile) != nullptr);
+      CHECK(server.requests == 2);
+      CHECK(server.not_modified == 1);
+      CHECK(std::chrono::file_clock::now() - std::filesystem::last_write_time(filename) < std::chrono::hours(1));
+    }
+  }
+
+  std::filesystem::remove_all(cache);
+}
+
+TEST_CASE("TileService tile states")
+{
+  MockTileServer server;
+
+  const std::string cache = "tiles/state-test";
+  std::filesystem::remove_all(cache);
+
+  TileServiceConfig config = {server.url(), UrlPattern::ZXY_Y_SOUTH, ".png", cache};
+  const TileId tile(10U, 548U, 358U);
+
+  SECTION("coalescing")
+  {
+    server.latency_ms = 50;
+    TileService service(config);
+
+    CHECK(service.get_tile(tile) == nullptr);
+    CHECK(service.tile_state(tile) == TileState::IN_FLIGHT);
+
+    std::vector<std::thread> threads;
+    std::atomic<unsigned> loaded{0};
+
+    for (int i = 0; i < 4; ++i) {
+      threads.push_back(std::thread([&]() {
+        if (service.get_tile_sync(tile)) loaded++;
+      }));
+    }
+
+    for (auto& thread : threads) thread.join();
+
+    CHECK(loaded == 4);
+    CHECK(server.requests == 1);
+    CHECK(service.tile_state(tile) == TileState::RESIDENT);
+    CHECK(service.get_tile(tile) == service.get_tile_sync(tile));
+    CHECK(service.stats().resident == 1);
+    CHECK(service.stats().in_flight == 0);
+  }
+
+  SECTION("not available")
+  {
+    server.set_missing({tile});
+
+    {
+      TileService service(config);
+      CHECK(service.get_tile_sync(tile) == nullptr);
+      CHECK(service.tile_state(tile) == TileState::NOT_AVAILABLE);
+
+      CHECK(service.get_tile(tile) == nullptr);
+      CHECK(service.get_tile_sync(tile) == nullptr);
+      CHECK(server.requests == 1);
+    }
+
+    {
+      // remembered on disk
+      TileService service(config);
+      CHECK(service.get_tile_sync(tile) == nullptr);
+      CHECK(service.is_marked_not_available(tile));
+      CHECK(server.requests == 1);
+    }
+  }
+
+  SECTION("transient failure")
+  {
+    server.unavailable = true;
+
+    TileService service(config);
+    CHECK(service.get_tile_sync(tile) == nullptr);
+    CHECK(service.tile_state(tile) == TileState::FAILED);
+    CHECK(service.stats().failed == 1);
+    CHECK(!service.is_marked_not_available(tile));
+
+    // not retried right away
+    server.unavailable = false;
+    CHECK(service.get_tile(tile) == nullptr);
+    CHECK(service.get_tile_sync(tile) == nullptr);
+    CHECK(server.requests == 1);
+  }
+
+  std::filesystem::remove_all(cache);
+}
+
+TEST_CASE("TileService prefetch bandwidth")
+{
+  MockTileServer server;
+
+  const std::string cache = "tiles/prefetch-test";
+  std::filesystem::remove_all(cache);
+
+  TileServiceConfig config = {server.url(), UrlPattern::ZXY_Y_SOUTH, ".png", cache};
+  config.max_concurrent_requests = 3;
+
+  auto tiles = test_tiles(11);
+  REQUIRE(tiles.size() > 6);
+
+  SECTION("budget")
+  {
+    TileService service(config);
+    service.prefetch_bandwidth = 100.0f;  // less than one tile per second
+
+    auto now = std::chrono::steady_clock::now();
+    service.prefetch_clock = [&]() { return now; };
+
+    // no time has passed yet
+    service.prefetch(tiles);
+    CHECK(service.tile_state(tiles[0]) == TileState::ABSENT);
+
+    // one byte of budget, the first tile is paid for with more than that
+    now += std::chrono::milliseconds(10);
+    service.prefetch(tiles);
+    CHECK(service.tile_state(tiles[1]) == TileState::ABSENT);
+    CHECK(service.get_tile_sync(tiles[0]) != nullptr);
+    CHECK(server.requests == 1);
+
+    // the workers are idle, but the tile cost more than a second of bandwidth
+    now += std::chrono::seconds(1);
+    service.prefetch(tiles);
+    CHECK(service.tile_state(tiles[1]) == TileState::ABSENT);
+
+    // the bucket only holds one second of bandwidth, so there is never more than one tile at a time
+    now += std::chrono::seconds(60);
+    service.prefetch(tiles);
+    CHECK(service.tile_state(tiles[2]) == TileState::ABSENT);
+    CHECK(service.get_tile_sync(tiles[1]) != nullptr);
+    CHECK(server.requests == 2);
+  }
+
+  SECTION("busy workers")
+  {
+    server.latency_ms = 50;
+    TileService service(config);
+
+    for (unsigned i = 0; i < 3; ++i) {
+      CHECK(service.get_tile(tiles[i]) == nullptr);
+    }
+
+    std::vector<TileId> prefetched(tiles.begin() + 3, tiles.end());
+
+    service.prefetch(prefetched);
+    CHECK(service.tile_state(prefetched.front()) == TileState::ABSENT);
+
+    for (unsigned i = 0; i < 3; ++i) {
+      CHECK(service.get_tile_sync(tiles[i]) != nullptr);
+    }
+    CHECK(server.requests == 3);
+
+    // prefetching continues once the workers are idle again
+    service.prefetch(prefetched);
+    CHECK(service.tile_state(prefetched.front()) != TileState::ABSENT);
+  }
+
+  std::filesystem::remove_all(cache);
+}
+
+// Time until the root tile and its children are loaded, as in the TerrainRenderer constructor.
+static float startup_time(const TileServiceConfig& config, float& blocking_time)
+{
+  using Clock = std::chrono::steady_clock;
+
+  const TileId root(1U, 1U, 0U);
+  std::vector<TileId> tiles = {root};
+  for (const auto& child : root.children()) tiles.push_back(child);
+
+  auto start = Clock::now();
+  TileService service(config);
+
+  for (const auto& tile : tiles) {
+    (void)service.get_tile(tile);
+  }
+  blocking_time = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+
+  auto loaded = [&]() {
+    return std::all_of(tiles.begin(), tiles.end(), [&](const TileId& tile) { return service.get_tile_cached(tile); });
+  };
+
+  while (!loaded()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+}
+
+TEST_CASE("TileService startup")
+{
+  MockTileServer server;
+
+  const std::string cache = "tiles/startup-test";
+  std::filesystem::remove_all(cache);
+  std::filesystem::remove_all(cache + "-empty");
+
+  TileServiceConfig config = {server.url(), UrlPattern::ZXY_Y_SOUTH, ".png", cache};
+  float blocking_time = 0.0f;
+
+  (void)startup_time(config, blocking_time);
+  CHECK(server.requests == 5);
+
+  // warm cache
+  (void)startup_time(config, blocking_time);
+  CHECK(server.requests == 5);
+
+  // the warm cache shipped with the application, nothing on disk yet
+  config.bundle_dir = cache;
+  config.cache_dir = cache + "-empty";
+  (void)startup_time(config, blocking_time);
+  CHECK(server.requests == 5);
+
+  std::filesystem::remove_all(cache);
+  std::filesystem::remove_all(cache + "-empty");
+}
+
+TEST_CASE("TileService startup benchmark", "[.][benchmark]")
+{
+  MockTileServer server;
+  server.latency_ms = 50;
+
+  const std::string cache = "tiles/startup-benchmark";
+  std::filesystem::remove_all(cache);
+  std::filesystem::remove_all(cache + "-empty");
+
+  TileServiceConfig config = {server.url(), UrlPattern::ZXY_Y_SOUTH, ".png", cache};
+  float blocking_time = 0.0f;
+
+  float cold = startup_time(config, blocking_time);
+  CHECK(blocking_time < float(server.latency_ms));
+
+  float warm = startup_time(config, blocking_time);
+
+  config.bundle_dir = cache;
+  config.cache_dir = cache + "-empty";
+  float bundled = startup_time(config, blocking_time);
+
+  std::cout << "Startup: " << cold << " ms cold, " << warm << " ms warm, " << bundled << " ms bundled\n";
+
+  CHECK(warm < cold);
+  CHECK(bundled < cold);
+
+  std::filesystem::remove_all(cache);
+  std::filesystem::remove_all(cache + "-empty");
+}
+
+TEST_CASE("TileService connection reuse benchmark", "[.][benchmark]")
+{
+  MockTileServer server;
+  server.latency_ms = 1;
+
+  const std::string cache = "tiles/service-benchmark";
+  std::filesystem::remove_all(cache);
+
+  TileService service(server.url(), UrlPattern::ZXY_Y_SOUTH, ".png", cache);
+  auto tiles = test_tiles(11);
+
+  using Clock = std::chrono::steady_clock;
+
+  auto start = Clock::now();
+  for (const auto& tile : tiles) {
+    cpr::Response r = cpr::Get(cpr::Url{fmt::format("{}/{}/{}/{}.png", server.url(), tile.zoom, tile.x, tile.y)});
+    REQUIRE(r.status_code == 200);
+  }
+  float fresh_sessions = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+  unsigned fresh_connections = server.connections;
+
+  start = Clock::now();
+  for (const auto& tile : tiles) {
+    REQUIRE(service.download_to_disk(tile));
+  }
+  float reused_session = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+  unsigned reused_connections = server.connections - fresh_connections;
+
+  std::cout << tiles.size() << " tiles: " << fresh_sessions << " ms with " << fresh_connections
+            << " connections, " << reused_session << " ms with " << reused_connections << " connections\n";
+
+  CHECK(reused_connections < fresh_connections);
+
+  std::filesystem::remove_all(cache);
+}
+#endif
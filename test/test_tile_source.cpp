@@ -0,0 +1,370 @@
+#include <bit>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <numbers>
+#include <sqlite3.h>
+#include <string>
+#include <vector>
+
+#include "MockTileServer.h"
+#include "TileCache.h"
+#include "TileRegion.h"
+#include "TileService.h"
+#include "TileSource.h"
+
+#if MOCK_TILE_SERVER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static std::string fake_tile(const TileId& tile) { return "tile " + tile.to_string(); }
+
+static std::string as_string(const std::vector<uint8_t>& bytes) { return std::string(bytes.begin(), bytes.end()); }
+
+static void write_file(const std::string& filename, const std::string& content)
+{
+  std::filesystem::create_directories(std::filesystem::path(filename).parent_path());
+  std::ofstream(filename, std::ios::binary) << content;
+}
+
+static void write_mbtiles(const std::string& filename, const std::vector<TileId>& tiles,
+                          const std::function<std::string(const TileId&)>& content)
+{
+  std::filesystem::remove(filename);
+
+  sqlite3* db = nullptr;
+  REQUIRE(sqlite3_open(filename.c_str(), &db) == SQLITE_OK);
+  REQUIRE(sqlite3_exec(db,
+                       "CREATE TABLE tiles (zoom_level integer, tile_column integer, tile_row integer, "
+                       "tile_data blob); CREATE UNIQUE INDEX tile_index ON tiles (zoom_level, tile_column, "
+                       "tile_row); BEGIN",
+                       nullptr, nullptr, nullptr) == SQLITE_OK);
+
+  sqlite3_stmt* insert = nullptr;
+  sqlite3_prepare_v2(db, "INSERT INTO tiles VALUES (?1, ?2, ?3, ?4)", -1, &insert, nullptr);
+
+  for (const TileId& tile : tiles) {
+    const std::string data = content(tile);
+    sqlite3_bind_int(insert, 1, int(tile.zoom));
+    sqlite3_bind_int(insert, 2, int(tile.x));
+    sqlite3_bind_int(insert, 3, int((1U << tile.zoom) - 1U - tile.y));
+    sqlite3_bind_blob(insert, 4, data.data(), int(data.size()), SQLITE_TRANSIENT);
+    CHECK(sqlite3_step(insert) == SQLITE_DONE);
+    sqlite3_reset(insert);
+  }
+
+  sqlite3_finalize(insert);
+  sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr);
+  sqlite3_close(db);
+}
+
+// One overview of a GeoTIFF, tiles are row by row and empty ones are left out of the file.
+struct TiffLevel {
+  unsigned zoom, first_x, first_y, tiles_across, tiles_down;
+  std::vector<std::string> tiles;
+  std::string jpeg_tables;
+};
+
+static std::string little_endian(uint64_t value, size_t size)
+{
+  std::string bytes;
+  for (size_t i = 0; i < size; ++i) bytes.push_back(char((value >> (8 * i)) & 0xff));
+  return bytes;
+}
+
+// Little endian TIFF with JPEG compressed 256x256 tiles in EPSG:3857, the first level is the full resolution.
+// shift moves the image east by a fraction of a tile.
+static std::string write_geotiff(const std::vector<TiffLevel>& levels, double shift = 0.0)
+{
+  const double mercator_width = 2.0 * std::numbers::pi * 6378137.0;
+  const double scale = mercator_width / (256.0 * double(1U << levels.front().zoom));
+
+  std::string file = "II" + little_endian(42, 2) + little_endian(0, 4);
+  size_t next_ifd = 4;
+
+  for (const TiffLevel& level : levels) {
+    std::string offsets, byte_counts;
+    for (const std::string& tile : level.tiles) {
+      offsets += little_endian(tile.empty() ? 0 : file.size(), 4);
+      byte_counts += little_endian(tile.size(), 4);
+      file += tile;
+    }
+
+    struct Field {
+      uint16_t tag, type;
+      uint32_t count;
+      std::string values;
+    };
+
+    auto shorts = [](std::vector<uint64_t> values) {
+      std::string bytes;
+      for (uint64_t value : values) bytes += little_endian(value, 2);
+      return bytes;
+    };
+
+    auto doubles = [](std::vector<double> values) {
+      std::string bytes;
+      for (double value : values) bytes += little_endian(std::bit_cast<uint64_t>(value), 8);
+      return bytes;
+    };
+
+    const uint32_t num_tiles = uint32_t(level.tiles.size());
+    std::vector<Field> fields = {
+        {254, 4, 1, little_endian(&level == &levels.front() ? 0 : 1, 4)},
+        {256, 4, 1, little_endian(level.tiles_across * 256U, 4)},
+        {257, 4, 1, little_endian(level.tiles_down * 256U, 4)},
+        {259, 3, 1, shorts({7})},
+        {322, 3, 1, shorts({256})},
+        {323, 3, 1, shorts({256})},
+        {324, 4, num_tiles, offsets},
+        {325, 4, num_tiles, byte_counts},
+    };
+
+    if (!level.jpeg_tables.empty()) {
+      fields.push_back({347, 7, uint32_t(level.jpeg_tables.size()), level.jpeg_tables});
+    }
+
+    if (&level == &levels.front()) {
+      const double x = -mercator_width / 2.0 + (double(level.first_x) + shift) * 256.0 * scale;
+      const double y = mercator_width / 2.0 - double(level.first_y) * 256.0 * scale;
+      fields.push_back({33550, 12, 3, doubles({scale, scale, 0.0})});
+      fields.push_back({33922, 12, 6, doubles({0.0, 0.0, 0.0, x, y, 0.0})});
+      fields.push_back({34735, 3, 8, shorts({1, 1, 0, 1, 3072, 0, 1, 3857})});
+    }
+
+    // values that do not fit into a field go before the IFD
+    std::string entries;
+    for (const Field& field : fields) {
+      std::string value = field.values;
+      if (value.size() > 4) {
+        if (file.size() % 2) file.push_back('\0');
+        value = little_endian(file.size(), 4);
+        file += field.values;
+      }
+      value.resize(4, '\0');
+      entries += little_endian(field.tag, 2) + little_endian(field.type, 2) + little_endian(field.count, 4) + value;
+    }
+
+    if (file.size() % 2) file.push_back('\0');
+    file.replace(next_ifd, 4, little_endian(file.size(), 4));
+    file += little_endian(fields.size(), 2) + entries;
+    next_ifd = file.size();
+    file += little_endian(0, 4);
+  }
+
+  return file;
+}
+
+TEST_CASE("Directory tile source")
+{
+  const std::string dir = "tiles/directory-source-test";
+  std::filesystem::remove_all(dir);
+
+  const TileId tile(10U, 548U, 358U);
+  write_file(fmt::format("{}/10/548/{}.png", dir, (1U << 10) - 1U - tile.y), fake_tile(tile));
+
+  DirectoryTileSource source(dir, UrlPattern::ZXY_Y_NORTH, ".png");
+  CHECK(source.is_local());
+
+  FetchResult result = source.fetch(tile);
+  CHECK(result.status == FetchStatus::OK);
+  CHECK(as_string(result.bytes) == fake_tile(tile));
+  CHECK(source.fetch(tile.neighbour(1, 0)).status == FetchStatus::NOT_AVAILABLE);
+
+  CHECK(guess_tile_source_type(dir) == TileSourceType::DIRECTORY);
+  CHECK(guess_tile_source_type("https://example.com/tiles") == TileSourceType::HTTP);
+  CHECK(guess_tile_source_type("assets/Ortho.MBTiles") == TileSourceType::MBTILES);
+  CHECK(guess_tile_source_type("assets/ortho.tif") == TileSourceType::GEOTIFF);
+  CHECK(parse_tile_source_type("mbtiles") == TileSourceType::MBTILES);
+  CHECK(!parse_tile_source_type("ftp"));
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("MBTiles tile source")
+{
+  const std::string filename = "tiles/source-test.mbtiles";
+  std::filesystem::create_directories("tiles");
+
+  const std::vector<TileId> tiles = {TileId(0U, 0U, 0U), TileId(10U, 548U, 358U), TileId(10U, 548U, 359U)};
+  write_mbtiles(filename, tiles, fake_tile);
+
+  MBTilesTileSource source(filename);
+
+  for (const TileId& tile : tiles) {
+    FetchResult result = source.fetch(tile);
+    CHECK(result.status == FetchStatus::OK);
+    CHECK(as_string(result.bytes) == fake_tile(tile));
+  }
+
+  CHECK(source.fetch(TileId(10U, 549U, 358U)).status == FetchStatus::NOT_AVAILABLE);
+
+  MBTilesTileSource missing("tiles/does-not-exist.mbtiles");
+  CHECK(missing.fetch(tiles.front()).status == FetchStatus::FAILED);
+
+  std::filesystem::remove(filename);
+}
+
+TEST_CASE("GeoTIFF tile source")
+{
+  const std::string filename = "tiles/source-test.tif";
+  std::filesystem::create_directories("tiles");
+
+  // abbreviated streams and the tables they share
+  const std::string tables = "\xff\xd8tables\xff\xd9";
+  const TileId corner(10U, 548U, 358U);
+
+  TiffLevel full = {10, corner.x, corner.y, 4, 2, {}, ""};
+  for (unsigned y = 0; y < full.tiles_down; ++y) {
+    for (unsigned x = 0; x < full.tiles_across; ++x) {
+      full.tiles.push_back(x == 3 && y == 1 ? "" : "\xff\xd8" + fake_tile(TileId(10U, corner.x + x, corner.y + y)));
+    }
+  }
+
+  TiffLevel overview = {9, corner.x / 2U, corner.y / 2U, 2, 1, {}, tables};
+  overview.tiles = {"\xff\xd8" "a", "\xff\xd8" "b"};
+
+  write_file(filename, write_geotiff({full, overview}));
+
+  GeoTiffTileSource source(filename);
+  CHECK(source.zoom_levels() == std::vector<unsigned>{10U, 9U});
+
+  FetchResult result = source.fetch(corner.neighbour(1, 1));
+  CHECK(result.status == FetchStatus::OK);
+  CHECK(as_string(result.bytes) == "\xff\xd8" + fake_tile(corner.neighbour(1, 1)));
+
+  // outside of the image and left out of the file
+  CHECK(source.fetch(corner.neighbour(4, 0)).status == FetchStatus::NOT_AVAILABLE);
+  CHECK(source.fetch(corner.neighbour(3, 1)).status == FetchStatus::NOT_AVAILABLE);
+  CHECK(source.fetch(corner.parent().parent()).status == FetchStatus::NOT_AVAILABLE);
+
+  result = source.fetch(corner.parent().neighbour(1, 0));
+  CHECK(result.status == FetchStatus::OK);
+  CHECK(as_string(result.bytes) == "\xff\xd8tablesb");
+
+  // not in the tile grid
+  write_file(filename, write_geotiff({full}, 0.5));
+  CHECK(GeoTiffTileSource(filename).zoom_levels().empty());
+
+  std::filesystem::remove(filename);
+}
+
+TEST_CASE("Tile source locations")
+{
+  TileServiceConfig other = TileSources::with_location(ORTHO_TILE_SERVICE, "https://other-server/tiles");
+  CHECK(other.url == "https://other-server/tiles");
+  CHECK(other.source == TileSourceType::HTTP);
+  CHECK(other.cache_dir != ORTHO_TILE_SERVICE.cache_dir);
+  CHECK(other.bundle_dir.empty());
+
+  TileServiceConfig local = TileSources::with_location(ORTHO_TILE_SERVICE, "data/ortho.mbtiles");
+  CHECK(local.source == TileSourceType::MBTILES);
+  CHECK(local.cache_dir != ORTHO_TILE_SERVICE.cache_dir);
+  CHECK(local.cache_dir != other.cache_dir);
+
+  // the same location always maps to the same directory
+  CHECK(TileSources::with_location(HEIGHT_TILE_SERVICE, "data/ortho.mbtiles").cache_dir == local.cache_dir);
+  CHECK(TileSources::with_location(ORTHO_TILE_SERVICE, "basemap").cache_dir == BASEMAP_TILE_SERVICE.cache_dir);
+}
+
+#if MOCK_TILE_SERVER
+TEST_CASE("TileService with a local source")
+{
+  const std::string cache = "tiles/local-source-test";
+  const std::string filename = "tiles/local-source-test.mbtiles";
+  std::filesystem::remove_all(cache);
+  std::filesystem::create_directories("tiles");
+
+  const std::vector<TileId> tiles = TileRegion::from_bounds(47.0, 11.0, 47.5, 12.0).tiles(10);
+  write_mbtiles(filename, tiles, [](const TileId&) { return encode_png(4, 4, std::vector<uint8_t>(48, 128)); });
+
+  TileServiceConfig config = {filename, UrlPattern::ZXY_Y_SOUTH, "", cache};
+  config.source = TileSourceType::MBTILES;
+  TileService service(config);
+
+  for (const TileId& tile : tiles) {
+    Image* image = service.get_tile_sync(tile);
+    REQUIRE(image != nullptr);
+    CHECK(image->width() == 4);
+  }
+
+  CHECK(service.get_tile_sync(tiles.front().parent()) == nullptr);
+  CHECK(service.tile_state(tiles.front().parent()) == TileState::NOT_AVAILABLE);
+  CHECK(service.stats().requested == tiles.size() + 1);
+
+  // nothing is copied into the disk cache
+  CHECK(!std::filesystem::exists(cache));
+
+  std::filesystem::remove(filename);
+}
+
+TEST_CASE("Tile source benchmark", "[.][benchmark]")
+{
+  const std::string dir = "tiles/source-benchmark";
+  std::filesystem::remove_all(dir);
+
+  const std::vector<TileId> tiles = TileRegion::from_bounds(47.0, 11.0, 47.5, 12.0).tiles(14);
+  const std::string png = encode_png(256, 256, std::vector<uint8_t>(256 * 256 * 3, 100));
+
+  for (const TileId& tile : tiles) write_file(fmt::format("{}/{}/{}/{}.png", dir, tile.zoom, tile.x, tile.y), png);
+  write_mbtiles(dir + "/tiles.mbtiles", tiles, [&](const TileId&) { return png; });
+
+  TiffLevel level = {14, tiles.front().x, tiles.front().y, 1, 1, {}, ""};
+  for (const TileId& tile : tiles) {
+    level.first_x = std::min(level.first_x, tile.x);
+    level.first_y = std::min(level.first_y, tile.y);
+  }
+  for (const TileId& tile : tiles) {
+    level.tiles_across = std::max(level.tiles_across, tile.x - level.first_x + 1U);
+    level.tiles_down = std::max(level.tiles_down, tile.y - level.first_y + 1U);
+  }
+  level.tiles.assign(size_t(level.tiles_across) * level.tiles_down, "\xff\xd8" + png);
+  write_file(dir + "/tiles.tif", write_geotiff({level}));
+
+  auto measure = [&](TileSource& source) {
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const TileId& tile : tiles) bytes += source.fetch(tile).bytes.size();
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    CHECK(bytes > 0);
+    return us / double(tiles.size());
+  };
+
+  // the files mapped into memory, for comparison
+  auto start = std::chrono::steady_clock::now();
+  size_t sum = 0;
+  for (const TileId& tile : tiles) {
+    int fd = open(fmt::format("{}/{}/{}/{}.png", dir, tile.zoom, tile.x, tile.y).c_str(), O_RDONLY);
+    struct stat info;
+    fstat(fd, &info);
+    void* data = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    std::vector<uint8_t> bytes(static_cast<uint8_t*>(data), static_cast<uint8_t*>(data) + info.st_size);
+    sum += bytes.size();
+    munmap(data, size_t(info.st_size));
+    close(fd);
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  const double mmap_us = std::chrono::duration<double, std::micro>(elapsed).count() / double(tiles.size());
+  CHECK(sum == tiles.size() * png.size());
+
+  DirectoryTileSource directory(dir, UrlPattern::ZXY_Y_SOUTH, ".png");
+  MBTilesTileSource mbtiles(dir + "/tiles.mbtiles");
+  GeoTiffTileSource geotiff(dir + "/tiles.tif");
+
+  MockTileServer server;
+  HttpTileSource http(server.url(), UrlPattern::ZXY_Y_SOUTH, ".png");
+
+  std::cout << tiles.size() << " tiles of " << png.size() << " bytes, per tile: " << mmap_us << " us mmap, "
+            << measure(directory) << " us directory, " << measure(mbtiles) << " us MBTiles, " << measure(geotiff)
+            << " us GeoTIFF, " << measure(http) << " us HTTP\n";
+
+  std::filesystem::remove_all(dir);
+}
+#endif
@@ -0,0 +1,210 @@
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <numbers>
+#include <random>
+#include <vector>
+
+#include "TileUtils.h"
+
+// references in double precision
+static double reference_lat2tiley(double lat, unsigned zoom)
+{
+  const double latrad = lat * std::numbers::pi / 180.0;
+  return (1.0 - std::asinh(std::tan(latrad)) / std::numbers::pi) / 2.0 * double(1 << zoom);
+}
+
+static double reference_tiley2lat(double y, unsigned zoom)
+{
+  const double n = std::numbers::pi * (1.0 - 2.0 * y / double(1 << zoom));
+  return std::atan(std::sinh(n)) * 180.0 / std::numbers::pi;
+}
+
+// the formulas the table replaces
+static float scalar_tiley2lat(unsigned y, unsigned zoom)
+{
+  float n = wms::PI - 2.0f * wms::PI * y / (float)(1 << zoom);
+  return 180.0f / wms::PI * std::atan(0.5f * (std::exp(n) - std::exp(-n)));
+}
+
+static float scalar_lat2tiley(float lat, unsigned zoom)
+{
+  float latrad = lat * wms::PI / 180.0f;
+  return (1.0f - std::asinh(std::tan(latrad)) / wms::PI) / 2.0f * (1 << zoom);
+}
+
+TEST_CASE("Tile edge tables")
+{
+  for (unsigned zoom = 0; zoom <= 18; ++zoom) {
+    const unsigned rows = 1U << zoom;
+    const unsigned step = std::max(rows / 512U, 1U);
+
+    for (unsigned y = 0; y <= rows; y += step) {
+      const double lat = reference_tiley2lat(double(y), zoom);
+      CHECK(std::abs(wms::tiley2lat(y, zoom) - lat) < 1e-5);
+      CHECK(std::abs(wms::tiley2cos(y, zoom) - std::cos(lat * std::numbers::pi / 180.0)) < 1e-6);
+
+      // the same edge on the next zoom level
+      CHECK(wms::tiley2lat(y, zoom) == wms::tiley2lat(2U * y, zoom + 1U));
+    }
+  }
+
+  const TileId tile(Coordinate(47.2692f, 11.4041f), 14);
+  CHECK(std::abs(tile.width_in_meters() - wms::tile_width(scalar_tiley2lat(tile.y, tile.zoom), tile.zoom)) < 0.01f);
+  CHECK(tile.bounds().min.lat == tile.neighbour(0, -1).bounds().max.lat);
+}
+
+TEST_CASE("Tile round trips at every zoom level")
+{
+  std::mt19937 gen(7);
+  size_t float_misses = 0;
+
+  for (unsigned zoom = 0; zoom <= TileId::MAX_ZOOM; ++zoom) {
+    std::uniform_int_distribution<unsigned> dist(0U, (1U << zoom) - 1U);
+
+    for (int i = 0; i < 200; ++i) {
+      const TileId tile(zoom, dist(gen), dist(gen));
+      const Bounds<DCoordinate> bounds = tile.bounds<double>();
+      const DCoordinate center(glm::mix(bounds.min.to_vec2(), bounds.max.to_vec2(), 0.5));
+      CHECK(TileId(center, zoom) == tile);
+
+      // the north west corner belongs to the tile, within a fraction of it
+      const glm::dvec2 inside = glm::mix(bounds.min.to_vec2(), bounds.max.to_vec2(), 0.01);
+      CHECK(TileId(DCoordinate(inside), zoom) == tile);
+
+      if (TileId(Coordinate(center), zoom) != tile) float_misses++;
+    }
+  }
+
+  // float gives up somewhere beyond zoom 16
+  CHECK(float_misses > 0);
+  static_assert(TileId::from_key(TileId(22U, 3456789U, 2345678U).key()) == TileId(22U, 3456789U, 2345678U));
+}
+
+TEST_CASE("Batch tile coordinate conversion")
+{
+  const unsigned zoom = 16;
+
+  SECTION("latitude to tile row")
+  {
+    // not a multiple of four, so the last values take the padded path
+    std::vector<float> lat, y(20003);
+    for (size_t i = 0; i < y.size(); ++i) lat.push_back(-85.05f + 170.1f * float(i) / float(y.size() - 1));
+
+    wms::lat2tiley(lat.data(), y.data(), lat.size(), zoom);
+
+    double max_error = 0.0, max_scalar_error = 0.0;
+    for (size_t i = 0; i < lat.size(); ++i) {
+      const double reference = reference_lat2tiley(lat[i], zoom);
+      max_error = std::max(max_error, std::abs(y[i] - reference));
+      max_scalar_error = std::max(max_scalar_error, std::abs(scalar_lat2tiley(lat[i], zoom) - reference));
+    }
+
+    // in tiles at zoom 16. Near the poles this is mostly the float resolution of the latitude, the scalar
+    // formula is not better there.
+    CHECK(max_error < 0.03);
+    CHECK(max_error <= 2.0 * max_scalar_error);
+
+    // clamped to the map
+    const float poles[] = {90.0f, -90.0f};
+    float rows[2];
+    wms::lat2tiley(poles, rows, 2, zoom);
+    CHECK(std::abs(rows[0]) < 0.02f);
+    CHECK(std::abs(rows[1] - float(1 << zoom)) < 0.02f);
+  }
+
+  SECTION("tile row to latitude")
+  {
+    std::vector<float> y, lat(20003);
+    for (size_t i = 0; i < lat.size(); ++i) y.push_back(float(1 << zoom) * float(i) / float(lat.size() - 1));
+
+    wms::tiley2lat(y.data(), lat.data(), y.size(), zoom);
+
+    double max_error = 0.0;
+    for (size_t i = 0; i < y.size(); ++i) {
+      max_error = std::max(max_error, std::abs(lat[i] - reference_tiley2lat(y[i], zoom)));
+    }
+
+    // degrees, a few float ulps at 85 degrees
+    CHECK(max_error < 5e-5);
+
+    // and back
+    std::vector<float> back(y.size());
+    wms::lat2tiley(lat.data(), back.data(), lat.size(), zoom);
+    for (size_t i = 0; i < y.size(); i += 97) CHECK(std::abs(back[i] - y[i]) < 0.05f);
+  }
+}
+
+TEST_CASE("Tile coordinate conversion benchmark", "[.][benchmark]")
+{
+  const unsigned zoom = 16;
+  const size_t count = 1 << 20;
+
+  std::vector<float> lat(count), y(count);
+  for (size_t i = 0; i < count; ++i) lat[i] = -85.0f + 170.0f * float(i) / float(count);
+
+  auto time = [](auto&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  };
+
+  const double scalar_ms = time([&]() {
+    for (size_t i = 0; i < count; ++i) y[i] = scalar_lat2tiley(lat[i], zoom);
+  });
+  const double batch_ms = time([&]() { wms::lat2tiley(lat.data(), y.data(), count, zoom); });
+
+  double max_error = 0.0;
+  for (size_t i = 0; i < count; i += 16) {
+    max_error = std::max(max_error, std::abs(y[i] - reference_lat2tiley(lat[i], zoom)));
+  }
+
+  const double scalar_inverse_ms = time([&]() {
+    for (size_t i = 0; i < count; ++i) {
+      const float n = wms::PI - 2.0f * wms::PI * y[i] / float(1 << zoom);
+      lat[i] = 180.0f / wms::PI * std::atan(0.5f * (std::exp(n) - std::exp(-n)));
+    }
+  });
+  const double batch_inverse_ms = time([&]() { wms::tiley2lat(y.data(), lat.data(), count, zoom); });
+
+  double max_inverse_error = 0.0;
+  for (size_t i = 0; i < count; i += 16) {
+    max_inverse_error = std::max(max_inverse_error, std::abs(lat[i] - reference_tiley2lat(y[i], zoom)));
+  }
+
+  // the edges of the nodes of a quad tree, the way the renderer asks for them
+  const TileId root(Coordinate(47.2692f, 11.4041f), 6);
+  std::vector<TileId> nodes;
+  for (unsigned depth = 0; depth <= 10; ++depth) {
+    const unsigned n = std::min(1U << depth, 32U);
+    for (unsigned i = 0; i < n * n; ++i) {
+      nodes.push_back(TileId(root.zoom + depth, (root.x << depth) + i % n, (root.y << depth) + i / n));
+    }
+  }
+
+  wms::tiley2lat(0U, 0U);  // builds the table
+
+  double width = 0.0;
+  const double scalar_nodes_ms = time([&]() {
+    for (const TileId& node : nodes) {
+      width += scalar_tiley2lat(node.y + 1U, node.zoom) - scalar_tiley2lat(node.y, node.zoom);
+      width += wms::tile_width(scalar_tiley2lat(node.y, node.zoom), node.zoom);
+    }
+  });
+  const double table_nodes_ms = time([&]() {
+    for (const TileId& node : nodes) {
+      const Bounds<Coordinate> bounds = node.bounds();
+      width += bounds.max.lat - bounds.min.lat;
+      width += node.width_in_meters();
+    }
+  });
+
+  CHECK(width > 0.0);
+  std::cout << count << " latitudes to tile rows: " << scalar_ms << " ms scalar, " << batch_ms
+            << " ms batched, max error " << max_error << " tiles at zoom " << zoom << "\n"
+            << count << " tile rows to latitudes: " << scalar_inverse_ms << " ms scalar, " << batch_inverse_ms
+            << " ms batched, max error " << max_inverse_error << " degrees\n"
+            << "bounds and width of " << nodes.size() << " nodes: " << scalar_nodes_ms << " ms computed, "
+            << table_nodes_ms << " ms from the tables\n";
+}